@@ -0,0 +1,108 @@
+#include "../include/minisql.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+
+// Microbenchmark of the comparison kernels: ConditionEvaluator::compare, which visits both
+// variants and switches on the operator per call, against the kernel selected once for the
+// operand types, both on bare values and through ConditionEvaluator::evaluate of a WHERE term.
+//
+// Build and run from miniSQL/bench:
+//   g++ -std=c++17 -O2 -o compare_bench compare_bench.cpp ../src/minisql.cpp ../src/Index.cpp ../src/Parser.cpp ../src/Expression.cpp ../src/Helper.cpp ../src/PageFile.cpp
+//   ./compare_bench
+
+static const size_t ROWS = 1000000;
+static const int ROUNDS = 20;
+
+// Best of ROUNDS runs of body, in nanoseconds per row.
+template<typename Body>
+static double measure(Body body) {
+    double best = 1e300;
+    for (int round = 0; round < ROUNDS; ++round) {
+        auto start = chrono::steady_clock::now();
+        body();
+        auto end = chrono::steady_clock::now();
+        best = min(best, chrono::duration<double, nano>(end - start).count() / ROWS);
+    }
+    return best;
+}
+
+static void report(const string& name, double generic, double kernel) {
+    cout << left << setw(28) << name << right << fixed << setprecision(2)
+         << setw(10) << generic << setw(10) << kernel << setw(9) << generic / kernel << "x" << endl;
+}
+
+int main() {
+    mt19937 random(42);
+    uniform_int_distribution<int> numbers(0, 999);
+    vector<Value> ints, doubles, strings;
+    vector<Row> rows;
+    for (size_t i = 0; i < ROWS; ++i) {
+        int n = numbers(random);
+        ints.push_back(n);
+        doubles.push_back(n / 10.0);
+        strings.push_back("name" + to_string(n));
+        rows.push_back(Row({Value(n), Value(n / 10.0), Value("name" + to_string(n))}));
+    }
+
+    cout << left << setw(28) << "case (ns per row)" << right << setw(10) << "compare" << setw(10) << "kernel" << setw(10) << "gain" << endl;
+
+    // Part I. Bare values against a constant.
+    struct Case { string name; const vector<Value>* values; Value constant; CompareOp op; };
+    vector<Case> cases = {
+        {"INT = INT", &ints, Value(500), CompareOp::EQUAL},
+        {"INT < INT", &ints, Value(500), CompareOp::LESS},
+        {"INT >= DOUBLE", &ints, Value(499.5), CompareOp::GREATER_EQUAL},
+        {"DOUBLE > DOUBLE", &doubles, Value(50.0), CompareOp::GREATER},
+        {"VARCHAR = VARCHAR", &strings, Value(string("name500")), CompareOp::EQUAL},
+        {"VARCHAR < VARCHAR", &strings, Value(string("name500")), CompareOp::LESS},
+    };
+    for (const auto& c : cases) {
+        const vector<Value>& values = *c.values;
+        size_t generic_matches = 0, kernel_matches = 0;
+        double generic = measure([&] {
+            generic_matches = 0;
+            for (const Value& value : values) generic_matches += ConditionEvaluator::compare(value, c.constant, c.op);
+        });
+        CompareKernel kernel = ConditionEvaluator::kernel(values[0], c.constant, c.op);
+        double specialized = measure([&] {
+            kernel_matches = 0;
+            for (const Value& value : values) kernel_matches += kernel(value, c.constant);
+        });
+        if (generic_matches != kernel_matches) {
+            cerr << "Error: " << c.name << " gave " << kernel_matches << " matches instead of " << generic_matches << endl;
+            return 1;
+        }
+        report(c.name, generic, specialized);
+    }
+
+    // Part II. Scan of a bound WHERE term, with and without its kernel.
+    vector<Column> columns = {{"id", "INT"}, {"price", "DOUBLE"}, {"name", "VARCHAR", 20}};
+    for (const string where : {"id > 500", "price <= 25.5", "name = 'name42'"}) {
+        auto expression = WhereParser::parse(where, columns);
+        if (!expression || !expression->isSingleCondition) {
+            cerr << "Error: Could not bind " << where << endl;
+            return 1;
+        }
+        Condition condition = get<Condition>(expression->left);
+        size_t generic_matches = 0, kernel_matches = 0;
+        double specialized = measure([&] {
+            kernel_matches = 0;
+            for (const Row& row : rows) kernel_matches += ConditionEvaluator::evaluate(row, condition);
+        });
+        condition.kernel = nullptr;
+        double generic = measure([&] {
+            generic_matches = 0;
+            for (const Row& row : rows) generic_matches += ConditionEvaluator::evaluate(row, condition);
+        });
+        if (generic_matches != kernel_matches) {
+            cerr << "Error: " << where << " gave " << kernel_matches << " matches instead of " << generic_matches << endl;
+            return 1;
+        }
+        report("WHERE " + where, generic, specialized);
+    }
+    return 0;
+}
@@ -0,0 +1,327 @@
+#ifndef BPLUSTREE_H
+#define BPLUSTREE_H
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+// In-memory B+Tree holding an ordered set of keys. Leaves are chained left to right
+// so range scans walk leaves without going back up the tree. Duplicate index keys
+// are stored by making the row position part of Key.
+template<typename Key, typename Less = less<Key>>
+class BPlusTree {
+private:
+    static constexpr size_t MAX_KEYS = 64;
+    static constexpr size_t MIN_KEYS = MAX_KEYS / 2;
+
+    struct Node {
+        bool is_leaf;
+        vector<Key> keys;                    // leaf: entries, inner: separators
+        vector<unique_ptr<Node>> children;   // inner only, keys.size() + 1 children
+        Node* next = nullptr;                // leaf chain
+
+        explicit Node(bool leaf) : is_leaf(leaf) {}
+    };
+
+    unique_ptr<Node> root_;
+    size_t size_ = 0;
+    Less less_;
+
+public:
+    class Iterator {
+    public:
+        Iterator() = default;
+        Iterator(const Node* leaf, size_t slot) : leaf_(leaf), slot_(slot) { skipEmpty(); }
+
+        bool valid() const { return leaf_ != nullptr; }
+        const Key& operator*() const { return leaf_->keys[slot_]; }
+        const Key* operator->() const { return &leaf_->keys[slot_]; }
+        Iterator& operator++() {
+            ++slot_;
+            skipEmpty();
+            return *this;
+        }
+
+    private:
+        const Node* leaf_ = nullptr;
+        size_t slot_ = 0;
+
+        void skipEmpty() {
+            while (leaf_ && slot_ >= leaf_->keys.size()) {
+                leaf_ = leaf_->next;
+                slot_ = 0;
+            }
+        }
+    };
+
+    BPlusTree() : root_(make_unique<Node>(true)) {}
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    // Bytes of the nodes and their key arrays; heap memory owned by the keys is not counted.
+    size_t memoryUsage() const { return nodeBytes(root_.get()); }
+
+    void clear() {
+        root_ = make_unique<Node>(true);
+        size_ = 0;
+    }
+
+    // Returns false when an equivalent key is already present.
+    bool insert(const Key& key) {
+        Key separator;
+        unique_ptr<Node> split = insertInto(root_.get(), key, separator);
+        if (!inserted_) return false;
+        if (split) {
+            auto new_root = make_unique<Node>(false);
+            new_root->keys.push_back(separator);
+            new_root->children.push_back(move(root_));
+            new_root->children.push_back(move(split));
+            root_ = move(new_root);
+        }
+        ++size_;
+        return true;
+    }
+
+    bool erase(const Key& key) {
+        if (!eraseFrom(root_.get(), key)) return false;
+        if (!root_->is_leaf && root_->keys.empty()) {
+            root_ = move(root_->children[0]);
+        }
+        --size_;
+        return true;
+    }
+
+    bool contains(const Key& key) const {
+        Iterator it = lowerBound(key);
+        return it.valid() && !less_(key, *it);
+    }
+
+    Iterator begin() const {
+        const Node* node = root_.get();
+        while (!node->is_leaf) node = node->children.front().get();
+        return Iterator(node, 0);
+    }
+
+    // First key that is not less than key.
+    Iterator lowerBound(const Key& key) const {
+        const Node* node = root_.get();
+        while (!node->is_leaf) {
+            size_t idx = upper_bound(node->keys.begin(), node->keys.end(), key, less_) - node->keys.begin();
+            node = node->children[idx].get();
+        }
+        size_t slot = lower_bound(node->keys.begin(), node->keys.end(), key, less_) - node->keys.begin();
+        return Iterator(node, slot);
+    }
+
+    // Builds the tree bottom-up from keys that are already sorted and unique.
+    void bulkLoad(vector<Key> sorted_keys) {
+        clear();
+        if (sorted_keys.empty()) return;
+        size_ = sorted_keys.size();
+
+        // Leaves filled to 3/4 so that later inserts do not split immediately.
+        const size_t fill = MAX_KEYS * 3 / 4;
+        vector<unique_ptr<Node>> level;
+        vector<Key> level_min;
+        for (size_t start = 0; start < sorted_keys.size(); start += fill) {
+            size_t end = min(start + fill, sorted_keys.size());
+            auto leaf = make_unique<Node>(true);
+            leaf->keys.assign(make_move_iterator(sorted_keys.begin() + start), make_move_iterator(sorted_keys.begin() + end));
+            if (!level.empty()) level.back()->next = leaf.get();
+            level_min.push_back(leaf->keys.front());
+            level.push_back(move(leaf));
+        }
+        rebalanceTail(level, level_min, true);
+
+        while (level.size() > 1) {
+            vector<unique_ptr<Node>> parents;
+            vector<Key> parent_min;
+            for (size_t start = 0; start < level.size(); start += fill + 1) {
+                size_t end = min(start + fill + 1, level.size());
+                auto parent = make_unique<Node>(false);
+                parent_min.push_back(level_min[start]);
+                for (size_t i = start; i < end; ++i) {
+                    if (i > start) parent->keys.push_back(level_min[i]);
+                    parent->children.push_back(move(level[i]));
+                }
+                parents.push_back(move(parent));
+            }
+            rebalanceTail(parents, parent_min, false);
+            level = move(parents);
+            level_min = move(parent_min);
+        }
+        root_ = move(level.front());
+    }
+
+private:
+    bool inserted_ = false;
+
+    static size_t nodeBytes(const Node* node) {
+        size_t bytes = sizeof(Node) + node->keys.capacity() * sizeof(Key) + node->children.capacity() * sizeof(unique_ptr<Node>);
+        for (const auto& child : node->children) bytes += nodeBytes(child.get());
+        return bytes;
+    }
+
+    // Returns the new right sibling when node had to split; separator receives its first key.
+    unique_ptr<Node> insertInto(Node* node, const Key& key, Key& separator) {
+        if (node->is_leaf) {
+            auto pos = lower_bound(node->keys.begin(), node->keys.end(), key, less_);
+            if (pos != node->keys.end() && !less_(key, *pos)) {
+                inserted_ = false;
+                return nullptr;
+            }
+            inserted_ = true;
+            node->keys.insert(pos, key);
+            if (node->keys.size() <= MAX_KEYS) return nullptr;
+
+            auto right = make_unique<Node>(true);
+            size_t mid = node->keys.size() / 2;
+            right->keys.assign(make_move_iterator(node->keys.begin() + mid), make_move_iterator(node->keys.end()));
+            node->keys.resize(mid);
+            right->next = node->next;
+            node->next = right.get();
+            separator = right->keys.front();
+            return right;
+        }
+
+        size_t idx = upper_bound(node->keys.begin(), node->keys.end(), key, less_) - node->keys.begin();
+        Key child_separator;
+        unique_ptr<Node> child_split = insertInto(node->children[idx].get(), key, child_separator);
+        if (!child_split) return nullptr;
+
+        node->keys.insert(node->keys.begin() + idx, child_separator);
+        node->children.insert(node->children.begin() + idx + 1, move(child_split));
+        if (node->keys.size() <= MAX_KEYS) return nullptr;
+
+        auto right = make_unique<Node>(false);
+        size_t mid = node->keys.size() / 2;
+        separator = node->keys[mid];
+        right->keys.assign(make_move_iterator(node->keys.begin() + mid + 1), make_move_iterator(node->keys.end()));
+        right->children.assign(make_move_iterator(node->children.begin() + mid + 1), make_move_iterator(node->children.end()));
+        node->keys.resize(mid);
+        node->children.resize(mid + 1);
+        return right;
+    }
+
+    bool eraseFrom(Node* node, const Key& key) {
+        if (node->is_leaf) {
+            auto pos = lower_bound(node->keys.begin(), node->keys.end(), key, less_);
+            if (pos == node->keys.end() || less_(key, *pos)) return false;
+            node->keys.erase(pos);
+            return true;
+        }
+
+        size_t idx = upper_bound(node->keys.begin(), node->keys.end(), key, less_) - node->keys.begin();
+        if (!eraseFrom(node->children[idx].get(), key)) return false;
+        if (node->children[idx]->keys.size() < MIN_KEYS) {
+            fixUnderflow(node, idx);
+        }
+        return true;
+    }
+
+    // Borrow from a sibling when it has spare keys, otherwise merge with it.
+    void fixUnderflow(Node* parent, size_t idx) {
+        Node* child = parent->children[idx].get();
+        Node* left = idx > 0 ? parent->children[idx - 1].get() : nullptr;
+        Node* right = idx + 1 < parent->children.size() ? parent->children[idx + 1].get() : nullptr;
+
+        if (left && left->keys.size() > MIN_KEYS) {
+            if (child->is_leaf) {
+                child->keys.insert(child->keys.begin(), move(left->keys.back()));
+                left->keys.pop_back();
+                parent->keys[idx - 1] = child->keys.front();
+            } else {
+                child->keys.insert(child->keys.begin(), move(parent->keys[idx - 1]));
+                child->children.insert(child->children.begin(), move(left->children.back()));
+                parent->keys[idx - 1] = move(left->keys.back());
+                left->keys.pop_back();
+                left->children.pop_back();
+            }
+            return;
+        }
+
+        if (right && right->keys.size() > MIN_KEYS) {
+            if (child->is_leaf) {
+                child->keys.push_back(move(right->keys.front()));
+                right->keys.erase(right->keys.begin());
+                parent->keys[idx] = right->keys.front();
+            } else {
+                child->keys.push_back(move(parent->keys[idx]));
+                child->children.push_back(move(right->children.front()));
+                parent->keys[idx] = move(right->keys.front());
+                right->keys.erase(right->keys.begin());
+                right->children.erase(right->children.begin());
+            }
+            return;
+        }
+
+        // Merge the right one of the pair (left, child) or (child, right) into its left neighbour.
+        size_t left_idx = left ? idx - 1 : idx;
+        Node* into = parent->children[left_idx].get();
+        Node* from = parent->children[left_idx + 1].get();
+        if (into->is_leaf) {
+            into->keys.insert(into->keys.end(), make_move_iterator(from->keys.begin()), make_move_iterator(from->keys.end()));
+            into->next = from->next;
+        } else {
+            into->keys.push_back(move(parent->keys[left_idx]));
+            into->keys.insert(into->keys.end(), make_move_iterator(from->keys.begin()), make_move_iterator(from->keys.end()));
+            into->children.insert(into->children.end(), make_move_iterator(from->children.begin()), make_move_iterator(from->children.end()));
+        }
+        parent->keys.erase(parent->keys.begin() + left_idx);
+        parent->children.erase(parent->children.begin() + left_idx + 1);
+    }
+
+    // Bulk loading can leave the last node of a level underfull: merge it into its
+    // neighbour when both fit in one node, otherwise split their contents evenly.
+    void rebalanceTail(vector<unique_ptr<Node>>& level, vector<Key>& level_min, bool leaves) {
+        if (level.size() < 2) return;
+        Node* last = level.back().get();
+        Node* prev = level[level.size() - 2].get();
+
+        if (leaves) {
+            if (last->keys.size() >= MIN_KEYS) return;
+            size_t total = prev->keys.size() + last->keys.size();
+            if (total <= MAX_KEYS) {
+                prev->keys.insert(prev->keys.end(), make_move_iterator(last->keys.begin()), make_move_iterator(last->keys.end()));
+                prev->next = last->next;
+                level.pop_back();
+                level_min.pop_back();
+                return;
+            }
+            size_t move_count = prev->keys.size() - total / 2;
+            last->keys.insert(last->keys.begin(), make_move_iterator(prev->keys.end() - move_count), make_move_iterator(prev->keys.end()));
+            prev->keys.resize(prev->keys.size() - move_count);
+            level_min.back() = last->keys.front();
+            return;
+        }
+
+        if (last->children.size() > MIN_KEYS) return;
+        size_t total = prev->children.size() + last->children.size();
+        if (total <= MAX_KEYS + 1) {
+            prev->keys.push_back(level_min.back());
+            prev->keys.insert(prev->keys.end(), make_move_iterator(last->keys.begin()), make_move_iterator(last->keys.end()));
+            prev->children.insert(prev->children.end(), make_move_iterator(last->children.begin()), make_move_iterator(last->children.end()));
+            level.pop_back();
+            level_min.pop_back();
+            return;
+        }
+        // Children moved over from prev bring their separators; the old minimum of last becomes one too.
+        size_t move_count = prev->children.size() - total / 2;
+        last->keys.insert(last->keys.begin(), level_min.back());
+        for (size_t i = 0; i < move_count; ++i) {
+            last->children.insert(last->children.begin(), move(prev->children.back()));
+            prev->children.pop_back();
+            if (i + 1 < move_count) {
+                last->keys.insert(last->keys.begin(), move(prev->keys.back()));
+            } else {
+                level_min.back() = move(prev->keys.back());
+            }
+            prev->keys.pop_back();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef BLOOMFILTER_H
+#define BLOOMFILTER_H
+
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Split-block Bloom filter: every key maps to one 256-bit block (8 x 32-bit words)
+// and sets one bit per word, so a lookup touches a single cache line.
+class BlockedBloomFilter {
+public:
+    explicit BlockedBloomFilter(size_t expected_keys, size_t bits_per_key = 10) {
+        size_t blocks = (expected_keys * bits_per_key + 255) / 256;
+        size_t capacity = 1;
+        while (capacity < blocks) capacity <<= 1;
+        blocks_.assign(capacity * 8, 0);
+        mask_ = capacity - 1;
+    }
+
+    void insert(uint64_t hash) {
+        uint32_t* block = &blocks_[(hash & mask_) * 8];
+        uint32_t key = static_cast<uint32_t>(hash >> 32);
+        for (int i = 0; i < 8; ++i) {
+            block[i] |= bitFor(key, i);
+        }
+    }
+
+    bool mayContain(uint64_t hash) const {
+        const uint32_t* block = &blocks_[(hash & mask_) * 8];
+        uint32_t key = static_cast<uint32_t>(hash >> 32);
+        for (int i = 0; i < 8; ++i) {
+            if ((block[i] & bitFor(key, i)) == 0) return false;
+        }
+        return true;
+    }
+
+    size_t memoryUsage() const { return blocks_.size() * sizeof(uint32_t); }
+
+private:
+    vector<uint32_t> blocks_;
+    size_t mask_;
+
+    static uint32_t bitFor(uint32_t key, int word) {
+        static const uint32_t salts[8] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+                                          0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+        return 1U << ((key * salts[word]) >> 27);
+    }
+};
+
+// Exact membership bitmap for int keys packed into a small range [min, max].
+class DenseKeyBitmap {
+public:
+    DenseKeyBitmap(int min_key, int max_key)
+        : min_(min_key), bits_((static_cast<size_t>(static_cast<int64_t>(max_key) - min_key) >> 6) + 1, 0),
+          range_(static_cast<uint64_t>(static_cast<int64_t>(max_key) - min_key)) {}
+
+    void insert(int key) {
+        uint64_t offset = static_cast<uint64_t>(static_cast<int64_t>(key) - min_);
+        bits_[offset >> 6] |= 1ULL << (offset & 63);
+    }
+
+    bool contains(int key) const {
+        uint64_t offset = static_cast<uint64_t>(static_cast<int64_t>(key) - min_);
+        if (offset > range_) return false;
+        return (bits_[offset >> 6] >> (offset & 63)) & 1;
+    }
+
+    size_t memoryUsage() const { return bits_.size() * sizeof(uint64_t); }
+
+private:
+    int64_t min_;
+    vector<uint64_t> bits_;
+    uint64_t range_;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef EXPRESSION_H
+#define EXPRESSION_H
+
+#include "minisql.h"
+#include "Parser.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Value expressions of SELECT lists, UPDATE ... SET and computed WHERE terms: arithmetic,
+// comparisons, AND / OR / NOT and CASE over the columns of a row.
+
+// Part I. Bytecode
+// Operands and results live on a stack. Types are checked when compiling, so every
+// arithmetic instruction knows whether it works on INT or DOUBLE values.
+enum class OpCode : uint8_t {
+    PUSH_CONSTANT,      // operand = index into the constants
+    PUSH_COLUMN,        // operand = column index in the row
+    TO_DOUBLE,          // INT operand-th below the top of the stack becomes DOUBLE
+    ADD_INT, SUB_INT, MUL_INT, DIV_INT, MOD_INT, NEGATE_INT,
+    ADD_DOUBLE, SUB_DOUBLE, MUL_DOUBLE, DIV_DOUBLE, MOD_DOUBLE, NEGATE_DOUBLE,
+    COMPARE,            // operand = index into the compare kernels, pushes 1 or 0
+    LIKE,               // operand = index into the patterns, pushes 1 or 0
+    NOT,
+    TO_BOOL,            // any value becomes 1 or 0
+    JUMP,               // operand = target instruction
+    JUMP_IF_FALSE,      // pops the condition
+    AND_JUMP,           // false: leaves 0 and jumps, true: pops and continues
+    OR_JUMP             // true: leaves 1 and jumps, false: pops and continues
+};
+
+struct Instruction {
+    OpCode op;
+    uint32_t operand = 0;
+};
+
+// A compiled expression with its column references resolved to positions in the row.
+// INT arithmetic fails on overflow and division by zero fails for both number types, so
+// evaluate() throws runtime_error for them.
+class Expression {
+public:
+    Value evaluate(const Row& row) const;
+    // "INT", "DOUBLE" or "VARCHAR", like Column::type. Comparisons, AND, OR and NOT are INT 1 / 0.
+    const string& type() const { return type_; }
+    // The expression as written, for EXPLAIN.
+    const string& text() const { return text_; }
+    // True when the expression reads no column, so evaluate() can be called with any row.
+    bool isConstant() const;
+    // Column index when the expression is a plain column reference, -1 otherwise.
+    int columnIndex() const;
+
+    static shared_ptr<const Expression> constant(const Value& value);
+    // Nonzero numbers and non-empty strings.
+    static bool isTrue(const Value& value);
+    // The row made of every projection evaluated on row.
+    static Row project(const Row& row, const vector<shared_ptr<const Expression>>& projections);
+
+private:
+    friend class ExpressionCompiler;
+
+    vector<Instruction> code_;
+    vector<Value> constants_;
+    vector<shared_ptr<const LikePattern>> patterns_;
+    vector<CompareKernel> kernels_;
+    string type_;
+    string text_;
+
+    // Runs the instructions [begin, end) on stack; jump targets are absolute.
+    void run(size_t begin, size_t end, const Row& row, vector<Value>& stack) const;
+};
+
+// Part II. Compiler
+// Compiles the parsed expression against columns. tables, when given, names the table of
+// every column (JOIN results), so table.column picks the right one; otherwise the qualifier
+// is ignored and a name resolves to the first column with it, as in WHERE clauses.
+// Throws runtime_error for unknown columns, ? parameters, subqueries and operands of the
+// wrong type, e.g. a string in arithmetic or a number compared with a string.
+class ExpressionCompiler {
+public:
+    static shared_ptr<const Expression> compile(const SqlExpr& expression, const vector<Column>& columns, const vector<string>& tables = {});
+
+private:
+    ExpressionCompiler(const vector<Column>& columns, const vector<string>& tables, Expression& out)
+        : columns_(columns), tables_(tables), out_(out) {}
+
+    const vector<Column>& columns_;
+    const vector<string>& tables_;
+    Expression& out_;
+
+    // Emits code leaving the value of expression on the stack and returns its type.
+    string emit(const SqlExpr& expression);
+    // Type emit() returns for expression, without emitting it. CASE needs the type of all
+    // branches before the first one is emitted.
+    string typeOf(const SqlExpr& expression) const;
+    string emitArithmetic(const SqlExpr& expression);
+    string emitCompare(const SqlExpr& expression);
+    string emitLogic(const SqlExpr& expression);
+    string emitCase(const SqlExpr& expression);
+    // Emits value converted to type (INT to DOUBLE is the only conversion).
+    void emitAs(const SqlExpr& value, const string& type);
+    size_t emitInstruction(OpCode op, uint32_t operand = 0);
+    void emitConstant(const Value& value);
+    void patchJump(size_t instruction);
+    // Replaces the code from start on with its value when it reads no column.
+    void foldFrom(size_t start);
+    int resolveColumn(const string& column_ref) const;
+};
+
+// Part III. Statements
+// Compiled SET values of an UPDATE against the table's columns. A bare word naming no column
+// is a string, as in SET name = Bob. With parameters, a ? value is left out for EXECUTE to
+// fill in; without, it is an error. Throws runtime_error like ExpressionCompiler::compile.
+unordered_map<string, shared_ptr<const Expression>> compileAssignments(const UpdateStatement& statement, const vector<Column>& columns, bool parameters = false);
+
+// Compiles the computed SELECT list of statement (statement.expressions) against columns,
+// see ExpressionCompiler::compile, and fills the result columns shown for it: the alias or
+// the text of each item, with the type of the column or of the computed value.
+// Errors are reported on cerr and yield false.
+bool compileSelectList(const SelectStatement& statement, const vector<Column>& columns, const vector<string>& tables,
+                       vector<shared_ptr<const Expression>>& projections, vector<Column>& result_columns);
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+// Part I. Key hashing
+// Typed hash functions used by the flat hash table. Each one ends with a 64-bit
+// finalizer so that sequential ids still spread over the whole slot array.
+inline uint64_t mixHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+template<typename Key>
+struct KeyHash;
+
+template<>
+struct KeyHash<int> {
+    uint64_t operator()(int key) const {
+        return mixHash(static_cast<uint64_t>(static_cast<uint32_t>(key)));
+    }
+};
+
+template<>
+struct KeyHash<double> {
+    uint64_t operator()(double key) const {
+        if (key == 0.0) key = 0.0;  // -0.0 and 0.0 compare equal, so they must hash equal
+        uint64_t bits;
+        memcpy(&bits, &key, sizeof(bits));
+        return mixHash(bits);
+    }
+};
+
+template<>
+struct KeyHash<string> {
+    uint64_t operator()(const string& key) const {
+        // FNV-1a over 8-byte words, then the tail bytes.
+        uint64_t h = 0xcbf29ce484222325ULL ^ key.size();
+        const char* data = key.data();
+        size_t n = key.size();
+        while (n >= 8) {
+            uint64_t word;
+            memcpy(&word, data, sizeof(word));
+            h = (h ^ word) * 0x100000001b3ULL;
+            data += 8;
+            n -= 8;
+        }
+        while (n > 0) {
+            h = (h ^ static_cast<unsigned char>(*data)) * 0x100000001b3ULL;
+            ++data;
+            --n;
+        }
+        return mixHash(h);
+    }
+};
+
+// Generic fallback for columns holding mixed types. Keys of different
+// alternatives never compare equal, so the alternative index is mixed in.
+template<typename... Ts>
+struct KeyHash<variant<Ts...>> {
+    uint64_t operator()(const variant<Ts...>& key) const {
+        return visit([&key](const auto& v) {
+            using T = decay_t<decltype(v)>;
+            return KeyHash<T>()(v) ^ (static_cast<uint64_t>(key.index()) * 0x9e3779b97f4a7c15ULL);
+        }, key);
+    }
+};
+
+// Part II. Flat hash table
+// Open-addressing multimap from Key to a 32-bit payload (usually a row position).
+// Slots hold a hash tag plus an index into the contiguous key array, so a probe
+// touches one slot cache line and only compares keys when the tags match.
+// Duplicate keys share one key entry and are chained through next_ in insertion order.
+template<typename Key, typename Hash = KeyHash<Key>>
+class FlatHashTable {
+public:
+    static constexpr uint32_t npos = UINT32_MAX;
+
+    explicit FlatHashTable(size_t expected_entries = 0) {
+        reserve(expected_entries);
+    }
+
+    void reserve(size_t expected_entries) {
+        payloads_.reserve(expected_entries);
+        next_.reserve(expected_entries);
+        size_t capacity = 16;
+        while (capacity < expected_entries * 2) capacity <<= 1;
+        if (capacity > slots_.size()) rehash(capacity);
+    }
+
+    void insert(const Key& key, uint32_t payload) {
+        insert(key, payload, hasher_(key));
+    }
+
+    // Same as insert() when the caller already hashed the key.
+    void insert(const Key& key, uint32_t payload, uint64_t hash) {
+        uint32_t entry = static_cast<uint32_t>(payloads_.size());
+        payloads_.push_back(payload);
+        next_.push_back(npos);
+
+        uint32_t key_index = findKey(key, hash);
+        if (key_index != npos) {
+            if (heads_[key_index] == npos) {
+                heads_[key_index] = entry;
+            } else {
+                next_[tails_[key_index]] = entry;
+            }
+            tails_[key_index] = entry;
+            return;
+        }
+
+        if ((keys_.size() + 1) * 2 > slots_.size()) {
+            rehash(slots_.size() * 2);
+        }
+
+        key_index = static_cast<uint32_t>(keys_.size());
+        keys_.push_back(key);
+        hashes_.push_back(hash);
+        heads_.push_back(entry);
+        tails_.push_back(entry);
+        placeSlot(hash, key_index);
+    }
+
+    // Set-style insert: adds key only if it is not present yet. Returns true when added.
+    bool insertUnique(const Key& key, uint32_t payload) {
+        uint64_t hash = hasher_(key);
+        uint32_t key_index = findKey(key, hash);
+        if (key_index != npos && heads_[key_index] != npos) return false;
+        insert(key, payload, hash);
+        return true;
+    }
+
+    // Drops every entry of key. The key keeps its slot, so inserting it again reuses it;
+    // size() still counts the dropped entries until the table is cleared.
+    bool eraseKey(const Key& key) {
+        uint32_t key_index = findKey(key, hasher_(key));
+        if (key_index == npos || heads_[key_index] == npos) return false;
+        heads_[key_index] = npos;
+        return true;
+    }
+
+    // Returns the first entry for key, or npos. Walk duplicates with next().
+    uint32_t find(const Key& key) const {
+        return find(key, hasher_(key));
+    }
+
+    // Same as find() when the caller already hashed the key (e.g. for a Bloom filter check).
+    uint32_t find(const Key& key, uint64_t hash) const {
+        uint32_t key_index = findKey(key, hash);
+        return key_index == npos ? npos : heads_[key_index];
+    }
+
+    uint64_t hashOf(const Key& key) const { return hasher_(key); }
+
+    bool contains(const Key& key) const { return find(key) != npos; }
+
+    uint32_t next(uint32_t entry) const { return next_[entry]; }
+    uint32_t payload(uint32_t entry) const { return payloads_[entry]; }
+
+    size_t size() const { return payloads_.size(); }
+    size_t distinctKeys() const { return keys_.size(); }
+    bool empty() const { return payloads_.empty(); }
+
+    size_t memoryUsage() const {
+        return slots_.capacity() * sizeof(Slot) + keys_.capacity() * sizeof(Key) +
+               (hashes_.capacity()) * sizeof(uint64_t) +
+               (heads_.capacity() + tails_.capacity() + payloads_.capacity() + next_.capacity()) * sizeof(uint32_t);
+    }
+
+    void clear() {
+        slots_.assign(slots_.size(), Slot{0, npos});
+        keys_.clear();
+        hashes_.clear();
+        heads_.clear();
+        tails_.clear();
+        payloads_.clear();
+        next_.clear();
+    }
+
+private:
+    struct Slot {
+        uint32_t tag;
+        uint32_t key_index;
+    };
+
+    vector<Slot> slots_;
+    size_t mask_ = 0;
+    vector<Key> keys_;
+    vector<uint64_t> hashes_;
+    vector<uint32_t> heads_;
+    vector<uint32_t> tails_;
+    vector<uint32_t> payloads_;
+    vector<uint32_t> next_;
+    Hash hasher_;
+
+    static uint32_t tagOf(uint64_t hash) { return static_cast<uint32_t>(hash >> 32); }
+
+    uint32_t findKey(const Key& key, uint64_t hash) const {
+        if (slots_.empty()) return npos;
+        uint32_t tag = tagOf(hash);
+        for (size_t pos = hash & mask_;; pos = (pos + 1) & mask_) {
+            const Slot& slot = slots_[pos];
+            if (slot.key_index == npos) return npos;
+            if (slot.tag == tag && keys_[slot.key_index] == key) return slot.key_index;
+        }
+    }
+
+    void placeSlot(uint64_t hash, uint32_t key_index) {
+        size_t pos = hash & mask_;
+        while (slots_[pos].key_index != npos) {
+            pos = (pos + 1) & mask_;
+        }
+        slots_[pos] = Slot{tagOf(hash), key_index};
+    }
+
+    void rehash(size_t capacity) {
+        slots_.assign(capacity, Slot{0, npos});
+        mask_ = capacity - 1;
+        for (uint32_t i = 0; i < keys_.size(); ++i) {
+            placeSlot(hashes_[i], i);
+        }
+    }
+};
+
+#endif
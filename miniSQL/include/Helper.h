@@ -2,6 +2,8 @@
 #define HELPER_H
 
 #include "minisql.h"
+#include "Parser.h"
+#include "Expression.h"
 #include <string>
 #include <vector>
 #include <memory>
@@ -13,26 +15,42 @@ using namespace std;
 string trim(const string& str);
 vector<string> split(const string& str, char delimiter);
 char toUpperChar(char c);
-size_t findOuterOperator(const string& expr, const string& op);
-vector<Column> parseColumnDefinitions(const string& columns_str);
-shared_ptr<LogicExpression> parseWhereClause(const string& where_str, const shared_ptr<Table>& table);
-shared_ptr<LogicExpression> parseJoinWhereClause(const string& where_str, const shared_ptr<Table>& left_table, const shared_ptr<Table>& right_table);
-JoinCondition parseJoinCondition(const string& join_str);
-unordered_map<string, Value> parseUpdateSet(const string& set_clause, const shared_ptr<Table>& table);
+// Both return nullptr when the table does not exist or the WHERE clause does not resolve against it.
+shared_ptr<LogicExpression> parseWhereClause(const SqlExpr& where, const shared_ptr<Table>& table);
+shared_ptr<LogicExpression> parseJoinWhereClause(const SqlExpr& where, const shared_ptr<Table>& left_table, const shared_ptr<Table>& right_table);
+// SET values compiled against the table, see compileAssignments. Throws runtime_error.
+unordered_map<string, shared_ptr<const Expression>> parseUpdateSet(const UpdateStatement& statement, const shared_ptr<Table>& table);
+// Tables a SELECT reads: its FROM and JOIN tables and those of its subqueries.
+vector<string> referencedTables(const SelectStatement& statement);
 
 //Query prehandle helper functions
 bool processCommand(MiniSQL& db, const string& input);
-void handleCreateTable(MiniSQL& db, const string& input);
-void handleInsert(MiniSQL& db, const string& input);
-void handleSimpleSelect(MiniSQL& db, const string& input);
-void handleJoinSelect(MiniSQL& db, const string& input, bool has_save_as, const string& save_table_name);
-void handleDropTable(MiniSQL& db, const string& input);
+// Runs a parsed statement; trimmed_input is its text without the semicolon. Returns true for
+// EXIT. processCommand holds db.statementMutex() around it.
+bool runStatement(MiniSQL& db, const Statement& statement, const string& trimmed_input);
+void handleCreateTable(MiniSQL& db, const CreateTableStatement& statement);
+void handleInsert(MiniSQL& db, const InsertStatement& statement);
+void handleSimpleSelect(MiniSQL& db, const SelectStatement& statement, const string& sql);
+void handleJoinSelect(MiniSQL& db, const SelectStatement& statement, const string& sql);
+void handleDropTable(MiniSQL& db, const DropTableStatement& statement);
 void handleShowTables(MiniSQL& db);
-void handleDelete(MiniSQL& db, const string& input);
-void handleUpdate(MiniSQL& db, const string& input);
+void handleCreateIndex(MiniSQL& db, const CreateIndexStatement& statement);
+void handleDropIndex(MiniSQL& db, const DropIndexStatement& statement);
+void handleShowIndexes(MiniSQL& db);
+void handleShowStats(MiniSQL& db);
+void handleShowCache(MiniSQL& db);
+void handleSet(MiniSQL& db, const SetStatement& statement);
+void handleDelete(MiniSQL& db, const DeleteStatement& statement);
+void handleUpdate(MiniSQL& db, const UpdateStatement& statement);
+void handlePrepare(MiniSQL& db, const PrepareStatement& statement);
+void handleExecute(MiniSQL& db, const ExecuteStatement& statement);
+void handleDeallocate(MiniSQL& db, const DeallocateStatement& statement);
+void handleExplain(MiniSQL& db, const ExplainStatement& statement);
 
 // Interface helper functions
 void displayResults(const vector<Row>& results, const vector<Column>& columns);
+// One line per operator, children indented below their parent, and the total time of an EXPLAIN ANALYZE.
+void displayPlan(const PlanNode& plan);
 void showHelp();
 
 #endif
\ No newline at end of file
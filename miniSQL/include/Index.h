@@ -0,0 +1,231 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "minisql.h"
+#include "BPlusTree.h"
+#include "HashTable.h"
+#include "RoaringBitmap.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Total order over Value that agrees with ConditionEvaluator::compare: INT and DOUBLE
+// compare numerically, and every number sorts before every string.
+struct ValueLess {
+    bool operator()(const Value& left, const Value& right) const;
+};
+
+// One index entry: the column value and the position of the row holding it.
+// The row position makes entries unique, so duplicate column values are allowed.
+// included holds the row's INCLUDE column values; it takes no part in the ordering.
+struct IndexEntry {
+    Value key;
+    size_t row = 0;
+    vector<Value> included;
+};
+
+struct IndexEntryLess {
+    bool operator()(const IndexEntry& left, const IndexEntry& right) const;
+};
+
+// Identifies the table file an index file was written for. A stored index is only
+// reused when its stamp still matches the CSV file, otherwise it is rebuilt from the rows.
+struct TableFileStamp {
+    uint64_t file_size = 0;
+    int64_t modified_time = 0;
+    uint64_t row_count = 0;
+    
+    bool operator==(const TableFileStamp& other) const {
+        return file_size == other.file_size && modified_time == other.modified_time && row_count == other.row_count;
+    }
+};
+
+// Secondary index over one table column, created with CREATE INDEX and kept in sync
+// by Table on insert, update and delete. INCLUDE columns are stored in the entries so
+// queries touching only the key and included columns never read the table rows.
+class TableIndex {
+private:
+    string name_;
+    string column_;
+    int column_idx_;
+    vector<string> include_columns_;
+    vector<int> include_idx_;
+    BPlusTree<IndexEntry, IndexEntryLess> tree_;
+
+    IndexEntry makeEntry(const Row& row, size_t row_pos) const;
+
+public:
+    TableIndex(string name, string column, int column_idx, vector<string> include_columns = {}, vector<int> include_idx = {});
+
+    const string& name() const { return name_; }
+    const string& column() const { return column_; }
+    int columnIndex() const { return column_idx_; }
+    const vector<string>& includeColumns() const { return include_columns_; }
+    // Position of column in the covered layout (key column first, then the INCLUDE
+    // columns), or -1 when the index does not store it.
+    int coveredPosition(const string& column) const;
+    size_t size() const { return tree_.size(); }
+    // Approximate heap bytes of the tree and its entries.
+    size_t memoryUsage() const;
+    // Heap bytes of the key and INCLUDE values the entry of row holds, as memoryUsage() counts them.
+    size_t entryBytes(const Row& row) const;
+
+    void build(const vector<Row>& rows);
+    void insert(const Row& row, size_t row_pos);
+    void erase(const Value& key, size_t row);
+    // Renumber rows after a delete compacted the table. new_positions[old] is the new
+    // position of a kept row, or SIZE_MAX for a deleted one.
+    void remap(const vector<size_t>& new_positions);
+
+    // Row positions (in key order) whose value lies in the range. A null bound is open.
+    vector<size_t> rangeLookup(const Value* low, bool low_inclusive, const Value* high, bool high_inclusive) const;
+    // Visits the entries of the range in key order.
+    void scanRange(const Value* low, bool low_inclusive, const Value* high, bool high_inclusive, const function<void(const IndexEntry&)>& visit) const;
+
+    // Index file: a header page followed by the leaf pages of the tree in key order, so
+    // loading is one sequential pass over a memory-mapped file plus a bulk load.
+    bool saveToFile(const string& path, const TableFileStamp& stamp) const;
+    // Returns false when the file is missing, damaged, was written for another stamp, or
+    // does not agree with rows; the caller then rebuilds the index from rows.
+    bool loadFromFile(const string& path, const TableFileStamp& stamp, const vector<Row>& rows);
+};
+
+// Hash index behind a PRIMARY KEY or UNIQUE column: O(1) duplicate checks on insert
+// and O(1) lookups for WHERE column = constant. INT keys are widened to DOUBLE, the
+// same way ConditionEvaluator::compare matches 1 and 1.0.
+class UniqueIndex {
+private:
+    string column_;
+    int column_idx_;
+    bool primary_key_;
+    FlatHashTable<double> numbers_;
+    FlatHashTable<string> strings_;
+    size_t live_keys_ = 0;
+
+public:
+    UniqueIndex(string column, int column_idx, bool primary_key);
+
+    const string& column() const { return column_; }
+    int columnIndex() const { return column_idx_; }
+    bool isPrimaryKey() const { return primary_key_; }
+    const char* constraintName() const { return primary_key_ ? "PRIMARY KEY" : "UNIQUE"; }
+
+    // Rebuilds from rows. Returns false if rows hold a duplicate key; the first row wins.
+    bool build(const vector<Row>& rows);
+    // Row position holding key, or SIZE_MAX.
+    size_t find(const Value& key) const;
+    // Returns false (and changes nothing) if key is already present.
+    bool insert(const Value& key, size_t row);
+    void erase(const Value& key);
+    // Erased keys still take space in the hash table; rebuild once they dominate.
+    bool needsRebuild() const { return numbers_.size() + strings_.size() > 2 * live_keys_ + 1024; }
+    size_t memoryUsage() const { return numbers_.memoryUsage() + strings_.memoryUsage(); }
+};
+
+// Bitmap index for a low-cardinality column, created with CREATE BITMAP INDEX: one
+// compressed bitmap of row positions per distinct value.
+class BitmapIndex {
+private:
+    string name_;
+    string column_;
+    int column_idx_;
+    vector<Value> values_;
+    vector<RoaringBitmap> bitmaps_;   // bitmaps_[i] holds the rows whose value is values_[i]
+    FlatHashTable<double> numbers_;   // value -> slot in values_, INT widened to DOUBLE
+    FlatHashTable<string> strings_;
+
+    uint32_t slotOf(const Value& key) const;
+    uint32_t addSlot(const Value& key);
+
+public:
+    BitmapIndex(string name, string column, int column_idx);
+
+    const string& name() const { return name_; }
+    const string& column() const { return column_; }
+    int columnIndex() const { return column_idx_; }
+    size_t distinctValues() const { return values_.size(); }
+    size_t memoryUsage() const;
+
+    void build(const vector<Row>& rows);
+    void insert(const Value& key, size_t row);
+    void erase(const Value& key, size_t row);
+    // Rows whose value satisfies value <op> constant, decided exactly like ConditionEvaluator::compare.
+    RoaringBitmap lookup(CompareOp op, const Value& constant) const;
+};
+
+// Trigram index for LIKE '%text%' on a VARCHAR column, created with CREATE TRIGRAM INDEX:
+// one bitmap of row positions per 3-byte substring. Rows holding every trigram of a
+// pattern's literal runs are a superset of the matches, which the caller rechecks.
+class TrigramIndex {
+private:
+    string name_;
+    string column_;
+    int column_idx_;
+    unordered_map<uint32_t, RoaringBitmap> postings_;
+
+public:
+    TrigramIndex(string name, string column, int column_idx);
+
+    const string& name() const { return name_; }
+    const string& column() const { return column_; }
+    int columnIndex() const { return column_idx_; }
+    size_t trigramCount() const { return postings_.size(); }
+    size_t memoryUsage() const;
+
+    void build(const vector<Row>& rows);
+    void insert(const Value& key, size_t row);
+    void erase(const Value& key, size_t row);
+    // Candidate rows for value LIKE pattern. Returns false when the pattern has no literal
+    // run of three or more bytes, so trigrams cannot narrow it.
+    bool candidates(const string& pattern, RoaringBitmap& result) const;
+};
+
+// Min/max summary of one column inside one block of rows. Numbers and strings are tracked
+// separately because ConditionEvaluator::compare never matches a number against a string.
+struct ColumnZone {
+    bool has_numbers = false;
+    bool has_strings = false;
+    bool has_nan = false;    // NaN is unordered, so such a zone is never skipped
+    double min_number = 0.0;
+    double max_number = 0.0;
+    string min_string;
+    string max_string;
+
+    void add(const Value& value);
+    // False only when no value in the zone can satisfy value <op> constant.
+    bool mayMatch(CompareOp op, const Value& constant) const;
+};
+
+// Zone map: per-block (BLOCK_ROWS rows) min/max for every column, used by table scans to
+// skip blocks that cannot satisfy a WHERE conjunct. Updates only widen a zone, so it stays
+// correct without rescanning; deletes shift rows and rebuild it.
+class ZoneMap {
+private:
+    size_t column_count_;
+    size_t row_count_ = 0;
+    vector<ColumnZone> zones_;   // zones_[block * column_count_ + column]
+
+public:
+    static constexpr size_t BLOCK_ROWS = 65536;
+
+    explicit ZoneMap(size_t column_count) : column_count_(column_count) {}
+
+    size_t blockCount() const { return (row_count_ + BLOCK_ROWS - 1) / BLOCK_ROWS; }
+    const ColumnZone& zone(size_t block, size_t column) const { return zones_[block * column_count_ + column]; }
+    size_t memoryUsage() const;
+
+    void build(const vector<Row>& rows);
+    // row was appended at position rowCount().
+    void append(const Row& row);
+    // row at position row_pos got new values.
+    void widen(size_t row_pos, const Row& row);
+
+    bool saveToFile(const string& path, const TableFileStamp& stamp) const;
+    bool loadFromFile(const string& path, const TableFileStamp& stamp);
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef LIKEPATTERN_H
+#define LIKEPATTERN_H
+
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+// Position of the first occurrence of needle in haystack, or nullptr. With SSE2, 16 start
+// positions are tested at once against the first and last needle byte, and only positions
+// where both match are verified with memcmp; the tail falls back to memchr + memcmp.
+inline const char* findSubstring(const char* haystack, size_t haystack_size, const char* needle, size_t needle_size) {
+    if (needle_size == 0) return haystack;
+    if (needle_size > haystack_size) return nullptr;
+    if (needle_size == 1) return static_cast<const char*>(memchr(haystack, needle[0], haystack_size));
+
+    size_t last_start = haystack_size - needle_size;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[needle_size - 1]);
+    for (; i + 16 <= last_start + 1; i += 16) {
+        __m128i block_first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        __m128i block_last = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needle_size - 1));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, block_first), _mm_cmpeq_epi8(last, block_last))));
+        while (mask) {
+            unsigned bit = __builtin_ctz(mask);
+            if (memcmp(haystack + i + bit + 1, needle + 1, needle_size - 2) == 0) {
+                return haystack + i + bit;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i <= last_start) {
+        const char* hit = static_cast<const char*>(memchr(haystack + i, needle[0], last_start - i + 1));
+        if (!hit) return nullptr;
+        if (memcmp(hit + 1, needle + 1, needle_size - 1) == 0) return hit;
+        i = static_cast<size_t>(hit - haystack) + 1;
+    }
+    return nullptr;
+}
+
+// Compiled LIKE pattern: '%' matches any run of bytes and '_' exactly one byte. Matching is
+// case-sensitive, like '=' on strings.
+class LikePattern {
+public:
+    explicit LikePattern(const string& pattern) {
+        size_t start = 0;
+        while (true) {
+            size_t percent = pattern.find('%', start);
+            segments_.push_back(Segment{pattern.substr(start, percent - start), false});
+            Segment& segment = segments_.back();
+            segment.has_underscore = segment.text.find('_') != string::npos;
+            if (percent == string::npos) break;
+            start = percent + 1;
+        }
+        prefix_ = prefixOf(pattern);
+        exact_ = segments_.size() == 1 && !segments_[0].has_underscore;
+    }
+
+    // Leading bytes before the first wildcard; every match starts with them.
+    static string prefixOf(const string& pattern) {
+        return pattern.substr(0, pattern.find_first_of("%_"));
+    }
+
+    const string& prefix() const { return prefix_; }
+    // True when the pattern has no wildcard, so it only matches the prefix itself.
+    bool isExact() const { return exact_; }
+
+    // Runs of literal bytes between wildcards, e.g. {"ab", "c", "d"} for 'ab%c_d'.
+    vector<string> literals() const {
+        vector<string> runs;
+        for (const auto& segment : segments_) {
+            size_t start = 0;
+            while (start <= segment.text.size()) {
+                size_t underscore = segment.text.find('_', start);
+                if (underscore == string::npos) underscore = segment.text.size();
+                if (underscore > start) runs.push_back(segment.text.substr(start, underscore - start));
+                start = underscore + 1;
+            }
+        }
+        return runs;
+    }
+
+    bool matches(const string& text) const {
+        const char* data = text.data();
+        size_t size = text.size();
+        if (segments_.size() == 1) {
+            return size == segments_[0].text.size() && matchesAt(segments_[0], data);
+        }
+
+        // The first segment is anchored at the start and the last at the end; the middle
+        // ones are taken at their leftmost occurrence in between, which never misses a match.
+        const Segment& head = segments_.front();
+        const Segment& tail = segments_.back();
+        if (size < head.text.size() + tail.text.size()) return false;
+        if (!matchesAt(head, data) || !matchesAt(tail, data + size - tail.text.size())) return false;
+
+        size_t pos = head.text.size();
+        size_t end = size - tail.text.size();
+        for (size_t s = 1; s + 1 < segments_.size(); ++s) {
+            const Segment& segment = segments_[s];
+            if (segment.text.empty()) continue;
+            const char* found = find(segment, data + pos, end - pos);
+            if (!found) return false;
+            pos = static_cast<size_t>(found - data) + segment.text.size();
+        }
+        return true;
+    }
+
+private:
+    struct Segment {
+        string text;            // bytes between two '%'
+        bool has_underscore;
+    };
+
+    vector<Segment> segments_;
+    string prefix_;
+    bool exact_ = false;
+
+    static bool matchesAt(const Segment& segment, const char* data) {
+        if (!segment.has_underscore) {
+            return memcmp(data, segment.text.data(), segment.text.size()) == 0;
+        }
+        for (size_t i = 0; i < segment.text.size(); ++i) {
+            if (segment.text[i] != '_' && segment.text[i] != data[i]) return false;
+        }
+        return true;
+    }
+
+    static const char* find(const Segment& segment, const char* data, size_t size) {
+        if (!segment.has_underscore) {
+            return findSubstring(data, size, segment.text.data(), segment.text.size());
+        }
+        for (size_t pos = 0; pos + segment.text.size() <= size; ++pos) {
+            if (matchesAt(segment, data + pos)) return data + pos;
+        }
+        return nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef PAGEFILE_H
+#define PAGEFILE_H
+
+#include "minisql.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Page file of a table, <table>.pages next to its CSV file: the rows in pages of PAGE_ROWS
+// consecutive rows, located through a page table. Writing back appends the changed pages and
+// a new page table, then overwrites the header, so unchanged pages are never written again.
+// Replaced page versions stay behind as garbage until the file is compacted.
+//
+// The CSV file is the table's export: the header records its size and modification time
+// when it was last read or written. While the CSV still matches, the page file holds the same
+// rows or newer ones (changes written back since) and is loaded instead. The file is only
+// created by the first write-back: a table unchanged since its CSV was read has none.
+class PageFile {
+public:
+    static constexpr size_t PAGE_ROWS = 1024;
+
+    PageFile(string path, size_t column_count) : path_(move(path)), column_count_(column_count) {}
+
+    const string& path() const { return path_; }
+    // Reads the header and page table. False when the file is missing, damaged, or was
+    // written for another number of columns.
+    bool open();
+    bool isOpen() const { return open_; }
+    // Every row of the opened file, in order. False when a page is damaged.
+    bool readRows(vector<Row>& rows) const;
+    // Writes back the pages of rows flagged in dirty (pages past the old end always) and drops
+    // the pages past the end of rows. Writes the whole file when it is not open yet or
+    // garbage outweighs the live pages. Marks the CSV file as behind.
+    bool write(const vector<Row>& rows, const vector<bool>& dirty);
+    // Records that the rows were just read from csv_file and removes a page file left behind
+    // for an older version of it. Nothing is written until the first write-back.
+    void setCsvRead(const string& csv_file);
+
+    // Whether csv_file is unchanged since it was last read or written, and whether it also
+    // holds the current rows.
+    bool matchesCsv(const string& csv_file) const;
+    bool csvCurrent() const { return open_ && header_.csv_current != 0; }
+    // Records that csv_file was just written with the current rows.
+    bool setCsvWritten(const string& csv_file);
+    // Whether the page file at path holds changes that csv_file, unchanged since, lacks.
+    // Reads only the header.
+    static bool csvBehind(const string& path, const string& csv_file);
+    size_t pageCount() const { return pages_.size(); }
+
+private:
+    struct PageRef {
+        uint64_t offset;
+        uint32_t bytes;
+        uint32_t rows;
+        uint64_t checksum;
+    };
+    struct Header {
+        char magic[8];
+        uint32_t page_rows;
+        uint32_t column_count;
+        uint64_t row_count;
+        uint64_t page_count;
+        uint64_t page_table_offset;
+        uint64_t end_offset;        // end of the data written so far
+        uint64_t live_bytes;        // bytes of the pages the page table points to
+        uint64_t csv_size;
+        int64_t csv_modified_time;
+        uint32_t csv_current;
+        uint32_t reserved;
+    };
+
+    string path_;
+    size_t column_count_;
+    Header header_ = {};
+    vector<PageRef> pages_;
+    bool open_ = false;
+
+    // Writes every page into a new file that replaces the old one.
+    bool writeAll(const vector<Row>& rows);
+    bool writeHeader();
+};
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "minisql.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+using namespace std;
+
+// Part I. Tokens
+enum class TokenType {
+    IDENTIFIER,     // names and keywords, keywords are matched case-insensitively
+    NUMBER,         // unsigned, e.g. 42, 2.5, 1e6
+    STRING,         // 'text', '' inside stands for one quote
+    SYMBOL,         // ( ) , . * / % ; = <> != < <= > >= + - ?
+    END
+};
+
+// text points into the statement, so tokens are only valid while it is alive.
+// For STRING it is the part between the quotes, with doubled quotes still doubled.
+struct Token {
+    TokenType type;
+    string_view text;
+    size_t pos;
+};
+
+// Thrown by tokenize and SqlParser for malformed statements.
+class SqlSyntaxError : public runtime_error {
+public:
+    explicit SqlSyntaxError(const string& message) : runtime_error(message) {}
+};
+
+// Splits a statement into tokens in one pass, ending with an END token.
+vector<Token> tokenize(string_view sql);
+// The tokens of a statement separated by single spaces, with the keywords of a query in upper
+// case, so statements that differ only in layout or keyword case normalize equally.
+string normalizeStatement(string_view sql);
+
+// Part II. Expressions
+enum class ExprKind {
+    COLUMN,         // text = name as written, possibly table.column
+    NUMBER,         // text = the literal, with its sign
+    STRING,         // text = the literal, unescaped
+    PARAMETER,      // ? of a prepared statement, parameter = its position
+    COMPARE,        // left op right
+    LIKE,           // left LIKE / NOT LIKE right, op tells which
+    IN_SUBQUERY,    // left IN (subquery), NOT IN is NOT over it
+    EXISTS,         // EXISTS (subquery), NOT EXISTS is NOT over it
+    AND,
+    OR,
+    NOT,            // NOT left
+    ARITHMETIC,     // left text right, text is one of + - * / %
+    NEGATE,         // -left
+    CASE,           // CASE WHEN left->left THEN left->right ELSE right END, left is a WHEN;
+                    // further WHEN branches are a CASE as right
+    WHEN            // WHEN left THEN right, only below a CASE
+};
+
+// Expression as written in a statement. Column names are resolved against a table
+// later, by WhereParser::bind or ExpressionCompiler::compile.
+struct SqlExpr {
+    ExprKind kind;
+    string text;
+    CompareOp op = CompareOp::EQUAL;
+    shared_ptr<const SqlExpr> left;
+    shared_ptr<const SqlExpr> right;
+    shared_ptr<const Subquery> subquery;   // IN_SUBQUERY / EXISTS
+    size_t parameter = 0;
+};
+
+// Part III. Statements
+struct CreateTableStatement {
+    string table;
+    vector<Column> columns;
+};
+
+struct DropTableStatement {
+    string table;
+};
+
+struct CreateIndexStatement {
+    string index;
+    string table;
+    string column;
+    IndexKind kind = IndexKind::BTREE;
+    vector<string> include_columns;
+};
+
+struct DropIndexStatement {
+    string index;
+    string table;                       // empty when ON is omitted
+};
+
+struct InsertStatement {
+    string table;
+    bool replace = false;               // INSERT OR REPLACE
+    vector<shared_ptr<const SqlExpr>> values;   // literals or ? parameters
+};
+
+struct SelectStatement {
+    vector<string> columns;             // as written, {"*"} for SELECT *; the alias of an item with AS
+    // One per item of columns when the list computes values or renames a column with AS,
+    // empty for plain column lists.
+    vector<shared_ptr<const SqlExpr>> expressions;
+    bool count_star = false;            // SELECT COUNT(*)
+    string table;
+    string join_table;                  // empty without JOIN
+    JoinCondition join;
+    shared_ptr<const SqlExpr> where;    // null without WHERE
+    string save_as;                     // SAVE AS target of a JOIN
+};
+
+struct UpdateStatement {
+    string table;
+    vector<pair<string, shared_ptr<const SqlExpr>>> assignments;   // values are computed from the old row
+    shared_ptr<const SqlExpr> where;
+};
+
+struct DeleteStatement {
+    string table;
+    shared_ptr<const SqlExpr> where;
+};
+
+struct ShowStatement {
+    enum class What { TABLES, INDEXES, STATS, CACHE } what;
+};
+
+struct SetStatement {
+    string name;                        // upper case
+    string value;                       // the tokens after the name (and '='), concatenated
+};
+
+// PREPARE <name> AS <statement>; the statement is parsed by MiniSQL::prepare.
+struct PrepareStatement {
+    string name;
+    string sql;
+};
+
+// EXECUTE <name>[(<value>, ...)]
+struct ExecuteStatement {
+    string name;
+    vector<Value> parameters;
+};
+
+// DEALLOCATE [PREPARE] <name>
+struct DeallocateStatement {
+    string name;
+};
+
+// EXPLAIN [ANALYZE] <select>: prints the plan; ANALYZE also runs the query and measures it.
+struct ExplainStatement {
+    bool analyze = false;
+    SelectStatement query;
+};
+
+struct HelpStatement {};
+struct ExitStatement {};
+
+using Statement = variant<CreateTableStatement, DropTableStatement, CreateIndexStatement, DropIndexStatement,
+                          InsertStatement, SelectStatement, UpdateStatement, DeleteStatement,
+                          ShowStatement, SetStatement, PrepareStatement, ExecuteStatement, DeallocateStatement,
+                          ExplainStatement, HelpStatement, ExitStatement>;
+
+// Part IV. Parser
+// Recursive-descent parser over the tokens of one statement (without its semicolon).
+// Every token is looked at a constant number of times, so parsing is linear.
+class SqlParser {
+public:
+    explicit SqlParser(string_view sql);
+
+    Statement parseStatement();
+    // The whole input as one WHERE expression.
+    shared_ptr<const SqlExpr> parseCondition();
+    // Number of ? parameters seen so far.
+    size_t parameterCount() const { return parameter_count_; }
+
+private:
+    string_view sql_;
+    vector<Token> tokens_;
+    size_t pos_ = 0;
+    size_t parameter_count_ = 0;
+
+    const Token& peek(size_t ahead = 0) const;
+    const Token& next();
+    bool isKeyword(const Token& token, string_view keyword) const;
+    bool isSymbol(const Token& token, string_view symbol) const;
+    bool acceptKeyword(string_view keyword);
+    bool acceptSymbol(string_view symbol);
+    void expectKeyword(string_view keyword);
+    void expectSymbol(string_view symbol);
+    string expectIdentifier(const char* what);
+    void expectEnd();
+    [[noreturn]] void fail(const string& expected) const;
+
+    CreateTableStatement parseCreateTable();
+    Column parseColumnDefinition();
+    CreateIndexStatement parseCreateIndex(IndexKind kind);
+    InsertStatement parseInsert();
+    SelectStatement parseSelect();
+    JoinCondition parseJoinCondition();
+    UpdateStatement parseUpdate();
+    DeleteStatement parseDelete();
+    SetStatement parseSet();
+    PrepareStatement parsePrepare();
+    ExecuteStatement parseExecute();
+    string parseColumnRef();
+
+    // OR binds loosest, then AND, NOT, comparisons, + and -, * / and %, unary -.
+    shared_ptr<const SqlExpr> parseOr();
+    shared_ptr<const SqlExpr> parseAnd();
+    shared_ptr<const SqlExpr> parseNot();
+    shared_ptr<const SqlExpr> parsePredicate();
+    shared_ptr<const SqlExpr> parseAdditive();
+    shared_ptr<const SqlExpr> parseMultiplicative();
+    shared_ptr<const SqlExpr> parseUnary();
+    // ( expression ), CASE ... END or an operand.
+    shared_ptr<const SqlExpr> parsePrimary();
+    shared_ptr<const SqlExpr> parseCase();
+    shared_ptr<const SqlExpr> parseOperand();
+    shared_ptr<const Subquery> parseSubquery(SubqueryKind kind);
+};
+
+// Value of a NUMBER literal: INT when it has no fraction or exponent and fits, DOUBLE otherwise.
+Value numberValue(const string& text);
+// Value of a literal operand: STRING, NUMBER, or a bare word taken as a string.
+// Throws runtime_error for a ? parameter, which only EXECUTE can fill in.
+Value literalValue(const SqlExpr& literal);
+// Value stored by UPDATE ... SET into a column of the given type: INT and DOUBLE columns
+// convert it (0 when it is not a number), VARCHAR columns keep it as text.
+Value assignmentValue(const Value& value, const string& type);
+// SQL text of an expression, with parentheses around every nested compound operand.
+string formatExpression(const SqlExpr& expression);
+// Value written as a literal: numbers as they print, strings quoted.
+string formatLiteral(const Value& value);
+// "(SELECT c FROM t WHERE ...)"
+string formatSubquery(const Subquery& subquery);
+// "=", "<>", "LIKE", ...
+const char* compareOpText(CompareOp op);
+
+#endif
@@ -0,0 +1,277 @@
+#ifndef ROARINGBITMAP_H
+#define ROARINGBITMAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Compressed bitmap of row positions in the Roaring layout: positions are split by their
+// high 16 bits into containers, and each container stores its low 16 bits either as a
+// sorted array (up to 4096 values) or as a 65536-bit bitmap, whichever is smaller.
+class RoaringBitmap {
+public:
+    void add(uint32_t value) {
+        Container& container = containerFor(static_cast<uint16_t>(value >> 16));
+        uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+        if (container.isBitmap()) {
+            uint64_t& word = container.bits[low >> 6];
+            uint64_t mask = 1ULL << (low & 63);
+            if (!(word & mask)) {
+                word |= mask;
+                ++container.cardinality;
+            }
+            return;
+        }
+        // Rows are mostly added in ascending order, so try the append first.
+        if (container.array.empty() || container.array.back() < low) {
+            container.array.push_back(low);
+        } else {
+            auto pos = lower_bound(container.array.begin(), container.array.end(), low);
+            if (*pos == low) return;
+            container.array.insert(pos, low);
+        }
+        ++container.cardinality;
+        normalize(container);
+    }
+
+    void remove(uint32_t value) {
+        auto it = findContainer(static_cast<uint16_t>(value >> 16));
+        if (it == containers_.end()) return;
+        uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+        if (it->isBitmap()) {
+            uint64_t& word = it->bits[low >> 6];
+            uint64_t mask = 1ULL << (low & 63);
+            if (!(word & mask)) return;
+            word &= ~mask;
+        } else {
+            auto pos = lower_bound(it->array.begin(), it->array.end(), low);
+            if (pos == it->array.end() || *pos != low) return;
+            it->array.erase(pos);
+        }
+        --it->cardinality;
+        if (it->cardinality == 0) {
+            containers_.erase(it);
+        } else {
+            normalize(*it);
+        }
+    }
+
+    bool contains(uint32_t value) const {
+        auto it = findContainer(static_cast<uint16_t>(value >> 16));
+        if (it == containers_.end()) return false;
+        uint16_t low = static_cast<uint16_t>(value & 0xFFFF);
+        if (it->isBitmap()) return (it->bits[low >> 6] >> (low & 63)) & 1;
+        return binary_search(it->array.begin(), it->array.end(), low);
+    }
+
+    size_t cardinality() const {
+        size_t total = 0;
+        for (const auto& container : containers_) total += container.cardinality;
+        return total;
+    }
+
+    bool empty() const { return containers_.empty(); }
+
+    // All positions in ascending order.
+    vector<size_t> toPositions() const {
+        vector<size_t> positions;
+        positions.reserve(cardinality());
+        for (const auto& container : containers_) {
+            size_t base = static_cast<size_t>(container.key) << 16;
+            if (container.isBitmap()) {
+                for (size_t w = 0; w < container.bits.size(); ++w) {
+                    uint64_t word = container.bits[w];
+                    while (word) {
+                        positions.push_back(base + w * 64 + __builtin_ctzll(word));
+                        word &= word - 1;
+                    }
+                }
+            } else {
+                for (uint16_t low : container.array) positions.push_back(base + low);
+            }
+        }
+        return positions;
+    }
+
+    static RoaringBitmap intersect(const RoaringBitmap& left, const RoaringBitmap& right) {
+        RoaringBitmap result;
+        size_t i = 0, j = 0;
+        while (i < left.containers_.size() && j < right.containers_.size()) {
+            const Container& a = left.containers_[i];
+            const Container& b = right.containers_[j];
+            if (a.key < b.key) { ++i; continue; }
+            if (b.key < a.key) { ++j; continue; }
+
+            Container out(a.key);
+            if (a.isBitmap() && b.isBitmap()) {
+                out.bits.resize(BITMAP_WORDS);
+                for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+                    out.bits[w] = a.bits[w] & b.bits[w];
+                    out.cardinality += __builtin_popcountll(out.bits[w]);
+                }
+            } else if (a.isBitmap() || b.isBitmap()) {
+                const Container& dense = a.isBitmap() ? a : b;
+                const Container& sparse = a.isBitmap() ? b : a;
+                for (uint16_t low : sparse.array) {
+                    if ((dense.bits[low >> 6] >> (low & 63)) & 1) out.array.push_back(low);
+                }
+                out.cardinality = static_cast<uint32_t>(out.array.size());
+            } else {
+                set_intersection(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+                out.cardinality = static_cast<uint32_t>(out.array.size());
+            }
+            if (out.cardinality > 0) {
+                normalize(out);
+                result.containers_.push_back(move(out));
+            }
+            ++i;
+            ++j;
+        }
+        return result;
+    }
+
+    static RoaringBitmap unite(const RoaringBitmap& left, const RoaringBitmap& right) {
+        RoaringBitmap result;
+        size_t i = 0, j = 0;
+        while (i < left.containers_.size() || j < right.containers_.size()) {
+            if (j == right.containers_.size() || (i < left.containers_.size() && left.containers_[i].key < right.containers_[j].key)) {
+                result.containers_.push_back(left.containers_[i++]);
+                continue;
+            }
+            if (i == left.containers_.size() || right.containers_[j].key < left.containers_[i].key) {
+                result.containers_.push_back(right.containers_[j++]);
+                continue;
+            }
+
+            const Container& a = left.containers_[i++];
+            const Container& b = right.containers_[j++];
+            Container out(a.key);
+            if (a.isBitmap() || b.isBitmap()) {
+                // Start from the bitmap side and OR the other container into it.
+                out.bits = a.isBitmap() ? a.bits : b.bits;
+                const Container& other = a.isBitmap() ? b : a;
+                if (other.isBitmap()) {
+                    for (size_t w = 0; w < BITMAP_WORDS; ++w) out.bits[w] |= other.bits[w];
+                } else {
+                    for (uint16_t low : other.array) out.bits[low >> 6] |= 1ULL << (low & 63);
+                }
+                for (uint64_t word : out.bits) out.cardinality += __builtin_popcountll(word);
+            } else {
+                set_union(a.array.begin(), a.array.end(), b.array.begin(), b.array.end(), back_inserter(out.array));
+                out.cardinality = static_cast<uint32_t>(out.array.size());
+            }
+            normalize(out);
+            result.containers_.push_back(move(out));
+        }
+        return result;
+    }
+
+    // Positions in [0, universe) that are not set.
+    RoaringBitmap complement(uint32_t universe) const {
+        RoaringBitmap result;
+        if (universe == 0) return result;
+        uint32_t last_key = (universe - 1) >> 16;
+        size_t next = 0;
+        for (uint32_t key = 0; key <= last_key; ++key) {
+            Container out(static_cast<uint16_t>(key));
+            out.bits.assign(BITMAP_WORDS, ~0ULL);
+            if (next < containers_.size() && containers_[next].key == key) {
+                const Container& existing = containers_[next++];
+                if (existing.isBitmap()) {
+                    for (size_t w = 0; w < BITMAP_WORDS; ++w) out.bits[w] &= ~existing.bits[w];
+                } else {
+                    for (uint16_t low : existing.array) out.bits[low >> 6] &= ~(1ULL << (low & 63));
+                }
+            }
+            if (key == last_key) {
+                // Clear everything at or above universe in the last chunk.
+                uint32_t limit = universe - (key << 16);
+                size_t word = limit / 64;
+                if (limit % 64) {
+                    out.bits[word++] &= (1ULL << (limit % 64)) - 1;
+                }
+                fill(out.bits.begin() + word, out.bits.end(), 0);
+            }
+            for (uint64_t word : out.bits) out.cardinality += __builtin_popcountll(word);
+            if (out.cardinality > 0) {
+                normalize(out);
+                result.containers_.push_back(move(out));
+            }
+        }
+        return result;
+    }
+
+    size_t memoryUsage() const {
+        size_t bytes = containers_.capacity() * sizeof(Container);
+        for (const auto& container : containers_) {
+            bytes += container.array.capacity() * sizeof(uint16_t) + container.bits.capacity() * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+private:
+    static constexpr size_t ARRAY_MAX = 4096;
+    static constexpr size_t BITMAP_WORDS = 1024;
+
+    struct Container {
+        uint16_t key;
+        uint32_t cardinality = 0;
+        vector<uint16_t> array;   // sorted low bits while cardinality <= ARRAY_MAX
+        vector<uint64_t> bits;    // BITMAP_WORDS words once the container is dense
+
+        explicit Container(uint16_t k) : key(k) {}
+        bool isBitmap() const { return !bits.empty(); }
+    };
+
+    vector<Container> containers_;   // sorted by key
+
+    vector<Container>::iterator findContainer(uint16_t key) {
+        auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& c, uint16_t k) { return c.key < k; });
+        return (it != containers_.end() && it->key == key) ? it : containers_.end();
+    }
+
+    vector<Container>::const_iterator findContainer(uint16_t key) const {
+        auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& c, uint16_t k) { return c.key < k; });
+        return (it != containers_.end() && it->key == key) ? it : containers_.end();
+    }
+
+    Container& containerFor(uint16_t key) {
+        if (!containers_.empty() && containers_.back().key == key) return containers_.back();
+        auto it = lower_bound(containers_.begin(), containers_.end(), key, [](const Container& c, uint16_t k) { return c.key < k; });
+        if (it == containers_.end() || it->key != key) {
+            it = containers_.insert(it, Container(key));
+        }
+        return *it;
+    }
+
+    static vector<uint64_t> toBits(const Container& container) {
+        vector<uint64_t> bits(BITMAP_WORDS, 0);
+        for (uint16_t low : container.array) bits[low >> 6] |= 1ULL << (low & 63);
+        return bits;
+    }
+
+    // Switch between the array and bitmap forms when the cardinality crosses ARRAY_MAX.
+    static void normalize(Container& container) {
+        if (!container.isBitmap() && container.cardinality > ARRAY_MAX) {
+            container.bits = toBits(container);
+            container.array.clear();
+            container.array.shrink_to_fit();
+        } else if (container.isBitmap() && container.cardinality <= ARRAY_MAX) {
+            container.array.clear();
+            container.array.reserve(container.cardinality);
+            for (size_t w = 0; w < BITMAP_WORDS; ++w) {
+                uint64_t word = container.bits[w];
+                while (word) {
+                    container.array.push_back(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+                    word &= word - 1;
+                }
+            }
+            container.bits.clear();
+            container.bits.shrink_to_fit();
+        }
+    }
+};
+
+#endif
@@ -1,23 +1,49 @@
 #ifndef MINISQL_H
 #define MINISQL_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <filesystem>
+#include <functional>
+#include <future>
 #include <iostream>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map> 
+#include <unordered_set>
 #include <variant>
 #include <vector>
+#include "HashTable.h"
 
 using namespace std;
 
+class LikePattern;
+class Expression;
+struct SqlExpr;
+struct SelectStatement;
+
 // PartI. Define Basic Variables 
 using Value = variant<int, double, string>;
 
+// Heap bytes owned by a string or value: the buffer of a string too long for the inline
+// (small string) storage, 15 characters in libstdc++. Used for memory accounting.
+inline size_t heapBytes(const string& text) { return text.capacity() > 15 ? text.capacity() + 1 : 0; }
+inline size_t heapBytes(const Value& value) {
+    const string* text = get_if<string>(&value);
+    return text ? heapBytes(*text) : 0;
+}
+
 struct Column {
     string name;
     string type;  
     size_t varchar_length = 0;
+    bool primary_key = false;
+    bool unique = false;     // also set for the PRIMARY KEY column
 };
 
 class Row {
@@ -33,8 +59,10 @@ public:
     
     size_t size() const { return values_.size(); }
     const vector<Value>& values() const { return values_; }
+    // Approximate bytes of the row, its value array and the strings it owns.
+    size_t memoryUsage() const;
     
-    Value getValue(const string& column_name, const vector<string>& column_names) const;
+    const Value& getValue(const string& column_name, const vector<string>& column_names) const;
 };
 
 enum class CompareOp {
@@ -43,13 +71,49 @@ enum class CompareOp {
     GREATER,       
     LESS,           
     GREATER_EQUAL,  
-    LESS_EQUAL      
+    LESS_EQUAL,
+    LIKE,           // string matches a '%' / '_' pattern
+    NOT_LIKE
 };
 
+// left op right for one pair of operand types and one operator, see ConditionEvaluator::kernel.
+using CompareKernel = bool (*)(const Value& left, const Value& right);
+
 enum class LogicOp {
     AND,
     OR,
-    NOT
+    NOT,
+    ALWAYS_TRUE,    // constant node left by WhereParser when the whole WHERE clause folds
+    ALWAYS_FALSE
+};
+
+enum class SubqueryKind {
+    IN,             // col IN (SELECT c FROM t ...), NOT IN is NOT over it
+    EXISTS          // EXISTS (SELECT * FROM t WHERE ...), NOT EXISTS is NOT over it
+};
+
+// Keys collected from a subquery and probed by semi/anti joins. INT keys are widened
+// to DOUBLE so that they match the way ConditionEvaluator::compare does.
+struct SemiJoinKeys {
+    FlatHashTable<double> numbers;
+    FlatHashTable<string> strings;
+    
+    void insert(const Value& key);
+    bool contains(const Value& key) const;
+};
+
+// The subquery is kept as parsed and resolved against its own table by
+// MiniSQL::bindSubqueries right before the statement runs.
+struct Subquery {
+    SubqueryKind kind;
+    string table;
+    string select_column;
+    shared_ptr<const SqlExpr> where;   // null without WHERE
+    // Filled in when bound.
+    string outer_column;    // outer side of an EXISTS correlation, empty if uncorrelated
+    int outer_index = -1;   // its position among the outer columns
+    shared_ptr<SemiJoinKeys> keys;
+    bool has_rows = false;
 };
 
 struct Condition {
@@ -58,6 +122,27 @@ struct Condition {
     Value constant_value;   
     string right_column;    
     bool is_column_comparison; 
+    shared_ptr<Subquery> subquery;   // set for IN / EXISTS predicates
+    shared_ptr<const LikePattern> like;   // compiled constant_value of LIKE / NOT LIKE
+    // Computed left side, e.g. salary * 12 of salary * 12 > 50000, in place of left_column
+    // (which is empty then, so no index applies). Terms without a plain side compare the
+    // whole expression <> 0.
+    shared_ptr<const Expression> expression;
+    // Comparison specialized for the column / constant types and op, selected by WhereParser::bind
+    // once the tree is final. Conditions built elsewhere leave it empty and use compare().
+    CompareKernel kernel = nullptr;
+    // Positions of left_column and right_column among the columns the tree was bound to,
+    // resolved by WhereParser::bind; -1 when not bound.
+    int left_index = -1;
+    int right_index = -1;
+};
+
+// A condition whose constant is the parameter-th ? of a prepared statement.
+// MiniSQL::execute stores the parameter there, converted for a column of type.
+struct ParameterSlot {
+    Condition* condition;
+    size_t parameter;
+    string type;
 };
 
 struct LogicExpression {
@@ -77,9 +162,97 @@ struct JoinCondition {
     string right_table;
     string right_column;
     CompareOp op = CompareOp::EQUAL;
+    // Further (left_column, right_column) equality pairs of a composite key,
+    // e.g. ON a.x = b.x AND a.y = b.y. Oriented like the first pair.
+    vector<pair<string, string>> extra_keys;
+};
+
+// Execution statistics of the last query, shown by SHOW STATS.
+// An IN / EXISTS subquery as bound by MiniSQL::bindSubqueries.
+struct SubqueryStats {
+    string description;         // the predicate, e.g. dept IN (SELECT id FROM departments)
+    string table;
+    size_t rows = 0;            // inner rows read
+    size_t keys = 0;            // distinct keys of the semi join set
+    size_t bytes = 0;           // memory of that set
+    double time_ms = 0;
+};
+
+// What the executor chose for the last query and what it measured. SHOW STATS prints the
+// join part, EXPLAIN the whole. Times are wall-clock milliseconds.
+struct QueryStats {
+    string join_algorithm;
+    size_t build_rows = 0;
+    size_t probe_rows = 0;
+    size_t probe_rows_filtered = 0;   // probe rows rejected by the join filter before probing
+    string join_filter;               // "bloom", "bitmap" or empty
+    string join_index;                // index probed by an index nested loop join
+    size_t spill_partitions = 0;      // > 0 when the join exceeded its memory budget and spilled
+    size_t bytes_spilled = 0;
+    size_t result_rows = 0;
+    bool build_is_left = true;        // hash join: the left table is built; index nested loop join: it is the outer side
+    string outer_filter;              // WHERE conjuncts an index nested loop join checks on the outer rows
+    size_t hash_entries = 0;          // rows inserted into hash tables, over all partitions
+    size_t hash_bytes = 0;            // memory of those hash tables and their join filters
+    size_t joined_rows = 0;           // row pairs matching the join keys, before the WHERE clause
+    double build_ms = 0;              // hash table builds; the outer filter of an index nested loop join
+    double probe_ms = 0;              // probing or looping, WHERE clause included
+    double partition_ms = 0;          // writing the spill partitions
+    
+    // Scan of a single table
+    string access_path;               // "Seq Scan", "Index Scan", "Unique Index Lookup", "Bitmap Index Scan" or "Index Only Scan"
+    string scan_index;                // index(es) of the access path
+    string index_condition;           // the part of the WHERE clause the index answers
+    string filter;                    // the part checked row by row; a bitmap scan that is not exact rechecks the whole clause
+    bool exact = false;               // the index answered the whole WHERE clause, no row is rechecked
+    size_t scan_rows = 0;             // rows read after the index or zone map narrowed them
+    size_t blocks_total = 0;          // zone map blocks of the table and those skipped
+    size_t blocks_skipped = 0;
+    double scan_ms = 0;
+    double project_ms = 0;            // building the output rows
+    
+    vector<SubqueryStats> subqueries;
+};
+
+// One operator of a query plan, see MiniSQL::explain. Its children produce its input.
+struct PlanNode {
+    string name;                      // e.g. "Hash Join", "Seq Scan on employees"
+    vector<string> details;           // e.g. "Filter: salary > 5000"
+    vector<PlanNode> children;
+    // Measured by EXPLAIN ANALYZE.
+    bool analyzed = false;
+    double time_ms = 0;               // this operator alone, its children excluded
+    size_t rows_in = 0;
+    size_t rows_out = 0;
+    size_t hash_entries = 0;
+    size_t bytes = 0;                 // allocated by this operator: hash tables, filters, positions, rows
 };
 
 // PartII. Define Main Classes
+class TableIndex;
+class UniqueIndex;
+class BitmapIndex;
+class TrigramIndex;
+class RoaringBitmap;
+class ZoneMap;
+class PageFile;
+struct TableFileStamp;
+struct KeyRange;
+
+enum class IndexKind {
+    BTREE,          // CREATE INDEX
+    BITMAP,         // CREATE BITMAP INDEX
+    TRIGRAM         // CREATE TRIGRAM INDEX
+};
+
+// An index as listed in a table's schema file.
+struct IndexDefinition {
+    string name;
+    string column;
+    IndexKind kind = IndexKind::BTREE;
+    vector<string> include;  // INCLUDE (...) columns stored in a B+Tree index
+};
+
 //Define Table class include operations: CSV operation, insert, select, join and where filter.
 class Table {
 private:
@@ -87,34 +260,149 @@ private:
     vector<Column> columns_;
     vector<Row> rows_;
     string csv_file_;
+    vector<shared_ptr<TableIndex>> indexes_;
+    vector<shared_ptr<UniqueIndex>> unique_indexes_;   // one per PRIMARY KEY / UNIQUE column
+    vector<shared_ptr<BitmapIndex>> bitmap_indexes_;
+    vector<shared_ptr<TrigramIndex>> trigram_indexes_;
+    shared_ptr<ZoneMap> zone_map_;                      // per-block min/max, used to skip blocks in scans
+    shared_ptr<PageFile> page_file_;                    // the rows as last written back
+    vector<bool> dirty_pages_;                          // pages of rows_ changed since then
+    size_t dirty_bytes_ = 0;                            // see dirtyBytes(), kept by markDirty
+    uint64_t version_ = 0;                              // changes whenever the rows change
+    static atomic<uint64_t> next_version_;              // tables may be loaded on prefetch threads
+    // Parts of memoryUsage(), adjusted by every INSERT, UPDATE and DELETE. A reload or an index
+    // created or dropped marks them stale and the next call measures them again.
+    mutable size_t row_bytes_ = 0;           // Row::memoryUsage() of every row
+    mutable size_t index_bytes_ = 0;         // indexes and zone map
+    mutable size_t index_row_bytes_ = 0;     // index_bytes_ per row when last measured
+    mutable bool memory_stale_ = true;
+    
+    // Row positions (ascending) that may satisfy where_clause, narrowed through the
+    // indexed conjuncts of its top-level AND chain. Returns false when no index applies.
+    // exact is set when the positions are precisely the matching rows (bitmap indexes).
+    // stats, when given, records the access path.
+    bool indexCandidates(const shared_ptr<LogicExpression>& where_clause, vector<size_t>& positions, bool& exact, QueryStats* stats = nullptr) const;
+    // Evaluates an AND / OR / NOT tree as bitmap operations over the bitmap indexes. Fails when
+    // a needed leaf has no bitmap index; exact is cleared when an AND dropped such a leaf or a
+    // trigram index supplied a superset for a LIKE leaf.
+    bool evaluateBitmap(const shared_ptr<LogicExpression>& expression, RoaringBitmap& result, bool& exact) const;
+    bool evaluateBitmap(const variant<Condition, shared_ptr<LogicExpression>>& operand, RoaringBitmap& result, bool& exact) const;
+    // Positions of the rows matching where_clause (every row when it is null).
+    vector<size_t> matchingPositions(const shared_ptr<LogicExpression>& where_clause, QueryStats* stats = nullptr) const;
+    // WHERE conjuncts a zone map can check, as (column index, condition), and whether a block
+    // may hold a row satisfying all of them.
+    vector<pair<int, const Condition*>> zoneFilters(const shared_ptr<LogicExpression>& where_clause) const;
+    bool blockMayMatch(size_t block, const vector<pair<int, const Condition*>>& filters) const;
+    // Index-only scan: answers the query from a TableIndex whose key and INCLUDE columns
+    // hold every column it references. Returns false when no index covers it.
+    bool coveringScan(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, vector<Row>& result, QueryStats* stats = nullptr) const;
+    // The index coveringScan reads and its key range (ranged is false for a full index scan),
+    // or nullptr when it does not apply.
+    const TableIndex* coveringIndex(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, KeyRange& range, bool& ranged) const;
+    void rebuildIndexes();
+    // Versions come from one counter shared by all tables, so a table that is dropped and
+    // created again never repeats a version of the old one.
+    void bumpVersion() { version_ = ++next_version_; }
+    // Heap bytes the B+Tree and unique indexes hold for the keys and INCLUDE values of row;
+    // an UPDATE changes index_bytes_ by the difference between the new and the old row.
+    size_t indexedValueBytes(const Row& row) const;
+    // The row with every value converted to its column's type, as loadFromCSV would read it back.
+    Row typedRow(const Row& row) const;
+    // Size, modification time and row count of the page file, or of the CSV file while there
+    // is no page file yet, stored in index files.
+    TableFileStamp fileStamp() const;
+    // Marks the page holding row_pos as changed; with to_end also every page after it (rows
+    // moved up by a delete).
+    void markDirty(size_t row_pos, bool to_end = false);
+    // Reads the rows from the page file while the CSV file is unchanged since the page file
+    // recorded it, from the CSV file otherwise.
+    bool loadRows();
+    void saveIndexFiles() const;
     
 public:
     Table(string name, vector<Column> columns, string csv_file);
     
     //CSV operation
     bool loadFromCSV();
+    // Writes the CSV, page and index files. The CSV file is written to a temporary file that
+    // then replaces it, so a crash never leaves it truncated. Changes in between only write
+    // back their pages.
     bool saveToCSV();
+    // Writes the changed pages back to the page file. INSERT, UPDATE and DELETE only mark
+    // pages; the checkpoint (see MiniSQL::checkpoint) and eviction write them back.
+    bool flushPages();
+    // Changes not written back to the page file yet. A table read from its CSV file and
+    // unchanged since has no page file and no dirty pages.
+    bool hasDirtyPages() const;
+    // Approximate bytes in memory of the rows on changed pages: a page is charged its rows at
+    // the size of its first row when it is marked, and every row appended to it after that.
+    size_t dirtyBytes() const { return dirty_bytes_; }
+    // Whether the CSV file lacks changes, written back to the page file or not.
+    bool isDirty() const;
     const string& getCsvFile() const { return csv_file_; }
     
+    //Schema and index files, stored next to the CSV file as <table>.schema and <table>.<index>.idx
+    string schemaFile() const;
+    string indexFile(const string& index_name) const;
+    string zoneMapFile() const;
+    string pageFile() const;
+    bool saveSchema() const;
+    // Reads the columns (with types and key constraints) and the indexes of a schema file.
+    static bool readSchema(const string& schema_file, vector<Column>& columns, vector<IndexDefinition>& indexes);
+    
     //INSERT operation
-    void insertRow(const Row& row);
+    // Returns false, after reporting why, when the column count does not match or a key
+    // constraint is violated.
+    // Values are stored converted to the column types, like UPDATE and loadFromCSV do.
+    bool insertRow(const Row& row);
+    // Replaces the row with the same primary key, or inserts it. replaced tells which one happened.
+    bool upsertRow(const Row& row, bool& replaced);
     
     //SELECT operation
-    vector<Row> selectRows(const vector<string>& columns, const vector<string>& column_aliases,const shared_ptr<LogicExpression>& where_clause = nullptr) const;
+    // stats, when given, records the access path and the time spent (see QueryStats).
+    vector<Row> selectRows(const vector<string>& columns, const vector<string>& column_aliases,const shared_ptr<LogicExpression>& where_clause = nullptr, QueryStats* stats = nullptr) const;
+    // Computed SELECT list: every projection evaluated on each matching row.
+    vector<Row> projectRows(const vector<shared_ptr<const Expression>>& projections, const shared_ptr<LogicExpression>& where_clause = nullptr, QueryStats* stats = nullptr) const;
+    // Records in stats the access path selectRows (or projectRows when columns is empty, or
+    // countRows when count_only) would take, without reading any row: the indexes are probed
+    // and the zone map consulted, and scan_rows is the number of rows the scan would read.
+    void explainScan(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, bool count_only, QueryStats& stats) const;
     
     //condition filter
     vector<Row> filterRows(const shared_ptr<LogicExpression>& where_clause) const;
     
-    void clearRows() { rows_.clear(); }
+    void clearRows();
+    
+    //COUNT(*), answered from bitmap indexes alone when they cover the WHERE clause
+    size_t countRows(const shared_ptr<LogicExpression>& where_clause, QueryStats* stats = nullptr) const;
     
     //JOIN operation
-    static vector<Row> joinTables(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    static vector<Row> joinTables(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause = nullptr, QueryStats* stats = nullptr, size_t memory_budget = 0);
 
     //DELETE operation
     int deleteRows(const shared_ptr<LogicExpression>& where_clause = nullptr);
     
     //UPDATE operation
-    int updateRows(const unordered_map<string, Value>& updates, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    // Every expression is evaluated on the row before the update, so SET a = b, b = a swaps,
+    // and its value is stored converted to the column type. All new values are computed
+    // before the first row changes, so an error (e.g. division by zero) changes nothing.
+    int updateRows(const unordered_map<string, shared_ptr<const Expression>>& updates, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    
+    //INDEX operation
+    bool createIndex(const string& index_name, const string& column_name, IndexKind kind = IndexKind::BTREE, const vector<string>& include_columns = {});
+    // Attaches an index listed in the schema file: loaded from its index file when that still
+    // matches the CSV file, rebuilt from the rows otherwise.
+    bool openIndex(const IndexDefinition& definition);
+    bool dropIndex(const string& index_name);
+    bool hasIndex(const string& index_name) const;
+    const vector<shared_ptr<TableIndex>>& indexes() const { return indexes_; }
+    const vector<shared_ptr<BitmapIndex>>& bitmapIndexes() const { return bitmap_indexes_; }
+    const vector<shared_ptr<TrigramIndex>>& trigramIndexes() const { return trigram_indexes_; }
+    // Name of an index usable for equality lookups on column_idx, or empty when there is none.
+    // unique is set for PRIMARY KEY / UNIQUE columns, where a lookup returns at most one row.
+    string equalityIndexOn(int column_idx, bool& unique) const;
+    // Appends the positions of the rows whose column_idx equals key. Returns false without an index.
+    bool indexLookup(int column_idx, const Value& key, vector<size_t>& positions) const;
     
     //Some helper functions
     int getColumnIndex(const string& column_name) const;
@@ -122,105 +410,469 @@ public:
     const vector<Column>& columns() const { return columns_; }
     const vector<Row>& getAllRows() const { return rows_; }
     size_t rowCount() const { return rows_.size(); }
+    // Approximate bytes held in memory by the rows, indexes and zone map. Charged against the
+    // buffer pool capacity.
+    size_t memoryUsage() const;
+    // Increases on every INSERT, UPDATE, DELETE and reload of the rows.
+    uint64_t version() const { return version_; }
 };
 
 // ** Define QueryOptimizer class
 class JoinOptimizer {
 public:
     // This method is used to judge and choose join methods.
-    static vector<Row> optimizeJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type,const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause);
+    // memory_budget bounds the hash table in bytes; 0 means unlimited.
+    static vector<Row> optimizeJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type,const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats = nullptr, size_t memory_budget = 0);
+    // Records in stats the algorithm optimizeJoin would choose, its build / outer side, index
+    // and spill partitions, without joining. Costing an index nested loop join filters the
+    // outer table like the join itself does.
+    static void planJoin(const Table& left_table, const Table& right_table, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats& stats, size_t memory_budget = 0);
     
 private:
+    // Outcome of costing an index nested loop join.
+    struct IndexJoinPlan {
+        bool outer_is_left = true;
+        string index_name;
+        vector<const Condition*> outer_filter;   // WHERE conjuncts local to the outer table
+        vector<size_t> outer_positions;          // outer rows passing them
+    };
+    // Picks the outer side and inner index of the cheapest index nested loop join. Returns
+    // false when no index applies or a hash join is cheaper.
+    static bool planIndexNestedLoopJoin(const Table& left_table, const Table& right_table, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, IndexJoinPlan& plan);
+    // Number of spill partitions of a grace hash join: enough that each build partition's
+    // hash table fits the budget with 2x headroom.
+    static size_t gracePartitions(size_t estimated_bytes, size_t memory_budget);
+    // Output side shared by all join algorithms: projection, WHERE filter and result rows.
+    struct JoinSink {
+        vector<pair<int, int>> projection;   // (side, column index), side 0 = left, 1 = right
+        bool select_all = false;
+        size_t joined_rows = 0;              // pairs offered, before the WHERE filter
+        vector<string> where_columns;
+        shared_ptr<LogicExpression> where_clause;
+        vector<Row> result;
+    };
+    
+    // Index Nested Loop Join: when the inner join column already has an index and the outer side
+    // (after its local WHERE conjuncts) is small, probe the index once per outer row instead of
+    // building a hash table. Returns false when no index applies or a hash join is cheaper.
+    static bool tryIndexNestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, vector<Row>& result);
     // Nested Loop Join
-    static vector<Row> nestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition,const shared_ptr<LogicExpression>& where_clause);
-    // Hash Join
-    static vector<Row> hashJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause);
+    static vector<Row> nestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition,const shared_ptr<LogicExpression>& where_clause, QueryStats* stats);
+    // Hash Join, switching to graceHashJoin when the build side does not fit the memory budget.
+    static vector<Row> hashJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, size_t memory_budget);
+    // Probe rows read one at a time: next() returns the next row, or nullptr after the last one.
+    // A spilled probe side is streamed from its file instead of being read into memory.
+    struct VectorRows {
+        const vector<Row>& rows;
+        size_t position = 0;
+        const Row* next() { return position < rows.size() ? &rows[position++] : nullptr; }
+    };
+    struct SpillRows {
+        istream& in;
+        Row row;
+        const Row* next() { return readSpillRow(in, row) ? &row : nullptr; }
+    };
+    // Grace Hash Join: partition both inputs into spill files under data/tmp/ and join partition by partition.
+    static void graceHashJoin(const Table& build_table, const vector<int>& build_keys, const Table& probe_table, const vector<int>& probe_keys, bool build_is_left, size_t memory_budget, JoinSink& sink, QueryStats* stats);
+    // Joins one spilled partition whose build side needs build_bytes of hash table. Over the
+    // budget it is partitioned again with the hash salted by level, up to MAX_SPILL_LEVELS deep
+    // and while that still splits it (parent_bytes is the partition it came from). A partition
+    // no hash can split (a hot key) is joined block by block instead: each block of build rows
+    // that fits the budget is hashed and the probe file streamed past it.
+    static void joinSpilledPartition(const string& build_file, const string& probe_file, size_t build_bytes, size_t parent_bytes, int level, const vector<int>& build_keys, const vector<int>& probe_keys, bool build_is_left, size_t memory_budget, JoinSink& sink, QueryStats* stats);
+    // Writes every row of rows to files[partition of its key hash salted by level] and returns
+    // the bytes written. partition_bytes, when given, gets the hash table bytes of each partition.
+    template<typename RowSource>
+    static size_t spillPartitions(RowSource& rows, const vector<int>& keys, int level, const vector<string>& files, vector<size_t>* partition_bytes);
+    // Pick the hash table key type from the build keys and run probeHashTable.
+    template<typename ProbeRows>
+    static void dispatchHashJoin(const vector<Row>& build_rows, const vector<int>& build_keys, ProbeRows& probe_rows, const vector<int>& probe_keys, bool build_is_left, JoinSink& sink, QueryStats* stats);
+    // Build a FlatHashTable<Key> plus a join filter on the build side, then probe it with every probe row.
+    // build_key(row) returns the key of a build row; probe_key(row, scratch) returns a pointer to
+    // the probe key (possibly stored in scratch), or nullptr when the row cannot match.
+    template<typename Key, typename BuildKeyFn, typename ProbeKeyFn, typename ProbeRows>
+    static void probeHashTable(const vector<Row>& build_rows, ProbeRows& probe_rows, BuildKeyFn build_key, ProbeKeyFn probe_key, bool build_is_left, JoinSink& sink, QueryStats* stats);
+    // Resolve every key pair of the condition to column indices, oriented to the FROM order.
+    static void resolveJoinKeys(const Table& left_table, const Table& right_table, const JoinCondition& condition, vector<int>& left_keys, vector<int>& right_keys);
+    // Type-coerced key handling: INT and DOUBLE keys that compare equal must hash and encode equally.
+    static uint64_t normalizedKeyHash(const Row& row, const vector<int>& keys);
+    static void encodeJoinKey(const Row& row, const vector<int>& keys, string& out);
+    static size_t estimateHashTableBytes(const vector<Row>& build_rows, const vector<int>& build_keys);
+    // Share of estimateHashTableBytes for one build row.
+    static size_t hashEntryBytes(const Row& row, const vector<int>& build_keys);
+    static void writeSpillRow(ostream& out, const Row& row);
+    static bool readSpillRow(istream& in, Row& row);
+    static JoinSink makeSink(const Table& left_table, const Table& right_table, const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause);
+    static void emitJoinedRow(const Row& left_row, const Row& right_row, JoinSink& sink);
 };
 
 //define a class to deal with the condition in clause.
 class ConditionEvaluator {
 public:
+    // Errors of a computed operand, e.g. a division by zero, are thrown and abort the
+    // statement rather than count as false, which NOT would turn into true.
+    // Row laid out like the columns the WHERE tree was bound to: operands are read at the
+    // positions WhereParser::bind resolved, without a lookup by name.
+    static bool evaluate(const Row& row, const Condition& condition);
+    static bool evaluate(const Row& row, const shared_ptr<LogicExpression>& expression);
+    // Row of another layout, e.g. the covered values of an index or one side of a join:
+    // operands are looked up by name in column_names.
     static bool evaluate(const Row& row, const vector<string>& column_names, const Condition& condition);
     static bool evaluate(const Row& row, const vector<string>& column_names, const shared_ptr<LogicExpression>& expression);
     static bool compare(const Value& left, const Value& right, CompareOp op);
+    // compare() specialized for operands of the given types ("INT", "DOUBLE", "VARCHAR") and op:
+    // no variant visit and no switch on op per call. Operands of other types than expected still
+    // give the result of compare(), and LIKE / NOT LIKE always run it.
+    static CompareKernel kernel(const string& left_type, const string& right_type, CompareOp op);
+    // Kernel for operands of the same types as left and right.
+    static CompareKernel kernel(const Value& left, const Value& right, CompareOp op);
     
 private:
     template<typename T>
     static bool compareValues(const T& left, const T& right, CompareOp op);
+    static CompareKernel kernel(size_t left_index, size_t right_index, CompareOp op);
+    // column_names is null for a row in the bound layout.
+    static const Value& operand(const Row& row, const vector<string>* column_names, const string& column, int index);
+    static bool evaluateCondition(const Row& row, const vector<string>* column_names, const Condition& condition);
+    static bool evaluateTree(const Row& row, const vector<string>* column_names, const shared_ptr<LogicExpression>& expression);
+    // Semi join probe of a bound subquery: one hash lookup, stops at the first match.
+    static bool evaluateSubquery(const Row& row, const vector<string>* column_names, const Condition& condition);
 };
 
-//define WHERE clauses parser
+//define WHERE clauses parser: resolves a parsed WHERE expression against the columns
+//of the queried tables. Errors are reported on cerr and yield nullptr.
 class WhereParser {
 public:
     static shared_ptr<LogicExpression> parse(const string& where_str, const vector<Column>& columns);
+    // Without parameters, a ? in the expression is an error. The bound tree is rewritten for
+    // evaluation, see rewrite().
+    static shared_ptr<LogicExpression> bind(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters = nullptr);
+    // A bound tree or condition as SQL text, after the rewrite, for EXPLAIN.
+    static string describe(const shared_ptr<LogicExpression>& expression);
+    static string describe(const Condition& condition);
+    // Parameter value compared with a column of the given type, converted like a literal.
+    static Value parameterValue(const Value& value, const string& type);
     
 private:
-    static Value parseValue(const string& str, const string& type);
-    static CompareOp parseCompareOp(const string& op_str);
-    static LogicOp parseLogicOp(const string& op_str);
+    static shared_ptr<LogicExpression> bindExpression(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters);
+    // Flattens AND / OR chains, folds terms that are always true or false, pushes NOT down into
+    // the comparisons and orders the terms of every chain so the cheapest and most selective
+    // are evaluated first. Leaves are modified in place, never copied, so parameter slots stay
+    // valid; opaque conditions (? parameters) are neither folded nor negated.
+    static shared_ptr<LogicExpression> rewrite(const shared_ptr<LogicExpression>& expression, bool negated, const vector<Column>& columns, const unordered_set<const Condition*>& opaque);
+    static shared_ptr<LogicExpression> makeConstant(bool value);
+    // Constant of a literal compared with a column of the given type: numbers stay numbers
+    // and quoted numbers become numbers for INT / DOUBLE columns, text stays text for VARCHAR.
+    static Value parseValue(const SqlExpr& literal, const string& type);
+    // Column name without its table qualifier, or empty when columns has no such column.
     static string parseColumnName(const string& column_ref, const vector<Column>& columns);
-    static shared_ptr<LogicExpression> parseSingleCondition(const string& condition_str, const vector<Column>& columns);
-    static shared_ptr<LogicExpression> parseExpression(const string& expr_str, const vector<Column>& columns);
-    static bool validateExpression(const string& expr_str);
-    static bool validateCondition(const string& cond_str);
+    static shared_ptr<LogicExpression> bindComparison(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters);
+    // A term with no plain side, e.g. WHERE a * 2 > b + 1 or WHERE CASE ... END, compiled as a
+    // whole into Condition::expression.
+    static shared_ptr<LogicExpression> bindComputed(const SqlExpr& expression, const vector<Column>& columns);
+    // Compiles a computed operand; errors are reported on cerr and yield nullptr.
+    static shared_ptr<const Expression> compileOperand(const SqlExpr& operand, const vector<Column>& columns);
+    static shared_ptr<LogicExpression> bindLike(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters);
+    static shared_ptr<LogicExpression> bindSubquery(const SqlExpr& expression, const vector<Column>& columns);
+    static shared_ptr<LogicExpression> makeLeaf(Condition condition);
+    // Records a slot for a ? operand; fails (with an error) when there are no parameters.
+    static bool addParameterSlot(const SqlExpr& operand, const shared_ptr<LogicExpression>& leaf, const string& type, vector<ParameterSlot>* parameters);
 };
 
-// define buffer pool in which LRU mechanism will be used.
+// Buffer pool of the tables held in memory: a cache over the catalog of tables on disk,
+// bounded by their total size in bytes (see Table::memoryUsage). Every access charges the
+// current size of a table; once the total exceeds the capacity, tables are dropped as chosen
+// by the policy, after writing back their changed pages. A miss reloads the table through the
+// catalog. A table is pinned while anything besides the pool holds a shared_ptr to it (a
+// statement running on it), and pinned tables are never evicted.
 class BufferPool {
-private:
-    size_t capacity_;
-    unordered_map<string, shared_ptr<Table>> cache_;
-    vector<string> access_order_;
-    
 public:
-    explicit BufferPool(size_t capacity = 10) : capacity_(capacity) {}
+    // LRU: every access moves a table to the front of one list, the least recently used go first.
+    // TWO_Q: a loaded table enters a FIFO probation queue, where further accesses do not move it,
+    // and only tables in probation are evicted while the queue holds over a quarter of the capacity.
+    // The names of tables evicted from probation are remembered (up to half the capacity in
+    // bytes); one loaded again while remembered goes to the LRU main list instead. Tables read
+    // once by a large scan thus pass through probation without pushing hot tables out.
+    enum class Policy { LRU, TWO_Q };
+    struct TableStats {
+        size_t hits = 0;
+        size_t misses = 0;      // loads from disk
+        size_t evictions = 0;
+    };
     
+    // Reads one table from disk. Runs on a prefetch thread, so it may only touch the files.
+    using Loader = function<shared_ptr<Table>()>;
+    // The loader of a cataloged table, or an empty function for an unknown name.
+    using Catalog = function<Loader(const string& table_name)>;
+    
+    explicit BufferPool(Catalog catalog, size_t capacity_bytes = 1024 * 1024 * 1024)
+        : catalog_(move(catalog)), capacity_bytes_(capacity_bytes) {}
+    
+    // Loads the table on a miss (waiting for its prefetch if one is running); nullptr when
+    // the catalog does not know it or it cannot be read.
     shared_ptr<Table> getTable(const string& table_name);
+    // Starts loading a table that is not in the pool on a background thread, so a statement
+    // reading several tables can overlap their loads.
+    void prefetch(const string& table_name);
     void putTable(const string& table_name, shared_ptr<Table> table);
+    // Drops the table, saving it first when it has unsaved changes.
     bool removeTable(const string& table_name);
-    bool hasTable(const string& table_name) const {return cache_.find(table_name) != cache_.end();}
+    // In memory now; getTable may still load a cataloged table that is not.
+    bool hasTable(const string& table_name) const { return entries_.find(table_name) != entries_.end(); }
+    // The table when it is in memory, without loading it or counting an access.
+    shared_ptr<Table> peekTable(const string& table_name) const {
+        auto it = entries_.find(table_name);
+        return it == entries_.end() ? nullptr : it->second->table;
+    }
+    // Writes the CSV files of the tables whose CSV file lacks changes, see Table::isDirty.
     void saveAllTables();
+    // Writes back the changed pages of every table; returns the number of tables written.
+    size_t flushAllTables();
+    // Sum of Table::dirtyBytes over the tables held; one counter read per table.
+    size_t dirtyBytes() const;
+    // Main list then probation queue, most recently used or loaded first.
+    vector<string> getAllTableNames() const;
+    void setCapacity(size_t bytes);
+    // Meant for startup; tables already held move to the main list.
+    void setPolicy(Policy policy);
     
-    vector<string> getAllTableNames() const {
-        vector<string> names;
-        for (const auto& pair : cache_) {
-            names.push_back(pair.first);
-        }
-        return names;
+    Policy policy() const { return policy_; }
+    size_t capacity() const { return capacity_bytes_; }
+    // Sizes charged at the last access of each table.
+    size_t bytes() const { return bytes_; }
+    size_t tableCount() const { return entries_.size(); }
+    size_t evictions() const { return evictions_; }
+    size_t loads() const { return loads_; }
+    size_t prefetches() const { return prefetches_; }
+    // Counters of every table accessed since startup, also of those evicted since.
+    const unordered_map<string, TableStats>& tableStats() const { return stats_; }
+    // Whether the table is held in the probation queue (TWO_Q) rather than the main list.
+    bool inProbation(const string& table_name) const {
+        auto it = entries_.find(table_name);
+        return it != entries_.end() && it->second->probation;
     }
     
 private:
-    void evictLRU();
+    struct Entry {
+        string name;
+        shared_ptr<Table> table;
+        size_t bytes = 0;
+        bool probation = false;
+    };
+    using LruList = list<Entry>;
+    using GhostList = list<pair<string, size_t>>;
+    Catalog catalog_;
+    Policy policy_ = Policy::LRU;
+    LruList main_;                                         // most recently used first
+    LruList probation_;                                    // most recently loaded first
+    unordered_map<string, LruList::iterator> entries_;
+    GhostList ghosts_;                                     // evicted from probation, newest first
+    unordered_map<string, GhostList::iterator> ghost_entries_;
+    unordered_map<string, future<shared_ptr<Table>>> pending_;   // running prefetches
+    unordered_map<string, TableStats> stats_;
+    const Entry* last_touched_ = nullptr;
+    size_t capacity_bytes_;
+    size_t bytes_ = 0;
+    size_t probation_bytes_ = 0;
+    size_t ghost_bytes_ = 0;
+    size_t evictions_ = 0;
+    size_t loads_ = 0;
+    size_t prefetches_ = 0;
+    
+    // Charges the current size of the entry's table, moves it to the front of the main list
+    // unless it is in probation, and evicts down to the capacity.
+    void touch(LruList::iterator entry);
+    // Saves and drops unpinned tables, never the one touched last, until bytes_ <= limit or
+    // only those are left: only from probation while it is over its share, otherwise the
+    // least recently used of the main list first.
+    void evictTo(size_t limit);
+    // Evicts the oldest unpinned table of list; false when there is none.
+    bool evictFrom(LruList& list);
+    void unlink(LruList::iterator entry);
+    // Ghost entries: names of tables evicted from probation, with their size then.
+    void remember(const string& table_name, size_t bytes);
+    // Drops the ghost entry of the table; false when there was none.
+    bool forget(const string& table_name);
+    // Drops the oldest ghost entries down to half the capacity.
+    void trimGhosts();
+};
+
+// Cache of SELECT results. Keys hold the normalized query text plus the versions of the tables
+// it reads, so any write to one of them makes the old entries unreachable; those are dropped
+// as least recently used once the cached rows exceed the byte capacity.
+class ResultCache {
+public:
+    struct Entry {
+        vector<Column> columns;
+        vector<Row> rows;
+        size_t bytes = 0;
+    };
+    
+    explicit ResultCache(size_t capacity_bytes = 16 * 1024 * 1024) : capacity_bytes_(capacity_bytes) {}
+    
+    // nullptr on a miss. An empty key is never cached and not counted.
+    const Entry* lookup(const string& key);
+    void insert(const string& key, vector<Column> columns, vector<Row> rows);
+    void clear();
+    // 0 disables the cache.
+    void setCapacity(size_t bytes);
+    
+    size_t capacity() const { return capacity_bytes_; }
+    size_t bytes() const { return bytes_; }
+    size_t entryCount() const { return entries_.size(); }
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+    size_t evictions() const { return evictions_; }
+    
+private:
+    using LruList = list<pair<string, Entry>>;
+    LruList lru_;                                          // most recently used first
+    unordered_map<string, LruList::iterator> entries_;
+    size_t capacity_bytes_;
+    size_t bytes_ = 0;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+    size_t evictions_ = 0;
+    
+    void evictTo(size_t limit);
 };
 
 //Part III. Main SQL Engine
+// Outcome of MiniSQL::execute. A SELECT fills columns and rows, INSERT, UPDATE and DELETE
+// set affected_rows. ok is false when the statement failed; the error went to cerr.
+struct QueryResult {
+    bool ok = false;
+    vector<Column> columns;
+    vector<Row> rows;
+    long long affected_rows = -1;   // -1 for SELECT
+};
+
+struct PreparedStatement;
+
 class MiniSQL {
 private:
-    unordered_map<string, shared_ptr<Table>> tables_;
+    unordered_map<string, string> catalog_;   // every table -> its CSV file, loaded or not
     unique_ptr<BufferPool> buffer_pool_;
+    QueryStats last_query_stats_;
+    size_t query_memory_budget_ = 256 * 1024 * 1024;
+    unordered_map<string, shared_ptr<PreparedStatement>> prepared_statements_;
+    ResultCache result_cache_;
+    
+    // Checkpoint: writes back the changed pages of every table in the buffer pool every
+    // checkpoint_interval_ms_, or sooner once they hold checkpoint_bytes_. Without the
+    // checkpoint thread (see startCheckpointer) checkpointIfNeeded does it inline. Statements
+    // and checkpoints both hold statement_mutex_; it is recursive so that the settings can
+    // lock it from inside a statement too.
+    mutable recursive_mutex statement_mutex_;
+    condition_variable_any checkpoint_wake_;
+    thread checkpointer_;
+    bool checkpoint_requested_ = false;
+    bool stopping_ = false;
+    size_t checkpoint_interval_ms_ = 1000;   // 0: after every change instead
+    size_t checkpoint_bytes_ = 4 * 1024 * 1024;
+    chrono::steady_clock::time_point last_checkpoint_ = chrono::steady_clock::now();
+    size_t checkpoints_ = 0;
+    size_t checkpointed_tables_ = 0;
     
 public:
     MiniSQL();
+    // Stops the checkpoint thread, if started, and writes the CSV files of changed tables
+    // (see saveAllTables), so the CSV files hold every change after a clean shutdown.
+    ~MiniSQL();
     
     void createTable(const string& name, const vector<Column>& columns,const string& csv_file = "");
     void saveAllTables();
     vector<string> listTables() const;
     bool dropTable(const string& table_name);
     bool insert(const string& table_name, const Row& row);
+    bool upsert(const string& table_name, const Row& row, bool& replaced);
+    // SELECT COUNT(*) FROM table_name [WHERE ...]; returns -1 when the table does not exist.
+    long long count(const string& table_name, const shared_ptr<LogicExpression>& where_clause = nullptr);
     vector<Row> select(const string& table_name, const vector<string>& columns, const vector<string>& column_aliases = {}, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    // SELECT with a computed list, compiled against the table's columns (see compileSelectList).
+    vector<Row> select(const string& table_name, const vector<shared_ptr<const Expression>>& projections, const shared_ptr<LogicExpression>& where_clause = nullptr);
     vector<Row> join(const string& left_table, const string& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause = nullptr);
     bool saveJoinAsTable(const string& new_table_name, const string& left_table_name, const string& right_table_name, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    // Loads the table when it is not in the buffer pool; nullptr when it does not exist.
     shared_ptr<Table> getTable(const string& table_name);
+    // Starts loading a table in the background when it is not in the buffer pool.
+    void prefetch(const string& table_name) { buffer_pool_->prefetch(table_name); }
     int deleteRows(const string& table_name, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    // SET column = constant for each entry of updates.
     int updateRows(const string& table_name, const unordered_map<string, Value>& updates, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    // SET column = expression, see Table::updateRows. Errors, e.g. a duplicate key, are thrown.
+    int updateRows(const string& table_name, const unordered_map<string, shared_ptr<const Expression>>& updates, const shared_ptr<LogicExpression>& where_clause = nullptr);
+    bool createIndex(const string& index_name, const string& table_name, const string& column_name, IndexKind kind = IndexKind::BTREE, const vector<string>& include_columns = {});
+    // table_name may be empty, then the index is looked up in every table.
+    bool dropIndex(const string& index_name, const string& table_name = "");
+    // PREPARE name AS sql: sql is parsed once and its WHERE clause bound to the table, with
+    // ? marking parameters. Only SELECT, INSERT, UPDATE and DELETE can be prepared.
+    bool prepare(const string& name, const string& sql);
+    // EXECUTE name(parameters): stores the parameters into the cached plan and runs it.
+    QueryResult execute(const string& name, const vector<Value>& parameters = {});
+    bool deallocate(const string& name);
+    // Number of ? in a prepared statement, or -1 when no statement has that name.
+    int parameterCount(const string& name) const;
+    const QueryStats& lastQueryStats() const { return last_query_stats_; }
+    // EXPLAIN [ANALYZE] of a SELECT: the plan the executor picks for it, see PlanNode. With
+    // analyze the query is run (bypassing the result cache) and every operator measured.
+    // Errors are reported on cerr and yield false.
+    bool explain(const SelectStatement& query, bool analyze, PlanNode& plan);
+    // A JOIN answered from the result cache: no join algorithm ran, only result_rows are known.
+    void recordCachedJoin(size_t result_rows) {
+        last_query_stats_ = QueryStats{};
+        last_query_stats_.join_algorithm = "Result cache";
+        last_query_stats_.result_rows = result_rows;
+    }
+    void setQueryMemoryBudget(size_t bytes) { query_memory_budget_ = bytes; }
+    size_t queryMemoryBudget() const { return query_memory_budget_; }
+    ResultCache& resultCache() { return result_cache_; }
+    BufferPool& bufferPool() { return *buffer_pool_; }
+    // Held while running a statement, so the checkpoint never sees a table half changed.
+    recursive_mutex& statementMutex() { return statement_mutex_; }
+    // Starts checkpointing on a background thread. From then on every other call into this
+    // object must hold statementMutex(), as processCommand does; the checkpoint settings
+    // below lock it themselves.
+    void startCheckpointer();
+    // Writes back the changed pages of every table in the buffer pool. Needs statementMutex().
+    void checkpoint();
+    void setCheckpointInterval(size_t milliseconds);
+    void setCheckpointBytes(size_t bytes);
+    size_t checkpointInterval() const;
+    size_t checkpointBytes() const;
+    size_t checkpoints() const { return checkpoints_; }
+    size_t checkpointedTables() const { return checkpointed_tables_; }
+    // Result cache key of a query reading tables: the normalized sql followed by the current
+    // version of every table. Empty when one of the tables does not exist.
+    string resultCacheKey(const string& sql, const vector<string>& tables);
     
 private:
     bool tableExists(const string& table_name) const;
     bool createTableFromJoin(const string& new_table_name, const string& left_table_name, const string& right_table_name, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause = nullptr);
     vector<string> getCSVFilesInDataDir() const;
     vector<string> getTableNamesFromDisk() const;
+    // Catalogs every CSV file of the data directory; the tables are loaded on first use.
     void loadAllTablesFromDisk();
+    // Run every IN / EXISTS subquery of a WHERE tree once and store its key set.
+    // stats, when given, gets one SubqueryStats per subquery.
+    void bindSubqueries(const shared_ptr<LogicExpression>& expression, const vector<string>& outer_columns, QueryStats* stats = nullptr);
+    void bindSubquery(Subquery& subquery, const vector<string>& outer_columns, QueryStats* stats = nullptr);
     bool loadTableFromDisk(const string& table_name, const string& csv_path);
+    // Builds the table of a CSV file with the types, keys and indexes of its schema file, or
+    // types inferred from the first rows without one. Reads only files, so it is safe on a
+    // prefetch thread. nullptr when the file cannot be read.
+    shared_ptr<Table> readTable(const string& table_name, const string& csv_path) const;
+    // Table holding the index named index_name, or empty. Tables outside the buffer pool are
+    // looked up in their schema files.
+    string indexOwner(const string& index_name) const;
+    // Binds a prepared statement to the current tables. Called again when a table was
+    // dropped, recreated or reloaded since the last binding.
+    bool compilePrepared(PreparedStatement& prepared);
+    void runCheckpointer();
+    // Called after every INSERT, UPDATE, DELETE and saved JOIN: checkpoints right away when
+    // the interval is 0 or, without the checkpoint thread, when the interval has passed or
+    // the byte threshold is reached; otherwise wakes the thread at the byte threshold.
+    void checkpointIfNeeded();
 };
 
 #endif
\ No newline at end of file
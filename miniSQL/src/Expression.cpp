@@ -0,0 +1,438 @@
+#include "../include/Expression.h"
+#include "../include/LikePattern.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+// Part I. Realization of the Expression class in Expression.h
+static int checkedInt(long long value) {
+    if (value < INT_MIN || value > INT_MAX) {
+        throw runtime_error("Integer overflow");
+    }
+    return static_cast<int>(value);
+}
+
+static double asDouble(const Value& value) {
+    if (const int* number = get_if<int>(&value)) return *number;
+    return get<double>(value);
+}
+
+bool Expression::isTrue(const Value& value) {
+    if (const int* number = get_if<int>(&value)) return *number != 0;
+    if (const double* number = get_if<double>(&value)) return *number != 0.0;
+    return !get<string>(value).empty();
+}
+
+void Expression::run(size_t begin, size_t end, const Row& row, vector<Value>& stack) const {
+    size_t pc = begin;
+    while (pc < end) {
+        const Instruction& instruction = code_[pc++];
+        if (instruction.op == OpCode::PUSH_CONSTANT) {
+            stack.push_back(constants_[instruction.operand]);
+            continue;
+        }
+        if (instruction.op == OpCode::PUSH_COLUMN) {
+            stack.push_back(row[instruction.operand]);
+            continue;
+        }
+
+        Value& top = stack.back();
+        switch (instruction.op) {
+            case OpCode::TO_DOUBLE: {
+                Value& operand = stack[stack.size() - 1 - instruction.operand];
+                if (const int* number = get_if<int>(&operand)) operand = static_cast<double>(*number);
+                break;
+            }
+            case OpCode::NEGATE_INT:
+                top = checkedInt(-static_cast<long long>(get<int>(top)));
+                break;
+            case OpCode::NEGATE_DOUBLE:
+                top = -get<double>(top);
+                break;
+            case OpCode::NOT:
+                top = isTrue(top) ? 0 : 1;
+                break;
+            case OpCode::TO_BOOL:
+                top = isTrue(top) ? 1 : 0;
+                break;
+            case OpCode::LIKE: {
+                const string* text = get_if<string>(&top);
+                top = text && patterns_[instruction.operand]->matches(*text) ? 1 : 0;
+                break;
+            }
+            case OpCode::JUMP:
+                pc = instruction.operand;
+                break;
+            case OpCode::JUMP_IF_FALSE: {
+                bool condition = isTrue(top);
+                stack.pop_back();
+                if (!condition) pc = instruction.operand;
+                break;
+            }
+            case OpCode::AND_JUMP:
+            case OpCode::OR_JUMP: {
+                bool stop_on = instruction.op == OpCode::OR_JUMP;
+                if (isTrue(top) == stop_on) {
+                    top = stop_on ? 1 : 0;
+                    pc = instruction.operand;
+                } else {
+                    stack.pop_back();
+                }
+                break;
+            }
+            default: {
+                // Binary operators: the right operand is on top, the result replaces the left one.
+                Value right = move(top);
+                stack.pop_back();
+                Value& left = stack.back();
+                switch (instruction.op) {
+                    case OpCode::ADD_INT: left = checkedInt(static_cast<long long>(get<int>(left)) + get<int>(right)); break;
+                    case OpCode::SUB_INT: left = checkedInt(static_cast<long long>(get<int>(left)) - get<int>(right)); break;
+                    case OpCode::MUL_INT: left = checkedInt(static_cast<long long>(get<int>(left)) * get<int>(right)); break;
+                    case OpCode::DIV_INT:
+                    case OpCode::MOD_INT: {
+                        long long divisor = get<int>(right);
+                        if (divisor == 0) throw runtime_error("Division by zero");
+                        long long dividend = get<int>(left);
+                        left = checkedInt(instruction.op == OpCode::DIV_INT ? dividend / divisor : dividend % divisor);
+                        break;
+                    }
+                    case OpCode::ADD_DOUBLE: left = asDouble(left) + asDouble(right); break;
+                    case OpCode::SUB_DOUBLE: left = asDouble(left) - asDouble(right); break;
+                    case OpCode::MUL_DOUBLE: left = asDouble(left) * asDouble(right); break;
+                    case OpCode::DIV_DOUBLE:
+                    case OpCode::MOD_DOUBLE: {
+                        double divisor = asDouble(right);
+                        if (divisor == 0.0) throw runtime_error("Division by zero");
+                        double dividend = asDouble(left);
+                        left = instruction.op == OpCode::DIV_DOUBLE ? dividend / divisor : fmod(dividend, divisor);
+                        break;
+                    }
+                    case OpCode::COMPARE:
+                        left = kernels_[instruction.operand](left, right) ? 1 : 0;
+                        break;
+                    default:
+                        throw runtime_error("Invalid expression instruction");
+                }
+                break;
+            }
+        }
+    }
+}
+
+Value Expression::evaluate(const Row& row) const {
+    if (code_.size() == 1) {
+        return code_[0].op == OpCode::PUSH_COLUMN ? row[code_[0].operand] : constants_[code_[0].operand];
+    }
+    // Reused between calls, so evaluating an expression per row allocates nothing for the stack.
+    thread_local vector<Value> stack;
+    stack.clear();
+    run(0, code_.size(), row, stack);
+    return move(stack.back());
+}
+
+bool Expression::isConstant() const {
+    for (const auto& instruction : code_) {
+        if (instruction.op == OpCode::PUSH_COLUMN) return false;
+    }
+    return true;
+}
+
+int Expression::columnIndex() const {
+    return code_.size() == 1 && code_[0].op == OpCode::PUSH_COLUMN ? static_cast<int>(code_[0].operand) : -1;
+}
+
+shared_ptr<const Expression> Expression::constant(const Value& value) {
+    auto expression = make_shared<Expression>();
+    expression->code_.push_back({OpCode::PUSH_CONSTANT, 0});
+    expression->constants_.push_back(value);
+    expression->type_ = holds_alternative<int>(value) ? "INT" : holds_alternative<double>(value) ? "DOUBLE" : "VARCHAR";
+    expression->text_ = formatLiteral(value);
+    return expression;
+}
+
+Row Expression::project(const Row& row, const vector<shared_ptr<const Expression>>& projections) {
+    vector<Value> values;
+    values.reserve(projections.size());
+    for (const auto& projection : projections) {
+        values.push_back(projection->evaluate(row));
+    }
+    return Row(move(values));
+}
+
+// Part II. Realization of the ExpressionCompiler class in Expression.h
+static bool isNumber(const string& type) {
+    return type == "INT" || type == "DOUBLE";
+}
+
+shared_ptr<const Expression> ExpressionCompiler::compile(const SqlExpr& expression, const vector<Column>& columns, const vector<string>& tables) {
+    auto compiled = make_shared<Expression>();
+    ExpressionCompiler compiler(columns, tables, *compiled);
+    compiled->type_ = compiler.emit(expression);
+    compiled->text_ = formatExpression(expression);
+    return compiled;
+}
+
+int ExpressionCompiler::resolveColumn(const string& column_ref) const {
+    size_t dot = column_ref.find('.');
+    string table = dot == string::npos ? "" : column_ref.substr(0, dot);
+    string name = dot == string::npos ? column_ref : column_ref.substr(dot + 1);
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        if (columns_[i].name == name && (table.empty() || tables_.empty() || tables_[i] == table)) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+string ExpressionCompiler::typeOf(const SqlExpr& expression) const {
+    switch (expression.kind) {
+        case ExprKind::COLUMN: {
+            int col_idx = resolveColumn(expression.text);
+            if (col_idx == -1) return "VARCHAR";
+            return isNumber(columns_[col_idx].type) ? columns_[col_idx].type : "VARCHAR";
+        }
+        case ExprKind::NUMBER:
+            return holds_alternative<int>(numberValue(expression.text)) ? "INT" : "DOUBLE";
+        case ExprKind::ARITHMETIC:
+            return typeOf(*expression.left) == "INT" && typeOf(*expression.right) == "INT" ? "INT" : "DOUBLE";
+        case ExprKind::NEGATE:
+            return typeOf(*expression.left);
+        case ExprKind::COMPARE:
+        case ExprKind::LIKE:
+        case ExprKind::AND:
+        case ExprKind::OR:
+        case ExprKind::NOT:
+            return "INT";
+        case ExprKind::CASE: {
+            // Every THEN value and the ELSE value: all strings, or all numbers (DOUBLE unless all INT).
+            vector<string> types;
+            const SqlExpr* node = &expression;
+            for (; node->kind == ExprKind::CASE; node = node->right.get()) {
+                types.push_back(typeOf(*node->left->right));
+            }
+            types.push_back(typeOf(*node));
+            bool strings = types[0] == "VARCHAR";
+            bool all_int = true;
+            for (const auto& type : types) {
+                if ((type == "VARCHAR") != strings) {
+                    throw runtime_error("CASE mixes numbers and strings in its results");
+                }
+                all_int = all_int && type == "INT";
+            }
+            return strings ? "VARCHAR" : all_int ? "INT" : "DOUBLE";
+        }
+        default:
+            return "VARCHAR";
+    }
+}
+
+string ExpressionCompiler::emit(const SqlExpr& expression) {
+    switch (expression.kind) {
+        case ExprKind::COLUMN: {
+            int col_idx = resolveColumn(expression.text);
+            if (col_idx == -1) {
+                throw runtime_error("Column '" + expression.text + "' not found");
+            }
+            emitInstruction(OpCode::PUSH_COLUMN, static_cast<uint32_t>(col_idx));
+            return typeOf(expression);
+        }
+        case ExprKind::NUMBER:
+            emitConstant(numberValue(expression.text));
+            return typeOf(expression);
+        case ExprKind::STRING:
+            emitConstant(expression.text);
+            return "VARCHAR";
+        case ExprKind::ARITHMETIC:
+        case ExprKind::NEGATE:
+            return emitArithmetic(expression);
+        case ExprKind::COMPARE:
+        case ExprKind::LIKE:
+            return emitCompare(expression);
+        case ExprKind::AND:
+        case ExprKind::OR:
+        case ExprKind::NOT:
+            return emitLogic(expression);
+        case ExprKind::CASE:
+            return emitCase(expression);
+        case ExprKind::PARAMETER:
+            throw runtime_error("Parameter ? can only be a whole value, not part of an expression");
+        default:
+            throw runtime_error("Subqueries are only supported in WHERE conditions");
+    }
+}
+
+string ExpressionCompiler::emitArithmetic(const SqlExpr& expression) {
+    size_t start = out_.code_.size();
+    if (expression.kind == ExprKind::NEGATE) {
+        string type = emit(*expression.left);
+        if (!isNumber(type)) {
+            throw runtime_error("Unary - needs a number, got " + type);
+        }
+        emitInstruction(type == "INT" ? OpCode::NEGATE_INT : OpCode::NEGATE_DOUBLE);
+        foldFrom(start);
+        return type;
+    }
+
+    string left_type = emit(*expression.left);
+    string right_type = emit(*expression.right);
+    if (!isNumber(left_type) || !isNumber(right_type)) {
+        throw runtime_error("Operator " + expression.text + " needs numbers, got " + left_type + " and " + right_type);
+    }
+
+    // INT op INT stays INT (so 7 / 2 is 3), anything with a DOUBLE is DOUBLE.
+    bool integer = left_type == "INT" && right_type == "INT";
+    if (!integer && left_type == "INT") emitInstruction(OpCode::TO_DOUBLE, 1);
+    if (!integer && right_type == "INT") emitInstruction(OpCode::TO_DOUBLE, 0);
+
+    OpCode op;
+    switch (expression.text[0]) {
+        case '+': op = integer ? OpCode::ADD_INT : OpCode::ADD_DOUBLE; break;
+        case '-': op = integer ? OpCode::SUB_INT : OpCode::SUB_DOUBLE; break;
+        case '*': op = integer ? OpCode::MUL_INT : OpCode::MUL_DOUBLE; break;
+        case '/': op = integer ? OpCode::DIV_INT : OpCode::DIV_DOUBLE; break;
+        default: op = integer ? OpCode::MOD_INT : OpCode::MOD_DOUBLE; break;
+    }
+    emitInstruction(op);
+    foldFrom(start);
+    return integer ? "INT" : "DOUBLE";
+}
+
+string ExpressionCompiler::emitCompare(const SqlExpr& expression) {
+    size_t start = out_.code_.size();
+    string left_type = emit(*expression.left);
+    if (expression.kind == ExprKind::LIKE) {
+        if (expression.right->kind != ExprKind::STRING) {
+            throw runtime_error("LIKE needs a quoted pattern");
+        }
+        out_.patterns_.push_back(make_shared<const LikePattern>(expression.right->text));
+        emitInstruction(OpCode::LIKE, static_cast<uint32_t>(out_.patterns_.size() - 1));
+        if (expression.op == CompareOp::NOT_LIKE) emitInstruction(OpCode::NOT);
+        foldFrom(start);
+        return "INT";
+    }
+
+    string right_type = emit(*expression.right);
+    if (isNumber(left_type) != isNumber(right_type)) {
+        throw runtime_error("Cannot compare " + left_type + " with " + right_type);
+    }
+    out_.kernels_.push_back(ConditionEvaluator::kernel(left_type, right_type, expression.op));
+    emitInstruction(OpCode::COMPARE, static_cast<uint32_t>(out_.kernels_.size() - 1));
+    foldFrom(start);
+    return "INT";
+}
+
+string ExpressionCompiler::emitLogic(const SqlExpr& expression) {
+    size_t start = out_.code_.size();
+    emit(*expression.left);
+    if (expression.kind == ExprKind::NOT) {
+        emitInstruction(OpCode::NOT);
+    } else {
+        // The right side only runs when the left one does not decide.
+        size_t jump = emitInstruction(expression.kind == ExprKind::AND ? OpCode::AND_JUMP : OpCode::OR_JUMP);
+        emit(*expression.right);
+        emitInstruction(OpCode::TO_BOOL);
+        patchJump(jump);
+    }
+    foldFrom(start);
+    return "INT";
+}
+
+string ExpressionCompiler::emitCase(const SqlExpr& expression) {
+    size_t start = out_.code_.size();
+    string type = typeOf(expression);
+    vector<size_t> exits;
+    const SqlExpr* node = &expression;
+    for (; node->kind == ExprKind::CASE; node = node->right.get()) {
+        const SqlExpr& when = *node->left;
+        emit(*when.left);
+        size_t next_branch = emitInstruction(OpCode::JUMP_IF_FALSE);
+        emitAs(*when.right, type);
+        exits.push_back(emitInstruction(OpCode::JUMP));
+        patchJump(next_branch);
+    }
+    emitAs(*node, type);
+    for (size_t exit : exits) {
+        patchJump(exit);
+    }
+    foldFrom(start);
+    return type;
+}
+
+void ExpressionCompiler::emitAs(const SqlExpr& value, const string& type) {
+    if (emit(value) != type) {
+        emitInstruction(OpCode::TO_DOUBLE, 0);
+    }
+}
+
+size_t ExpressionCompiler::emitInstruction(OpCode op, uint32_t operand) {
+    out_.code_.push_back({op, operand});
+    return out_.code_.size() - 1;
+}
+
+void ExpressionCompiler::emitConstant(const Value& value) {
+    out_.constants_.push_back(value);
+    emitInstruction(OpCode::PUSH_CONSTANT, static_cast<uint32_t>(out_.constants_.size() - 1));
+}
+
+void ExpressionCompiler::patchJump(size_t instruction) {
+    out_.code_[instruction].operand = static_cast<uint32_t>(out_.code_.size());
+}
+
+void ExpressionCompiler::foldFrom(size_t start) {
+    vector<Instruction>& code = out_.code_;
+    if (code.size() - start == 1 && code[start].op == OpCode::PUSH_CONSTANT) return;
+    for (size_t pc = start; pc < code.size(); ++pc) {
+        if (code[pc].op == OpCode::PUSH_COLUMN) return;
+    }
+    vector<Value> stack;
+    out_.run(start, code.size(), Row(), stack);
+    code.resize(start);
+    emitConstant(stack.back());
+}
+
+// Part III. Realization of statement helpers in Expression.h
+unordered_map<string, shared_ptr<const Expression>> compileAssignments(const UpdateStatement& statement, const vector<Column>& columns, bool parameters) {
+    unordered_map<string, shared_ptr<const Expression>> assignments;
+    for (const auto& [col_name, value] : statement.assignments) {
+        if (value->kind == ExprKind::PARAMETER) {
+            if (!parameters) {
+                throw runtime_error("Parameter ? can only be used in a prepared statement");
+            }
+            continue;
+        }
+        bool bare_word = value->kind == ExprKind::COLUMN && value->text.find('.') == string::npos &&
+                         none_of(columns.begin(), columns.end(), [&value](const Column& col) { return col.name == value->text; });
+        assignments[col_name] = bare_word ? Expression::constant(value->text) : ExpressionCompiler::compile(*value, columns);
+    }
+    return assignments;
+}
+
+bool compileSelectList(const SelectStatement& statement, const vector<Column>& columns, const vector<string>& tables,
+                       vector<shared_ptr<const Expression>>& projections, vector<Column>& result_columns) {
+    try {
+        for (size_t i = 0; i < statement.expressions.size(); ++i) {
+            auto projection = ExpressionCompiler::compile(*statement.expressions[i], columns, tables);
+            Column column;
+            int col_idx = projection->columnIndex();
+            if (col_idx != -1) {
+                column = columns[col_idx];
+                column.primary_key = false;
+                column.unique = false;
+            } else {
+                column.type = projection->type();
+            }
+            column.name = statement.columns[i];
+            projections.push_back(move(projection));
+            result_columns.push_back(move(column));
+        }
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return false;
+    }
+    return true;
+}
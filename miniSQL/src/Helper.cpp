@@ -1,9 +1,10 @@
 #include "../include/Helper.h"
+#include "../include/Index.h"
 #include <iostream>
 #include <sstream>
 #include <algorithm>
 #include <cctype>
-#include <regex>
+#include <iomanip>
 
 using namespace std;
 
@@ -48,103 +49,20 @@ char toUpperChar(char c) {
     return c;
 }
 
-size_t findOuterOperator(const string& expr, const string& op) {
-    int paren_depth = 0;
-    
-    for (size_t i = 0; i < expr.size(); ++i) {
-        if (expr[i] == '(') paren_depth++;
-        else if (expr[i] == ')') paren_depth--;
-        
-        if (paren_depth == 0 && i + op.size() <= expr.size()) {
-            bool match = true;
-            for (size_t j = 0; j < op.size(); ++j) {
-                if (toUpperChar(expr[i + j]) != toUpperChar(op[j])) {
-                    match = false;
-                    break;
-                }
-            }
-            
-            if (match) {
-                bool left_ok = (i == 0 || isspace(expr[i-1]) || expr[i-1] == '(');
-                bool right_ok = (i + op.size() == expr.size() || 
-                               isspace(expr[i + op.size()]) || expr[i + op.size()] == ')');
-                
-                if (left_ok && right_ok) {
-                    return i;
-                }
-            }
-        }
-    }
-    
-    return string::npos;
-}
-
-vector<Column> parseColumnDefinitions(const string& columns_str) {
-    vector<Column> columns;
-    vector<string> column_tokens = split(columns_str, ',');
-    
-    for (const auto& column_def : column_tokens) {
-        if (column_def.empty()) continue;
-        
-        size_t last_space = column_def.find_last_of(' ');
-        if (last_space == string::npos) {
-            cerr << "Error Command! Invalid column definition: " << column_def << endl;
-            continue;
-        }
-        
-        string col_name = trim(column_def.substr(0, last_space));
-        string col_type_str = column_def.substr(last_space + 1);
-        transform(col_type_str.begin(), col_type_str.end(), col_type_str.begin(), ::toupper);
-        
-        Column col;
-        col.name = col_name;
-        
-        if (col_type_str.find("INT") == 0) {
-            col.type = "INT";
-        } else if (col_type_str.find("DOUBLE") == 0) {
-            col.type = "DOUBLE";
-        } else if (col_type_str.find("VARCHAR") == 0) {
-            col.type = "VARCHAR";
-            size_t open_paren = col_type_str.find('(');
-            if (open_paren != string::npos) {
-                size_t close_paren = col_type_str.find(')', open_paren);
-                if (close_paren != string::npos) {
-                    string length_str = col_type_str.substr(open_paren + 1, close_paren - open_paren - 1);
-                    try {
-                        col.varchar_length = stoul(length_str);
-                    } catch (...) {
-                        col.varchar_length = 255;
-                    }
-                }
-            } else {
-                col.varchar_length = 255;
-            }
-        } else {
-            cerr << "Warning: Unrecognized type '" << col_type_str << "', defaulting to VARCHAR" << endl;
-            col.type = "VARCHAR";
-            col.varchar_length = 255;
-        }
-        
-        columns.push_back(col);
-    }
-    
-    return columns;
-}
-
-shared_ptr<LogicExpression> parseWhereClause(const string& where_str, const shared_ptr<Table>& table) {
-    if (!table || where_str.empty()) {
+shared_ptr<LogicExpression> parseWhereClause(const SqlExpr& where, const shared_ptr<Table>& table) {
+    if (!table) {
         return nullptr;
     }
     
-    return WhereParser::parse(trim(where_str), table->columns());
+    return WhereParser::bind(where, table->columns());
 }
 
 shared_ptr<LogicExpression> parseJoinWhereClause(
-    const string& where_str, 
+    const SqlExpr& where, 
     const shared_ptr<Table>& left_table,
     const shared_ptr<Table>& right_table) {
     
-    if (!left_table || !right_table || where_str.empty()) {
+    if (!left_table || !right_table) {
         return nullptr;
     }
     
@@ -152,77 +70,32 @@ shared_ptr<LogicExpression> parseJoinWhereClause(
     all_columns.insert(all_columns.end(), left_table->columns().begin(), left_table->columns().end());
     all_columns.insert(all_columns.end(), right_table->columns().begin(), right_table->columns().end());
     
-    return WhereParser::parse(where_str, all_columns);
+    return WhereParser::bind(where, all_columns);
 }
 
-JoinCondition parseJoinCondition(const string& join_str) {
-    JoinCondition condition;
-    string str = trim(join_str);
-    
-    size_t dot1 = str.find('.');
-    size_t equal_pos = str.find('=');
-    size_t dot2 = str.find('.', equal_pos);
-    
-    if (dot1 != string::npos && equal_pos != string::npos && dot2 != string::npos) {
-        condition.left_table = trim(str.substr(0, dot1));
-        condition.left_column = trim(str.substr(dot1 + 1, equal_pos - dot1 - 1));
-        condition.right_table = trim(str.substr(equal_pos + 1, dot2 - equal_pos - 1));
-        condition.right_column = trim(str.substr(dot2 + 1));
-        condition.op = CompareOp::EQUAL;
-    }
-    
-    return condition;
+unordered_map<string, shared_ptr<const Expression>> parseUpdateSet(const UpdateStatement& statement, const shared_ptr<Table>& table) {
+    if (!table) return {};
+    return compileAssignments(statement, table->columns());
 }
 
-unordered_map<string, Value> parseUpdateSet(const string& set_clause, const shared_ptr<Table>& table) {
-    unordered_map<string, Value> updates;
-    
-    if (!table) return updates;
-    
-    vector<string> assignments = split(set_clause, ',');
-    
-    for (const auto& assignment : assignments) {
-        size_t equal_pos = assignment.find('=');
-        if (equal_pos == string::npos) {
-            cout << "Error Command! Invalid assignment: " << assignment << endl;
-            continue;
-        }
-        
-        string col_name = trim(assignment.substr(0, equal_pos));
-        string value_str = trim(assignment.substr(equal_pos + 1));
-        
-        string col_type = "VARCHAR";
-        for (const auto& col : table->columns()) {
-            if (col.name == col_name) {
-                col_type = col.type;
-                break;
-            }
-        }
-        
-        Value value;
-        if (col_type == "INT") {
-            try {
-                value = stoi(value_str);
-            } catch (...) {
-                value = 0;
-            }
-        } else if (col_type == "DOUBLE") {
-            try {
-                value = stod(value_str);
-            } catch (...) {
-                value = 0.0;
-            }
-        } else {
-            if (value_str.front() == '\'' && value_str.back() == '\'') {
-                value_str = value_str.substr(1, value_str.length() - 2);
-            }
-            value = value_str;
-        }
-        
-        updates[col_name] = value;
+// Tables read by the subqueries of a WHERE expression.
+static void collectSubqueryTables(const shared_ptr<const SqlExpr>& expression, vector<string>& tables) {
+    if (!expression) return;
+    if (expression->subquery) {
+        tables.push_back(expression->subquery->table);
+        collectSubqueryTables(expression->subquery->where, tables);
+    }
+    collectSubqueryTables(expression->left, tables);
+    collectSubqueryTables(expression->right, tables);
+}
+
+vector<string> referencedTables(const SelectStatement& statement) {
+    vector<string> tables = {statement.table};
+    if (!statement.join_table.empty()) {
+        tables.push_back(statement.join_table);
     }
-    
-    return updates;
+    collectSubqueryTables(statement.where, tables);
+    return tables;
 }
 
 //Part III. Realization of query prehandle helper functions.
@@ -245,121 +118,140 @@ bool processCommand(MiniSQL& db, const string& input) {
         return false;
     }
     
-    string upper_input = trimmed_input;
-    transform(upper_input.begin(), upper_input.end(), upper_input.begin(), ::toupper);
+    // Dispatch on the parsed statement, so keywords inside string literals never matter.
+    Statement statement;
+    try {
+        statement = SqlParser(trimmed_input).parseStatement();
+    } catch (const SqlSyntaxError& e) {
+        cout << "Error Command! " << e.what() << endl;
+        return false;
+    }
     
-    if (upper_input == "EXIT") {
+    lock_guard<recursive_mutex> lock(db.statementMutex());
+    return runStatement(db, statement, trimmed_input);
+}
+
+bool runStatement(MiniSQL& db, const Statement& statement, const string& trimmed_input) {
+    if (holds_alternative<ExitStatement>(statement)) {
         cout << "Saving all tables to CSV..." << endl;
         db.saveAllTables();
         cout << "Thank you for using MiniSQL!" << endl;
         return true;
     }
     
-    if (upper_input == "HELP") {
+    if (holds_alternative<HelpStatement>(statement)) {
         showHelp();
         return false;
     }
     
-    if (upper_input == "SHOW TABLES") {
-        handleShowTables(db);
+    if (auto* show = get_if<ShowStatement>(&statement)) {
+        if (show->what == ShowStatement::What::TABLES) handleShowTables(db);
+        else if (show->what == ShowStatement::What::INDEXES) handleShowIndexes(db);
+        else if (show->what == ShowStatement::What::CACHE) handleShowCache(db);
+        else handleShowStats(db);
+        return false;
+    }
+    
+    if (auto* set = get_if<SetStatement>(&statement)) {
+        handleSet(db, *set);
+        return false;
+    }
+    
+    if (auto* create_index = get_if<CreateIndexStatement>(&statement)) {
+        handleCreateIndex(db, *create_index);
         return false;
     }
     
-    if (upper_input.find("DROP TABLE") == 0) {
-        handleDropTable(db, trimmed_input);
+    if (auto* drop_index = get_if<DropIndexStatement>(&statement)) {
+        handleDropIndex(db, *drop_index);
         return false;
     }
     
-    if (upper_input.find("CREATE TABLE") == 0) {
+    if (auto* drop_table = get_if<DropTableStatement>(&statement)) {
+        handleDropTable(db, *drop_table);
+        return false;
+    }
+    
+    if (auto* create_table = get_if<CreateTableStatement>(&statement)) {
         try {
-            handleCreateTable(db, trimmed_input);
+            handleCreateTable(db, *create_table);
         } catch (const exception& e) {
             cout << "Error creating table: " << e.what() << endl;
         }
         return false;
     }
     
-    if (upper_input.find("INSERT INTO") == 0) {
+    if (auto* insert = get_if<InsertStatement>(&statement)) {
         try {
-            handleInsert(db, trimmed_input);
+            handleInsert(db, *insert);
         } catch (const exception& e) {
             cout << "Insert error: " << e.what() << endl;
         }
         return false;
     }
     
-    if (upper_input.find("SELECT") == 0) {
+    if (auto* select = get_if<SelectStatement>(&statement)) {
         try {
-            bool has_save_as = false;
-            string save_table_name = "";
-            
-            string select_upper = trimmed_input;
-            transform(select_upper.begin(), select_upper.end(), select_upper.begin(), ::toupper);
-            
-            size_t save_as_pos = select_upper.find("SAVE AS");
-            if (save_as_pos != string::npos) {
-                has_save_as = true;
-                save_table_name = trim(trimmed_input.substr(save_as_pos + 7));
-                trimmed_input = trim(trimmed_input.substr(0, save_as_pos));
-            }
-            
-            size_t join_pos = select_upper.find("JOIN");
-            if (join_pos != string::npos) {
-                handleJoinSelect(db, trimmed_input, has_save_as, save_table_name);
+            if (!select->join_table.empty()) {
+                handleJoinSelect(db, *select, trimmed_input);
             } else {
-                handleSimpleSelect(db, trimmed_input);
+                handleSimpleSelect(db, *select, trimmed_input);
             }
         } catch (const exception& e) {
             cout << "Query error: " << e.what() << endl;
         }
         return false;
     }
-    if (upper_input.find("DELETE FROM") == 0) {
+    
+    if (auto* remove = get_if<DeleteStatement>(&statement)) {
         try {
-            handleDelete(db, trimmed_input);
+            handleDelete(db, *remove);
         } catch (const exception& e) {
             cout << "DELETE error: " << e.what() << endl;
         }
         return false;
     }
 
-    if (upper_input.find("UPDATE") == 0) {
+    if (auto* update = get_if<UpdateStatement>(&statement)) {
         try {
-            handleUpdate(db, trimmed_input);
+            handleUpdate(db, *update);
         } catch (const exception& e) {
             cout << "UPDATE error: " << e.what() << endl;
         }
         return false;
     }
     
-    cout << "Unknown command. Type 'HELP;' for available commands" << endl;
-    return false;
-}
-
-void handleCreateTable(MiniSQL& db, const string& input) {
-    size_t open_paren = input.find('(');
-    size_t close_paren = input.rfind(')');
-    
-    if (open_paren == string::npos || close_paren == string::npos || close_paren <= open_paren) {
-        cout << "Error Command! Invalid CREATE TABLE syntax." << endl;
-        return;
+    if (auto* prepare = get_if<PrepareStatement>(&statement)) {
+        handlePrepare(db, *prepare);
+        return false;
     }
     
-    string table_name = trim(input.substr(12, open_paren - 12));
-    if (table_name.empty()) {
-        cout << "Error Command! Table name cannot be empty" << endl;
-        return;
+    if (auto* execute = get_if<ExecuteStatement>(&statement)) {
+        try {
+            handleExecute(db, *execute);
+        } catch (const exception& e) {
+            cout << "EXECUTE error: " << e.what() << endl;
+        }
+        return false;
     }
     
-    string columns_str = input.substr(open_paren + 1, close_paren - open_paren - 1);
-    vector<Column> columns = parseColumnDefinitions(columns_str);
+    if (auto* deallocate = get_if<DeallocateStatement>(&statement)) {
+        handleDeallocate(db, *deallocate);
+        return false;
+    }
     
-    if (columns.empty()) {
-        cout << "Error Command! No valid column definitions found" << endl;
-        return;
+    if (auto* explain = get_if<ExplainStatement>(&statement)) {
+        handleExplain(db, *explain);
+        return false;
     }
     
-    db.createTable(table_name, columns, table_name + ".csv");
+    cout << "Unknown command. Type 'HELP;' for available commands" << endl;
+    return false;
+}
+
+void handleCreateTable(MiniSQL& db, const CreateTableStatement& statement) {
+    const vector<Column>& columns = statement.columns;
+    db.createTable(statement.table, columns, statement.table + ".csv");
     
     cout <<"Columns: ";
     for (size_t i = 0; i < columns.size(); ++i) {
@@ -367,285 +259,229 @@ void handleCreateTable(MiniSQL& db, const string& input) {
         if (columns[i].type == "VARCHAR" && columns[i].varchar_length > 0) {
             cout << "(" << columns[i].varchar_length << ")";
         }
+        if (columns[i].primary_key) {
+            cout << " PRIMARY KEY";
+        } else if (columns[i].unique) {
+            cout << " UNIQUE";
+        }
         if (i < columns.size() - 1) cout << ", ";
     }
     cout << endl;
 }
 
-void handleInsert(MiniSQL& db, const string& input) {
-    size_t values_pos = input.find("VALUES");
-    if (values_pos == string::npos) {
-        cout << "Error Command! INSERT INTO <table_name> VALUES (...)" << endl;
-        return;
+void handleInsert(MiniSQL& db, const InsertStatement& statement) {
+    // INSERT OR REPLACE INTO is an upsert keyed on the PRIMARY KEY column.
+    vector<Value> values;
+    for (const auto& value : statement.values) {
+        values.push_back(literalValue(*value));
+    }
+    Row row(values);
+    bool replaced = false;
+    bool success = statement.replace ? db.upsert(statement.table, row, replaced) : db.insert(statement.table, row);
+    // On failure insert / upsert have reported why.
+    if (success) {
+        cout << (replaced ? "Data replaced successfully!" : "Data inserted successfully!") << endl;
     }
+}
+
+void handleSimpleSelect(MiniSQL& db, const SelectStatement& statement, const string& sql) {
+    const string& table_name = statement.table;
+    const vector<string>& columns = statement.columns;
     
-    string table_name = trim(input.substr(11, values_pos - 11));
-    if (table_name.empty()) {
-        cout << "Error Command! Table name cannot be empty" << endl;
+    string cache_key = db.resultCacheKey(sql, referencedTables(statement));
+    if (const auto* cached = db.resultCache().lookup(cache_key)) {
+        displayResults(cached->rows, cached->columns);
         return;
     }
     
-    string values_str = trim(input.substr(values_pos + 6));
-    if (values_str.front() == '(' && values_str.back() == ')') {
-        values_str = values_str.substr(1, values_str.length() - 2);
+    shared_ptr<LogicExpression> where_clause = nullptr;
+    auto table = db.getTable(table_name);
+    if (statement.where && table) {
+        where_clause = parseWhereClause(*statement.where, table);
+        if (!where_clause) {
+            return;
+        }
     }
     
-    vector<string> value_tokens = split(values_str, ',');
-    vector<Value> row_values;
-    
-    auto isValidNumber = [](const string& str) -> bool {
-        if (str.empty()) return false;
-        
-        size_t start = 0;
-        if (str[0] == '-' || str[0] == '+') {
-            start = 1;
-            if (str.length() == 1) return false;
-        }
-        
-        bool has_digits = false;
-        bool has_decimal_point = false;
-        
-        for (size_t i = start; i < str.length(); ++i) {
-            char c = str[i];
-            if (c == '.') {
-                if (has_decimal_point) return false; 
-                has_decimal_point = true;
-            } else if (!isdigit(c)) {
-                return false;  
-            } else {
-                has_digits = true;
+    try {
+        vector<Row> results;
+        vector<Column> selected_columns;
+        if (statement.count_star) {
+            long long count = db.count(table_name, where_clause);
+            if (count < 0) {
+                return;
             }
-        }
-        
-        return has_digits; 
-    };
-    
-    for (const auto& val : value_tokens) {
-        string cleaned_val = trim(val);
-        
-        bool is_quoted_string = (cleaned_val.front() == '\'' && cleaned_val.back() == '\'');
-        if (is_quoted_string) {
-            cleaned_val = cleaned_val.substr(1, cleaned_val.length() - 2);
-            row_values.push_back(cleaned_val);
-            continue;
-        }
-        
-        if (isValidNumber(cleaned_val)) {
-            bool has_decimal_point = (cleaned_val.find('.') != string::npos);
+            results.push_back(Row({Value(static_cast<int>(count))}));
+            selected_columns.push_back(Column{"COUNT(*)", "INT"});
+        } else if (!statement.expressions.empty()) {
+            vector<shared_ptr<const Expression>> projections;
+            if (!table) {
+                cout << "Error: Table '" << table_name << "' does not exist" << endl;
+                return;
+            }
+            if (!compileSelectList(statement, table->columns(), {}, projections, selected_columns)) {
+                return;
+            }
+            results = db.select(table_name, projections, where_clause);
+        } else {
+            results = db.select(table_name, columns, {}, where_clause);
             
-            if (has_decimal_point) {
-                try {
-                    row_values.push_back(stod(cleaned_val));
-                } catch (...) {
-                    row_values.push_back(cleaned_val);
-                }
-            } else {
-                try {
-                    row_values.push_back(stoi(cleaned_val));
-                } catch (...) {
-                    row_values.push_back(cleaned_val);
+            if (table) {
+                for (const auto& col_name : columns) {
+                    if (col_name == "*") {
+                        selected_columns = table->columns();
+                        break;
+                    }
+                    for (const auto& col : table->columns()) {
+                        if (col.name == col_name) {
+                            selected_columns.push_back(col);
+                            break;
+                        }
+                    }
                 }
             }
-        } else {
-            row_values.push_back(cleaned_val);
         }
-    }
-    
-    Row row(row_values);
-    bool success = db.insert(table_name, row);
-    if (success) {
-        cout << "Data inserted successfully!" << endl;
-    } else {
-        cout << "Insert failed: Table does not exist or column count mismatch" << endl;
+        
+        displayResults(results, selected_columns);
+        db.resultCache().insert(cache_key, move(selected_columns), move(results));
+    } catch (const exception& e) {
+        cout << "Query error: " << e.what() << endl;
     }
 }
 
-void handleSimpleSelect(MiniSQL& db, const string& input) {
-    string upper_input = input;
-    transform(upper_input.begin(), upper_input.end(), upper_input.begin(), ::toupper);
-    
-    size_t from_pos = upper_input.find("FROM");
-    if (from_pos == string::npos) {
-        cout << "Error Command! SELECT columns FROM <table_name>." << endl;
+void handleJoinSelect(MiniSQL& db, const SelectStatement& statement, const string& sql) {
+    const string& table1 = statement.table;
+    const string& table2 = statement.join_table;
+    const vector<string>& columns = statement.columns;
+    const JoinCondition& join_condition = statement.join;
+    
+    // SAVE AS writes a table, so only plain JOIN queries go through the result cache.
+    string cache_key = statement.save_as.empty() ? db.resultCacheKey(sql, referencedTables(statement)) : "";
+    if (const auto* cached = db.resultCache().lookup(cache_key)) {
+        db.recordCachedJoin(cached->rows.size());
+        displayResults(cached->rows, cached->columns);
         return;
     }
     
-    string select_part = trim(input.substr(0, from_pos));
-    
-    string upper_select = select_part;
-    transform(upper_select.begin(), upper_select.end(), upper_select.begin(), ::toupper);
-    if (upper_select.find("SELECT ") == 0) {
-        select_part = select_part.substr(7); 
-        select_part = trim(select_part);
+    // Parse WHERE clause conditions
+    shared_ptr<LogicExpression> where_clause = nullptr;
+    auto left_table = db.getTable(table1);
+    auto right_table = db.getTable(table2);
+    if (statement.where && left_table && right_table) {
+        where_clause = parseJoinWhereClause(*statement.where, left_table, right_table);
+        if (!where_clause) {
+            return;
+        }
     }
     
-    vector<string> columns;
-    string columns_str = trim(select_part);
-    
-    if (columns_str == "*") {
-        columns.push_back("*");
-    } else {
-        vector<string> column_tokens = split(columns_str, ',');
-        for (auto& col : column_tokens) {
-            col = trim(col);
-            if (!col.empty()) {
-                columns.push_back(col);
-            }
+    if (!statement.save_as.empty()) {
+        bool success = db.saveJoinAsTable(statement.save_as, table1, table2, join_condition, where_clause);
+        if (success) {
+            cout << "JOIN results saved as table: '" << statement.save_as << "'" << endl;
         }
+        return;
     }
     
-    if (columns.empty()) {
-        cout << "Error Command! No columns specified." << endl;
-        return;
+    vector<Column> display_columns;
+    vector<shared_ptr<const Expression>> projections;
+    if (!statement.expressions.empty() && left_table && right_table) {
+        // Computed lists are evaluated on the joined rows, whose columns are those of both tables.
+        vector<Column> joined_columns = left_table->columns();
+        joined_columns.insert(joined_columns.end(), right_table->columns().begin(), right_table->columns().end());
+        vector<string> joined_tables(left_table->columns().size(), table1);
+        joined_tables.resize(joined_columns.size(), table2);
+        if (!compileSelectList(statement, joined_columns, joined_tables, projections, display_columns)) {
+            return;
+        }
     }
     
-    string table_name;
-    shared_ptr<LogicExpression> where_clause = nullptr;
-    size_t where_pos = upper_input.find("WHERE");
+    vector<Row> results = db.join(table1, table2, projections.empty() ? columns : vector<string>{"*"}, JoinType::INNER_JOIN, join_condition, where_clause);
     
-    if (where_pos != string::npos) {
-        table_name = trim(input.substr(from_pos + 4, where_pos - from_pos - 4));
-        string where_str = trim(input.substr(where_pos + 5));
-        auto table = db.getTable(table_name);
-        where_clause = parseWhereClause(where_str, table);
+    if (!projections.empty()) {
+        try {
+            for (Row& row : results) {
+                row = Expression::project(row, projections);
+            }
+        } catch (const exception& e) {
+            cout << "Query error: " << e.what() << endl;
+            return;
+        }
+    } else if (columns.size() == 1 && columns[0] == "*") {
+        if (left_table) {
+            for (const auto& col : left_table->columns()) {
+                Column display_col = col;
+                display_col.name = table1 + "." + col.name;
+                display_columns.push_back(display_col);
+            }
+        }
+        if (right_table) {
+            for (const auto& col : right_table->columns()) {
+                Column display_col = col;
+                display_col.name = table2 + "." + col.name;
+                display_columns.push_back(display_col);
+            }
+        }
     } else {
-        table_name = trim(input.substr(from_pos + 4));
+        for (const auto& col_name : columns) {
+            Column display_col;
+            display_col.name = col_name;
+            display_col.type = "VARCHAR";
+            display_col.varchar_length = 50;
+            display_columns.push_back(display_col);
+        }
     }
     
-    if (table_name.empty()) {
-        cout << "Error Command! Table name cannot be empty." << endl;
-        return;
+    displayResults(results, display_columns);
+    db.resultCache().insert(cache_key, move(display_columns), move(results));
+}
+
+void handleDropTable(MiniSQL& db, const DropTableStatement& statement) {
+    db.dropTable(statement.table);
+}
+
+// CREATE [BITMAP | TRIGRAM] INDEX <index_name> ON <table_name>(<column_name>) [INCLUDE (<column>, ...)]
+void handleCreateIndex(MiniSQL& db, const CreateIndexStatement& statement) {
+    IndexKind kind = statement.kind;
+    if (db.createIndex(statement.index, statement.table, statement.column, kind, statement.include_columns)) {
+        const char* label = kind == IndexKind::BITMAP ? "Bitmap index '" : kind == IndexKind::TRIGRAM ? "Trigram index '" : "Index '";
+        cout << label << statement.index << "' created on " << statement.table << "(" << statement.column << ")" << endl;
     }
-    
-    try {
-        vector<Row> results = db.select(table_name, columns, {}, where_clause);
-        
-        auto table = db.getTable(table_name);
-        if (table) {
-            vector<Column> selected_columns;
-            for (const auto& col_name : columns) {
-                if (col_name == "*") {
-                    displayResults(results, table->columns());
-                    return;
-                }
-                for (const auto& col : table->columns()) {
-                    if (col.name == col_name) {
-                        selected_columns.push_back(col);
-                        break;
-                    }
-                }
-            }
-            displayResults(results, selected_columns);
-        } else {
-            displayResults(results, {});
-        }
-    } catch (const exception& e) {
-        cout << "Query error: " << e.what() << endl;
+}
+
+// DROP INDEX <index_name> [ON <table_name>]
+void handleDropIndex(MiniSQL& db, const DropIndexStatement& statement) {
+    if (db.dropIndex(statement.index, statement.table)) {
+        cout << "Index '" << statement.index << "' dropped successfully!" << endl;
     }
 }
 
-void handleJoinSelect(MiniSQL& db, const string& input, bool has_save_as, const string& save_table_name) {
-    // ** regular expression 
-    regex pattern(R"(SELECT\s+(.*?)\s+FROM\s+(\w+)\s+JOIN\s+(\w+)\s+ON\s+(.*?)(?:\s+WHERE\s+(.*))?$)", regex::icase);
-    smatch matches;
-    
-    if (regex_search(input, matches, pattern)) {
-        string select_part = matches[1].str(); 
-        string table1 = matches[2].str();
-        string table2 = matches[3].str();
-        string join_condition_str = matches[4].str();
-        string where_str = (matches.size() > 5) ? matches[5].str() : "";
-        
-        // Parse SELECT columns
-        vector<string> columns;
-        string columns_str = trim(select_part);
-        if (columns_str == "*") {
-            columns.push_back("*");
-        } else {
-            vector<string> column_tokens = split(columns_str, ',');
-            for (auto& col : column_tokens) {
-                col = trim(col);
-                if (!col.empty()) {
-                    columns.push_back(col);
-                }
+void handleShowIndexes(MiniSQL& db) {
+    cout << "Indexes in database:" << endl;
+    cout << "--------------------" << endl;
+    bool found = false;
+    for (const auto& table_name : db.listTables()) {
+        auto table = db.getTable(table_name);
+        if (!table) continue;
+        for (const auto& index : table->indexes()) {
+            cout << "- " << index->name() << " ON " << table_name << "(" << index->column() << ")";
+            for (size_t i = 0; i < index->includeColumns().size(); ++i) {
+                cout << (i == 0 ? " INCLUDE (" : ", ") << index->includeColumns()[i];
             }
+            cout << (index->includeColumns().empty() ? "" : ")") << ", " << index->size() << " entries" << endl;
+            found = true;
         }
-        
-        if (columns.empty()) {
-            cout << "Error Command! No columns specified in SELECT" << endl;
-            return;
+        for (const auto& index : table->bitmapIndexes()) {
+            cout << "- " << index->name() << " ON " << table_name << "(" << index->column() << ") (bitmap), " << index->distinctValues() << " distinct values" << endl;
+            found = true;
         }
-        
-        // Parse JOIN conditions
-        JoinCondition join_condition = parseJoinCondition(join_condition_str);
-        if (join_condition.left_table.empty() || join_condition.right_table.empty()) {
-            cout << "Error Command! Invalid JOIN condition format" << endl;
-            return;
+        for (const auto& index : table->trigramIndexes()) {
+            cout << "- " << index->name() << " ON " << table_name << "(" << index->column() << ") (trigram), " << index->trigramCount() << " trigrams" << endl;
+            found = true;
         }
-        
-        // Parse WHERE clause conditions
-        shared_ptr<LogicExpression> where_clause = nullptr;
-        if (!where_str.empty()) {
-            auto left_table = db.getTable(table1);
-            auto right_table = db.getTable(table2);
-            where_clause = parseJoinWhereClause(where_str, left_table, right_table);
-        }
-        
-        if (has_save_as) {
-            bool success = db.saveJoinAsTable(save_table_name, table1, table2, join_condition, where_clause);
-            if (success) {
-                cout << "JOIN results saved as table: '" << save_table_name << "'" << endl;
-            }
-        } else {
-            vector<Row> results = db.join(table1, table2, columns, JoinType::INNER_JOIN, join_condition, where_clause);
-            
-            vector<Column> display_columns;
-            
-            if (columns.size() == 1 && columns[0] == "*") {
-
-                auto left_table_ptr = db.getTable(table1);
-                auto right_table_ptr = db.getTable(table2);
-                
-                if (left_table_ptr) {
-                    for (const auto& col : left_table_ptr->columns()) {
-                        Column display_col = col;
-                        display_col.name = table1 + "." + col.name;
-                        display_columns.push_back(display_col);
-                    }
-                }
-                if (right_table_ptr) {
-                    for (const auto& col : right_table_ptr->columns()) {
-                        Column display_col = col;
-                        display_col.name = table2 + "." + col.name;
-                        display_columns.push_back(display_col);
-                    }
-                }
-            } else {
-                for (const auto& col_name : columns) {
-                    Column display_col;
-                    display_col.name = col_name;
-                    display_col.type = "VARCHAR";
-                    display_col.varchar_length = 50;
-                    display_columns.push_back(display_col);
-                }
-            }
-            
-            displayResults(results, display_columns);
-        }
-    } else {
-        cout << "Error Command! Cannot parse JOIN query" << endl;
-        cout << "Input: " << input << endl;
-        return;
     }
-}
-
-void handleDropTable(MiniSQL& db, const string& input) {
-    string table_name = trim(input.substr(10));
-    if (table_name.empty()) {
-        cout << "Error Command! Table name cannot be empty" << endl;
-        return;
+    if (!found) {
+        cout << "No indexes found" << endl;
     }
-    db.dropTable(table_name);
 }
 
 void handleShowTables(MiniSQL& db) {
@@ -661,32 +497,141 @@ void handleShowTables(MiniSQL& db) {
     }
 }
 
-void handleDelete(MiniSQL& db, const string& input) {
-    string upper_input = input;
-    transform(upper_input.begin(), upper_input.end(), upper_input.begin(), ::toupper);
+void handleShowStats(MiniSQL& db) {
+    const QueryStats& stats = db.lastQueryStats();
+    cout << "Last query statistics:" << endl;
+    cout << "----------------------" << endl;
+    if (stats.join_algorithm.empty()) {
+        cout << "No join has been executed yet" << endl;
+        return;
+    }
+    cout << "Join algorithm:      " << stats.join_algorithm << endl;
+    if (stats.join_algorithm == "Result cache") {
+        cout << "Result rows:         " << stats.result_rows << endl;
+        return;
+    }
+    cout << "Build rows:          " << stats.build_rows << endl;
+    cout << "Probe rows:          " << stats.probe_rows << endl;
+    if (!stats.join_index.empty()) {
+        cout << "Join index:          " << stats.join_index << endl;
+        cout << "Outer rows filtered: " << stats.probe_rows_filtered << endl;
+    }
+    if (!stats.join_filter.empty()) {
+        cout << "Join filter:         " << stats.join_filter << endl;
+        cout << "Probe rows filtered: " << stats.probe_rows_filtered << endl;
+    }
+    if (stats.spill_partitions > 0) {
+        cout << "Spill partitions:    " << stats.spill_partitions << endl;
+        cout << "Bytes spilled:       " << stats.bytes_spilled << endl;
+    }
+    cout << "Result rows:         " << stats.result_rows << endl;
+}
+
+void handleShowCache(MiniSQL& db) {
+    const ResultCache& cache = db.resultCache();
+    cout << "Result cache:" << endl;
+    cout << "-------------" << endl;
+    cout << "Entries:   " << cache.entryCount() << endl;
+    cout << "Bytes:     " << cache.bytes() << " / " << cache.capacity() << (cache.capacity() == 0 ? " (disabled)" : "") << endl;
+    cout << "Hits:      " << cache.hits() << endl;
+    cout << "Misses:    " << cache.misses() << endl;
+    cout << "Evictions: " << cache.evictions() << endl;
+    
+    const BufferPool& pool = db.bufferPool();
+    cout << endl;
+    cout << "Buffer pool:" << endl;
+    cout << "------------" << endl;
+    cout << "Tables:    " << pool.tableCount() << endl;
+    cout << "Bytes:     " << pool.bytes() << " / " << pool.capacity() << endl;
+    cout << "Loads:     " << pool.loads() << " (" << pool.prefetches() << " prefetched)" << endl;
+    cout << "Evictions: " << pool.evictions() << endl;
+    cout << "Policy:    " << (pool.policy() == BufferPool::Policy::TWO_Q ? "2Q" : "LRU") << endl;
+    cout << "Dirty:     " << pool.dirtyBytes() << " bytes, checkpoint at " << db.checkpointBytes() << " bytes or every ";
+    if (db.checkpointInterval() == 0) cout << "change" << endl;
+    else cout << db.checkpointInterval() << " ms" << endl;
+    cout << "Checkpoints: " << db.checkpoints() << " (" << db.checkpointedTables() << " table writes)" << endl;
+    
+    if (pool.tableStats().empty()) {
+        return;
+    }
+    vector<string> names;
+    for (const auto& [name, stats] : pool.tableStats()) {
+        names.push_back(name);
+    }
+    sort(names.begin(), names.end());
+    cout << "Per table:" << endl;
+    for (const auto& name : names) {
+        const auto& stats = pool.tableStats().at(name);
+        string state = !pool.hasTable(name) ? "on disk" : pool.inProbation(name) ? "in probation" : "in memory";
+        cout << "- " << name << " (" << state << "): " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evictions" << endl;
+    }
+}
+
+void handleSet(MiniSQL& db, const SetStatement& statement) {
+    // SET MEMORY_BUDGET [=] <bytes>[K|M|G]
+    // SET RESULT_CACHE [=] <bytes>[K|M|G]
+    // SET BUFFER_POOL [=] <bytes>[K|M|G]
+    // SET CHECKPOINT_BYTES [=] <bytes>[K|M|G]
+    // SET CHECKPOINT_INTERVAL [=] <milliseconds>
+    if (statement.name != "MEMORY_BUDGET" && statement.name != "RESULT_CACHE" && statement.name != "BUFFER_POOL" &&
+        statement.name != "CHECKPOINT_BYTES" && statement.name != "CHECKPOINT_INTERVAL") {
+        cout << "Error: Unknown setting '" << statement.name << "'" << endl;
+        return;
+    }
     
-    size_t from_pos = upper_input.find("FROM");
-    if (from_pos == string::npos) {
-        cout << "Syntax error: DELETE FROM <table_name> [WHERE condition]" << endl;
+    string value_str = statement.value;
+    if (value_str.empty()) {
+        cout << "Syntax error: SET " << statement.name << (statement.name == "CHECKPOINT_INTERVAL" ? " <milliseconds>" : " <bytes>[K|M|G]") << endl;
         return;
     }
     
-    string table_name;
-    shared_ptr<LogicExpression> where_clause = nullptr;
-    size_t where_pos = upper_input.find("WHERE");
+    size_t multiplier = 1;
+    char unit = toUpperChar(value_str.back());
+    if (unit == 'K') multiplier = 1024;
+    else if (unit == 'M') multiplier = 1024 * 1024;
+    else if (unit == 'G') multiplier = 1024 * 1024 * 1024;
+    if (multiplier > 1) value_str.pop_back();
     
-    if (where_pos != string::npos) {
-        table_name = trim(input.substr(from_pos + 4, where_pos - from_pos - 4));
-        string where_str = trim(input.substr(where_pos + 5));
-        auto table = db.getTable(table_name);
-        where_clause = parseWhereClause(where_str, table);
-    } else {
-        table_name = trim(input.substr(from_pos + 4));
+    try {
+        size_t pos = 0;
+        unsigned long long bytes = stoull(value_str, &pos);
+        // stoull accepts a sign and wraps negative numbers around.
+        if (pos != value_str.size() || value_str[0] == '-') {
+            throw invalid_argument(value_str);
+        }
+        if (statement.name == "RESULT_CACHE") {
+            db.resultCache().setCapacity(static_cast<size_t>(bytes) * multiplier);
+            cout << "Result cache size set to " << db.resultCache().capacity() << " bytes" << (bytes == 0 ? " (disabled)" : "") << endl;
+        } else if (statement.name == "BUFFER_POOL") {
+            db.bufferPool().setCapacity(static_cast<size_t>(bytes) * multiplier);
+            cout << "Buffer pool size set to " << db.bufferPool().capacity() << " bytes" << endl;
+        } else if (statement.name == "CHECKPOINT_BYTES") {
+            db.setCheckpointBytes(static_cast<size_t>(bytes) * multiplier);
+            cout << "Checkpoint threshold set to " << db.checkpointBytes() << " bytes" << endl;
+        } else if (statement.name == "CHECKPOINT_INTERVAL") {
+            db.setCheckpointInterval(static_cast<size_t>(bytes) * multiplier);
+            cout << "Checkpoint interval set to " << db.checkpointInterval() << " ms" << (bytes == 0 ? " (after every change)" : "") << endl;
+        } else {
+            db.setQueryMemoryBudget(static_cast<size_t>(bytes) * multiplier);
+            cout << "Query memory budget set to " << db.queryMemoryBudget() << " bytes" << (bytes == 0 ? " (unlimited)" : "") << endl;
+        }
+    } catch (...) {
+        string what = statement.name == "MEMORY_BUDGET" ? "memory budget" : statement.name == "CHECKPOINT_BYTES" ? "checkpoint threshold" :
+                      statement.name == "CHECKPOINT_INTERVAL" ? "checkpoint interval" : "cache size";
+        cout << "Error: Invalid " << what << " '" << value_str << "'" << endl;
     }
+}
+
+void handleDelete(MiniSQL& db, const DeleteStatement& statement) {
+    const string& table_name = statement.table;
     
-    if (table_name.empty()) {
-        cout << "Error Command! Table name cannot be empty" << endl;
-        return;
+    shared_ptr<LogicExpression> where_clause = nullptr;
+    auto table = db.getTable(table_name);
+    if (statement.where && table) {
+        where_clause = parseWhereClause(*statement.where, table);
+        if (!where_clause) {
+            return;
+        }
     }
     
     try {
@@ -701,37 +646,8 @@ void handleDelete(MiniSQL& db, const string& input) {
     }
 }
 
-void handleUpdate(MiniSQL& db, const string& input) {
-    string upper_input = input;
-    transform(upper_input.begin(), upper_input.end(), upper_input.begin(), ::toupper);
-    
-    size_t set_pos = upper_input.find("SET");
-    if (set_pos == string::npos) {
-        cout << "Syntax error: UPDATE <table_name> SET column1=value1, ... [WHERE condition]" << endl;
-        return;
-    }
-    
-    size_t where_pos = upper_input.find("WHERE");
-    string table_name = trim(input.substr(6, set_pos - 6)); 
-    string set_clause;
-    string where_str;
-    
-    if (where_pos != string::npos) {
-        set_clause = trim(input.substr(set_pos + 3, where_pos - set_pos - 3));
-        where_str = trim(input.substr(where_pos + 5));
-    } else {
-        set_clause = trim(input.substr(set_pos + 3));
-    }
-    
-    if (table_name.empty()) {
-        cout << "Error: Table name cannot be empty" << endl;
-        return;
-    }
-    
-    if (set_clause.empty()) {
-        cout << "Error: SET clause cannot be empty" << endl;
-        return;
-    }
+void handleUpdate(MiniSQL& db, const UpdateStatement& statement) {
+    const string& table_name = statement.table;
     
     auto table = db.getTable(table_name);
     if (!table) {
@@ -739,7 +655,13 @@ void handleUpdate(MiniSQL& db, const string& input) {
         return;
     }
     
-    unordered_map<string, Value> updates = parseUpdateSet(set_clause, table);
+    unordered_map<string, shared_ptr<const Expression>> updates;
+    try {
+        updates = parseUpdateSet(statement, table);
+    } catch (const exception& e) {
+        cout << "Error: " << e.what() << endl;
+        return;
+    }
 
     if (updates.empty()) {
         cout << "Error: No valid update assignments found" << endl;
@@ -747,8 +669,11 @@ void handleUpdate(MiniSQL& db, const string& input) {
     }
     
     shared_ptr<LogicExpression> where_clause = nullptr;
-    if (!where_str.empty()) {
-        where_clause = parseWhereClause(where_str, table);
+    if (statement.where) {
+        where_clause = parseWhereClause(*statement.where, table);
+        if (!where_clause) {
+            return;
+        }
     }
     
     try {
@@ -763,6 +688,41 @@ void handleUpdate(MiniSQL& db, const string& input) {
     }
 }
 
+// PREPARE <name> AS <statement>, with ? for each parameter
+void handlePrepare(MiniSQL& db, const PrepareStatement& statement) {
+    if (db.prepare(statement.name, statement.sql)) {
+        cout << "Statement '" << statement.name << "' prepared with " << db.parameterCount(statement.name) << " parameter(s)" << endl;
+    }
+}
+
+// EXECUTE <name>[(<value>, ...)]
+void handleExecute(MiniSQL& db, const ExecuteStatement& statement) {
+    QueryResult result = db.execute(statement.name, statement.parameters);
+    if (!result.ok) {
+        return;
+    }
+    if (result.affected_rows < 0) {
+        displayResults(result.rows, result.columns);
+    } else {
+        cout << result.affected_rows << " row(s) affected" << endl;
+    }
+}
+
+// DEALLOCATE [PREPARE] <name>
+void handleDeallocate(MiniSQL& db, const DeallocateStatement& statement) {
+    if (db.deallocate(statement.name)) {
+        cout << "Statement '" << statement.name << "' deallocated" << endl;
+    }
+}
+
+// EXPLAIN [ANALYZE] SELECT ...
+void handleExplain(MiniSQL& db, const ExplainStatement& statement) {
+    PlanNode plan;
+    if (db.explain(statement.query, statement.analyze, plan)) {
+        displayPlan(plan);
+    }
+}
+
 // Part III.Realization of interface helper functions.
 void displayResults(const vector<Row>& results, const vector<Column>& columns) {
     if (results.empty()) {
@@ -798,25 +758,69 @@ void displayResults(const vector<Row>& results, const vector<Column>& columns) {
     }
 }
 
+static void displayPlanNode(const PlanNode& node, size_t depth) {
+    string indent(depth * 3, ' ');
+    cout << indent << "-> " << node.name;
+    if (node.analyzed) {
+        cout << "  (time=" << fixed << setprecision(3) << node.time_ms << " ms, rows in=" << node.rows_in << ", rows out=" << node.rows_out;
+        if (node.hash_entries > 0) cout << ", hash entries=" << node.hash_entries;
+        if (node.bytes > 0) cout << ", bytes=" << node.bytes;
+        cout << ")";
+    }
+    cout << endl;
+    for (const auto& detail : node.details) {
+        cout << indent << "     " << detail << endl;
+    }
+    for (const auto& child : node.children) {
+        displayPlanNode(child, depth + 1);
+    }
+}
+
+static double planTime(const PlanNode& node) {
+    double total = node.time_ms;
+    for (const auto& child : node.children) total += planTime(child);
+    return total;
+}
+
+void displayPlan(const PlanNode& plan) {
+    ios saved(nullptr);
+    saved.copyfmt(cout);
+    cout << "Query plan:" << endl;
+    cout << "-----------" << endl;
+    displayPlanNode(plan, 0);
+    if (plan.analyzed) {
+        cout << "Execution time: " << fixed << setprecision(3) << planTime(plan) << " ms" << endl;
+    }
+    cout.copyfmt(saved);
+}
+
 void showHelp() {
     cout << "\nAvailable commands:" << endl;
     cout << "  CREATE TABLE <table_name> (<column_definitions>);" << endl;
     cout << "    Example: CREATE TABLE employees (id INT, name VARCHAR(50), age INT);" << endl;
+    cout << "    Example: CREATE TABLE users (id INT PRIMARY KEY, email VARCHAR(50) UNIQUE);" << endl;
     cout << endl;
     cout << "  INSERT INTO <table_name> VALUES (...);" << endl;
     cout << "    Example: INSERT INTO employees VALUES (1, 'Alice', 28);" << endl;
+    cout << "  INSERT OR REPLACE INTO <table_name> VALUES (...); - Replace the row with the same PRIMARY KEY, or insert it" << endl;
     cout << endl;
     cout << "  SELECT <columns> FROM <table_name> [WHERE condition];" << endl;
     cout << "    Example: SELECT * FROM employees;" << endl;
     cout << "    Example: SELECT name, age FROM employees;" << endl;
     cout << "    Example: SELECT name, age FROM employees WHERE age > 25;" << endl;
+    cout << "    Example: SELECT COUNT(*) FROM employees WHERE department = 'Sales' AND NOT age > 40;" << endl;
+    cout << "    Example: SELECT * FROM employees WHERE name LIKE 'J%' AND email NOT LIKE '%@example.com';" << endl;
+    cout << "    Example: SELECT name FROM employees WHERE department_id IN (SELECT dept_id FROM departments WHERE location = 'Boston');" << endl;
+    cout << "    Example: SELECT name FROM employees WHERE NOT EXISTS (SELECT * FROM departments WHERE dept_id = department_id);" << endl;
+    cout << "    Example: SELECT name, salary * 12 AS yearly, CASE WHEN age >= 60 THEN 'senior' ELSE 'regular' END AS grade FROM employees;" << endl;
+    cout << "    Example: SELECT name FROM employees WHERE salary * 12 > 60000;" << endl;
     cout << endl;
     cout << "  SELECT <columns> FROM <table1> JOIN <table2> ON <condition> [WHERE condition] (SAVE AS <table_name>);" << endl;
     cout << "    Example: SELECT * FROM employees JOIN departments ON employees.department_id = departments.dept_id;" << endl;
     cout << "    Example: SELECT employees.name, departments.dept_name FROM employees JOIN departments ON employees.department_id = departments.dept_id;" << endl;
     cout << "    Example: SELECT employees.name, departments.dept_name FROM employees JOIN departments ON employees.department_id = departments.dept_id SAVE AS choose;" << endl;
     cout << endl;
-    cout << "  UPDATE <table_name> SET column=value, ... [WHERE condition]" << endl;
+    cout << "  UPDATE <table_name> SET column=expression, ... [WHERE condition]; - Values are computed from the row before the update" << endl;
     cout << "    Example: UPDATE employees SET age = 30 WHERE id = 1;" << endl;
     cout << "    Example: UPDATE employees SET salary = salary * 1.1 WHERE department = 'Sales';" << endl;
     cout << endl;
@@ -824,8 +828,35 @@ void showHelp() {
     cout << "    Example: DELETE FROM employees WHERE id = 1;" << endl;
     cout << "    Example: DELETE FROM employees WHERE age > 65;" << endl;
     cout << endl;
+    cout << "  CREATE INDEX <index_name> ON <table_name>(<column_name>);" << endl;
+    cout << "    Example: CREATE INDEX idx_age ON employees(age);" << endl;
+    cout << "    Example: CREATE INDEX idx_age_name ON employees(age) INCLUDE (id, name); - SELECT id, name ... WHERE age > 30 reads only the index" << endl;
+    cout << "  CREATE BITMAP INDEX <index_name> ON <table_name>(<column_name>); - For low-cardinality columns" << endl;
+    cout << "    Example: CREATE BITMAP INDEX idx_dept ON employees(department);" << endl;
+    cout << "  CREATE TRIGRAM INDEX <index_name> ON <table_name>(<column_name>); - Speeds up LIKE '%text%' on a VARCHAR column" << endl;
+    cout << "    Example: CREATE TRIGRAM INDEX idx_name_trgm ON employees(name);" << endl;
+    cout << "  DROP INDEX <index_name> [ON <table_name>]; - Delete an index" << endl;
+    cout << endl;
+    cout << "  PREPARE <name> AS <statement>; - Parse and bind a SELECT, INSERT, UPDATE or DELETE once, ? marks a parameter" << endl;
+    cout << "    Example: PREPARE by_id AS SELECT * FROM employees WHERE id = ?;" << endl;
+    cout << "  EXECUTE <name>[(<value>, ...)]; - Run a prepared statement with the given parameters" << endl;
+    cout << "    Example: EXECUTE by_id(42);" << endl;
+    cout << "  DEALLOCATE [PREPARE] <name>; - Forget a prepared statement" << endl;
+    cout << endl;
+    cout << "  EXPLAIN SELECT ...; - Show the plan of a SELECT: access path, index conditions, join algorithm" << endl;
+    cout << "  EXPLAIN ANALYZE SELECT ...; - Run the SELECT and show time, rows in / out and memory of every operator" << endl;
+    cout << "    Example: EXPLAIN ANALYZE SELECT name FROM employees WHERE age > 30;" << endl;
+    cout << endl;
     cout << "  DROP TABLE <table_name>; - Delete a table" << endl;
+    cout << "  SHOW INDEXES; - List all indexes" << endl;
     cout << "  SHOW TABLES; - List all tables" << endl;
+    cout << "  SHOW STATS; - Show execution statistics of the last JOIN" << endl;
+    cout << "  SET MEMORY_BUDGET <bytes>[K|M|G]; - Limit join hash tables, larger joins spill to data/tmp/ (0 = unlimited)" << endl;
+    cout << "  SHOW CACHE; - Show size and hit / miss counts of the SELECT result cache and the buffer pool, also per table" << endl;
+    cout << "  SET RESULT_CACHE <bytes>[K|M|G]; - Limit the SELECT result cache, least recently used results are dropped first (0 = off)" << endl;
+    cout << "  SET BUFFER_POOL <bytes>[K|M|G]; - Limit the memory of the tables held in memory, least recently used tables are saved and reloaded on their next use" << endl;
+    cout << "  SET CHECKPOINT_INTERVAL <milliseconds>; - Write changed pages back in the background this often (0 = after every change)" << endl;
+    cout << "  SET CHECKPOINT_BYTES <bytes>[K|M|G]; - Write changed pages back sooner once they hold this many bytes" << endl;
     cout << "  EXIT; - Exit the program" << endl;
     cout << "  HELP; - Show this help message" << endl;
 }
\ No newline at end of file
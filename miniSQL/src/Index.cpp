@@ -0,0 +1,724 @@
+#include "../include/Index.h"
+#include "../include/LikePattern.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// Part I. Realization of index key ordering in Index.h
+bool ValueLess::operator()(const Value& left, const Value& right) const {
+    bool left_is_string = holds_alternative<string>(left);
+    bool right_is_string = holds_alternative<string>(right);
+    if (left_is_string != right_is_string) {
+        return !left_is_string;
+    }
+    if (left_is_string) {
+        return get<string>(left) < get<string>(right);
+    }
+
+    double left_number = holds_alternative<int>(left) ? get<int>(left) : get<double>(left);
+    double right_number = holds_alternative<int>(right) ? get<int>(right) : get<double>(right);
+    return left_number < right_number;
+}
+
+bool IndexEntryLess::operator()(const IndexEntry& left, const IndexEntry& right) const {
+    ValueLess less;
+    if (less(left.key, right.key)) return true;
+    if (less(right.key, left.key)) return false;
+    return left.row < right.row;
+}
+
+// Part II. Realization of TableIndex class in Index.h
+TableIndex::TableIndex(string name, string column, int column_idx, vector<string> include_columns, vector<int> include_idx)
+    : name_(move(name)), column_(move(column)), column_idx_(column_idx),
+      include_columns_(move(include_columns)), include_idx_(move(include_idx)) {}
+
+int TableIndex::coveredPosition(const string& column) const {
+    if (column == column_) return 0;
+    for (size_t i = 0; i < include_columns_.size(); ++i) {
+        if (include_columns_[i] == column) return static_cast<int>(i + 1);
+    }
+    return -1;
+}
+
+IndexEntry TableIndex::makeEntry(const Row& row, size_t row_pos) const {
+    IndexEntry entry{row[column_idx_], row_pos, {}};
+    entry.included.reserve(include_idx_.size());
+    for (int idx : include_idx_) {
+        entry.included.push_back(row[idx]);
+    }
+    return entry;
+}
+
+size_t TableIndex::memoryUsage() const {
+    size_t bytes = tree_.memoryUsage();
+    for (auto it = tree_.begin(); it.valid(); ++it) {
+        bytes += heapBytes(it->key) + it->included.capacity() * sizeof(Value);
+        for (const auto& value : it->included) bytes += heapBytes(value);
+    }
+    return bytes;
+}
+
+size_t TableIndex::entryBytes(const Row& row) const {
+    size_t bytes = heapBytes(row[column_idx_]) + include_idx_.size() * sizeof(Value);
+    for (int idx : include_idx_) bytes += heapBytes(row[idx]);
+    return bytes;
+}
+
+void TableIndex::build(const vector<Row>& rows) {
+    vector<IndexEntry> entries;
+    entries.reserve(rows.size());
+    for (size_t i = 0; i < rows.size(); ++i) {
+        entries.push_back(makeEntry(rows[i], i));
+    }
+    sort(entries.begin(), entries.end(), IndexEntryLess());
+    tree_.bulkLoad(move(entries));
+}
+
+void TableIndex::insert(const Row& row, size_t row_pos) {
+    tree_.insert(makeEntry(row, row_pos));
+}
+
+void TableIndex::erase(const Value& key, size_t row) {
+    tree_.erase({key, row, {}});
+}
+
+void TableIndex::remap(const vector<size_t>& new_positions) {
+    // Renumbering keeps relative row order, so the entries stay sorted and can be bulk loaded.
+    vector<IndexEntry> entries;
+    entries.reserve(tree_.size());
+    for (auto it = tree_.begin(); it.valid(); ++it) {
+        size_t new_row = new_positions[it->row];
+        if (new_row != SIZE_MAX) {
+            entries.push_back({it->key, new_row, it->included});
+        }
+    }
+    tree_.bulkLoad(move(entries));
+}
+
+vector<size_t> TableIndex::rangeLookup(const Value* low, bool low_inclusive, const Value* high, bool high_inclusive) const {
+    vector<size_t> rows;
+    scanRange(low, low_inclusive, high, high_inclusive, [&](const IndexEntry& entry) {
+        rows.push_back(entry.row);
+    });
+    return rows;
+}
+
+void TableIndex::scanRange(const Value* low, bool low_inclusive, const Value* high, bool high_inclusive, const function<void(const IndexEntry&)>& visit) const {
+    ValueLess less;
+
+    // (low, 0) is the first entry of key low; (low, SIZE_MAX) skips all of them.
+    auto it = low ? tree_.lowerBound({*low, low_inclusive ? 0 : SIZE_MAX, {}}) : tree_.begin();
+    for (; it.valid(); ++it) {
+        if (high) {
+            if (less(*high, it->key)) break;
+            if (!high_inclusive && !less(it->key, *high)) break;
+        }
+        visit(*it);
+    }
+}
+
+// Part III. Index file format
+// Page 0 is the header. Pages 1..n are leaves chained by next_page (0 ends the chain), each
+// holding [uint32 next_page][uint16 entry_count] followed by entries of the form
+// [uint8 type][key][uint64 row], where key is int32, double, or uint32 length + bytes.
+namespace {
+
+const size_t INDEX_PAGE_SIZE = 4096;
+const size_t LEAF_HEADER_SIZE = 6;
+const char INDEX_MAGIC[8] = {'M', 'S', 'Q', 'L', 'I', 'D', 'X', '1'};
+
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t page_size;
+    int32_t column_idx;
+    uint64_t file_size;
+    int64_t modified_time;
+    uint64_t row_count;
+    uint64_t entry_count;
+    uint64_t leaf_pages;
+};
+
+size_t encodedEntrySize(const IndexEntry& entry) {
+    size_t key_size = holds_alternative<int>(entry.key) ? sizeof(int32_t)
+                    : holds_alternative<double>(entry.key) ? sizeof(double)
+                    : sizeof(uint32_t) + get<string>(entry.key).size();
+    return 1 + key_size + sizeof(uint64_t);
+}
+
+void encodeEntry(const IndexEntry& entry, char* out) {
+    uint64_t row = entry.row;
+    if (holds_alternative<int>(entry.key)) {
+        int32_t value = get<int>(entry.key);
+        *out++ = 'I';
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+    } else if (holds_alternative<double>(entry.key)) {
+        double value = get<double>(entry.key);
+        *out++ = 'D';
+        memcpy(out, &value, sizeof(value));
+        out += sizeof(value);
+    } else {
+        const string& value = get<string>(entry.key);
+        uint32_t length = static_cast<uint32_t>(value.size());
+        *out++ = 'S';
+        memcpy(out, &length, sizeof(length));
+        memcpy(out + sizeof(length), value.data(), length);
+        out += sizeof(length) + length;
+    }
+    memcpy(out, &row, sizeof(row));
+}
+
+// Decodes one entry from [data, end). Returns the number of bytes used, or 0 if damaged.
+size_t decodeEntry(const char* data, const char* end, IndexEntry& entry) {
+    const char* start = data;
+    if (data >= end) return 0;
+    char type = *data++;
+    if (type == 'I') {
+        int32_t value;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(value))) return 0;
+        memcpy(&value, data, sizeof(value));
+        entry.key = static_cast<int>(value);
+        data += sizeof(value);
+    } else if (type == 'D') {
+        double value;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(value))) return 0;
+        memcpy(&value, data, sizeof(value));
+        entry.key = value;
+        data += sizeof(value);
+    } else if (type == 'S') {
+        uint32_t length;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(length))) return 0;
+        memcpy(&length, data, sizeof(length));
+        data += sizeof(length);
+        if (end - data < static_cast<ptrdiff_t>(length)) return 0;
+        entry.key = string(data, length);
+        data += length;
+    } else {
+        return 0;
+    }
+    uint64_t row;
+    if (end - data < static_cast<ptrdiff_t>(sizeof(row))) return 0;
+    memcpy(&row, data, sizeof(row));
+    entry.row = static_cast<size_t>(row);
+    return static_cast<size_t>(data + sizeof(row) - start);
+}
+
+// Read-only view of a whole file: memory-mapped where available, read into memory otherwise.
+class MappedFile {
+public:
+    explicit MappedFile(const string& path) {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const char*>(mapped);
+                size_ = static_cast<size_t>(st.st_size);
+                madvise(mapped, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+#else
+        ifstream file(path, ios::binary);
+        if (!file.is_open()) return;
+        buffer_.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data_ = buffer_.data();
+        size_ = buffer_.size();
+#endif
+    }
+    
+    ~MappedFile() {
+#ifndef _WIN32
+        if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+    }
+    
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+    
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    vector<char> buffer_;
+#endif
+};
+
+}
+
+bool TableIndex::saveToFile(const string& path, const TableFileStamp& stamp) const {
+    // Write to a temporary file first so a crash never leaves a half-written index behind.
+    string temp_path = path + ".tmp";
+    ofstream file(temp_path, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    vector<char> page(INDEX_PAGE_SIZE, 0);
+    file.write(page.data(), page.size());   // header page, filled in at the end
+    
+    uint64_t leaf_pages = 0;
+    uint16_t entry_count = 0;
+    size_t used = LEAF_HEADER_SIZE;
+    auto flushLeaf = [&](bool last) {
+        uint32_t next_page = last ? 0 : static_cast<uint32_t>(leaf_pages + 2);
+        memcpy(page.data(), &next_page, sizeof(next_page));
+        memcpy(page.data() + sizeof(next_page), &entry_count, sizeof(entry_count));
+        file.write(page.data(), page.size());
+        fill(page.begin(), page.end(), 0);
+        ++leaf_pages;
+        entry_count = 0;
+        used = LEAF_HEADER_SIZE;
+    };
+    
+    for (auto it = tree_.begin(); it.valid(); ++it) {
+        size_t entry_size = encodedEntrySize(*it);
+        if (LEAF_HEADER_SIZE + entry_size > INDEX_PAGE_SIZE) {
+            file.close();
+            remove(temp_path.c_str());
+            return false;   // a key too long for one page; the index is rebuilt on load instead
+        }
+        if (used + entry_size > INDEX_PAGE_SIZE || entry_count == UINT16_MAX) {
+            flushLeaf(false);
+        }
+        encodeEntry(*it, page.data() + used);
+        used += entry_size;
+        ++entry_count;
+    }
+    if (entry_count > 0) {
+        flushLeaf(true);
+    }
+    
+    IndexFileHeader header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+    header.page_size = static_cast<uint32_t>(INDEX_PAGE_SIZE);
+    header.column_idx = column_idx_;
+    header.file_size = stamp.file_size;
+    header.modified_time = stamp.modified_time;
+    header.row_count = stamp.row_count;
+    header.entry_count = tree_.size();
+    header.leaf_pages = leaf_pages;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.close();
+    if (!file) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    
+    return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+bool TableIndex::loadFromFile(const string& path, const TableFileStamp& stamp, const vector<Row>& rows) {
+    MappedFile file(path);
+    if (!file.data() || file.size() < INDEX_PAGE_SIZE) {
+        return false;
+    }
+    
+    IndexFileHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+    if (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 || header.page_size != INDEX_PAGE_SIZE ||
+        header.column_idx != column_idx_ || header.file_size != stamp.file_size ||
+        header.modified_time != stamp.modified_time || header.row_count != stamp.row_count || rows.size() != stamp.row_count ||
+        file.size() != (header.leaf_pages + 1) * INDEX_PAGE_SIZE) {
+        return false;
+    }
+    
+    vector<IndexEntry> entries;
+    entries.reserve(header.entry_count);
+    IndexEntryLess less;
+    uint64_t page_no = header.leaf_pages > 0 ? 1 : 0;
+    for (uint64_t visited = 0; page_no != 0; ++visited) {
+        if (visited >= header.leaf_pages || page_no > header.leaf_pages) return false;
+        const char* page = file.data() + page_no * INDEX_PAGE_SIZE;
+        const char* page_end = page + INDEX_PAGE_SIZE;
+        uint32_t next_page;
+        uint16_t entry_count;
+        memcpy(&next_page, page, sizeof(next_page));
+        memcpy(&entry_count, page + sizeof(next_page), sizeof(entry_count));
+        
+        const char* cursor = page + LEAF_HEADER_SIZE;
+        for (uint16_t i = 0; i < entry_count; ++i) {
+            IndexEntry entry;
+            size_t used = decodeEntry(cursor, page_end, entry);
+            if (used == 0 || entry.row >= rows.size()) return false;
+            // Keys (and INCLUDE values) come from the rows themselves, so the tree always
+            // matches the loaded values exactly (e.g. DOUBLEs rounded by the CSV writer);
+            // the stored key only has to agree with them.
+            IndexEntry loaded = makeEntry(rows[entry.row], entry.row);
+            if (less(loaded, entry) || less(entry, loaded)) return false;
+            if (!entries.empty() && !less(entries.back(), loaded)) return false;
+            entries.push_back(move(loaded));
+            cursor += used;
+        }
+        page_no = next_page;
+    }
+    if (entries.size() != header.entry_count) {
+        return false;
+    }
+    
+    tree_.bulkLoad(move(entries));
+    return true;
+}
+
+// Part IV. Realization of UniqueIndex class in Index.h
+static double numericKey(const Value& key) {
+    return holds_alternative<int>(key) ? static_cast<double>(get<int>(key)) : get<double>(key);
+}
+
+UniqueIndex::UniqueIndex(string column, int column_idx, bool primary_key)
+    : column_(move(column)), column_idx_(column_idx), primary_key_(primary_key) {}
+
+bool UniqueIndex::build(const vector<Row>& rows) {
+    numbers_.clear();
+    strings_.clear();
+    live_keys_ = 0;
+    numbers_.reserve(rows.size());
+    
+    bool all_unique = true;
+    for (size_t i = 0; i < rows.size(); ++i) {
+        if (!insert(rows[i][column_idx_], i)) {
+            all_unique = false;
+        }
+    }
+    return all_unique;
+}
+
+size_t UniqueIndex::find(const Value& key) const {
+    uint32_t entry = holds_alternative<string>(key) ? strings_.find(get<string>(key)) : numbers_.find(numericKey(key));
+    if (entry == FlatHashTable<double>::npos) return SIZE_MAX;
+    return holds_alternative<string>(key) ? strings_.payload(entry) : numbers_.payload(entry);
+}
+
+bool UniqueIndex::insert(const Value& key, size_t row) {
+    bool added = holds_alternative<string>(key) ? strings_.insertUnique(get<string>(key), static_cast<uint32_t>(row))
+                                                : numbers_.insertUnique(numericKey(key), static_cast<uint32_t>(row));
+    if (added) ++live_keys_;
+    return added;
+}
+
+void UniqueIndex::erase(const Value& key) {
+    bool erased = holds_alternative<string>(key) ? strings_.eraseKey(get<string>(key)) : numbers_.eraseKey(numericKey(key));
+    if (erased) --live_keys_;
+}
+
+// Part V. Realization of BitmapIndex class in Index.h
+BitmapIndex::BitmapIndex(string name, string column, int column_idx)
+    : name_(move(name)), column_(move(column)), column_idx_(column_idx) {}
+
+uint32_t BitmapIndex::slotOf(const Value& key) const {
+    uint32_t entry = holds_alternative<string>(key) ? strings_.find(get<string>(key)) : numbers_.find(numericKey(key));
+    if (entry == FlatHashTable<double>::npos) return entry;
+    return holds_alternative<string>(key) ? strings_.payload(entry) : numbers_.payload(entry);
+}
+
+uint32_t BitmapIndex::addSlot(const Value& key) {
+    uint32_t slot = slotOf(key);
+    if (slot != FlatHashTable<double>::npos) return slot;
+    
+    slot = static_cast<uint32_t>(values_.size());
+    values_.push_back(key);
+    bitmaps_.emplace_back();
+    if (holds_alternative<string>(key)) {
+        strings_.insert(get<string>(key), slot);
+    } else {
+        numbers_.insert(numericKey(key), slot);
+    }
+    return slot;
+}
+
+size_t BitmapIndex::memoryUsage() const {
+    size_t bytes = values_.capacity() * sizeof(Value) + bitmaps_.capacity() * sizeof(RoaringBitmap) +
+                   numbers_.memoryUsage() + strings_.memoryUsage();
+    for (const auto& value : values_) bytes += heapBytes(value);
+    for (const auto& bitmap : bitmaps_) bytes += bitmap.memoryUsage();
+    return bytes;
+}
+
+void BitmapIndex::build(const vector<Row>& rows) {
+    values_.clear();
+    bitmaps_.clear();
+    numbers_.clear();
+    strings_.clear();
+    for (size_t i = 0; i < rows.size(); ++i) {
+        bitmaps_[addSlot(rows[i][column_idx_])].add(static_cast<uint32_t>(i));
+    }
+}
+
+void BitmapIndex::insert(const Value& key, size_t row) {
+    bitmaps_[addSlot(key)].add(static_cast<uint32_t>(row));
+}
+
+void BitmapIndex::erase(const Value& key, size_t row) {
+    uint32_t slot = slotOf(key);
+    if (slot != FlatHashTable<double>::npos) {
+        bitmaps_[slot].remove(static_cast<uint32_t>(row));
+    }
+}
+
+RoaringBitmap BitmapIndex::lookup(CompareOp op, const Value& constant) const {
+    if (op == CompareOp::EQUAL) {
+        uint32_t slot = slotOf(constant);
+        return slot == FlatHashTable<double>::npos ? RoaringBitmap() : bitmaps_[slot];
+    }
+    
+    // Low cardinality: checking every distinct value is cheap and keeps the type rules of compare.
+    RoaringBitmap result;
+    if (values_.empty()) return result;
+    CompareKernel matches = ConditionEvaluator::kernel(values_[0], constant, op);
+    for (size_t i = 0; i < values_.size(); ++i) {
+        if (matches(values_[i], constant)) {
+            result = RoaringBitmap::unite(result, bitmaps_[i]);
+        }
+    }
+    return result;
+}
+
+// Part VI. Realization of TrigramIndex class in Index.h
+static uint32_t trigramKey(const char* text) {
+    return (static_cast<uint32_t>(static_cast<unsigned char>(text[0])) << 16) |
+           (static_cast<uint32_t>(static_cast<unsigned char>(text[1])) << 8) |
+           static_cast<uint32_t>(static_cast<unsigned char>(text[2]));
+}
+
+TrigramIndex::TrigramIndex(string name, string column, int column_idx)
+    : name_(move(name)), column_(move(column)), column_idx_(column_idx) {}
+
+size_t TrigramIndex::memoryUsage() const {
+    // Each posting is a hash node holding the key, the bitmap and a next pointer.
+    size_t bytes = postings_.bucket_count() * sizeof(void*);
+    for (const auto& [trigram, bitmap] : postings_) {
+        bytes += sizeof(void*) + sizeof(trigram) + sizeof(RoaringBitmap) + bitmap.memoryUsage();
+    }
+    return bytes;
+}
+
+void TrigramIndex::build(const vector<Row>& rows) {
+    postings_.clear();
+    for (size_t i = 0; i < rows.size(); ++i) {
+        insert(rows[i][column_idx_], i);
+    }
+}
+
+void TrigramIndex::insert(const Value& key, size_t row) {
+    const string* text = get_if<string>(&key);
+    if (!text) return;   // LIKE never matches a number
+    for (size_t i = 0; i + 3 <= text->size(); ++i) {
+        postings_[trigramKey(text->data() + i)].add(static_cast<uint32_t>(row));
+    }
+}
+
+void TrigramIndex::erase(const Value& key, size_t row) {
+    const string* text = get_if<string>(&key);
+    if (!text) return;
+    for (size_t i = 0; i + 3 <= text->size(); ++i) {
+        auto it = postings_.find(trigramKey(text->data() + i));
+        if (it == postings_.end()) continue;
+        it->second.remove(static_cast<uint32_t>(row));
+        if (it->second.empty()) postings_.erase(it);
+    }
+}
+
+bool TrigramIndex::candidates(const string& pattern, RoaringBitmap& result) const {
+    bool narrowed = false;
+    for (const auto& literal : LikePattern(pattern).literals()) {
+        for (size_t i = 0; i + 3 <= literal.size(); ++i) {
+            auto it = postings_.find(trigramKey(literal.data() + i));
+            if (it == postings_.end()) {
+                result = RoaringBitmap();
+                return true;
+            }
+            result = narrowed ? RoaringBitmap::intersect(result, it->second) : it->second;
+            narrowed = true;
+            if (result.empty()) return true;
+        }
+    }
+    return narrowed;
+}
+
+// Part VII. Realization of ZoneMap class in Index.h
+void ColumnZone::add(const Value& value) {
+    if (const string* str = get_if<string>(&value)) {
+        if (!has_strings || *str < min_string) min_string = *str;
+        if (!has_strings || *str > max_string) max_string = *str;
+        has_strings = true;
+        return;
+    }
+    
+    double number = numericKey(value);
+    if (number != number) {
+        has_nan = true;
+        return;
+    }
+    if (!has_numbers || number < min_number) min_number = number;
+    if (!has_numbers || number > max_number) max_number = number;
+    has_numbers = true;
+}
+
+// Whether some value in [low, high] can satisfy value <op> constant.
+template<typename T>
+static bool rangeMayMatch(const T& low, const T& high, CompareOp op, const T& constant) {
+    switch (op) {
+        case CompareOp::EQUAL: return !(constant < low) && !(high < constant);
+        case CompareOp::NOT_EQUAL: return !(low == constant && high == constant);
+        case CompareOp::GREATER: return constant < high;
+        case CompareOp::GREATER_EQUAL: return !(high < constant);
+        case CompareOp::LESS: return low < constant;
+        case CompareOp::LESS_EQUAL: return !(constant < low);
+        default: return true;
+    }
+}
+
+bool ColumnZone::mayMatch(CompareOp op, const Value& constant) const {
+    if (const string* str = get_if<string>(&constant)) {
+        if (op == CompareOp::LIKE) {
+            // Strings starting with the prefix form one interval; it overlaps [min, max] unless
+            // max sorts before it or min sorts after it without starting with the prefix.
+            string prefix = LikePattern::prefixOf(*str);
+            return has_strings && !(max_string < prefix) && (!(prefix < min_string) || min_string.compare(0, prefix.size(), prefix) == 0);
+        }
+        if (op == CompareOp::NOT_LIKE) return has_strings;
+    }
+    if (has_nan) return true;
+    if (const string* str = get_if<string>(&constant)) {
+        return has_strings && rangeMayMatch(min_string, max_string, op, *str);
+    }
+    double number = numericKey(constant);
+    if (number != number) return true;
+    return has_numbers && rangeMayMatch(min_number, max_number, op, number);
+}
+
+size_t ZoneMap::memoryUsage() const {
+    size_t bytes = zones_.capacity() * sizeof(ColumnZone);
+    for (const auto& zone : zones_) bytes += heapBytes(zone.min_string) + heapBytes(zone.max_string);
+    return bytes;
+}
+
+void ZoneMap::build(const vector<Row>& rows) {
+    zones_.clear();
+    row_count_ = 0;
+    zones_.reserve(((rows.size() + BLOCK_ROWS - 1) / BLOCK_ROWS) * column_count_);
+    for (const auto& row : rows) {
+        append(row);
+    }
+}
+
+void ZoneMap::append(const Row& row) {
+    if (row_count_ % BLOCK_ROWS == 0) {
+        zones_.resize(zones_.size() + column_count_);
+    }
+    widen(row_count_, row);
+    ++row_count_;
+}
+
+void ZoneMap::widen(size_t row_pos, const Row& row) {
+    ColumnZone* block = &zones_[(row_pos / BLOCK_ROWS) * column_count_];
+    for (size_t col = 0; col < column_count_ && col < row.size(); ++col) {
+        block[col].add(row[col]);
+    }
+}
+
+// Zone map file: magic, stamp, column and row count, then per zone its flags, numeric
+// bounds and length-prefixed string bounds.
+static const char ZONEMAP_MAGIC[8] = {'M', 'S', 'Q', 'L', 'Z', 'O', 'N', '1'};
+
+template<typename T>
+static void writePod(ostream& out, const T& value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<typename T>
+static bool readPod(istream& in, T& value) {
+    return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(value)));
+}
+
+static void writeString(ostream& out, const string& value) {
+    writePod(out, static_cast<uint32_t>(value.size()));
+    out.write(value.data(), value.size());
+}
+
+static bool readString(istream& in, string& value) {
+    uint32_t length;
+    if (!readPod(in, length) || length > (1U << 24)) return false;
+    value.resize(length);
+    return static_cast<bool>(in.read(&value[0], length));
+}
+
+bool ZoneMap::saveToFile(const string& path, const TableFileStamp& stamp) const {
+    string temp_path = path + ".tmp";
+    ofstream file(temp_path, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    file.write(ZONEMAP_MAGIC, sizeof(ZONEMAP_MAGIC));
+    writePod(file, stamp.file_size);
+    writePod(file, stamp.modified_time);
+    writePod(file, stamp.row_count);
+    writePod(file, static_cast<uint64_t>(column_count_));
+    writePod(file, static_cast<uint64_t>(row_count_));
+    for (const auto& zone : zones_) {
+        uint8_t flags = (zone.has_numbers ? 1 : 0) | (zone.has_strings ? 2 : 0) | (zone.has_nan ? 4 : 0);
+        writePod(file, flags);
+        writePod(file, zone.min_number);
+        writePod(file, zone.max_number);
+        writeString(file, zone.min_string);
+        writeString(file, zone.max_string);
+    }
+    file.close();
+    if (!file) {
+        remove(temp_path.c_str());
+        return false;
+    }
+    
+    return rename(temp_path.c_str(), path.c_str()) == 0;
+}
+
+bool ZoneMap::loadFromFile(const string& path, const TableFileStamp& stamp) {
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    char magic[sizeof(ZONEMAP_MAGIC)];
+    TableFileStamp stored;
+    uint64_t column_count, row_count;
+    if (!file.read(magic, sizeof(magic)) || memcmp(magic, ZONEMAP_MAGIC, sizeof(magic)) != 0 ||
+        !readPod(file, stored.file_size) || !readPod(file, stored.modified_time) || !readPod(file, stored.row_count) ||
+        !readPod(file, column_count) || !readPod(file, row_count) ||
+        !(stored == stamp) || column_count != column_count_ || row_count != stamp.row_count) {
+        return false;
+    }
+    
+    vector<ColumnZone> zones(((row_count + BLOCK_ROWS - 1) / BLOCK_ROWS) * column_count);
+    for (auto& zone : zones) {
+        uint8_t flags;
+        if (!readPod(file, flags) || !readPod(file, zone.min_number) || !readPod(file, zone.max_number) ||
+            !readString(file, zone.min_string) || !readString(file, zone.max_string)) {
+            return false;
+        }
+        zone.has_numbers = flags & 1;
+        zone.has_strings = flags & 2;
+        zone.has_nan = flags & 4;
+    }
+    
+    zones_ = move(zones);
+    row_count_ = row_count;
+    return true;
+}
@@ -0,0 +1,338 @@
+#include "../include/PageFile.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+
+// File layout: the header, padded to HEADER_SIZE, followed by pages and page tables in the
+// order they were written. A page holds its rows back to back, every value as [uint8 type]
+// followed by int32, double, or uint32 length + bytes. The header points to the current page
+// table, an array of PageRef; everything it does not reach is garbage.
+namespace {
+
+const size_t HEADER_SIZE = 4096;
+const char PAGE_MAGIC[8] = {'M', 'S', 'Q', 'L', 'P', 'G', 'S', '1'};
+
+// FNV-1a over the page bytes, to notice torn or damaged pages.
+uint64_t checksumOf(const char* data, size_t size) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+void encodeValue(const Value& value, string& out) {
+    if (holds_alternative<int>(value)) {
+        int32_t number = get<int>(value);
+        out += 'I';
+        out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    } else if (holds_alternative<double>(value)) {
+        double number = get<double>(value);
+        out += 'D';
+        out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+    } else {
+        const string& text = get<string>(value);
+        uint32_t length = static_cast<uint32_t>(text.size());
+        out += 'S';
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out += text;
+    }
+}
+
+// Decodes one value from [data, end). Returns the number of bytes used, or 0 if damaged.
+size_t decodeValue(const char* data, const char* end, Value& value) {
+    const char* start = data;
+    if (data >= end) return 0;
+    char type = *data++;
+    if (type == 'I') {
+        int32_t number;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(number))) return 0;
+        memcpy(&number, data, sizeof(number));
+        value = static_cast<int>(number);
+        data += sizeof(number);
+    } else if (type == 'D') {
+        double number;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(number))) return 0;
+        memcpy(&number, data, sizeof(number));
+        value = number;
+        data += sizeof(number);
+    } else if (type == 'S') {
+        uint32_t length;
+        if (end - data < static_cast<ptrdiff_t>(sizeof(length))) return 0;
+        memcpy(&length, data, sizeof(length));
+        data += sizeof(length);
+        if (end - data < static_cast<ptrdiff_t>(length)) return 0;
+        value = string(data, length);
+        data += length;
+    } else {
+        return 0;
+    }
+    return static_cast<size_t>(data - start);
+}
+
+// Rows [begin, end) encoded as one page.
+string encodePage(const vector<Row>& rows, size_t begin, size_t end) {
+    string page;
+    for (size_t i = begin; i < end; ++i) {
+        for (const auto& value : rows[i].values()) {
+            encodeValue(value, page);
+        }
+    }
+    return page;
+}
+
+// Size and modification time of a file; both 0 when it does not exist.
+void stampOf(const string& path, uint64_t& size, int64_t& modified_time) {
+    error_code ec;
+    size = filesystem::file_size(path, ec);
+    if (ec) size = 0;
+    auto modified = filesystem::last_write_time(path, ec);
+    modified_time = ec ? 0 : static_cast<int64_t>(modified.time_since_epoch().count());
+}
+
+}
+
+bool PageFile::open() {
+    open_ = false;
+    pages_.clear();
+    ifstream file(path_, ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+
+    error_code ec;
+    uint64_t file_size = filesystem::file_size(path_, ec);
+    Header header;
+    if (ec || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, PAGE_MAGIC, sizeof(PAGE_MAGIC)) != 0 || header.page_rows != PAGE_ROWS ||
+        header.column_count != column_count_ || header.end_offset > file_size ||
+        header.page_count != (header.row_count + PAGE_ROWS - 1) / PAGE_ROWS ||
+        header.page_table_offset + header.page_count * sizeof(PageRef) > header.end_offset) {
+        return false;
+    }
+
+    vector<PageRef> pages(header.page_count);
+    file.seekg(static_cast<streamoff>(header.page_table_offset));
+    if (!pages.empty() && !file.read(reinterpret_cast<char*>(pages.data()), pages.size() * sizeof(PageRef))) {
+        return false;
+    }
+    uint64_t rows = 0;
+    for (size_t page = 0; page < pages.size(); ++page) {
+        bool last = page + 1 == pages.size();
+        if (pages[page].offset < HEADER_SIZE || pages[page].offset + pages[page].bytes > header.end_offset ||
+            (!last && pages[page].rows != PAGE_ROWS) || pages[page].rows == 0 || pages[page].rows > PAGE_ROWS) {
+            return false;
+        }
+        rows += pages[page].rows;
+    }
+    if (rows != header.row_count) {
+        return false;
+    }
+
+    header_ = header;
+    pages_ = move(pages);
+    open_ = true;
+    return true;
+}
+
+bool PageFile::readRows(vector<Row>& rows) const {
+    ifstream file(path_, ios::binary);
+    if (!open_ || !file.is_open()) {
+        return false;
+    }
+
+    rows.clear();
+    rows.reserve(header_.row_count);
+    string page;
+    for (const auto& ref : pages_) {
+        page.resize(ref.bytes);
+        file.seekg(static_cast<streamoff>(ref.offset));
+        if ((ref.bytes > 0 && !file.read(&page[0], ref.bytes)) || checksumOf(page.data(), page.size()) != ref.checksum) {
+            return false;
+        }
+
+        const char* cursor = page.data();
+        const char* end = cursor + page.size();
+        for (uint32_t i = 0; i < ref.rows; ++i) {
+            vector<Value> values(column_count_);
+            for (auto& value : values) {
+                size_t used = decodeValue(cursor, end, value);
+                if (used == 0) return false;
+                cursor += used;
+            }
+            rows.emplace_back(move(values));
+        }
+        if (cursor != end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool PageFile::write(const vector<Row>& rows, const vector<bool>& dirty) {
+    size_t page_count = (rows.size() + PAGE_ROWS - 1) / PAGE_ROWS;
+    if (!open_) {
+        header_.csv_current = 0;
+        return writeAll(rows);
+    }
+
+    bool changed = page_count != pages_.size();
+    for (size_t page = 0; page < page_count && page < dirty.size() && !changed; ++page) {
+        changed = dirty[page];
+    }
+    if (!changed) {
+        return true;
+    }
+
+    // Compact once the replaced page versions outweigh the live ones.
+    uint64_t used = HEADER_SIZE + header_.live_bytes + pages_.size() * sizeof(PageRef);
+    if (header_.end_offset - used > header_.live_bytes + (1 << 20)) {
+        header_.csv_current = 0;
+        return writeAll(rows);
+    }
+
+    fstream file(path_, ios::in | ios::out | ios::binary);
+    if (!file.is_open()) {
+        open_ = false;
+        header_.csv_current = 0;
+        return writeAll(rows);
+    }
+
+    uint64_t offset = header_.end_offset;
+    file.seekp(static_cast<streamoff>(offset));
+    for (size_t page = page_count; page < pages_.size(); ++page) {
+        header_.live_bytes -= pages_[page].bytes;
+    }
+    size_t old_count = pages_.size();
+    pages_.resize(page_count);
+    for (size_t page = 0; page < page_count; ++page) {
+        if (page < old_count && !(page < dirty.size() && dirty[page])) continue;
+
+        size_t begin = page * PAGE_ROWS;
+        size_t end = min(begin + PAGE_ROWS, rows.size());
+        string data = encodePage(rows, begin, end);
+        if (page < old_count) header_.live_bytes -= pages_[page].bytes;
+        pages_[page] = {offset, static_cast<uint32_t>(data.size()), static_cast<uint32_t>(end - begin), checksumOf(data.data(), data.size())};
+        file.write(data.data(), data.size());
+        offset += data.size();
+        header_.live_bytes += data.size();
+    }
+
+    header_.page_table_offset = offset;
+    if (!pages_.empty()) {
+        file.write(reinterpret_cast<const char*>(pages_.data()), pages_.size() * sizeof(PageRef));
+    }
+    header_.end_offset = offset + pages_.size() * sizeof(PageRef);
+    header_.page_count = pages_.size();
+    header_.row_count = rows.size();
+    header_.csv_current = 0;
+
+    // The header goes last: until it is written, the old page table stays valid.
+    file.flush();
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    file.close();
+    if (!file) {
+        open_ = false;
+        return false;
+    }
+    return true;
+}
+
+void PageFile::setCsvRead(const string& csv_file) {
+    error_code ec;
+    filesystem::remove(path_, ec);
+    header_ = {};
+    pages_.clear();
+    open_ = false;
+    stampOf(csv_file, header_.csv_size, header_.csv_modified_time);
+    header_.csv_current = 1;
+}
+
+bool PageFile::writeAll(const vector<Row>& rows) {
+    // Write to a temporary file first so a crash never leaves a half-written page file behind.
+    string temp_path = path_ + ".tmp";
+    ofstream file(temp_path, ios::binary | ios::trunc);
+    if (!file.is_open()) {
+        open_ = false;
+        return false;
+    }
+
+    string padding(HEADER_SIZE, '\0');
+    file.write(padding.data(), padding.size());
+
+    uint64_t offset = HEADER_SIZE;
+    vector<PageRef> pages;
+    pages.reserve((rows.size() + PAGE_ROWS - 1) / PAGE_ROWS);
+    for (size_t begin = 0; begin < rows.size(); begin += PAGE_ROWS) {
+        size_t end = min(begin + PAGE_ROWS, rows.size());
+        string data = encodePage(rows, begin, end);
+        pages.push_back({offset, static_cast<uint32_t>(data.size()), static_cast<uint32_t>(end - begin), checksumOf(data.data(), data.size())});
+        file.write(data.data(), data.size());
+        offset += data.size();
+    }
+    if (!pages.empty()) {
+        file.write(reinterpret_cast<const char*>(pages.data()), pages.size() * sizeof(PageRef));
+    }
+
+    memcpy(header_.magic, PAGE_MAGIC, sizeof(PAGE_MAGIC));
+    header_.page_rows = static_cast<uint32_t>(PAGE_ROWS);
+    header_.column_count = static_cast<uint32_t>(column_count_);
+    header_.row_count = rows.size();
+    header_.page_count = pages.size();
+    header_.page_table_offset = offset;
+    header_.end_offset = offset + pages.size() * sizeof(PageRef);
+    header_.live_bytes = offset - HEADER_SIZE;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    file.close();
+    if (!file || rename(temp_path.c_str(), path_.c_str()) != 0) {
+        remove(temp_path.c_str());
+        open_ = false;
+        return false;
+    }
+
+    pages_ = move(pages);
+    open_ = true;
+    return true;
+}
+
+bool PageFile::matchesCsv(const string& csv_file) const {
+    uint64_t size;
+    int64_t modified_time;
+    stampOf(csv_file, size, modified_time);
+    return open_ && size == header_.csv_size && modified_time == header_.csv_modified_time;
+}
+
+bool PageFile::setCsvWritten(const string& csv_file) {
+    stampOf(csv_file, header_.csv_size, header_.csv_modified_time);
+    header_.csv_current = 1;
+    return !open_ || writeHeader();
+}
+
+bool PageFile::csvBehind(const string& path, const string& csv_file) {
+    ifstream file(path, ios::binary);
+    Header header;
+    if (!file.is_open() || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+        memcmp(header.magic, PAGE_MAGIC, sizeof(PAGE_MAGIC)) != 0 || header.csv_current != 0) {
+        return false;
+    }
+    uint64_t size;
+    int64_t modified_time;
+    stampOf(csv_file, size, modified_time);
+    return size == header.csv_size && modified_time == header.csv_modified_time;
+}
+
+bool PageFile::writeHeader() {
+    fstream file(path_, ios::in | ios::out | ios::binary);
+    if (!file.is_open()) {
+        open_ = false;
+        return false;
+    }
+    file.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    file.close();
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,807 @@
+#include "../include/Parser.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+// Realization of the tokenizer and parser defined in Parser.h
+// Part I. Tokenizer
+vector<Token> tokenize(string_view sql) {
+    vector<Token> tokens;
+    tokens.reserve(sql.size() / 4 + 2);
+    size_t i = 0;
+    while (i < sql.size()) {
+        unsigned char c = static_cast<unsigned char>(sql[i]);
+        if (isspace(c)) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        if (isalpha(c) || c == '_') {
+            while (i < sql.size() && (isalnum(static_cast<unsigned char>(sql[i])) || sql[i] == '_')) ++i;
+            tokens.push_back({TokenType::IDENTIFIER, sql.substr(start, i - start), start});
+        } else if (isdigit(c) || (c == '.' && i + 1 < sql.size() && isdigit(static_cast<unsigned char>(sql[i + 1])))) {
+            while (i < sql.size() && isdigit(static_cast<unsigned char>(sql[i]))) ++i;
+            if (i < sql.size() && sql[i] == '.') {
+                ++i;
+                while (i < sql.size() && isdigit(static_cast<unsigned char>(sql[i]))) ++i;
+            }
+            if (i < sql.size() && (sql[i] == 'e' || sql[i] == 'E')) {
+                size_t exponent = i + 1;
+                if (exponent < sql.size() && (sql[exponent] == '+' || sql[exponent] == '-')) ++exponent;
+                if (exponent < sql.size() && isdigit(static_cast<unsigned char>(sql[exponent]))) {
+                    i = exponent;
+                    while (i < sql.size() && isdigit(static_cast<unsigned char>(sql[i]))) ++i;
+                }
+            }
+            tokens.push_back({TokenType::NUMBER, sql.substr(start, i - start), start});
+        } else if (c == '\'') {
+            ++i;
+            while (true) {
+                if (i >= sql.size()) {
+                    throw SqlSyntaxError("Unterminated string starting at position " + to_string(start));
+                }
+                if (sql[i] == '\'') {
+                    if (i + 1 < sql.size() && sql[i + 1] == '\'') {
+                        i += 2;
+                        continue;
+                    }
+                    break;
+                }
+                ++i;
+            }
+            tokens.push_back({TokenType::STRING, sql.substr(start + 1, i - start - 1), start});
+            ++i;
+        } else if ((c == '<' || c == '>' || c == '!') && i + 1 < sql.size() && sql[i + 1] == '=') {
+            tokens.push_back({TokenType::SYMBOL, sql.substr(start, 2), start});
+            i += 2;
+        } else if (c == '<' && i + 1 < sql.size() && sql[i + 1] == '>') {
+            tokens.push_back({TokenType::SYMBOL, sql.substr(start, 2), start});
+            i += 2;
+        } else if (string_view("(),.*/%;=<>+-?").find(static_cast<char>(c)) != string_view::npos) {
+            tokens.push_back({TokenType::SYMBOL, sql.substr(start, 1), start});
+            ++i;
+        } else {
+            throw SqlSyntaxError("Unexpected character '" + string(1, static_cast<char>(c)) + "' at position " + to_string(start));
+        }
+    }
+    tokens.push_back({TokenType::END, string_view(), sql.size()});
+    return tokens;
+}
+
+static string toUpper(string_view text);
+
+string normalizeStatement(string_view sql) {
+    static const char* const keywords[] = {"SELECT", "FROM", "WHERE", "AND", "OR", "NOT", "JOIN", "ON",
+                                           "IN", "EXISTS", "LIKE", "COUNT", "SAVE", "AS",
+                                           "CASE", "WHEN", "THEN", "ELSE", "END"};
+    string normalized;
+    normalized.reserve(sql.size());
+    for (const auto& token : tokenize(sql)) {
+        if (token.type == TokenType::END) break;
+        if (!normalized.empty()) normalized += ' ';
+        if (token.type == TokenType::STRING) {
+            normalized += '\'';
+            normalized += token.text;
+            normalized += '\'';
+        } else if (token.type == TokenType::IDENTIFIER) {
+            string upper = toUpper(token.text);
+            bool keyword = any_of(begin(keywords), end(keywords), [&upper](const char* k) { return upper == k; });
+            normalized += keyword ? upper : string(token.text);
+        } else {
+            normalized += token.text;
+        }
+    }
+    return normalized;
+}
+
+static string unescapeString(string_view text) {
+    string result;
+    result.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        result += text[i];
+        if (text[i] == '\'') ++i;   // '' stands for one quote
+    }
+    return result;
+}
+
+static string toUpper(string_view text) {
+    string result(text);
+    for (auto& c : result) c = static_cast<char>(toupper(static_cast<unsigned char>(c)));
+    return result;
+}
+
+Value numberValue(const string& text) {
+    if (text.find_first_of(".eE") == string::npos) {
+        try {
+            return stoi(text);
+        } catch (const out_of_range&) {
+        }
+    }
+    return stod(text);
+}
+
+Value literalValue(const SqlExpr& literal) {
+    if (literal.kind == ExprKind::NUMBER) {
+        return numberValue(literal.text);
+    }
+    if (literal.kind == ExprKind::PARAMETER) {
+        throw runtime_error("Parameter ? can only be used in a prepared statement");
+    }
+    return literal.text;
+}
+
+Value assignmentValue(const Value& value, const string& type) {
+    if (type == "INT" || type == "DOUBLE") {
+        double number = 0.0;
+        if (holds_alternative<int>(value)) {
+            number = get<int>(value);
+        } else if (holds_alternative<double>(value)) {
+            number = get<double>(value);
+        } else {
+            try {
+                number = stod(get<string>(value));
+            } catch (...) {
+                number = 0.0;
+            }
+        }
+        if (type == "DOUBLE") return number;
+        return holds_alternative<int>(value) ? get<int>(value) : static_cast<int>(number);
+    }
+    
+    if (holds_alternative<string>(value)) return value;
+    ostringstream text;
+    visit([&text](auto&& arg) { text << arg; }, value);
+    return text.str();
+}
+
+const char* compareOpText(CompareOp op) {
+    switch (op) {
+        case CompareOp::EQUAL: return "=";
+        case CompareOp::NOT_EQUAL: return "<>";
+        case CompareOp::GREATER: return ">";
+        case CompareOp::LESS: return "<";
+        case CompareOp::GREATER_EQUAL: return ">=";
+        case CompareOp::LESS_EQUAL: return "<=";
+        case CompareOp::LIKE: return "LIKE";
+        default: return "NOT LIKE";
+    }
+}
+
+static string quoted(const string& text) {
+    string result = "'";
+    for (char c : text) {
+        result += c;
+        if (c == '\'') result += '\'';
+    }
+    return result + "'";
+}
+
+string formatLiteral(const Value& value) {
+    if (const string* text = get_if<string>(&value)) return quoted(*text);
+    ostringstream text;
+    visit([&text](auto&& arg) { text << arg; }, value);
+    return text.str();
+}
+
+string formatSubquery(const Subquery& subquery) {
+    string text = "(SELECT " + (subquery.kind == SubqueryKind::IN ? subquery.select_column : string("*")) + " FROM " + subquery.table;
+    if (subquery.where) text += " WHERE " + formatExpression(*subquery.where);
+    return text + ")";
+}
+
+string formatExpression(const SqlExpr& expression) {
+    // An operand of the same AND / OR chain needs no parentheses.
+    auto operand = [&expression](const shared_ptr<const SqlExpr>& child) {
+        string text = formatExpression(*child);
+        bool compound = child->kind == ExprKind::COMPARE || child->kind == ExprKind::LIKE || child->kind == ExprKind::IN_SUBQUERY ||
+                        child->kind == ExprKind::ARITHMETIC || ((child->kind == ExprKind::AND || child->kind == ExprKind::OR) && child->kind != expression.kind);
+        return compound ? "(" + text + ")" : text;
+    };
+    switch (expression.kind) {
+        case ExprKind::COLUMN:
+        case ExprKind::NUMBER: return expression.text;
+        case ExprKind::STRING: return quoted(expression.text);
+        case ExprKind::PARAMETER: return "?";
+        case ExprKind::COMPARE:
+        case ExprKind::LIKE: return operand(expression.left) + " " + compareOpText(expression.op) + " " + operand(expression.right);
+        case ExprKind::IN_SUBQUERY: return operand(expression.left) + " IN " + formatSubquery(*expression.subquery);
+        case ExprKind::EXISTS: return "EXISTS " + formatSubquery(*expression.subquery);
+        case ExprKind::AND: return operand(expression.left) + " AND " + operand(expression.right);
+        case ExprKind::OR: return operand(expression.left) + " OR " + operand(expression.right);
+        case ExprKind::NOT: return "NOT " + operand(expression.left);
+        case ExprKind::ARITHMETIC: return operand(expression.left) + " " + expression.text + " " + operand(expression.right);
+        case ExprKind::NEGATE: return "-" + operand(expression.left);
+        case ExprKind::WHEN: return "WHEN " + formatExpression(*expression.left) + " THEN " + formatExpression(*expression.right);
+        case ExprKind::CASE: {
+            string text = "CASE";
+            const SqlExpr* branch = &expression;
+            while (branch->kind == ExprKind::CASE) {
+                text += " " + formatExpression(*branch->left);
+                branch = branch->right.get();
+            }
+            return text + " ELSE " + formatExpression(*branch) + " END";
+        }
+    }
+    return expression.text;
+}
+
+// Part II. Parser helpers
+SqlParser::SqlParser(string_view sql) : sql_(sql), tokens_(tokenize(sql)) {}
+
+const Token& SqlParser::peek(size_t ahead) const {
+    return tokens_[min(pos_ + ahead, tokens_.size() - 1)];
+}
+
+const Token& SqlParser::next() {
+    const Token& token = tokens_[pos_];
+    if (token.type != TokenType::END) ++pos_;
+    return token;
+}
+
+bool SqlParser::isKeyword(const Token& token, string_view keyword) const {
+    if (token.type != TokenType::IDENTIFIER || token.text.size() != keyword.size()) return false;
+    for (size_t i = 0; i < keyword.size(); ++i) {
+        if (toupper(static_cast<unsigned char>(token.text[i])) != keyword[i]) return false;
+    }
+    return true;
+}
+
+bool SqlParser::isSymbol(const Token& token, string_view symbol) const {
+    return token.type == TokenType::SYMBOL && token.text == symbol;
+}
+
+bool SqlParser::acceptKeyword(string_view keyword) {
+    if (!isKeyword(peek(), keyword)) return false;
+    ++pos_;
+    return true;
+}
+
+bool SqlParser::acceptSymbol(string_view symbol) {
+    if (!isSymbol(peek(), symbol)) return false;
+    ++pos_;
+    return true;
+}
+
+void SqlParser::expectKeyword(string_view keyword) {
+    if (!acceptKeyword(keyword)) fail(string(keyword));
+}
+
+void SqlParser::expectSymbol(string_view symbol) {
+    if (!acceptSymbol(symbol)) fail("'" + string(symbol) + "'");
+}
+
+string SqlParser::expectIdentifier(const char* what) {
+    if (peek().type != TokenType::IDENTIFIER) fail(what);
+    return string(next().text);
+}
+
+void SqlParser::expectEnd() {
+    if (peek().type != TokenType::END) fail("end of command");
+}
+
+void SqlParser::fail(const string& expected) const {
+    const Token& token = peek();
+    if (token.type == TokenType::END) {
+        throw SqlSyntaxError("Expected " + expected + " at end of command");
+    }
+    string shown = token.type == TokenType::STRING ? "'" + string(token.text) + "'" : string(token.text);
+    throw SqlSyntaxError("Expected " + expected + " near '" + shown + "' at position " + to_string(token.pos));
+}
+
+// Part III. Statements
+Statement SqlParser::parseStatement() {
+    Statement statement;
+    if (acceptKeyword("SELECT")) {
+        statement = parseSelect();
+    } else if (acceptKeyword("INSERT")) {
+        statement = parseInsert();
+    } else if (acceptKeyword("UPDATE")) {
+        statement = parseUpdate();
+    } else if (acceptKeyword("DELETE")) {
+        statement = parseDelete();
+    } else if (acceptKeyword("CREATE")) {
+        if (acceptKeyword("TABLE")) {
+            statement = parseCreateTable();
+        } else if (acceptKeyword("INDEX")) {
+            statement = parseCreateIndex(IndexKind::BTREE);
+        } else if (acceptKeyword("BITMAP")) {
+            expectKeyword("INDEX");
+            statement = parseCreateIndex(IndexKind::BITMAP);
+        } else if (acceptKeyword("TRIGRAM")) {
+            expectKeyword("INDEX");
+            statement = parseCreateIndex(IndexKind::TRIGRAM);
+        } else {
+            fail("TABLE or [BITMAP | TRIGRAM] INDEX");
+        }
+    } else if (acceptKeyword("DROP")) {
+        if (acceptKeyword("TABLE")) {
+            statement = DropTableStatement{expectIdentifier("table name")};
+        } else if (acceptKeyword("INDEX")) {
+            DropIndexStatement drop;
+            drop.index = expectIdentifier("index name");
+            if (acceptKeyword("ON")) drop.table = expectIdentifier("table name");
+            statement = drop;
+        } else {
+            fail("TABLE or INDEX");
+        }
+    } else if (acceptKeyword("SHOW")) {
+        if (acceptKeyword("TABLES")) statement = ShowStatement{ShowStatement::What::TABLES};
+        else if (acceptKeyword("INDEXES")) statement = ShowStatement{ShowStatement::What::INDEXES};
+        else if (acceptKeyword("STATS")) statement = ShowStatement{ShowStatement::What::STATS};
+        else if (acceptKeyword("CACHE")) statement = ShowStatement{ShowStatement::What::CACHE};
+        else fail("TABLES, INDEXES, STATS or CACHE");
+    } else if (acceptKeyword("SET")) {
+        statement = parseSet();
+    } else if (acceptKeyword("PREPARE")) {
+        statement = parsePrepare();
+    } else if (acceptKeyword("EXECUTE")) {
+        statement = parseExecute();
+    } else if (acceptKeyword("DEALLOCATE")) {
+        acceptKeyword("PREPARE");
+        statement = DeallocateStatement{expectIdentifier("statement name")};
+    } else if (acceptKeyword("EXPLAIN")) {
+        ExplainStatement explain;
+        explain.analyze = acceptKeyword("ANALYZE");
+        expectKeyword("SELECT");
+        explain.query = parseSelect();
+        if (!explain.query.save_as.empty()) {
+            throw SqlSyntaxError("EXPLAIN cannot be used with SAVE AS");
+        }
+        statement = explain;
+    } else if (acceptKeyword("HELP")) {
+        statement = HelpStatement{};
+    } else if (acceptKeyword("EXIT")) {
+        statement = ExitStatement{};
+    } else {
+        throw SqlSyntaxError("Unknown command. Type 'HELP;' for available commands");
+    }
+    expectEnd();
+    return statement;
+}
+
+// CREATE TABLE <name> (<column> <type> [PRIMARY KEY | UNIQUE], ... [, PRIMARY KEY (<column>)] [, UNIQUE (<column>)])
+CreateTableStatement SqlParser::parseCreateTable() {
+    CreateTableStatement create;
+    create.table = expectIdentifier("table name");
+    expectSymbol("(");
+
+    // Table-level constraints, applied once all columns are known.
+    vector<pair<string, bool>> key_constraints;
+    do {
+        bool is_primary_key = isKeyword(peek(), "PRIMARY") && isKeyword(peek(1), "KEY");
+        if (is_primary_key || (isKeyword(peek(), "UNIQUE") && isSymbol(peek(1), "("))) {
+            pos_ += is_primary_key ? 2 : 1;
+            expectSymbol("(");
+            key_constraints.push_back({expectIdentifier("column name"), is_primary_key});
+            expectSymbol(")");
+            continue;
+        }
+        create.columns.push_back(parseColumnDefinition());
+    } while (acceptSymbol(","));
+    expectSymbol(")");
+
+    for (const auto& [column_name, is_primary_key] : key_constraints) {
+        auto it = find_if(create.columns.begin(), create.columns.end(), [&column_name](const Column& col) { return col.name == column_name; });
+        if (it == create.columns.end()) {
+            throw SqlSyntaxError("Key constraint on unknown column: " + column_name);
+        }
+        it->primary_key = it->primary_key || is_primary_key;
+        it->unique = true;
+    }
+    if (count_if(create.columns.begin(), create.columns.end(), [](const Column& col) { return col.primary_key; }) > 1) {
+        throw SqlSyntaxError("A table can only have one PRIMARY KEY column");
+    }
+    return create;
+}
+
+Column SqlParser::parseColumnDefinition() {
+    Column col;
+    col.name = expectIdentifier("column name");
+    string type = toUpper(expectIdentifier("column type"));
+
+    if (type.find("INT") == 0) {
+        col.type = "INT";
+    } else if (type.find("DOUBLE") == 0) {
+        col.type = "DOUBLE";
+    } else {
+        if (type.find("VARCHAR") != 0) {
+            cerr << "Warning: Unrecognized type '" << type << "', defaulting to VARCHAR" << endl;
+        }
+        col.type = "VARCHAR";
+        col.varchar_length = 255;
+    }
+    if (acceptSymbol("(")) {
+        if (peek().type != TokenType::NUMBER) fail("type length");
+        size_t length = stoul(string(next().text));
+        if (col.type == "VARCHAR") col.varchar_length = length;
+        expectSymbol(")");
+    }
+
+    while (true) {
+        if (acceptKeyword("PRIMARY")) {
+            expectKeyword("KEY");
+            col.primary_key = true;
+        } else if (acceptKeyword("UNIQUE")) {
+            col.unique = true;
+        } else {
+            break;
+        }
+    }
+    col.unique = col.unique || col.primary_key;
+    return col;
+}
+
+// CREATE [BITMAP | TRIGRAM] INDEX <name> ON <table>(<column>) [INCLUDE (<column>, ...)]
+CreateIndexStatement SqlParser::parseCreateIndex(IndexKind kind) {
+    CreateIndexStatement create;
+    create.kind = kind;
+    create.index = expectIdentifier("index name");
+    expectKeyword("ON");
+    create.table = expectIdentifier("table name");
+    expectSymbol("(");
+    create.column = expectIdentifier("column name");
+    expectSymbol(")");
+    if (acceptKeyword("INCLUDE")) {
+        expectSymbol("(");
+        do {
+            create.include_columns.push_back(expectIdentifier("column name"));
+        } while (acceptSymbol(","));
+        expectSymbol(")");
+    }
+    return create;
+}
+
+// INSERT [OR REPLACE] INTO <table> VALUES (<value>, ...)
+InsertStatement SqlParser::parseInsert() {
+    InsertStatement insert;
+    if (acceptKeyword("OR")) {
+        expectKeyword("REPLACE");
+        insert.replace = true;
+    }
+    expectKeyword("INTO");
+    insert.table = expectIdentifier("table name");
+    expectKeyword("VALUES");
+    expectSymbol("(");
+    // A quoted string, a signed number, a bare word taken as a string, or ?.
+    do {
+        insert.values.push_back(parseOperand());
+    } while (acceptSymbol(","));
+    expectSymbol(")");
+    return insert;
+}
+
+// SELECT <columns> | * | COUNT(*) FROM <table> [[INNER] JOIN <table> ON <condition>] [WHERE <condition>] [SAVE AS <table>]
+SelectStatement SqlParser::parseSelect() {
+    SelectStatement select;
+    if (isKeyword(peek(), "COUNT") && isSymbol(peek(1), "(")) {
+        pos_ += 2;
+        expectSymbol("*");
+        expectSymbol(")");
+        select.count_star = true;
+    } else if (acceptSymbol("*")) {
+        select.columns.push_back("*");
+    } else {
+        // Items are kept as written; plain column lists need no expressions.
+        bool computed = false;
+        do {
+            size_t start = peek().pos;
+            auto item = parseOr();
+            const Token& last = tokens_[pos_ - 1];
+            size_t end = last.pos + last.text.size() + (last.type == TokenType::STRING ? 2 : 0);
+            string name = item->kind == ExprKind::COLUMN ? item->text : string(sql_.substr(start, end - start));
+            if (acceptKeyword("AS")) {
+                name = expectIdentifier("column alias");
+                computed = true;
+            }
+            computed = computed || item->kind != ExprKind::COLUMN;
+            select.columns.push_back(move(name));
+            select.expressions.push_back(move(item));
+        } while (acceptSymbol(","));
+        if (!computed) {
+            select.expressions.clear();
+        }
+    }
+
+    expectKeyword("FROM");
+    select.table = expectIdentifier("table name");
+    bool inner = acceptKeyword("INNER");
+    if (acceptKeyword("JOIN")) {
+        select.join_table = expectIdentifier("table name");
+        expectKeyword("ON");
+        select.join = parseJoinCondition();
+    } else if (inner) {
+        fail("JOIN");
+    }
+    if (acceptKeyword("WHERE")) {
+        select.where = parseOr();
+    }
+    if (acceptKeyword("SAVE")) {
+        expectKeyword("AS");
+        select.save_as = expectIdentifier("table name");
+    }
+
+    if (select.join_table.empty() && !select.save_as.empty()) {
+        throw SqlSyntaxError("SAVE AS needs a JOIN query");
+    }
+    if (!select.join_table.empty() && select.count_star) {
+        throw SqlSyntaxError("COUNT(*) is not supported on JOIN queries");
+    }
+    return select;
+}
+
+// <table>.<column> = <table>.<column> [AND ...]; every further pair is oriented like the first.
+JoinCondition SqlParser::parseJoinCondition() {
+    JoinCondition condition;
+    do {
+        string left_table = expectIdentifier("table name");
+        expectSymbol(".");
+        string left_column = expectIdentifier("column name");
+        expectSymbol("=");
+        string right_table = expectIdentifier("table name");
+        expectSymbol(".");
+        string right_column = expectIdentifier("column name");
+
+        if (condition.left_table.empty()) {
+            condition.left_table = left_table;
+            condition.left_column = left_column;
+            condition.right_table = right_table;
+            condition.right_column = right_column;
+            condition.op = CompareOp::EQUAL;
+        } else if (left_table == condition.left_table && right_table == condition.right_table) {
+            condition.extra_keys.emplace_back(left_column, right_column);
+        } else if (left_table == condition.right_table && right_table == condition.left_table) {
+            condition.extra_keys.emplace_back(right_column, left_column);
+        } else {
+            throw SqlSyntaxError("Every JOIN key must compare the same two tables");
+        }
+    } while (acceptKeyword("AND"));
+    return condition;
+}
+
+// UPDATE <table> SET <column> = <value>, ... [WHERE <condition>]
+UpdateStatement SqlParser::parseUpdate() {
+    UpdateStatement update;
+    update.table = expectIdentifier("table name");
+    expectKeyword("SET");
+    do {
+        string column = expectIdentifier("column name");
+        expectSymbol("=");
+        update.assignments.emplace_back(column, parseOr());
+    } while (acceptSymbol(","));
+    if (acceptKeyword("WHERE")) {
+        update.where = parseOr();
+    }
+    return update;
+}
+
+// DELETE FROM <table> [WHERE <condition>]
+DeleteStatement SqlParser::parseDelete() {
+    DeleteStatement remove;
+    expectKeyword("FROM");
+    remove.table = expectIdentifier("table name");
+    if (acceptKeyword("WHERE")) {
+        remove.where = parseOr();
+    }
+    return remove;
+}
+
+// SET <name> [=] <value>, the value is kept as text, e.g. 64M
+SetStatement SqlParser::parseSet() {
+    SetStatement set;
+    set.name = toUpper(expectIdentifier("setting name"));
+    acceptSymbol("=");
+    while (peek().type != TokenType::END) {
+        set.value += next().text;
+    }
+    return set;
+}
+
+// PREPARE <name> AS <statement>
+PrepareStatement SqlParser::parsePrepare() {
+    PrepareStatement prepare;
+    prepare.name = expectIdentifier("statement name");
+    expectKeyword("AS");
+    if (peek().type == TokenType::END) fail("statement");
+    prepare.sql = string(sql_.substr(peek().pos));
+    pos_ = tokens_.size() - 1;
+    return prepare;
+}
+
+// EXECUTE <name>[(<value>, ...)]
+ExecuteStatement SqlParser::parseExecute() {
+    ExecuteStatement execute;
+    execute.name = expectIdentifier("statement name");
+    if (acceptSymbol("(") && !acceptSymbol(")")) {
+        do {
+            if (isSymbol(peek(), "?")) fail("value");
+            execute.parameters.push_back(literalValue(*parseOperand()));
+        } while (acceptSymbol(","));
+        expectSymbol(")");
+    }
+    return execute;
+}
+
+string SqlParser::parseColumnRef() {
+    string name = expectIdentifier("column name");
+    if (acceptSymbol(".")) {
+        name += ".";
+        name += expectIdentifier("column name");
+    }
+    return name;
+}
+
+// Part IV. Expressions
+shared_ptr<const SqlExpr> SqlParser::parseCondition() {
+    auto expression = parseOr();
+    expectEnd();
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseOr() {
+    auto expression = parseAnd();
+    while (acceptKeyword("OR")) {
+        expression = make_shared<const SqlExpr>(SqlExpr{ExprKind::OR, "", CompareOp::EQUAL, expression, parseAnd(), nullptr, 0});
+    }
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseAnd() {
+    auto expression = parseNot();
+    while (acceptKeyword("AND")) {
+        expression = make_shared<const SqlExpr>(SqlExpr{ExprKind::AND, "", CompareOp::EQUAL, expression, parseNot(), nullptr, 0});
+    }
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseNot() {
+    if (acceptKeyword("NOT")) {
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::NOT, "", CompareOp::EQUAL, parseNot(), nullptr, nullptr, 0});
+    }
+    return parsePredicate();
+}
+
+shared_ptr<const SqlExpr> SqlParser::parsePredicate() {
+    if (isKeyword(peek(), "EXISTS") && isSymbol(peek(1), "(")) {
+        ++pos_;
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::EXISTS, "", CompareOp::EQUAL, nullptr, nullptr, parseSubquery(SubqueryKind::EXISTS), 0});
+    }
+
+    auto left = parseAdditive();
+    bool negate = acceptKeyword("NOT");
+    if (acceptKeyword("LIKE")) {
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::LIKE, "", negate ? CompareOp::NOT_LIKE : CompareOp::LIKE, left, parseOperand(), nullptr, 0});
+    }
+    if (acceptKeyword("IN")) {
+        auto in = make_shared<const SqlExpr>(SqlExpr{ExprKind::IN_SUBQUERY, "", CompareOp::EQUAL, left, nullptr, parseSubquery(SubqueryKind::IN), 0});
+        if (!negate) return in;
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::NOT, "", CompareOp::EQUAL, in, nullptr, nullptr, 0});
+    }
+    if (negate) fail("LIKE or IN");
+
+    // Without a comparison the operand stands for itself: a value in a SELECT list, or a
+    // parenthesized condition.
+    const Token& token = peek();
+    CompareOp op;
+    if (isSymbol(token, "=")) op = CompareOp::EQUAL;
+    else if (isSymbol(token, "<>") || isSymbol(token, "!=")) op = CompareOp::NOT_EQUAL;
+    else if (isSymbol(token, ">")) op = CompareOp::GREATER;
+    else if (isSymbol(token, "<")) op = CompareOp::LESS;
+    else if (isSymbol(token, ">=")) op = CompareOp::GREATER_EQUAL;
+    else if (isSymbol(token, "<=")) op = CompareOp::LESS_EQUAL;
+    else return left;
+    ++pos_;
+    return make_shared<const SqlExpr>(SqlExpr{ExprKind::COMPARE, "", op, left, parseAdditive(), nullptr, 0});
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseAdditive() {
+    auto expression = parseMultiplicative();
+    while (isSymbol(peek(), "+") || isSymbol(peek(), "-")) {
+        string op(next().text);
+        expression = make_shared<const SqlExpr>(SqlExpr{ExprKind::ARITHMETIC, op, CompareOp::EQUAL, expression, parseMultiplicative(), nullptr, 0});
+    }
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseMultiplicative() {
+    auto expression = parseUnary();
+    while (isSymbol(peek(), "*") || isSymbol(peek(), "/") || isSymbol(peek(), "%")) {
+        string op(next().text);
+        expression = make_shared<const SqlExpr>(SqlExpr{ExprKind::ARITHMETIC, op, CompareOp::EQUAL, expression, parseUnary(), nullptr, 0});
+    }
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseUnary() {
+    // A sign directly before a number belongs to the literal, see parseOperand.
+    if ((isSymbol(peek(), "-") || isSymbol(peek(), "+")) && peek(1).type != TokenType::NUMBER) {
+        bool minus = next().text == "-";
+        auto operand = parseUnary();
+        if (!minus) return operand;
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::NEGATE, "-", CompareOp::EQUAL, operand, nullptr, nullptr, 0});
+    }
+    return parsePrimary();
+}
+
+shared_ptr<const SqlExpr> SqlParser::parsePrimary() {
+    if (acceptSymbol("(")) {
+        auto expression = parseOr();
+        expectSymbol(")");
+        return expression;
+    }
+    if (acceptKeyword("CASE")) {
+        return parseCase();
+    }
+    return parseOperand();
+}
+
+// CASE [<value>] WHEN <condition or value> THEN <value> ... ELSE <value> END; with a value
+// after CASE, every WHEN compares it for equality.
+shared_ptr<const SqlExpr> SqlParser::parseCase() {
+    shared_ptr<const SqlExpr> operand;
+    if (!isKeyword(peek(), "WHEN")) {
+        operand = parseAdditive();
+    }
+    vector<shared_ptr<const SqlExpr>> branches;
+    expectKeyword("WHEN");
+    do {
+        auto condition = operand ? parseAdditive() : parseOr();
+        if (operand) {
+            condition = make_shared<const SqlExpr>(SqlExpr{ExprKind::COMPARE, "", CompareOp::EQUAL, operand, condition, nullptr, 0});
+        }
+        expectKeyword("THEN");
+        branches.push_back(make_shared<const SqlExpr>(SqlExpr{ExprKind::WHEN, "", CompareOp::EQUAL, condition, parseOr(), nullptr, 0}));
+    } while (acceptKeyword("WHEN"));
+    expectKeyword("ELSE");
+    auto expression = parseOr();
+    expectKeyword("END");
+    for (auto it = branches.rbegin(); it != branches.rend(); ++it) {
+        expression = make_shared<const SqlExpr>(SqlExpr{ExprKind::CASE, "", CompareOp::EQUAL, *it, expression, nullptr, 0});
+    }
+    return expression;
+}
+
+shared_ptr<const SqlExpr> SqlParser::parseOperand() {
+    const Token& token = peek();
+    if (token.type == TokenType::STRING) {
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::STRING, unescapeString(next().text), CompareOp::EQUAL, nullptr, nullptr, nullptr, 0});
+    }
+    if (token.type == TokenType::IDENTIFIER) {
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::COLUMN, parseColumnRef(), CompareOp::EQUAL, nullptr, nullptr, nullptr, 0});
+    }
+    if (isSymbol(token, "?")) {
+        ++pos_;
+        return make_shared<const SqlExpr>(SqlExpr{ExprKind::PARAMETER, "?", CompareOp::EQUAL, nullptr, nullptr, nullptr, parameter_count_++});
+    }
+    string sign;
+    if ((isSymbol(token, "-") || isSymbol(token, "+")) && peek(1).type == TokenType::NUMBER) {
+        sign = string(next().text);
+    }
+    if (peek().type != TokenType::NUMBER) fail("column or value");
+    return make_shared<const SqlExpr>(SqlExpr{ExprKind::NUMBER, sign + string(next().text), CompareOp::EQUAL, nullptr, nullptr, nullptr, 0});
+}
+
+// (SELECT <column> | * FROM <table> [WHERE <condition>])
+shared_ptr<const Subquery> SqlParser::parseSubquery(SubqueryKind kind) {
+    expectSymbol("(");
+    expectKeyword("SELECT");
+    auto subquery = make_shared<Subquery>();
+    subquery->kind = kind;
+    if (acceptSymbol("*")) {
+        subquery->select_column = "*";
+    } else {
+        subquery->select_column = parseColumnRef();
+    }
+    if (kind == SubqueryKind::IN && (subquery->select_column == "*" || isSymbol(peek(), ","))) {
+        throw SqlSyntaxError("IN subquery must select exactly one column");
+    }
+    expectKeyword("FROM");
+    subquery->table = expectIdentifier("table name");
+    if (acceptKeyword("WHERE")) {
+        subquery->where = parseOr();
+    }
+    expectSymbol(")");
+    return subquery;
+}
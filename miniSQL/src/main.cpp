@@ -4,8 +4,25 @@
 
 using namespace std;
 
-int main() {
+int main(int argc, char* argv[]) {
     MiniSQL db;
+    
+    // --buffer-policy=lru|2q picks how the buffer pool replaces tables.
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--buffer-policy=lru") {
+            db.bufferPool().setPolicy(BufferPool::Policy::LRU);
+        } else if (arg == "--buffer-policy=2q") {
+            db.bufferPool().setPolicy(BufferPool::Policy::TWO_Q);
+        } else {
+            cerr << "Error: Unknown option '" << arg << "'" << endl;
+            cerr << "Usage: " << argv[0] << " [--buffer-policy=lru|2q]" << endl;
+            return 1;
+        }
+    }
+    // Every statement goes through processCommand, which holds the statement mutex.
+    db.startCheckpointer();
+    
     string input;
     
     cout << "========== Welcome to MiniSQL Database System ==========" << endl;
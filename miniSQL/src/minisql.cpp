@@ -1,20 +1,53 @@
 #include "../include/minisql.h"
+#include "../include/HashTable.h"
+#include "../include/BloomFilter.h"
+#include "../include/Index.h"
+#include "../include/LikePattern.h"
+#include "../include/PageFile.h"
+#include "../include/Parser.h"
+#include "../include/Expression.h"
 #include <fstream>      
 #include <sstream>     
 #include <algorithm>   
 #include <cctype>      
-#include <regex>       
 #include <filesystem>  
 #include <unordered_map> 
 #include <iomanip>
+#include <climits>
+#include <cmath>
+#include <chrono>
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace fs = std::filesystem;
 string trim(const string& str);
-size_t findOuterOperator(const string& expr, const string& op);
+
+using Clock = chrono::steady_clock;
+
+// Milliseconds since start, for the timings of QueryStats.
+static double elapsedMs(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Heap bytes of materialized rows: the value arrays and the strings that do not fit inline.
+static size_t estimateRowBytes(const vector<Row>& rows) {
+    size_t bytes = (rows.capacity() - rows.size()) * sizeof(Row);
+    for (const auto& row : rows) bytes += row.memoryUsage();
+    return bytes;
+}
 
 // Realization of functions defined in minisql.h
 // Part I.Realization of Row class in minisql.h
-Value Row::getValue(const string& column_name, const vector<string>& column_names) const {
+size_t Row::memoryUsage() const {
+    size_t bytes = sizeof(Row) + values_.capacity() * sizeof(Value);
+    for (const auto& value : values_) bytes += heapBytes(value);
+    return bytes;
+}
+
+const Value& Row::getValue(const string& column_name, const vector<string>& column_names) const {
     for (size_t i = 0; i < column_names.size(); ++i) {
         if (column_names[i] == column_name) {
             return values_[i];
@@ -24,13 +57,38 @@ Value Row::getValue(const string& column_name, const vector<string>& column_name
 }
 
 // Part II.Realization of Table class in minisql.h
+atomic<uint64_t> Table::next_version_{0};
+
 Table::Table(string name, vector<Column> columns, string csv_file)
     : name_(move(name)), columns_(move(columns)), csv_file_(move(csv_file)) {
+    bumpVersion();
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        if (columns_[i].primary_key || columns_[i].unique) {
+            unique_indexes_.push_back(make_shared<UniqueIndex>(columns_[i].name, static_cast<int>(i), columns_[i].primary_key));
+        }
+    }
+    zone_map_ = make_shared<ZoneMap>(columns_.size());
+    page_file_ = make_shared<PageFile>(pageFile(), columns_.size());
+    
     if (!csv_file_.empty() && filesystem::exists(csv_file_)) {
-        loadFromCSV();
+        loadRows();
     }
 }
 
+bool Table::loadRows() {
+    vector<Row> rows;
+    if (!page_file_->open() || !page_file_->matchesCsv(csv_file_) || !page_file_->readRows(rows)) {
+        return loadFromCSV();
+    }
+    
+    rows_ = move(rows);
+    dirty_pages_.assign(page_file_->pageCount(), false);
+    dirty_bytes_ = 0;
+    bumpVersion();
+    rebuildIndexes();
+    return true;
+}
+
 bool Table::loadFromCSV() {
     ifstream file(csv_file_);
     if (!file.is_open()) {
@@ -39,9 +97,14 @@ bool Table::loadFromCSV() {
     }
     
     rows_.clear();
+    bumpVersion();
     string line;
     
     if (!getline(file, line)) {
+        page_file_->setCsvRead(csv_file_);
+        dirty_pages_.clear();
+        dirty_bytes_ = 0;
+        rebuildIndexes();
         return true;
     }
     
@@ -79,13 +142,18 @@ bool Table::loadFromCSV() {
     }
     
     file.close();
+    page_file_->setCsvRead(csv_file_);
+    dirty_pages_.clear();
+    dirty_bytes_ = 0;
+    rebuildIndexes();
     return true;
 }
 
 bool Table::saveToCSV() {
-    ofstream file(csv_file_);
+    string temp_file = csv_file_ + ".tmp";
+    ofstream file(temp_file);
     if (!file.is_open()) {
-        cerr << "Fail to open: "<< csv_file_ << endl;
+        cerr << "Fail to open: "<< temp_file << endl;
         return false;
     }
     
@@ -112,14 +180,312 @@ bool Table::saveToCSV() {
     }
     
     file.close();
+    error_code ec;
+    if (file) filesystem::rename(temp_file, csv_file_, ec);
+    if (!file || ec) {
+        cerr << "Fail to write: " << csv_file_ << endl;
+        filesystem::remove(temp_file, ec);
+        return false;
+    }
+    // The index files are stamped with the page file, whose header changes last.
+    flushPages();
+    page_file_->setCsvWritten(csv_file_);
+    saveIndexFiles();
+    return true;
+}
+
+string Table::schemaFile() const {
+    return filesystem::path(csv_file_).replace_extension(".schema").string();
+}
+
+string Table::indexFile(const string& index_name) const {
+    return filesystem::path(csv_file_).replace_extension("." + index_name + ".idx").string();
+}
+
+string Table::zoneMapFile() const {
+    return filesystem::path(csv_file_).replace_extension(".zonemap").string();
+}
+
+string Table::pageFile() const {
+    return filesystem::path(csv_file_).replace_extension(".pages").string();
+}
+
+bool Table::saveSchema() const {
+    // Replaced through a temporary file like the CSV file: without its schema a table loses
+    // its types, keys and indexes.
+    string temp_file = schemaFile() + ".tmp";
+    ofstream file(temp_file);
+    if (!file.is_open()) {
+        cerr << "Fail to open: " << temp_file << endl;
+        return false;
+    }
+    
+    // One line per column: column <name> <type> <varchar_length> [PRIMARY_KEY | UNIQUE]
+    for (const auto& col : columns_) {
+        file << "column " << col.name << " " << col.type << " " << col.varchar_length;
+        if (col.primary_key) {
+            file << " PRIMARY_KEY";
+        } else if (col.unique) {
+            file << " UNIQUE";
+        }
+        file << "\n";
+    }
+    // One line per index: index <index_name> <column> [include <col1>,<col2>...],
+    // bitmap_index <index_name> <column> or trigram_index <index_name> <column>
+    for (const auto& index : indexes_) {
+        file << "index " << index->name() << " " << index->column();
+        for (size_t i = 0; i < index->includeColumns().size(); ++i) {
+            file << (i == 0 ? " include " : ",") << index->includeColumns()[i];
+        }
+        file << "\n";
+    }
+    for (const auto& index : bitmap_indexes_) {
+        file << "bitmap_index " << index->name() << " " << index->column() << "\n";
+    }
+    for (const auto& index : trigram_indexes_) {
+        file << "trigram_index " << index->name() << " " << index->column() << "\n";
+    }
+    
+    file.close();
+    error_code ec;
+    if (file) filesystem::rename(temp_file, schemaFile(), ec);
+    if (!file || ec) {
+        cerr << "Fail to write: " << schemaFile() << endl;
+        filesystem::remove(temp_file, ec);
+        return false;
+    }
+    return true;
+}
+
+bool Table::readSchema(const string& schema_file, vector<Column>& columns, vector<IndexDefinition>& indexes) {
+    ifstream file(schema_file);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    string line;
+    while (getline(file, line)) {
+        stringstream ss(line);
+        string kind;
+        ss >> kind;
+        if (kind == "column") {
+            Column col;
+            string constraint;
+            if (!(ss >> col.name >> col.type >> col.varchar_length)) return false;
+            ss >> constraint;
+            col.primary_key = (constraint == "PRIMARY_KEY");
+            col.unique = col.primary_key || constraint == "UNIQUE";
+            columns.push_back(col);
+        } else if (kind == "index" || kind == "bitmap_index" || kind == "trigram_index") {
+            IndexDefinition definition;
+            if (!(ss >> definition.name >> definition.column)) return false;
+            if (kind == "bitmap_index") definition.kind = IndexKind::BITMAP;
+            if (kind == "trigram_index") definition.kind = IndexKind::TRIGRAM;
+            string include_keyword, include_list;
+            if (ss >> include_keyword >> include_list && include_keyword == "include") {
+                stringstream list(include_list);
+                string column_name;
+                while (getline(list, column_name, ',')) {
+                    if (!column_name.empty()) definition.include.push_back(column_name);
+                }
+            }
+            indexes.push_back(definition);
+        }
+    }
+    
+    return !columns.empty();
+}
+
+TableFileStamp Table::fileStamp() const {
+    TableFileStamp stamp;
+    error_code ec;
+    string stamp_file = page_file_->isOpen() ? pageFile() : csv_file_;
+    stamp.file_size = filesystem::file_size(stamp_file, ec);
+    auto modified = filesystem::last_write_time(stamp_file, ec);
+    if (!ec) {
+        stamp.modified_time = static_cast<int64_t>(modified.time_since_epoch().count());
+    }
+    stamp.row_count = rows_.size();
+    return stamp;
+}
+
+void Table::markDirty(size_t row_pos, bool to_end) {
+    size_t page = row_pos / PageFile::PAGE_ROWS;
+    size_t page_count = (rows_.size() + PageFile::PAGE_ROWS - 1) / PageFile::PAGE_ROWS;
+    dirty_pages_.resize(max(page_count, page + 1), false);
+    if (dirty_pages_[page] && !to_end) {
+        // An INSERT appending to a page that is dirty already.
+        if (row_pos + 1 == rows_.size()) dirty_bytes_ += rows_[row_pos].memoryUsage();
+        return;
+    }
+    size_t last_page = to_end ? dirty_pages_.size() : page + 1;
+    for (; page < last_page; ++page) {
+        size_t begin = page * PageFile::PAGE_ROWS;
+        if (!dirty_pages_[page] && begin < rows_.size()) {
+            dirty_bytes_ += min(PageFile::PAGE_ROWS, rows_.size() - begin) * rows_[begin].memoryUsage();
+        }
+        dirty_pages_[page] = true;
+    }
+}
+
+bool Table::flushPages() {
+    if (!hasDirtyPages()) {
+        return true;
+    }
+    if (!page_file_->write(rows_, dirty_pages_)) {
+        cerr << "Fail to write: " << page_file_->path() << endl;
+        return false;
+    }
+    dirty_pages_.assign(page_file_->pageCount(), false);
+    dirty_bytes_ = 0;
+    return true;
+}
+
+bool Table::hasDirtyPages() const {
+    size_t page_count = (rows_.size() + PageFile::PAGE_ROWS - 1) / PageFile::PAGE_ROWS;
+    return (page_file_->isOpen() && page_count != page_file_->pageCount()) ||
+           find(dirty_pages_.begin(), dirty_pages_.end(), true) != dirty_pages_.end();
+}
+
+bool Table::isDirty() const {
+    return hasDirtyPages() || (page_file_->isOpen() && !page_file_->csvCurrent());
+}
+
+void Table::saveIndexFiles() const {
+    TableFileStamp stamp = fileStamp();
+    // A single block is rebuilt faster than it is read back, so only larger tables keep a file.
+    error_code ec;
+    if (zone_map_->blockCount() > 1) {
+        zone_map_->saveToFile(zoneMapFile(), stamp);
+    } else {
+        filesystem::remove(zoneMapFile(), ec);
+    }
+    
+    for (const auto& index : indexes_) {
+        if (!index->saveToFile(indexFile(index->name()), stamp)) {
+            filesystem::remove(indexFile(index->name()), ec);
+        }
+    }
+}
+
+Row Table::typedRow(const Row& row) const {
+    vector<Value> values;
+    values.reserve(row.size());
+    for (size_t i = 0; i < row.size(); ++i) {
+        values.push_back(assignmentValue(row[i], columns_[i].type));
+    }
+    return Row(move(values));
+}
+
+bool Table::insertRow(const Row& input) {
+    if (input.size() != columns_.size()) {
+        cout << "Error: Table '" << name_ << "' has " << columns_.size() << " columns but " << input.size() << " values were given" << endl;
+        return false;
+    }
+    Row row = typedRow(input);
+    
+    for (const auto& unique : unique_indexes_) {
+        if (unique->find(row[unique->columnIndex()]) != SIZE_MAX) {
+            cout << "Error: Duplicate value for " << unique->constraintName() << " column '" << unique->column() << "'" << endl;
+            return false;
+        }
+    }
+    
+    rows_.push_back(row);
+    size_t pos = rows_.size() - 1;
+    row_bytes_ += row.memoryUsage();
+    index_bytes_ += index_row_bytes_;
+    for (auto& unique : unique_indexes_) {
+        unique->insert(row[unique->columnIndex()], pos);
+    }
+    for (auto& index : indexes_) {
+        index->insert(row, pos);
+    }
+    for (auto& bitmap : bitmap_indexes_) {
+        bitmap->insert(row[bitmap->columnIndex()], pos);
+    }
+    for (auto& trigram : trigram_indexes_) {
+        trigram->insert(row[trigram->columnIndex()], pos);
+    }
+    zone_map_->append(row);
+    bumpVersion();
+    markDirty(pos);
+    return true;
+}
+
+bool Table::upsertRow(const Row& input, bool& replaced) {
+    replaced = false;
+    if (input.size() != columns_.size()) {
+        cout << "Error: Table '" << name_ << "' has " << columns_.size() << " columns but " << input.size() << " values were given" << endl;
+        return false;
+    }
+    Row row = typedRow(input);
+    
+    UniqueIndex* primary = nullptr;
+    for (const auto& unique : unique_indexes_) {
+        if (unique->isPrimaryKey()) primary = unique.get();
+    }
+    if (!primary) {
+        cout << "Error: Table '" << name_ << "' has no PRIMARY KEY to match rows on" << endl;
+        return false;
+    }
+    
+    size_t pos = primary->find(row[primary->columnIndex()]);
+    if (pos == SIZE_MAX) {
+        return insertRow(row);
+    }
+    
+    // The new row may only collide with the row it replaces.
+    for (const auto& unique : unique_indexes_) {
+        size_t owner = unique->find(row[unique->columnIndex()]);
+        if (owner != SIZE_MAX && owner != pos) {
+            cout << "Error: Duplicate value for " << unique->constraintName() << " column '" << unique->column() << "'" << endl;
+            return false;
+        }
+    }
+    
+    for (auto& unique : unique_indexes_) {
+        unique->erase(rows_[pos][unique->columnIndex()]);
+    }
+    for (auto& index : indexes_) {
+        index->erase(rows_[pos][index->columnIndex()], pos);
+    }
+    for (auto& bitmap : bitmap_indexes_) {
+        bitmap->erase(rows_[pos][bitmap->columnIndex()], pos);
+    }
+    for (auto& trigram : trigram_indexes_) {
+        trigram->erase(rows_[pos][trigram->columnIndex()], pos);
+    }
+    row_bytes_ += row.memoryUsage() - rows_[pos].memoryUsage();
+    index_bytes_ += indexedValueBytes(row) - indexedValueBytes(rows_[pos]);
+    rows_[pos] = row;
+    for (auto& unique : unique_indexes_) {
+        unique->insert(row[unique->columnIndex()], pos);
+    }
+    for (auto& index : indexes_) {
+        index->insert(row, pos);
+    }
+    for (auto& bitmap : bitmap_indexes_) {
+        bitmap->insert(row[bitmap->columnIndex()], pos);
+    }
+    for (auto& trigram : trigram_indexes_) {
+        trigram->insert(row[trigram->columnIndex()], pos);
+    }
+    zone_map_->widen(pos, row);
+    
+    replaced = true;
+    bumpVersion();
+    markDirty(pos);
     return true;
 }
 
-void Table::insertRow(const Row& row) {
-    if (row.size() == columns_.size()) {
-        rows_.push_back(row);
-        saveToCSV();
+void Table::clearRows() {
+    if (!rows_.empty()) {
+        markDirty(0, true);
     }
+    rows_.clear();
+    bumpVersion();
+    rebuildIndexes();
 }
 
 int Table::getColumnIndex(const string& column_name) const {
@@ -131,11 +497,23 @@ int Table::getColumnIndex(const string& column_name) const {
     return -1;
 }
 
-vector<Row> Table::selectRows(const vector<string>& columns, const vector<string>& column_aliases, const shared_ptr<LogicExpression>& where_clause) const {
+vector<Row> Table::selectRows(const vector<string>& columns, const vector<string>& column_aliases, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats) const {
+    
+    vector<Row> covered_rows;
+    if (coveringScan(columns, where_clause, covered_rows, stats)) {
+        return covered_rows;
+    }
     
-    vector<Row> filtered_rows = where_clause ? filterRows(where_clause) : rows_;
+    vector<size_t> positions = matchingPositions(where_clause, stats);
+    auto start = Clock::now();
+    vector<Row> filtered_rows;
+    filtered_rows.reserve(positions.size());
+    for (size_t pos : positions) {
+        filtered_rows.push_back(rows_[pos]);
+    }
     // '*' means that select all colmuns
     if (columns.size() == 1 && columns[0] == "*") {
+        if (stats) stats->project_ms = elapsedMs(start);
         return filtered_rows;
     }
     
@@ -158,826 +536,3171 @@ vector<Row> Table::selectRows(const vector<string>& columns, const vector<string
         result.emplace_back(move(selected_values));
     }
     
+    if (stats) stats->project_ms = elapsedMs(start);
     return result;
 }
 
-vector<Row> Table::filterRows(const shared_ptr<LogicExpression>& where_clause) const {
+vector<Row> Table::projectRows(const vector<shared_ptr<const Expression>>& projections, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats) const {
+    vector<size_t> positions = matchingPositions(where_clause, stats);
+    auto start = Clock::now();
     vector<Row> result;
-    vector<string> column_names;
-    
-    for (const auto& col : columns_) {
-        column_names.push_back(col.name);
+    result.reserve(positions.size());
+    for (size_t pos : positions) {
+        result.push_back(Expression::project(rows_[pos], projections));
     }
-    
-    for (const auto& row : rows_) {
-        if (ConditionEvaluator::evaluate(row, column_names, where_clause)) {
-            result.push_back(row);
+    if (stats) stats->project_ms = elapsedMs(start);
+    return result;
+}
+
+// Collects the conditions of a bound tree.
+static void collectConditions(const shared_ptr<LogicExpression>& expression, unordered_set<const Condition*>& conditions) {
+    for (const auto* side : {&expression->left, &expression->right}) {
+        if (const auto* child = get_if<shared_ptr<LogicExpression>>(side)) {
+            if (*child) collectConditions(*child, conditions);
+        } else {
+            conditions.insert(&get<Condition>(*side));
         }
     }
-    
-    return result;
 }
 
-vector<Row> Table::joinTables(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
+// Collect the conjuncts of the top-level AND chain. Conditions under OR / NOT are skipped,
+// which only widens the candidate set.
+static void collectConjuncts(const shared_ptr<LogicExpression>& expression, vector<const Condition*>& conjuncts) {
+    if (!expression) return;
+    if (expression->isSingleCondition) {
+        if (holds_alternative<Condition>(expression->left)) {
+            conjuncts.push_back(&get<Condition>(expression->left));
+        }
+        return;
+    }
+    if (expression->op != LogicOp::AND) return;
     
-    return JoinOptimizer::optimizeJoin(left_table, right_table, columns, join_type, condition, where_clause);
+    for (const auto* side : {&expression->left, &expression->right}) {
+        if (holds_alternative<Condition>(*side)) {
+            conjuncts.push_back(&get<Condition>(*side));
+        } else {
+            collectConjuncts(get<shared_ptr<LogicExpression>>(*side), conjuncts);
+        }
+    }
 }
 
-int Table::deleteRows(const shared_ptr<LogicExpression>& where_clause) {
-    if (rows_.empty()) {
-        return 0;
+// Key range on one indexed column. A bound is open while its has_ flag is unset.
+struct KeyRange {
+    Value low;
+    bool has_low = false;
+    bool low_inclusive = true;
+    Value high;
+    bool has_high = false;
+    bool high_inclusive = true;
+    
+    const Value* lowBound() const { return has_low ? &low : nullptr; }
+    const Value* highBound() const { return has_high ? &high : nullptr; }
+    
+    void tightenLow(const Value& value, bool inclusive) {
+        ValueLess less;
+        if (!has_low || less(low, value) || (!less(value, low) && !inclusive)) {
+            low = value;
+            has_low = true;
+            low_inclusive = inclusive;
+        }
     }
     
-    vector<string> column_names;
-    for (const auto& col : columns_) {
-        column_names.push_back(col.name);
+    void tightenHigh(const Value& value, bool inclusive) {
+        ValueLess less;
+        if (!has_high || less(value, high) || (!less(high, value) && !inclusive)) {
+            high = value;
+            has_high = true;
+            high_inclusive = inclusive;
+        }
     }
-    
-    vector<Row> remaining_rows;
-    int deleted_count = 0;
-    
-    for (const auto& row : rows_) {
-        bool should_delete = false;
-        
-        if (where_clause) {
-            should_delete = ConditionEvaluator::evaluate(row, column_names, where_clause);
-        } else {
-            should_delete = true;
+};
+
+// column <op> constant, where <op> narrows a key range: not NOT_EQUAL / NOT LIKE, and
+// LIKE only when the pattern starts with a literal prefix.
+static bool isRangeCondition(const Condition& condition) {
+    if (condition.is_column_comparison || condition.subquery || condition.expression) return false;
+    if (condition.op == CompareOp::LIKE) {
+        const string* pattern = get_if<string>(&condition.constant_value);
+        return pattern && !LikePattern::prefixOf(*pattern).empty();
+    }
+    return condition.op != CompareOp::NOT_EQUAL && condition.op != CompareOp::NOT_LIKE;
+}
+
+static void tightenRange(KeyRange& range, const Condition& condition) {
+    const Value& value = condition.constant_value;
+    CompareOp op = condition.op;
+    if (op == CompareOp::LIKE) {
+        // LIKE 'abc%' is the key range ['abc', 'abd'); without wildcards it is = 'abc'.
+        const string& pattern = get<string>(value);
+        string prefix = LikePattern::prefixOf(pattern);
+        range.tightenLow(prefix, true);
+        if (prefix.size() == pattern.size()) {
+            range.tightenHigh(prefix, true);
+            return;
         }
-        
-        if (should_delete) {
-            deleted_count++;
-        } else {
-            remaining_rows.push_back(row);
+        while (!prefix.empty() && static_cast<unsigned char>(prefix.back()) == 0xFF) {
+            prefix.pop_back();
         }
+        if (!prefix.empty()) {
+            prefix.back() = static_cast<char>(static_cast<unsigned char>(prefix.back()) + 1);
+            range.tightenHigh(prefix, false);
+        }
+        return;
     }
-    
-    if (deleted_count > 0) {
-        rows_ = move(remaining_rows);
-        saveToCSV(); 
+    if (op == CompareOp::EQUAL || op == CompareOp::GREATER || op == CompareOp::GREATER_EQUAL) {
+        range.tightenLow(value, op != CompareOp::GREATER);
+    }
+    if (op == CompareOp::EQUAL || op == CompareOp::LESS || op == CompareOp::LESS_EQUAL) {
+        range.tightenHigh(value, op != CompareOp::LESS);
     }
-    
-    return deleted_count;
 }
 
-int Table::updateRows(const unordered_map<string, Value>& updates, const shared_ptr<LogicExpression>& where_clause) {
-    if (rows_.empty() || updates.empty()) {
-        return 0;
+// Appends every column the expression reads. Returns false for subqueries, which read
+// columns of other tables.
+static bool collectReferencedColumns(const shared_ptr<LogicExpression>& expression, vector<string>& columns) {
+    if (!expression) return true;
+    for (const auto* side : {&expression->left, &expression->right}) {
+        if (holds_alternative<shared_ptr<LogicExpression>>(*side)) {
+            if (!collectReferencedColumns(get<shared_ptr<LogicExpression>>(*side), columns)) return false;
+            continue;
+        }
+        const Condition& condition = get<Condition>(*side);
+        if (condition.subquery || condition.expression) return false;
+        if (!condition.left_column.empty()) columns.push_back(condition.left_column);
+        if (condition.is_column_comparison) columns.push_back(condition.right_column);
+        if (expression->isSingleCondition || expression->op == LogicOp::NOT) break;
     }
-    
-    vector<string> column_names;
-    for (const auto& col : columns_) {
-        column_names.push_back(col.name);
+    return true;
+}
+
+// The columns a SELECT list outputs, with * expanded.
+static vector<string> outputColumns(const vector<string>& columns, const vector<Column>& table_columns) {
+    if (columns.size() == 1 && columns[0] == "*") {
+        vector<string> names;
+        for (const auto& col : table_columns) names.push_back(col.name);
+        return names;
     }
-    
-    for (const auto& [col_name, _] : updates) {
-        if (getColumnIndex(col_name) == -1) {
-            throw runtime_error("Column '" + col_name + "' not found in table");
+    return columns;
+}
+
+const TableIndex* Table::coveringIndex(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, KeyRange& range, bool& ranged) const {
+    if (indexes_.empty() || !where_clause) return nullptr;
+    
+    vector<string> referenced = outputColumns(columns, columns_);
+    if (!collectReferencedColumns(where_clause, referenced)) return nullptr;
+    
+    vector<const Condition*> conjuncts;
+    collectConjuncts(where_clause, conjuncts);
+    // A PRIMARY KEY / UNIQUE point lookup reads one row, which beats any index scan.
+    for (const Condition* condition : conjuncts) {
+        if (!isRangeCondition(*condition) || condition->op != CompareOp::EQUAL) continue;
+        for (const auto& unique : unique_indexes_) {
+            if (unique->column() == condition->left_column) return nullptr;
         }
     }
     
-    int updated_count = 0;
-    
-    for (auto& row : rows_) {
-        bool should_update = false;
-        
-        if (where_clause) {
-            should_update = ConditionEvaluator::evaluate(row, column_names, where_clause);
-        } else {
-            should_update = true;
+    const TableIndex* chosen = nullptr;
+    bool other_ranged = false;
+    ranged = false;
+    for (const auto& index : indexes_) {
+        KeyRange index_range;
+        bool index_ranged = false;
+        for (const Condition* condition : conjuncts) {
+            if (isRangeCondition(*condition) && condition->left_column == index->column()) {
+                tightenRange(index_range, *condition);
+                index_ranged = true;
+            }
         }
         
-        if (should_update) {
-            for (const auto& [col_name, new_value] : updates) {
-                int col_idx = getColumnIndex(col_name);
-                if (col_idx != -1) {
-                    row[col_idx] = new_value;
-                }
-            }
-            updated_count++;
+        bool covers = all_of(referenced.begin(), referenced.end(), [&](const string& column) {
+            return index->coveredPosition(column) != -1;
+        });
+        if (!covers) {
+            other_ranged = other_ranged || index_ranged;
+            continue;
+        }
+        if (!chosen || (index_ranged && !ranged)) {
+            chosen = index.get();
+            range = index_range;
+            ranged = index_ranged;
         }
     }
-    
-    if (updated_count > 0) {
-        saveToCSV(); 
+    // A full scan of the covering index loses to a range scan of another index.
+    if (!chosen || (!ranged && other_ranged)) return nullptr;
+    return chosen;
+}
+
+// Terms of the AND chain starting at operand.
+static void collectAndTerms(const variant<Condition, shared_ptr<LogicExpression>>& operand, vector<const variant<Condition, shared_ptr<LogicExpression>>*>& terms) {
+    if (const auto* child = get_if<shared_ptr<LogicExpression>>(&operand)) {
+        if (*child && (*child)->isSingleCondition) {
+            collectAndTerms((*child)->left, terms);
+            return;
+        }
+        if (*child && (*child)->op == LogicOp::AND) {
+            collectAndTerms((*child)->left, terms);
+            collectAndTerms((*child)->right, terms);
+            return;
+        }
     }
-    
-    return updated_count;
+    terms.push_back(&operand);
 }
 
-// Part III.Realization of Queryoptimizer class in minisql.h
-vector<Row> JoinOptimizer::optimizeJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
+// Splits the top-level AND chain of where_clause, as SQL text, into the terms an index answers
+// (answers(condition) holds) and the filter of the others. An OR / NOT term counts as answered
+// when whole_terms is set and answers() holds for all of its conditions.
+static void splitConditionText(const shared_ptr<LogicExpression>& where_clause, const function<bool(const Condition&)>& answers, bool whole_terms, string& index_condition, string& filter) {
+    index_condition.clear();
+    filter.clear();
+    if (!where_clause) return;
+    
+    variant<Condition, shared_ptr<LogicExpression>> root = where_clause;
+    vector<const variant<Condition, shared_ptr<LogicExpression>>*> terms;
+    collectAndTerms(root, terms);
+    for (const auto* term : terms) {
+        bool answered = false;
+        string text;
+        if (const Condition* condition = get_if<Condition>(term)) {
+            answered = answers(*condition);
+            text = WhereParser::describe(*condition);
+        } else {
+            const auto& expression = get<shared_ptr<LogicExpression>>(*term);
+            unordered_set<const Condition*> conditions;
+            collectConditions(expression, conditions);
+            // The unused right side of a NOT node is an empty condition.
+            answered = whole_terms && all_of(conditions.begin(), conditions.end(), [&answers](const Condition* condition) {
+                return (condition->left_column.empty() && !condition->expression && !condition->subquery) || answers(*condition);
+            });
+            text = WhereParser::describe(expression);
+            if (expression->op == LogicOp::OR) text = "(" + text + ")";
+        }
+        string& target = answered ? index_condition : filter;
+        target += (target.empty() ? "" : " AND ") + text;
+    }
+}
+
+// Index Cond and Filter of a scan of the index on column: the range conjuncts on column
+// narrow the key range, the other terms are checked row by row.
+static void rangeConditionText(const shared_ptr<LogicExpression>& where_clause, const string& column, bool ranged, QueryStats& stats) {
+    if (!ranged) {
+        stats.index_condition.clear();
+        stats.filter = WhereParser::describe(where_clause);
+        return;
+    }
+    splitConditionText(where_clause, [&column](const Condition& condition) {
+        return isRangeCondition(condition) && condition.left_column == column;
+    }, false, stats.index_condition, stats.filter);
+}
+
+bool Table::coveringScan(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, vector<Row>& result, QueryStats* stats) const {
+    auto start = Clock::now();
+    KeyRange chosen_range;
+    bool chosen_ranged = false;
+    const TableIndex* chosen = coveringIndex(columns, where_clause, chosen_range, chosen_ranged);
+    if (!chosen) return false;
+    
+    vector<string> output_columns = outputColumns(columns, columns_);
+    vector<string> covered_names = {chosen->column()};
+    covered_names.insert(covered_names.end(), chosen->includeColumns().begin(), chosen->includeColumns().end());
+    vector<int> projection;
+    for (const auto& column : output_columns) {
+        projection.push_back(chosen->coveredPosition(column));
+    }
     
-    size_t left_size = left_table.rowCount();
-    size_t right_size = right_table.rowCount();
+    // The WHERE clause is evaluated on the covered values alone; no table row is read.
+    vector<pair<size_t, Row>> matches;
+    size_t entries_read = 0;
+    chosen->scanRange(chosen_range.lowBound(), chosen_range.low_inclusive, chosen_range.highBound(), chosen_range.high_inclusive, [&](const IndexEntry& entry) {
+        ++entries_read;
+        vector<Value> covered_values;
+        covered_values.reserve(covered_names.size());
+        covered_values.push_back(entry.key);
+        covered_values.insert(covered_values.end(), entry.included.begin(), entry.included.end());
+        Row covered_row(move(covered_values));
+        if (!ConditionEvaluator::evaluate(covered_row, covered_names, where_clause)) return;
+        
+        vector<Value> selected_values;
+        selected_values.reserve(projection.size());
+        for (int pos : projection) {
+            selected_values.push_back(covered_row[pos]);
+        }
+        matches.emplace_back(entry.row, Row(move(selected_values)));
+    });
     
-    return (left_size < 1000 && right_size < 1000) ? nestedLoopJoin(left_table, right_table, columns, join_type, condition, where_clause) : hashJoin(left_table, right_table, columns, join_type, condition, where_clause);
+    // Same row order as a table scan.
+    sort(matches.begin(), matches.end(), [](const pair<size_t, Row>& left, const pair<size_t, Row>& right) {
+        return left.first < right.first;
+    });
+    result.clear();
+    result.reserve(matches.size());
+    for (auto& match : matches) {
+        result.push_back(move(match.second));
+    }
+    if (stats) {
+        stats->access_path = "Index Only Scan";
+        stats->scan_index = chosen->name();
+        rangeConditionText(where_clause, chosen->column(), chosen_ranged, *stats);
+        stats->scan_rows = entries_read;
+        stats->scan_ms = elapsedMs(start);
+    }
+    return true;
 }
 
-vector<Row> JoinOptimizer::nestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
-    
+vector<Row> Table::filterRows(const shared_ptr<LogicExpression>& where_clause) const {
     vector<Row> result;
-    
-    vector<string> left_cols, right_cols;
-    for (const auto& col : left_table.columns()) left_cols.push_back(col.name);
-    for (const auto& col : right_table.columns()) right_cols.push_back(col.name);
-    
-    int left_idx = left_table.getColumnIndex(condition.left_column);
-    int right_idx = right_table.getColumnIndex(condition.right_column);
-    
-    if (left_idx == -1 || right_idx == -1) {
-        throw runtime_error("Join column not found");
+    for (size_t pos : matchingPositions(where_clause)) {
+        result.push_back(rows_[pos]);
     }
-    
-    if (join_type != JoinType::INNER_JOIN) {
-        cout << "Warning: Only INNER JOIN is currently supported" << endl;
+    return result;
+}
+
+vector<size_t> Table::matchingPositions(const shared_ptr<LogicExpression>& where_clause, QueryStats* stats) const {
+    auto start = Clock::now();
+    vector<size_t> positions;
+    if (!where_clause) {
+        positions.resize(rows_.size());
+        for (size_t i = 0; i < rows_.size(); ++i) positions[i] = i;
+        if (stats) {
+            stats->access_path = "Seq Scan";
+            stats->scan_rows = rows_.size();
+            stats->scan_ms = elapsedMs(start);
+        }
+        return positions;
     }
     
-    bool select_all = (columns.size() == 1 && columns[0] == "*");
-    
-    vector<string> all_columns_for_where = left_cols;
-    all_columns_for_where.insert(all_columns_for_where.end(), right_cols.begin(), right_cols.end());
-    
-    for (const auto& left_row : left_table.getAllRows()) {
-        for (const auto& right_row : right_table.getAllRows()) {
-            bool match = false;
-            
-            try {
-                match = ConditionEvaluator::compare(left_row[left_idx], right_row[right_idx], condition.op);
-            } catch (...) {
-                match = false;
+    // Unless the bitmap indexes answered it exactly, an index only narrows the candidates
+    // and the whole WHERE clause is still checked on each of them.
+    vector<size_t> candidates;
+    bool exact = false;
+    if (indexCandidates(where_clause, candidates, exact, stats)) {
+        if (exact) {
+            if (stats) stats->scan_ms = elapsedMs(start);
+            return candidates;
+        }
+        for (size_t pos : candidates) {
+            if (ConditionEvaluator::evaluate(rows_[pos], where_clause)) {
+                positions.push_back(pos);
+            }
+        }
+        if (stats) stats->scan_ms = elapsedMs(start);
+        return positions;
+    }
+    
+    // Zone maps: a block is skipped when one conjunct cannot hold for any of its rows.
+    vector<pair<int, const Condition*>> zone_filters = zoneFilters(where_clause);
+    size_t rows_read = 0;
+    size_t blocks_skipped = 0;
+    for (size_t block = 0; block < zone_map_->blockCount(); ++block) {
+        if (!blockMayMatch(block, zone_filters)) {
+            ++blocks_skipped;
+            continue;
+        }
+        
+        size_t block_end = min(rows_.size(), (block + 1) * ZoneMap::BLOCK_ROWS);
+        rows_read += block_end - block * ZoneMap::BLOCK_ROWS;
+        for (size_t i = block * ZoneMap::BLOCK_ROWS; i < block_end; ++i) {
+            if (ConditionEvaluator::evaluate(rows_[i], where_clause)) {
+                positions.push_back(i);
+            }
+        }
+    }
+    if (stats) {
+        stats->access_path = "Seq Scan";
+        stats->filter = WhereParser::describe(where_clause);
+        stats->scan_rows = rows_read;
+        stats->blocks_total = zone_filters.empty() ? 0 : zone_map_->blockCount();
+        stats->blocks_skipped = blocks_skipped;
+        stats->scan_ms = elapsedMs(start);
+    }
+    return positions;
+}
+
+vector<pair<int, const Condition*>> Table::zoneFilters(const shared_ptr<LogicExpression>& where_clause) const {
+    vector<const Condition*> conjuncts;
+    collectConjuncts(where_clause, conjuncts);
+    vector<pair<int, const Condition*>> filters;
+    for (const Condition* condition : conjuncts) {
+        if (condition->is_column_comparison || condition->subquery || condition->expression) continue;
+        int col_idx = getColumnIndex(condition->left_column);
+        if (col_idx != -1) filters.emplace_back(col_idx, condition);
+    }
+    return filters;
+}
+
+bool Table::blockMayMatch(size_t block, const vector<pair<int, const Condition*>>& filters) const {
+    for (const auto& [col_idx, condition] : filters) {
+        if (!zone_map_->zone(block, col_idx).mayMatch(condition->op, condition->constant_value)) return false;
+    }
+    return true;
+}
+
+// Bitmap and trigram indexes on the columns where_clause reads, comma separated.
+static string bitmapIndexNames(const shared_ptr<LogicExpression>& where_clause, const vector<shared_ptr<BitmapIndex>>& bitmaps, const vector<shared_ptr<TrigramIndex>>& trigrams) {
+    unordered_set<const Condition*> conditions;
+    collectConditions(where_clause, conditions);
+    auto reads = [&conditions](const string& column) {
+        return any_of(conditions.begin(), conditions.end(), [&column](const Condition* condition) { return condition->left_column == column; });
+    };
+    string names;
+    for (const auto& index : bitmaps) {
+        if (reads(index->column())) names += (names.empty() ? "" : ", ") + index->name();
+    }
+    for (const auto& index : trigrams) {
+        if (reads(index->column())) names += (names.empty() ? "" : ", ") + index->name();
+    }
+    return names;
+}
+
+// Index Cond and Filter of a bitmap scan that is not exact: the terms over bitmap / trigram
+// indexed columns give the candidates, and every candidate is checked against the whole WHERE clause.
+static void bitmapConditionText(const shared_ptr<LogicExpression>& where_clause, const vector<shared_ptr<BitmapIndex>>& bitmaps, const vector<shared_ptr<TrigramIndex>>& trigrams, QueryStats& stats) {
+    string filter;
+    splitConditionText(where_clause, [&](const Condition& condition) {
+        if (condition.is_column_comparison || condition.expression || condition.subquery) return false;
+        return any_of(bitmaps.begin(), bitmaps.end(), [&condition](const auto& index) { return index->column() == condition.left_column; }) ||
+               any_of(trigrams.begin(), trigrams.end(), [&condition](const auto& index) { return index->column() == condition.left_column; });
+    }, true, stats.index_condition, filter);
+    stats.filter = WhereParser::describe(where_clause);
+}
+
+size_t Table::countRows(const shared_ptr<LogicExpression>& where_clause, QueryStats* stats) const {
+    if (!where_clause) {
+        if (stats) {
+            stats->access_path = "Seq Scan";
+            stats->scan_rows = rows_.size();
+        }
+        return rows_.size();
+    }
+    
+    // Exact bitmap answers are counted without materializing any row position.
+    auto start = Clock::now();
+    RoaringBitmap bitmap;
+    bool exact = false;
+    if ((!bitmap_indexes_.empty() || !trigram_indexes_.empty()) && evaluateBitmap(where_clause, bitmap, exact) && exact) {
+        if (stats) {
+            stats->access_path = "Bitmap Index Scan";
+            stats->scan_index = bitmapIndexNames(where_clause, bitmap_indexes_, trigram_indexes_);
+            stats->index_condition = WhereParser::describe(where_clause);
+            stats->exact = true;
+            stats->scan_rows = bitmap.cardinality();
+            stats->scan_ms = elapsedMs(start);
+        }
+        return bitmap.cardinality();
+    }
+    return matchingPositions(where_clause, stats).size();
+}
+
+void Table::explainScan(const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause, bool count_only, QueryStats& stats) const {
+    stats.access_path = "Seq Scan";
+    stats.scan_rows = rows_.size();
+    if (!where_clause) return;
+    
+    RoaringBitmap bitmap;
+    bool exact = false;
+    if (count_only && (!bitmap_indexes_.empty() || !trigram_indexes_.empty()) && evaluateBitmap(where_clause, bitmap, exact) && exact) {
+        stats.access_path = "Bitmap Index Scan";
+        stats.scan_index = bitmapIndexNames(where_clause, bitmap_indexes_, trigram_indexes_);
+        stats.index_condition = WhereParser::describe(where_clause);
+        stats.exact = true;
+        stats.scan_rows = bitmap.cardinality();
+        return;
+    }
+    
+    KeyRange range;
+    bool ranged = false;
+    const TableIndex* covering = (!count_only && !columns.empty()) ? coveringIndex(columns, where_clause, range, ranged) : nullptr;
+    if (covering) {
+        stats.access_path = "Index Only Scan";
+        stats.scan_index = covering->name();
+        rangeConditionText(where_clause, covering->column(), ranged, stats);
+        stats.scan_rows = covering->rangeLookup(range.lowBound(), range.low_inclusive, range.highBound(), range.high_inclusive).size();
+        return;
+    }
+    
+    vector<size_t> candidates;
+    if (indexCandidates(where_clause, candidates, exact, &stats)) {
+        stats.scan_rows = candidates.size();
+        return;
+    }
+    
+    stats.filter = WhereParser::describe(where_clause);
+    vector<pair<int, const Condition*>> zone_filters = zoneFilters(where_clause);
+    if (zone_filters.empty()) return;
+    stats.scan_rows = 0;
+    stats.blocks_total = zone_map_->blockCount();
+    for (size_t block = 0; block < zone_map_->blockCount(); ++block) {
+        if (blockMayMatch(block, zone_filters)) {
+            stats.scan_rows += min(rows_.size(), (block + 1) * ZoneMap::BLOCK_ROWS) - block * ZoneMap::BLOCK_ROWS;
+        } else {
+            ++stats.blocks_skipped;
+        }
+    }
+}
+
+vector<Row> Table::joinTables(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, size_t memory_budget) {
+    
+    return JoinOptimizer::optimizeJoin(left_table, right_table, columns, join_type, condition, where_clause, stats, memory_budget);
+}
+
+int Table::deleteRows(const shared_ptr<LogicExpression>& where_clause) {
+    if (rows_.empty()) {
+        return 0;
+    }
+    
+    vector<size_t> deleted = matchingPositions(where_clause);
+    int deleted_count = static_cast<int>(deleted.size());
+    
+    if (deleted_count > 0) {
+        // new_positions maps every old row position to its position after compaction.
+        vector<size_t> new_positions(rows_.size(), 0);
+        for (size_t pos : deleted) {
+            new_positions[pos] = SIZE_MAX;
+        }
+        
+        for (size_t pos : deleted) {
+            row_bytes_ -= rows_[pos].memoryUsage();
+        }
+        index_bytes_ -= min(index_bytes_, deleted.size() * index_row_bytes_);
+        
+        vector<Row> remaining_rows;
+        remaining_rows.reserve(rows_.size() - deleted.size());
+        for (size_t i = 0; i < rows_.size(); ++i) {
+            if (new_positions[i] != SIZE_MAX) {
+                new_positions[i] = remaining_rows.size();
+                remaining_rows.push_back(move(rows_[i]));
+            }
+        }
+        
+        rows_ = move(remaining_rows);
+        for (auto& index : indexes_) {
+            index->remap(new_positions);
+        }
+        for (auto& unique : unique_indexes_) {
+            unique->build(rows_);
+        }
+        for (auto& bitmap : bitmap_indexes_) {
+            bitmap->build(rows_);
+        }
+        for (auto& trigram : trigram_indexes_) {
+            trigram->build(rows_);
+        }
+        zone_map_->build(rows_);
+        bumpVersion();
+        markDirty(*min_element(deleted.begin(), deleted.end()), true);
+    }
+    
+    return deleted_count;
+}
+
+int Table::updateRows(const unordered_map<string, shared_ptr<const Expression>>& updates, const shared_ptr<LogicExpression>& where_clause) {
+    if (rows_.empty() || updates.empty()) {
+        return 0;
+    }
+    
+    // (column index, expression) in a fixed order, so new values are stored per row in that order.
+    vector<pair<int, const Expression*>> assignments;
+    for (const auto& [col_name, expression] : updates) {
+        int col_idx = getColumnIndex(col_name);
+        if (col_idx == -1) {
+            throw runtime_error("Column '" + col_name + "' not found in table");
+        }
+        assignments.emplace_back(col_idx, expression.get());
+    }
+    
+    // Only indexes storing an updated column (as key or INCLUDE column) need maintenance.
+    vector<TableIndex*> touched_indexes;
+    for (auto& index : indexes_) {
+        for (const auto& update : updates) {
+            if (index->coveredPosition(update.first) != -1) {
+                touched_indexes.push_back(index.get());
+                break;
+            }
+        }
+    }
+    
+    vector<pair<UniqueIndex*, size_t>> touched_uniques;   // (index, assignment)
+    for (auto& unique : unique_indexes_) {
+        for (size_t a = 0; a < assignments.size(); ++a) {
+            if (assignments[a].first == unique->columnIndex()) {
+                touched_uniques.emplace_back(unique.get(), a);
+            }
+        }
+    }
+    
+    vector<BitmapIndex*> touched_bitmaps;
+    for (auto& bitmap : bitmap_indexes_) {
+        if (updates.count(bitmap->column())) {
+            touched_bitmaps.push_back(bitmap.get());
+        }
+    }
+    
+    vector<TrigramIndex*> touched_trigrams;
+    for (auto& trigram : trigram_indexes_) {
+        if (updates.count(trigram->column())) {
+            touched_trigrams.push_back(trigram.get());
+        }
+    }
+    
+    vector<size_t> positions = matchingPositions(where_clause);
+    int updated_count = static_cast<int>(positions.size());
+    
+    // New values of every matching row, computed from the old rows: assignments.size() per row.
+    vector<Value> new_values;
+    new_values.reserve(positions.size() * assignments.size());
+    for (size_t pos : positions) {
+        for (const auto& [col_idx, expression] : assignments) {
+            new_values.push_back(assignmentValue(expression->evaluate(rows_[pos]), columns_[col_idx].type));
+        }
+    }
+    
+    // Check key constraints before touching any row, so a violation leaves the table unchanged:
+    // the new keys must differ from each other and from the keys of the rows not updated.
+    for (const auto& [unique, a] : touched_uniques) {
+        unordered_set<Value> new_keys;
+        for (size_t i = 0; i < positions.size(); ++i) {
+            const Value& key = new_values[i * assignments.size() + a];
+            size_t owner = unique->find(key);
+            if (!new_keys.insert(key).second ||
+                (owner != SIZE_MAX && !binary_search(positions.begin(), positions.end(), owner))) {
+                throw runtime_error("Duplicate value for " + string(unique->constraintName()) + " column '" + unique->column() + "'");
+            }
+        }
+    }
+    
+    // Unique keys are swapped in two passes: with SET id = id + 1 the new key of one row is
+    // the old key of the next.
+    for (const auto& [unique, a] : touched_uniques) {
+        for (size_t pos : positions) {
+            unique->erase(rows_[pos][unique->columnIndex()]);
+        }
+    }
+    for (size_t i = 0; i < positions.size(); ++i) {
+        size_t pos = positions[i];
+        Row& row = rows_[pos];
+        for (TableIndex* index : touched_indexes) {
+            index->erase(row[index->columnIndex()], pos);
+        }
+        for (BitmapIndex* bitmap : touched_bitmaps) {
+            bitmap->erase(row[bitmap->columnIndex()], pos);
+        }
+        for (TrigramIndex* trigram : touched_trigrams) {
+            trigram->erase(row[trigram->columnIndex()], pos);
+        }
+        row_bytes_ -= row.memoryUsage();
+        index_bytes_ -= indexedValueBytes(row);
+        for (size_t a = 0; a < assignments.size(); ++a) {
+            row[assignments[a].first] = move(new_values[i * assignments.size() + a]);
+        }
+        row_bytes_ += row.memoryUsage();
+        index_bytes_ += indexedValueBytes(row);
+        for (TableIndex* index : touched_indexes) {
+            index->insert(row, pos);
+        }
+        for (BitmapIndex* bitmap : touched_bitmaps) {
+            bitmap->insert(row[bitmap->columnIndex()], pos);
+        }
+        for (TrigramIndex* trigram : touched_trigrams) {
+            trigram->insert(row[trigram->columnIndex()], pos);
+        }
+        zone_map_->widen(pos, row);
+    }
+    for (const auto& [unique, a] : touched_uniques) {
+        for (size_t pos : positions) {
+            unique->insert(rows_[pos][unique->columnIndex()], pos);
+        }
+        if (unique->needsRebuild()) unique->build(rows_);
+    }
+    
+    if (updated_count > 0) {
+        for (size_t pos : positions) {
+            markDirty(pos);
+        }
+        bumpVersion();
+    }
+    
+    return updated_count;
+}
+
+bool Table::createIndex(const string& index_name, const string& column_name, IndexKind kind, const vector<string>& include_columns) {
+    memory_stale_ = true;
+    int col_idx = getColumnIndex(column_name);
+    if (col_idx == -1) {
+        cout << "Error: Column '" << column_name << "' does not exist in table '" << name_ << "'" << endl;
+        return false;
+    }
+    if (hasIndex(index_name)) {
+        cout << "Error: Index '" << index_name << "' already exists" << endl;
+        return false;
+    }
+    if (kind == IndexKind::TRIGRAM && columns_[col_idx].type != "VARCHAR") {
+        cout << "Error: Trigram indexes need a VARCHAR column" << endl;
+        return false;
+    }
+    if (kind != IndexKind::BTREE && !include_columns.empty()) {
+        cout << "Error: INCLUDE columns are only supported on B+Tree indexes" << endl;
+        return false;
+    }
+    
+    vector<int> include_idx;
+    for (const auto& include_column : include_columns) {
+        int idx = getColumnIndex(include_column);
+        if (idx == -1) {
+            cout << "Error: Column '" << include_column << "' does not exist in table '" << name_ << "'" << endl;
+            return false;
+        }
+        if (idx == col_idx || find(include_idx.begin(), include_idx.end(), idx) != include_idx.end()) {
+            cout << "Error: Column '" << include_column << "' is already part of index '" << index_name << "'" << endl;
+            return false;
+        }
+        include_idx.push_back(idx);
+    }
+    
+    if (kind == IndexKind::BITMAP) {
+        auto index = make_shared<BitmapIndex>(index_name, column_name, col_idx);
+        index->build(rows_);
+        bitmap_indexes_.push_back(move(index));
+    } else if (kind == IndexKind::TRIGRAM) {
+        auto index = make_shared<TrigramIndex>(index_name, column_name, col_idx);
+        index->build(rows_);
+        trigram_indexes_.push_back(move(index));
+    } else {
+        auto index = make_shared<TableIndex>(index_name, column_name, col_idx, include_columns, include_idx);
+        index->build(rows_);
+        index->saveToFile(indexFile(index_name), fileStamp());
+        indexes_.push_back(move(index));
+    }
+    saveSchema();
+    return true;
+}
+
+bool Table::openIndex(const IndexDefinition& definition) {
+    memory_stale_ = true;
+    int col_idx = getColumnIndex(definition.column);
+    if (col_idx == -1 || hasIndex(definition.name)) {
+        return false;
+    }
+    
+    // Bitmap and trigram indexes are rebuilt in one pass over the rows; B+Tree indexes come from their file.
+    if (definition.kind == IndexKind::BITMAP) {
+        auto index = make_shared<BitmapIndex>(definition.name, definition.column, col_idx);
+        index->build(rows_);
+        bitmap_indexes_.push_back(move(index));
+        return true;
+    }
+    if (definition.kind == IndexKind::TRIGRAM) {
+        auto index = make_shared<TrigramIndex>(definition.name, definition.column, col_idx);
+        index->build(rows_);
+        trigram_indexes_.push_back(move(index));
+        return true;
+    }
+    
+    vector<int> include_idx;
+    for (const auto& include_column : definition.include) {
+        int idx = getColumnIndex(include_column);
+        if (idx == -1) return false;
+        include_idx.push_back(idx);
+    }
+    
+    auto index = make_shared<TableIndex>(definition.name, definition.column, col_idx, definition.include, include_idx);
+    if (!index->loadFromFile(indexFile(definition.name), fileStamp(), rows_)) {
+        index->build(rows_);
+        index->saveToFile(indexFile(definition.name), fileStamp());
+    }
+    indexes_.push_back(move(index));
+    return true;
+}
+
+bool Table::dropIndex(const string& index_name) {
+    memory_stale_ = true;
+    for (auto it = indexes_.begin(); it != indexes_.end(); ++it) {
+        if ((*it)->name() == index_name) {
+            indexes_.erase(it);
+            error_code ec;
+            filesystem::remove(indexFile(index_name), ec);
+            saveSchema();
+            return true;
+        }
+    }
+    for (auto it = bitmap_indexes_.begin(); it != bitmap_indexes_.end(); ++it) {
+        if ((*it)->name() == index_name) {
+            bitmap_indexes_.erase(it);
+            saveSchema();
+            return true;
+        }
+    }
+    for (auto it = trigram_indexes_.begin(); it != trigram_indexes_.end(); ++it) {
+        if ((*it)->name() == index_name) {
+            trigram_indexes_.erase(it);
+            saveSchema();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Table::hasIndex(const string& index_name) const {
+    for (const auto& index : indexes_) {
+        if (index->name() == index_name) return true;
+    }
+    for (const auto& index : bitmap_indexes_) {
+        if (index->name() == index_name) return true;
+    }
+    for (const auto& index : trigram_indexes_) {
+        if (index->name() == index_name) return true;
+    }
+    return false;
+}
+
+string Table::equalityIndexOn(int column_idx, bool& unique) const {
+    for (const auto& index : unique_indexes_) {
+        if (index->columnIndex() == column_idx) {
+            unique = true;
+            return index->constraintName();
+        }
+    }
+    for (const auto& index : indexes_) {
+        if (index->columnIndex() == column_idx) {
+            unique = false;
+            return index->name();
+        }
+    }
+    return "";
+}
+
+bool Table::indexLookup(int column_idx, const Value& key, vector<size_t>& positions) const {
+    for (const auto& index : unique_indexes_) {
+        if (index->columnIndex() == column_idx) {
+            size_t pos = index->find(key);
+            if (pos != SIZE_MAX) positions.push_back(pos);
+            return true;
+        }
+    }
+    for (const auto& index : indexes_) {
+        if (index->columnIndex() == column_idx) {
+            vector<size_t> rows = index->rangeLookup(&key, true, &key, true);
+            positions.insert(positions.end(), rows.begin(), rows.end());
+            return true;
+        }
+    }
+    return false;
+}
+
+void Table::rebuildIndexes() {
+    memory_stale_ = true;
+    for (auto& unique : unique_indexes_) {
+        if (!unique->build(rows_)) {
+            cerr << "Warning: Table '" << name_ << "' holds duplicate values in " << unique->constraintName() << " column '" << unique->column() << "'" << endl;
+        }
+    }
+    for (auto& index : indexes_) {
+        index->build(rows_);
+    }
+    for (auto& bitmap : bitmap_indexes_) {
+        bitmap->build(rows_);
+    }
+    for (auto& trigram : trigram_indexes_) {
+        trigram->build(rows_);
+    }
+    if (!zone_map_->loadFromFile(zoneMapFile(), fileStamp())) {
+        zone_map_->build(rows_);
+    }
+}
+
+size_t Table::memoryUsage() const {
+    // Row and index bytes are kept up to date by every change; only a reload or an index change
+    // walks every row and index again. Inserts and deletes charge the indexes their average
+    // bytes per row, UPDATE the exact change of the stored keys.
+    if (memory_stale_) {
+        row_bytes_ = 0;
+        for (const auto& row : rows_) row_bytes_ += row.memoryUsage();
+        index_bytes_ = zone_map_->memoryUsage();
+        for (const auto& unique : unique_indexes_) index_bytes_ += unique->memoryUsage();
+        for (const auto& index : indexes_) index_bytes_ += index->memoryUsage();
+        for (const auto& bitmap : bitmap_indexes_) index_bytes_ += bitmap->memoryUsage();
+        for (const auto& trigram : trigram_indexes_) index_bytes_ += trigram->memoryUsage();
+        index_row_bytes_ = rows_.empty() ? 0 : index_bytes_ / rows_.size();
+        memory_stale_ = false;
+    }
+    return sizeof(Table) + (rows_.capacity() - rows_.size()) * sizeof(Row) + row_bytes_ + index_bytes_;
+}
+
+size_t Table::indexedValueBytes(const Row& row) const {
+    size_t bytes = 0;
+    for (const auto& index : indexes_) bytes += index->entryBytes(row);
+    for (const auto& unique : unique_indexes_) bytes += heapBytes(row[unique->columnIndex()]);
+    return bytes;
+}
+
+bool Table::evaluateBitmap(const variant<Condition, shared_ptr<LogicExpression>>& operand, RoaringBitmap& result, bool& exact) const {
+    if (holds_alternative<shared_ptr<LogicExpression>>(operand)) {
+        return evaluateBitmap(get<shared_ptr<LogicExpression>>(operand), result, exact);
+    }
+    
+    const Condition& condition = get<Condition>(operand);
+    if (condition.is_column_comparison || condition.subquery || condition.expression) return false;
+    for (const auto& bitmap : bitmap_indexes_) {
+        if (bitmap->column() == condition.left_column) {
+            result = bitmap->lookup(condition.op, condition.constant_value);
+            exact = true;
+            return true;
+        }
+    }
+    if (condition.op == CompareOp::LIKE) {
+        for (const auto& trigram : trigram_indexes_) {
+            const string* pattern = get_if<string>(&condition.constant_value);
+            if (pattern && trigram->column() == condition.left_column && trigram->candidates(*pattern, result)) {
+                exact = false;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool Table::evaluateBitmap(const shared_ptr<LogicExpression>& expression, RoaringBitmap& result, bool& exact) const {
+    if (!expression) return false;
+    if (expression->isSingleCondition) {
+        return evaluateBitmap(expression->left, result, exact);
+    }
+    
+    RoaringBitmap left, right;
+    bool left_exact = false, right_exact = false;
+    bool has_left = evaluateBitmap(expression->left, left, left_exact);
+    
+    // The complement of a superset is not a subset, so NOT needs an exact operand.
+    if (expression->op == LogicOp::NOT) {
+        if (!has_left || !left_exact) return false;
+        result = left.complement(static_cast<uint32_t>(rows_.size()));
+        exact = true;
+        return true;
+    }
+    
+    bool has_right = evaluateBitmap(expression->right, right, right_exact);
+    if (expression->op == LogicOp::AND) {
+        // One side alone still bounds the result; the caller then rechecks the other side.
+        if (has_left && has_right) {
+            result = RoaringBitmap::intersect(left, right);
+            exact = left_exact && right_exact;
+        } else if (has_left || has_right) {
+            result = has_left ? move(left) : move(right);
+            exact = false;
+        } else {
+            return false;
+        }
+        return true;
+    }
+    if (expression->op == LogicOp::OR && has_left && has_right) {
+        result = RoaringBitmap::unite(left, right);
+        exact = left_exact && right_exact;
+        return true;
+    }
+    return false;
+}
+
+bool Table::indexCandidates(const shared_ptr<LogicExpression>& where_clause, vector<size_t>& positions, bool& exact, QueryStats* stats) const {
+    exact = false;
+    if ((indexes_.empty() && unique_indexes_.empty() && bitmap_indexes_.empty() && trigram_indexes_.empty()) || !where_clause) return false;
+    
+    vector<const Condition*> conjuncts;
+    collectConjuncts(where_clause, conjuncts);
+    
+    // key = constant on a PRIMARY KEY / UNIQUE column matches at most one row.
+    for (const Condition* condition : conjuncts) {
+        if (condition->is_column_comparison || condition->subquery || condition->expression || condition->op != CompareOp::EQUAL) continue;
+        for (const auto& unique : unique_indexes_) {
+            if (unique->column() == condition->left_column) {
+                positions.clear();
+                size_t pos = unique->find(condition->constant_value);
+                if (pos != SIZE_MAX) positions.push_back(pos);
+                if (stats) {
+                    stats->access_path = "Unique Index Lookup";
+                    stats->scan_index = string(unique->constraintName()) + " (" + unique->column() + ")";
+                    splitConditionText(where_clause, [condition](const Condition& term) { return &term == condition; }, false, stats->index_condition, stats->filter);
+                    stats->scan_rows = positions.size();
+                }
+                return true;
+            }
+        }
+    }
+    
+    // AND / OR / NOT over bitmap-indexed columns is answered with bitmap operations, and
+    // trigram indexes contribute candidate bitmaps for LIKE.
+    RoaringBitmap bitmap;
+    bool bitmap_exact = false;
+    bool has_bitmap = (!bitmap_indexes_.empty() || !trigram_indexes_.empty()) && evaluateBitmap(where_clause, bitmap, bitmap_exact);
+    if (has_bitmap && bitmap_exact) {
+        positions = bitmap.toPositions();
+        exact = true;
+        if (stats) {
+            stats->access_path = "Bitmap Index Scan";
+            stats->scan_index = bitmapIndexNames(where_clause, bitmap_indexes_, trigram_indexes_);
+            stats->index_condition = WhereParser::describe(where_clause);
+            stats->exact = true;
+            stats->scan_rows = positions.size();
+        }
+        return true;
+    }
+    
+    // Every conjunct on the same indexed column tightens one key range.
+    unordered_map<TableIndex*, KeyRange> ranges;
+    for (const Condition* condition : conjuncts) {
+        if (!isRangeCondition(*condition)) continue;
+        
+        TableIndex* index = nullptr;
+        for (const auto& candidate : indexes_) {
+            if (candidate->column() == condition->left_column) {
+                index = candidate.get();
+                break;
+            }
+        }
+        if (!index) continue;
+        
+        tightenRange(ranges[index], *condition);
+    }
+    if (ranges.empty() && !has_bitmap) return false;
+    
+    // Use the most selective index; the remaining conjuncts are checked by the caller.
+    bool found = false;
+    const TableIndex* chosen = nullptr;
+    if (has_bitmap) {
+        positions = bitmap.toPositions();
+        found = true;
+    }
+    for (const auto& [index, range] : ranges) {
+        vector<size_t> rows = index->rangeLookup(range.lowBound(), range.low_inclusive, range.highBound(), range.high_inclusive);
+        if (!found || rows.size() < positions.size()) {
+            positions = move(rows);
+            chosen = index;
+            found = true;
+        }
+    }
+    sort(positions.begin(), positions.end());
+    if (stats) {
+        stats->access_path = chosen ? "Index Scan" : "Bitmap Index Scan";
+        stats->scan_index = chosen ? chosen->name() : bitmapIndexNames(where_clause, bitmap_indexes_, trigram_indexes_);
+        if (chosen) {
+            rangeConditionText(where_clause, chosen->column(), true, *stats);
+        } else {
+            bitmapConditionText(where_clause, bitmap_indexes_, trigram_indexes_, *stats);
+        }
+        stats->scan_rows = positions.size();
+    }
+    return true;
+}
+
+// Part III.Realization of Queryoptimizer class in minisql.h
+vector<Row> JoinOptimizer::optimizeJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, size_t memory_budget) {
+    
+    size_t left_size = left_table.rowCount();
+    size_t right_size = right_table.rowCount();
+    
+    vector<Row> result;
+    if (join_type != JoinType::INNER_JOIN || !tryIndexNestedLoopJoin(left_table, right_table, columns, condition, where_clause, stats, result)) {
+        result = (left_size < 1000 && right_size < 1000) ? nestedLoopJoin(left_table, right_table, columns, join_type, condition, where_clause, stats) : hashJoin(left_table, right_table, columns, join_type, condition, where_clause, stats, memory_budget);
+    }
+    if (stats) {
+        stats->result_rows = result.size();
+    }
+    return result;
+}
+
+// True when every column the condition reads resolves to the given side of the joined row,
+// i.e. it can be checked on a row of that table alone. Join WHERE columns resolve to the
+// first match, so a right-side name only counts when the left table has no such column.
+static bool isLocalCondition(const Condition& condition, const Table& left_table, const Table& right_table, bool left_side) {
+    // Computed terms are compiled against the columns of both tables.
+    if (condition.expression) return false;
+    vector<string> names;
+    if (!condition.left_column.empty()) names.push_back(condition.left_column);
+    if (condition.is_column_comparison) names.push_back(condition.right_column);
+    if (condition.subquery && !condition.subquery->outer_column.empty()) names.push_back(condition.subquery->outer_column);
+    
+    for (const auto& name : names) {
+        bool in_left = left_table.getColumnIndex(name) != -1;
+        bool in_right = right_table.getColumnIndex(name) != -1;
+        if (left_side ? !in_left : (in_left || !in_right)) return false;
+    }
+    return true;
+}
+
+bool JoinOptimizer::planIndexNestedLoopJoin(const Table& left_table, const Table& right_table, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, IndexJoinPlan& plan) {
+    if (condition.op != CompareOp::EQUAL) return false;
+    
+    vector<int> left_keys, right_keys;
+    resolveJoinKeys(left_table, right_table, condition, left_keys, right_keys);
+    
+    vector<const Condition*> conjuncts;
+    collectConjuncts(where_clause, conjuncts);
+    
+    // Cost in row touches: a hash join reads both tables once, an index nested loop join does
+    // one index probe per surviving outer row (1 for a hash index, ~log2(n) for a B+Tree).
+    double best_cost = static_cast<double>(left_table.rowCount() + right_table.rowCount());
+    bool found = false;
+    
+    for (bool left_outer : {true, false}) {
+        const Table& outer_table = left_outer ? left_table : right_table;
+        const Table& inner_table = left_outer ? right_table : left_table;
+        int inner_key = left_outer ? right_keys[0] : left_keys[0];
+        
+        bool unique = false;
+        string name = inner_table.equalityIndexOn(inner_key, unique);
+        if (name.empty()) continue;
+        
+        vector<string> outer_columns;
+        for (const auto& col : outer_table.columns()) outer_columns.push_back(col.name);
+        vector<const Condition*> local;
+        for (const Condition* conjunct : conjuncts) {
+            if (isLocalCondition(*conjunct, left_table, right_table, left_outer)) local.push_back(conjunct);
+        }
+        
+        vector<size_t> positions;
+        const vector<Row>& outer_rows = outer_table.getAllRows();
+        for (size_t i = 0; i < outer_rows.size(); ++i) {
+            bool keep = true;
+            for (size_t c = 0; keep && c < local.size(); ++c) {
+                keep = ConditionEvaluator::evaluate(outer_rows[i], outer_columns, *local[c]);
+            }
+            if (keep) positions.push_back(i);
+        }
+        
+        double probe_cost = unique ? 1.0 : log2(static_cast<double>(inner_table.rowCount()) + 2.0);
+        double cost = static_cast<double>(positions.size()) * probe_cost;
+        if (cost < best_cost) {
+            best_cost = cost;
+            found = true;
+            plan.outer_is_left = left_outer;
+            plan.index_name = name;
+            plan.outer_filter = move(local);
+            plan.outer_positions = move(positions);
+        }
+    }
+    return found;
+}
+
+// Text of the outer filter of an index nested loop join, conjuncts joined with AND.
+static string describeConjuncts(const vector<const Condition*>& conjuncts) {
+    string text;
+    for (const Condition* conjunct : conjuncts) {
+        text += (text.empty() ? "" : " AND ") + WhereParser::describe(*conjunct);
+    }
+    return text;
+}
+
+bool JoinOptimizer::tryIndexNestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, vector<Row>& result) {
+    auto start = Clock::now();
+    IndexJoinPlan plan;
+    if (!planIndexNestedLoopJoin(left_table, right_table, condition, where_clause, plan)) return false;
+    double plan_ms = elapsedMs(start);
+    
+    vector<int> left_keys, right_keys;
+    resolveJoinKeys(left_table, right_table, condition, left_keys, right_keys);
+    bool outer_is_left = plan.outer_is_left;
+    const vector<size_t>& outer_positions = plan.outer_positions;
+    const Table& outer_table = outer_is_left ? left_table : right_table;
+    const Table& inner_table = outer_is_left ? right_table : left_table;
+    const vector<int>& outer_keys = outer_is_left ? left_keys : right_keys;
+    const vector<int>& inner_keys = outer_is_left ? right_keys : left_keys;
+    const vector<Row>& outer_rows = outer_table.getAllRows();
+    const vector<Row>& inner_rows = inner_table.getAllRows();
+    
+    if (stats) {
+        stats->join_algorithm = "index nested loop join";
+        stats->join_index = inner_table.name() + "." + plan.index_name;
+        stats->build_rows = 0;
+        stats->probe_rows = outer_positions.size();
+        stats->probe_rows_filtered = outer_rows.size() - outer_positions.size();
+        stats->build_is_left = outer_is_left;
+        stats->outer_filter = describeConjuncts(plan.outer_filter);
+        stats->build_ms = plan_ms;
+    }
+    start = Clock::now();
+    
+    vector<CompareKernel> key_equal;
+    for (size_t k = 0; k < outer_keys.size(); ++k) {
+        key_equal.push_back(ConditionEvaluator::kernel(outer_table.columns()[outer_keys[k]].type, inner_table.columns()[inner_keys[k]].type, CompareOp::EQUAL));
+    }
+    
+    JoinSink sink = makeSink(left_table, right_table, columns, where_clause);
+    vector<size_t> matches;
+    for (size_t outer_pos : outer_positions) {
+        const Row& outer_row = outer_rows[outer_pos];
+        matches.clear();
+        inner_table.indexLookup(inner_keys[0], outer_row[outer_keys[0]], matches);
+        
+        for (size_t inner_pos : matches) {
+            const Row& inner_row = inner_rows[inner_pos];
+            bool match = true;
+            for (size_t k = 1; match && k < outer_keys.size(); ++k) {
+                match = key_equal[k](outer_row[outer_keys[k]], inner_row[inner_keys[k]]);
             }
-            
             if (match) {
-                vector<Value> joined_values;
-                vector<Value> all_values_for_where; 
-                vector<string> where_eval_columns;
-                
-                if (select_all) {
-                    for (const auto& val : left_row.values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : right_row.values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    where_eval_columns = all_columns_for_where;
+                emitJoinedRow(outer_is_left ? outer_row : inner_row, outer_is_left ? inner_row : outer_row, sink);
+            }
+        }
+    }
+    if (stats) {
+        stats->joined_rows = sink.joined_rows;
+        stats->probe_ms = elapsedMs(start);
+    }
+    
+    result = move(sink.result);
+    return true;
+}
+
+void JoinOptimizer::planJoin(const Table& left_table, const Table& right_table, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats& stats, size_t memory_budget) {
+    IndexJoinPlan plan;
+    if (join_type == JoinType::INNER_JOIN && planIndexNestedLoopJoin(left_table, right_table, condition, where_clause, plan)) {
+        const Table& inner_table = plan.outer_is_left ? right_table : left_table;
+        stats.join_algorithm = "index nested loop join";
+        stats.join_index = inner_table.name() + "." + plan.index_name;
+        stats.build_is_left = plan.outer_is_left;
+        stats.outer_filter = describeConjuncts(plan.outer_filter);
+        stats.probe_rows = plan.outer_positions.size();
+        stats.probe_rows_filtered = (plan.outer_is_left ? left_table : right_table).rowCount() - plan.outer_positions.size();
+        return;
+    }
+    
+    size_t left_size = left_table.rowCount();
+    size_t right_size = right_table.rowCount();
+    if (left_size < 1000 && right_size < 1000) {
+        stats.join_algorithm = "nested loop join";
+        stats.build_rows = right_size;
+        stats.probe_rows = left_size;
+        return;
+    }
+    
+    vector<int> left_keys, right_keys;
+    resolveJoinKeys(left_table, right_table, condition, left_keys, right_keys);
+    stats.build_is_left = (left_size <= right_size);
+    const Table& build_table = stats.build_is_left ? left_table : right_table;
+    stats.join_algorithm = "hash join";
+    stats.build_rows = build_table.rowCount();
+    stats.probe_rows = (stats.build_is_left ? right_table : left_table).rowCount();
+    
+    size_t estimated_bytes = estimateHashTableBytes(build_table.getAllRows(), stats.build_is_left ? left_keys : right_keys);
+    if (memory_budget > 0 && estimated_bytes > memory_budget) {
+        stats.join_algorithm = "grace hash join";
+        stats.spill_partitions = gracePartitions(estimated_bytes, memory_budget);
+    }
+}
+
+size_t JoinOptimizer::gracePartitions(size_t estimated_bytes, size_t memory_budget) {
+    size_t partitions = 2;
+    while (partitions < 256 && partitions * memory_budget < estimated_bytes * 2) {
+        partitions <<= 1;
+    }
+    return partitions;
+}
+
+vector<Row> JoinOptimizer::nestedLoopJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats) {
+    
+    if (stats) {
+        stats->join_algorithm = "nested loop join";
+        stats->build_rows = right_table.rowCount();
+        stats->probe_rows = left_table.rowCount();
+    }
+    
+    vector<int> left_keys, right_keys;
+    resolveJoinKeys(left_table, right_table, condition, left_keys, right_keys);
+    
+    if (join_type != JoinType::INNER_JOIN) {
+        cout << "Warning: Only INNER JOIN is currently supported" << endl;
+    }
+    
+    // The first pair uses the condition's operator, composite key pairs are equalities.
+    vector<CompareKernel> key_compare;
+    for (size_t k = 0; k < left_keys.size(); ++k) {
+        key_compare.push_back(ConditionEvaluator::kernel(left_table.columns()[left_keys[k]].type, right_table.columns()[right_keys[k]].type,
+                                                         k == 0 ? condition.op : CompareOp::EQUAL));
+    }
+    
+    JoinSink sink = makeSink(left_table, right_table, columns, where_clause);
+    auto start = Clock::now();
+    
+    for (const auto& left_row : left_table.getAllRows()) {
+        const Value& left_key = left_row[left_keys[0]];
+        for (const auto& right_row : right_table.getAllRows()) {
+            bool match = key_compare[0](left_key, right_row[right_keys[0]]);
+            for (size_t k = 1; match && k < left_keys.size(); ++k) {
+                match = key_compare[k](left_row[left_keys[k]], right_row[right_keys[k]]);
+            }
+            
+            if (match) {
+                emitJoinedRow(left_row, right_row, sink);
+            }
+        }
+    }
+    if (stats) {
+        stats->joined_rows = sink.joined_rows;
+        stats->probe_ms = elapsedMs(start);
+    }
+    
+    return move(sink.result);
+}
+
+vector<Row> JoinOptimizer::hashJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, QueryStats* stats, size_t memory_budget) {
+    
+    if (join_type != JoinType::INNER_JOIN) {
+        cout << "Warning: Only INNER JOIN is currently supported" << endl;
+    }
+    
+    vector<int> left_keys, right_keys;
+    resolveJoinKeys(left_table, right_table, condition, left_keys, right_keys);
+    
+    // Choose the smaller table as the build table.
+    size_t left_size = left_table.rowCount();
+    size_t right_size = right_table.rowCount();
+    bool build_is_left = (left_size <= right_size);
+    const Table& build_table = build_is_left ? left_table : right_table;
+    const Table& probe_table = build_is_left ? right_table : left_table;
+    const vector<int>& build_keys = build_is_left ? left_keys : right_keys;
+    const vector<int>& probe_keys = build_is_left ? right_keys : left_keys;
+    
+    if (stats) {
+        stats->join_algorithm = "hash join";
+        stats->build_rows = build_table.rowCount();
+        stats->probe_rows = probe_table.rowCount();
+        stats->build_is_left = build_is_left;
+    }
+    
+    JoinSink sink = makeSink(left_table, right_table, columns, where_clause);
+    
+    if (memory_budget > 0 && estimateHashTableBytes(build_table.getAllRows(), build_keys) > memory_budget) {
+        graceHashJoin(build_table, build_keys, probe_table, probe_keys, build_is_left, memory_budget, sink, stats);
+    } else {
+        VectorRows probe_rows{probe_table.getAllRows()};
+        dispatchHashJoin(build_table.getAllRows(), build_keys, probe_rows, probe_keys, build_is_left, sink, stats);
+    }
+    if (stats) {
+        stats->joined_rows = sink.joined_rows;
+    }
+    
+    return move(sink.result);
+}
+
+// Spilled partitions are split again at most this many times before a hot key falls back to
+// joining the build side block by block.
+static const int MAX_SPILL_LEVELS = 3;
+
+// Unique prefix of the spill files of one partitioning pass. The process id keeps processes
+// sharing the data directory apart.
+static string spillPrefix() {
+    static atomic<size_t> spill_sequence{0};
+#ifdef _WIN32
+    long process_id = _getpid();
+#else
+    long process_id = getpid();
+#endif
+    string spill_dir = "../../data/tmp/";
+    error_code ec;
+    filesystem::create_directories(spill_dir, ec);
+    return spill_dir + "join_" + to_string(process_id) + "_" + to_string(++spill_sequence) + "_";
+}
+
+// Spill files of one partitioning pass, removed on every exit path, including exceptions.
+struct SpillFiles {
+    vector<string> build;
+    vector<string> probe;
+    
+    explicit SpillFiles(size_t partitions) {
+        string prefix = spillPrefix();
+        for (size_t p = 0; p < partitions; ++p) {
+            build.push_back(prefix + "build_" + to_string(p) + ".spill");
+            probe.push_back(prefix + "probe_" + to_string(p) + ".spill");
+        }
+    }
+    ~SpillFiles() {
+        error_code ec;
+        for (const auto& file : build) filesystem::remove(file, ec);
+        for (const auto& file : probe) filesystem::remove(file, ec);
+    }
+};
+
+// Hash deciding the partition of a key at level: the normalized key hash at level 0, remixed
+// with a different salt on every level below, so rows that shared a partition spread again.
+static uint64_t saltedHash(uint64_t hash, int level) {
+    if (level == 0) return hash;
+    hash += static_cast<uint64_t>(level) * 0x9e3779b97f4a7c15ULL;
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+void JoinOptimizer::graceHashJoin(const Table& build_table, const vector<int>& build_keys, const Table& probe_table, const vector<int>& probe_keys, bool build_is_left, size_t memory_budget, JoinSink& sink, QueryStats* stats) {
+    
+    auto start = Clock::now();
+    size_t estimated_bytes = estimateHashTableBytes(build_table.getAllRows(), build_keys);
+    size_t partitions = gracePartitions(estimated_bytes, memory_budget);
+    SpillFiles files(partitions);
+    
+    vector<size_t> partition_bytes;
+    VectorRows build_rows{build_table.getAllRows()};
+    VectorRows probe_rows{probe_table.getAllRows()};
+    size_t bytes_spilled = spillPartitions(build_rows, build_keys, 0, files.build, &partition_bytes);
+    bytes_spilled += spillPartitions(probe_rows, probe_keys, 0, files.probe, nullptr);
+    
+    if (stats) {
+        stats->join_algorithm = "grace hash join";
+        stats->spill_partitions = partitions;
+        stats->bytes_spilled = bytes_spilled;
+        stats->partition_ms = elapsedMs(start);
+    }
+    
+    for (size_t p = 0; p < partitions; ++p) {
+        joinSpilledPartition(files.build[p], files.probe[p], partition_bytes[p], estimated_bytes, 1, build_keys, probe_keys, build_is_left, memory_budget, sink, stats);
+    }
+}
+
+void JoinOptimizer::joinSpilledPartition(const string& build_file, const string& probe_file, size_t build_bytes, size_t parent_bytes, int level, const vector<int>& build_keys, const vector<int>& probe_keys, bool build_is_left, size_t memory_budget, JoinSink& sink, QueryStats* stats) {
+    
+    if (build_bytes == 0) {
+        return;
+    }
+    
+    if (build_bytes > memory_budget && level <= MAX_SPILL_LEVELS && build_bytes < parent_bytes) {
+        auto start = Clock::now();
+        size_t partitions = gracePartitions(build_bytes, memory_budget);
+        SpillFiles files(partitions);
+        vector<size_t> partition_bytes;
+        size_t bytes_spilled = 0;
+        {
+            ifstream build_in(build_file, ios::binary);
+            SpillRows build_rows{build_in, Row()};
+            bytes_spilled += spillPartitions(build_rows, build_keys, level, files.build, &partition_bytes);
+            ifstream probe_in(probe_file, ios::binary);
+            SpillRows probe_rows{probe_in, Row()};
+            bytes_spilled += spillPartitions(probe_rows, probe_keys, level, files.probe, nullptr);
+        }
+        if (stats) {
+            stats->spill_partitions += partitions;
+            stats->bytes_spilled += bytes_spilled;
+            stats->partition_ms += elapsedMs(start);
+        }
+        
+        for (size_t p = 0; p < partitions; ++p) {
+            joinSpilledPartition(files.build[p], files.probe[p], partition_bytes[p], build_bytes, level + 1, build_keys, probe_keys, build_is_left, memory_budget, sink, stats);
+        }
+        return;
+    }
+    
+    // Build blocks that fit the budget; a partition within the budget is a single block.
+    ifstream build_in(build_file, ios::binary);
+    vector<Row> block;
+    size_t block_bytes = 0;
+    Row row;
+    auto joinBlock = [&]() {
+        ifstream probe_in(probe_file, ios::binary);
+        SpillRows probe_rows{probe_in, Row()};
+        dispatchHashJoin(block, build_keys, probe_rows, probe_keys, build_is_left, sink, stats);
+        block.clear();
+        block_bytes = 0;
+    };
+    while (readSpillRow(build_in, row)) {
+        size_t bytes = hashEntryBytes(row, build_keys);
+        if (!block.empty() && block_bytes + bytes > memory_budget) {
+            joinBlock();
+        }
+        block_bytes += bytes;
+        block.push_back(move(row));
+    }
+    if (!block.empty()) {
+        joinBlock();
+    }
+}
+
+// Partition on the top bits of the (salted) normalized key hash, so that INT and DOUBLE keys
+// that compare equal meet in the same partition; the per-partition hash table uses the low bits.
+template<typename RowSource>
+size_t JoinOptimizer::spillPartitions(RowSource& rows, const vector<int>& keys, int level, const vector<string>& files, vector<size_t>* partition_bytes) {
+    int partition_bits = 1;
+    while ((size_t(1) << partition_bits) < files.size()) {
+        partition_bits++;
+    }
+    
+    vector<ofstream> outs;
+    for (const auto& file : files) {
+        outs.emplace_back(file, ios::binary | ios::trunc);
+        if (!outs.back().is_open()) {
+            throw runtime_error("Cannot create spill file: " + file);
+        }
+    }
+    if (partition_bytes) {
+        partition_bytes->assign(files.size(), 0);
+    }
+    while (const Row* row = rows.next()) {
+        size_t partition = saltedHash(normalizedKeyHash(*row, keys), level) >> (64 - partition_bits);
+        writeSpillRow(outs[partition], *row);
+        if (partition_bytes) {
+            (*partition_bytes)[partition] += hashEntryBytes(*row, keys);
+        }
+    }
+    size_t bytes = 0;
+    for (auto& out : outs) {
+        bytes += static_cast<size_t>(out.tellp());
+        out.close();
+    }
+    return bytes;
+}
+
+template<typename ProbeRows>
+void JoinOptimizer::dispatchHashJoin(const vector<Row>& build_rows, const vector<int>& build_keys, ProbeRows& probe_rows, const vector<int>& probe_keys, bool build_is_left, JoinSink& sink, QueryStats* stats) {
+    
+    // Composite keys are packed into one byte string per row and stay on the hash path.
+    if (build_keys.size() > 1) {
+        auto build_key = [&build_keys](const Row& row) {
+            string key;
+            encodeJoinKey(row, build_keys, key);
+            return key;
+        };
+        auto probe_key = [&probe_keys](const Row& row, string& scratch) -> const string* {
+            encodeJoinKey(row, probe_keys, scratch);
+            return &scratch;
+        };
+        probeHashTable<string>(build_rows, probe_rows, build_key, probe_key, build_is_left, sink, stats);
+        return;
+    }
+    
+    // Single keys use a typed hash table chosen from the build key types. Probe keys are
+    // coerced to that type, so INT 1 and DOUBLE 1.0 meet just like ConditionEvaluator::compare.
+    int build_idx = build_keys[0];
+    int probe_idx = probe_keys[0];
+    bool has_int = false, has_double = false, has_string = false;
+    for (const auto& row : build_rows) {
+        switch (row[build_idx].index()) {
+            case 0: has_int = true; break;
+            case 1: has_double = true; break;
+            default: has_string = true; break;
+        }
+    }
+    
+    if (has_int && !has_double && !has_string) {
+        auto build_key = [build_idx](const Row& row) { return get<int>(row[build_idx]); };
+        auto probe_key = [probe_idx](const Row& row, int& scratch) -> const int* {
+            const Value& value = row[probe_idx];
+            if (const int* key = get_if<int>(&value)) return key;
+            // A DOUBLE probe key can only equal an INT build key when it is integral.
+            if (const double* key = get_if<double>(&value)) {
+                if (*key >= INT_MIN && *key <= INT_MAX && *key == static_cast<double>(static_cast<int>(*key))) {
+                    scratch = static_cast<int>(*key);
+                    return &scratch;
+                }
+            }
+            return nullptr;
+        };
+        probeHashTable<int>(build_rows, probe_rows, build_key, probe_key, build_is_left, sink, stats);
+    } else if (!has_string) {
+        auto toDouble = [](const Value& value) { return holds_alternative<int>(value) ? static_cast<double>(get<int>(value)) : get<double>(value); };
+        auto build_key = [build_idx, toDouble](const Row& row) { return toDouble(row[build_idx]); };
+        auto probe_key = [probe_idx, toDouble](const Row& row, double& scratch) -> const double* {
+            if (holds_alternative<string>(row[probe_idx])) return nullptr;
+            scratch = toDouble(row[probe_idx]);
+            return &scratch;
+        };
+        probeHashTable<double>(build_rows, probe_rows, build_key, probe_key, build_is_left, sink, stats);
+    } else if (!has_int && !has_double) {
+        auto build_key = [build_idx](const Row& row) { return get<string>(row[build_idx]); };
+        auto probe_key = [probe_idx](const Row& row, string&) -> const string* { return get_if<string>(&row[probe_idx]); };
+        probeHashTable<string>(build_rows, probe_rows, build_key, probe_key, build_is_left, sink, stats);
+    } else {
+        // Mixed column: hash the whole variant with INT keys widened to DOUBLE.
+        auto normalize = [](const Value& value) { return holds_alternative<int>(value) ? Value(static_cast<double>(get<int>(value))) : value; };
+        auto build_key = [build_idx, normalize](const Row& row) { return normalize(row[build_idx]); };
+        auto probe_key = [probe_idx, normalize](const Row& row, Value& scratch) -> const Value* {
+            if (!holds_alternative<int>(row[probe_idx])) return &row[probe_idx];
+            scratch = normalize(row[probe_idx]);
+            return &scratch;
+        };
+        probeHashTable<Value>(build_rows, probe_rows, build_key, probe_key, build_is_left, sink, stats);
+    }
+}
+
+template<typename Key, typename BuildKeyFn, typename ProbeKeyFn, typename ProbeRows>
+void JoinOptimizer::probeHashTable(const vector<Row>& build_rows, ProbeRows& probe_rows, BuildKeyFn build_key, ProbeKeyFn probe_key, bool build_is_left, JoinSink& sink, QueryStats* stats) {
+    
+    auto start = Clock::now();
+    FlatHashTable<Key> hash_table(build_rows.size());
+    
+    // Join filter built from the build keys: an exact bitmap when int keys fall in a
+    // dense range, otherwise a blocked Bloom filter. Probe rows it rejects skip the
+    // hash table entirely.
+    unique_ptr<DenseKeyBitmap> key_bitmap;
+    unique_ptr<BlockedBloomFilter> bloom_filter;
+    if constexpr (is_same_v<Key, int>) {
+        if (!build_rows.empty()) {
+            int min_key = build_key(build_rows[0]);
+            int max_key = min_key;
+            for (const auto& row : build_rows) {
+                int key = build_key(row);
+                min_key = min(min_key, key);
+                max_key = max(max_key, key);
+            }
+            int64_t range = static_cast<int64_t>(max_key) - min_key + 1;
+            if (range <= static_cast<int64_t>(build_rows.size()) * 64) {
+                key_bitmap = make_unique<DenseKeyBitmap>(min_key, max_key);
+            }
+        }
+    }
+    if (!key_bitmap) {
+        bloom_filter = make_unique<BlockedBloomFilter>(build_rows.size());
+    }
+    
+    // construct hash table
+    for (size_t i = 0; i < build_rows.size(); ++i) {
+        Key key = build_key(build_rows[i]);
+        uint64_t hash = hash_table.hashOf(key);
+        if constexpr (is_same_v<Key, int>) {
+            if (key_bitmap) key_bitmap->insert(key);
+        }
+        if (bloom_filter) bloom_filter->insert(hash);
+        hash_table.insert(key, static_cast<uint32_t>(i), hash);
+    }
+    double build_ms = elapsedMs(start);
+    start = Clock::now();
+    
+    // Stop consulting a filter that rejects less than 10% of the first probe rows.
+    const size_t filter_sample = 4096;
+    bool use_filter = true;
+    size_t checked = 0;
+    size_t filtered = 0;
+    Key scratch{};
+    
+    // scan probe table(the larger one)
+    while (const Row* probe_row_ptr = probe_rows.next()) {
+        const Row& probe_row = *probe_row_ptr;
+        const Key* key = probe_key(probe_row, scratch);
+        if (!key) continue;
+        
+        if constexpr (is_same_v<Key, int>) {
+            if (use_filter && key_bitmap) {
+                ++checked;
+                if (!key_bitmap->contains(*key)) {
+                    ++filtered;
+                    continue;
+                }
+            }
+        }
+        
+        uint64_t hash = hash_table.hashOf(*key);
+        if (use_filter && bloom_filter) {
+            ++checked;
+            if (!bloom_filter->mayContain(hash)) {
+                ++filtered;
+                continue;
+            }
+        }
+        if (use_filter && checked == filter_sample && filtered < filter_sample / 10) {
+            use_filter = false;
+        }
+        
+        for (uint32_t entry = hash_table.find(*key, hash); entry != FlatHashTable<Key>::npos; entry = hash_table.next(entry)) {
+            const Row& build_row = build_rows[hash_table.payload(entry)];
+            if (build_is_left) {
+                emitJoinedRow(build_row, probe_row, sink);
+            } else {
+                emitJoinedRow(probe_row, build_row, sink);
+            }
+        }
+    }
+    
+    if (stats) {
+        stats->join_filter = key_bitmap ? "bitmap" : "bloom";
+        stats->probe_rows_filtered += filtered;
+        stats->hash_entries += hash_table.size();
+        stats->hash_bytes += hash_table.memoryUsage() + (key_bitmap ? key_bitmap->memoryUsage() : bloom_filter->memoryUsage());
+        stats->build_ms += build_ms;
+        stats->probe_ms += elapsedMs(start);
+    }
+}
+
+void JoinOptimizer::resolveJoinKeys(const Table& left_table, const Table& right_table, const JoinCondition& condition, vector<int>& left_keys, vector<int>& right_keys) {
+    vector<pair<string, string>> pairs = {{condition.left_column, condition.right_column}};
+    pairs.insert(pairs.end(), condition.extra_keys.begin(), condition.extra_keys.end());
+    
+    // ON may name the tables in the opposite order of FROM ... JOIN.
+    bool swapped = (condition.left_table == right_table.name() && condition.right_table == left_table.name() && left_table.name() != right_table.name());
+    
+    left_keys.clear();
+    right_keys.clear();
+    for (const auto& [left_column, right_column] : pairs) {
+        int left_idx = left_table.getColumnIndex(swapped ? right_column : left_column);
+        int right_idx = right_table.getColumnIndex(swapped ? left_column : right_column);
+        if (left_idx == -1 || right_idx == -1) {
+            throw runtime_error("Join column not found");
+        }
+        left_keys.push_back(left_idx);
+        right_keys.push_back(right_idx);
+    }
+}
+
+uint64_t JoinOptimizer::normalizedKeyHash(const Row& row, const vector<int>& keys) {
+    if (keys.size() > 1) {
+        string encoded;
+        encodeJoinKey(row, keys, encoded);
+        return KeyHash<string>()(encoded);
+    }
+    const Value& value = row[keys[0]];
+    if (const string* key = get_if<string>(&value)) {
+        return KeyHash<string>()(*key);
+    }
+    double key = holds_alternative<int>(value) ? static_cast<double>(get<int>(value)) : get<double>(value);
+    return KeyHash<double>()(key);
+}
+
+// Packed key encoding: numbers take a fixed 9 bytes (tag + 8-byte payload), strings a
+// tag, a 4-byte length and the bytes. Integral numbers are always encoded as 'I' + int64,
+// so INT 3 and DOUBLE 3.0 produce the same bytes.
+void JoinOptimizer::encodeJoinKey(const Row& row, const vector<int>& keys, string& out) {
+    out.clear();
+    for (int idx : keys) {
+        const Value& value = row[idx];
+        if (const string* str = get_if<string>(&value)) {
+            uint32_t length = static_cast<uint32_t>(str->size());
+            out.push_back('S');
+            out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.append(*str);
+            continue;
+        }
+        
+        double number = holds_alternative<int>(value) ? static_cast<double>(get<int>(value)) : get<double>(value);
+        if (number >= -9.2e18 && number <= 9.2e18 && number == static_cast<double>(static_cast<int64_t>(number))) {
+            int64_t integral = static_cast<int64_t>(number);
+            out.push_back('I');
+            out.append(reinterpret_cast<const char*>(&integral), sizeof(integral));
+        } else {
+            out.push_back('D');
+            out.append(reinterpret_cast<const char*>(&number), sizeof(number));
+        }
+    }
+}
+
+size_t JoinOptimizer::estimateHashTableBytes(const vector<Row>& build_rows, const vector<int>& build_keys) {
+    size_t bytes = 0;
+    for (const auto& row : build_rows) {
+        bytes += hashEntryBytes(row, build_keys);
+    }
+    return bytes;
+}
+
+size_t JoinOptimizer::hashEntryBytes(const Row& row, const vector<int>& build_keys) {
+    // Slots, stored hash, chain links and payload per entry, plus a copy of every key.
+    size_t bytes = 2 * sizeof(uint64_t) + 4 * sizeof(uint32_t) + sizeof(Value);
+    for (int idx : build_keys) {
+        if (const string* key = get_if<string>(&row[idx])) {
+            bytes += key->capacity();
+        } else if (build_keys.size() > 1) {
+            bytes += 9;
+        }
+    }
+    return bytes;
+}
+
+// Spill row format: uint32 value count, then per value a one-byte alternative index
+// followed by int32 / double / (uint32 length + bytes).
+void JoinOptimizer::writeSpillRow(ostream& out, const Row& row) {
+    uint32_t count = static_cast<uint32_t>(row.size());
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    for (const auto& value : row.values()) {
+        uint8_t tag = static_cast<uint8_t>(value.index());
+        out.write(reinterpret_cast<const char*>(&tag), sizeof(tag));
+        visit([&out](const auto& arg) {
+            using T = decay_t<decltype(arg)>;
+            if constexpr (is_same_v<T, string>) {
+                uint32_t length = static_cast<uint32_t>(arg.size());
+                out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+                out.write(arg.data(), length);
+            } else {
+                out.write(reinterpret_cast<const char*>(&arg), sizeof(arg));
+            }
+        }, value);
+    }
+}
+
+bool JoinOptimizer::readSpillRow(istream& in, Row& row) {
+    uint32_t count;
+    if (!in.read(reinterpret_cast<char*>(&count), sizeof(count))) {
+        return false;
+    }
+    vector<Value> values;
+    values.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        uint8_t tag = 0;
+        in.read(reinterpret_cast<char*>(&tag), sizeof(tag));
+        if (tag == 0) {
+            int v;
+            in.read(reinterpret_cast<char*>(&v), sizeof(v));
+            values.emplace_back(v);
+        } else if (tag == 1) {
+            double v;
+            in.read(reinterpret_cast<char*>(&v), sizeof(v));
+            values.emplace_back(v);
+        } else {
+            uint32_t length;
+            in.read(reinterpret_cast<char*>(&length), sizeof(length));
+            string v(length, '\0');
+            in.read(v.data(), length);
+            values.emplace_back(move(v));
+        }
+    }
+    if (!in) {
+        throw runtime_error("Corrupted spill file");
+    }
+    row = Row(move(values));
+    return true;
+}
+
+JoinOptimizer::JoinSink JoinOptimizer::makeSink(const Table& left_table, const Table& right_table, const vector<string>& columns, const shared_ptr<LogicExpression>& where_clause) {
+    JoinSink sink;
+    sink.select_all = (columns.size() == 1 && columns[0] == "*");
+    sink.where_clause = where_clause;
+    for (const auto& col : left_table.columns()) sink.where_columns.push_back(col.name);
+    for (const auto& col : right_table.columns()) sink.where_columns.push_back(col.name);
+    
+    if (sink.select_all) {
+        return sink;
+    }
+    
+    // Resolve the SELECT list once per join instead of once per joined row.
+    for (const auto& col_name : columns) {
+        int side = -1;
+        int col_idx = -1;
+        size_t dot_pos = col_name.find('.');
+        if (dot_pos != string::npos) {
+            string table_name = col_name.substr(0, dot_pos);
+            string column_name = col_name.substr(dot_pos + 1);
+            if (table_name == left_table.name()) {
+                side = 0;
+                col_idx = left_table.getColumnIndex(column_name);
+            } else if (table_name == right_table.name()) {
+                side = 1;
+                col_idx = right_table.getColumnIndex(column_name);
+            }
+        } else {
+            col_idx = left_table.getColumnIndex(col_name);
+            side = 0;
+            if (col_idx == -1) {
+                col_idx = right_table.getColumnIndex(col_name);
+                side = 1;
+            }
+        }
+        
+        if (col_idx == -1) {
+            cout << "Warning: Column '" << col_name << "' not found in join tables" << endl;
+            continue;
+        }
+        sink.projection.emplace_back(side, col_idx);
+    }
+    
+    return sink;
+}
+
+void JoinOptimizer::emitJoinedRow(const Row& left_row, const Row& right_row, JoinSink& sink) {
+    
+    ++sink.joined_rows;
+    if (sink.where_clause) {
+        vector<Value> all_values_for_where;
+        all_values_for_where.reserve(left_row.size() + right_row.size());
+        all_values_for_where.insert(all_values_for_where.end(), left_row.values().begin(), left_row.values().end());
+        all_values_for_where.insert(all_values_for_where.end(), right_row.values().begin(), right_row.values().end());
+        
+        Row where_eval_row(move(all_values_for_where));
+        if (!ConditionEvaluator::evaluate(where_eval_row, sink.where_clause)) {
+            return;
+        }
+        if (sink.select_all) {
+            sink.result.push_back(move(where_eval_row));
+            return;
+        }
+    }
+    
+    vector<Value> joined_values;
+    if (sink.select_all) {
+        joined_values.reserve(left_row.size() + right_row.size());
+        joined_values.insert(joined_values.end(), left_row.values().begin(), left_row.values().end());
+        joined_values.insert(joined_values.end(), right_row.values().begin(), right_row.values().end());
+    } else {
+        joined_values.reserve(sink.projection.size());
+        for (const auto& [side, col_idx] : sink.projection) {
+            joined_values.push_back(side == 0 ? left_row[col_idx] : right_row[col_idx]);
+        }
+    }
+    sink.result.emplace_back(move(joined_values));
+}
+
+// Part IV.Realization of ConditionEvaluator class in minisql.h
+void SemiJoinKeys::insert(const Value& key) {
+    if (const string* str = get_if<string>(&key)) {
+        strings.insertUnique(*str, 0);
+    } else {
+        numbers.insertUnique(holds_alternative<int>(key) ? static_cast<double>(get<int>(key)) : get<double>(key), 0);
+    }
+}
+
+bool SemiJoinKeys::contains(const Value& key) const {
+    if (const string* str = get_if<string>(&key)) {
+        return strings.contains(*str);
+    }
+    return numbers.contains(holds_alternative<int>(key) ? static_cast<double>(get<int>(key)) : get<double>(key));
+}
+
+template<typename T>
+bool ConditionEvaluator::compareValues(const T& left, const T& right, CompareOp op) {
+    switch (op) {
+        case CompareOp::EQUAL: return left == right;
+        case CompareOp::NOT_EQUAL: return left != right;
+        case CompareOp::GREATER: return left > right;
+        case CompareOp::LESS: return left < right;
+        case CompareOp::GREATER_EQUAL: return left >= right;
+        case CompareOp::LESS_EQUAL: return left <= right;
+        default: return false;
+    }
+}
+
+bool ConditionEvaluator::compare(const Value& left, const Value& right, CompareOp op) {
+    // LIKE / NOT LIKE only apply to strings; a number never matches either of them.
+    if (op == CompareOp::LIKE || op == CompareOp::NOT_LIKE) {
+        const string* text = get_if<string>(&left);
+        const string* pattern = get_if<string>(&right);
+        return text && pattern && LikePattern(*pattern).matches(*text) == (op == CompareOp::LIKE);
+    }
+    
+    return visit([&right, op](auto&& left_val) {
+        return visit([&left_val, op](auto&& right_val) {
+            using LeftType = decay_t<decltype(left_val)>;
+            using RightType = decay_t<decltype(right_val)>;
+            
+            if constexpr (is_same_v<LeftType, RightType>) {
+                return compareValues(left_val, right_val, op);
+            } else if constexpr (is_arithmetic_v<LeftType> && is_arithmetic_v<RightType>) {
+                double left_double = static_cast<double>(left_val);
+                double right_double = static_cast<double>(right_val);
+                return compareValues(left_double, right_double, op);
+            } else {
+                return false;
+            }
+        }, right);
+    }, left);
+}
+
+// The comparison of compareValues with op fixed at compile time.
+template<CompareOp Op, typename T>
+static inline bool compareAs(const T& left, const T& right) {
+    if constexpr (Op == CompareOp::EQUAL) return left == right;
+    else if constexpr (Op == CompareOp::NOT_EQUAL) return left != right;
+    else if constexpr (Op == CompareOp::GREATER) return left > right;
+    else if constexpr (Op == CompareOp::LESS) return left < right;
+    else if constexpr (Op == CompareOp::GREATER_EQUAL) return left >= right;
+    else return left <= right;
+}
+
+// ConditionEvaluator::compare for a Left and a Right operand: two index checks and one inlined
+// comparison. Any other pair of types takes the general path, so the result never differs.
+template<typename Left, typename Right, CompareOp Op>
+static bool compareKernel(const Value& left, const Value& right) {
+    const Left* left_val = get_if<Left>(&left);
+    const Right* right_val = get_if<Right>(&right);
+    if (!left_val || !right_val) [[unlikely]] {
+        return ConditionEvaluator::compare(left, right, Op);
+    }
+    if constexpr (is_same_v<Left, Right>) {
+        return compareAs<Op>(*left_val, *right_val);
+    } else if constexpr (is_arithmetic_v<Left> && is_arithmetic_v<Right>) {
+        return compareAs<Op>(static_cast<double>(*left_val), static_cast<double>(*right_val));
+    } else {
+        return false;
+    }
+}
+
+template<CompareOp Op>
+static bool compareAny(const Value& left, const Value& right) {
+    return ConditionEvaluator::compare(left, right, Op);
+}
+
+template<typename Left, typename Right>
+static CompareKernel kernelFor(CompareOp op) {
+    switch (op) {
+        case CompareOp::EQUAL: return &compareKernel<Left, Right, CompareOp::EQUAL>;
+        case CompareOp::NOT_EQUAL: return &compareKernel<Left, Right, CompareOp::NOT_EQUAL>;
+        case CompareOp::GREATER: return &compareKernel<Left, Right, CompareOp::GREATER>;
+        case CompareOp::LESS: return &compareKernel<Left, Right, CompareOp::LESS>;
+        case CompareOp::GREATER_EQUAL: return &compareKernel<Left, Right, CompareOp::GREATER_EQUAL>;
+        case CompareOp::LESS_EQUAL: return &compareKernel<Left, Right, CompareOp::LESS_EQUAL>;
+        case CompareOp::LIKE: return &compareAny<CompareOp::LIKE>;
+        default: return &compareAny<CompareOp::NOT_LIKE>;
+    }
+}
+
+template<typename Left>
+static CompareKernel kernelFor(size_t right_index, CompareOp op) {
+    switch (right_index) {
+        case 0: return kernelFor<Left, int>(op);
+        case 1: return kernelFor<Left, double>(op);
+        default: return kernelFor<Left, string>(op);
+    }
+}
+
+// Value alternative of a column type.
+static size_t typeIndex(const string& type) {
+    return type == "INT" ? 0 : type == "DOUBLE" ? 1 : 2;
+}
+
+CompareKernel ConditionEvaluator::kernel(size_t left_index, size_t right_index, CompareOp op) {
+    switch (left_index) {
+        case 0: return kernelFor<int>(right_index, op);
+        case 1: return kernelFor<double>(right_index, op);
+        default: return kernelFor<string>(right_index, op);
+    }
+}
+
+CompareKernel ConditionEvaluator::kernel(const string& left_type, const string& right_type, CompareOp op) {
+    return kernel(typeIndex(left_type), typeIndex(right_type), op);
+}
+
+CompareKernel ConditionEvaluator::kernel(const Value& left, const Value& right, CompareOp op) {
+    return kernel(left.index(), right.index(), op);
+}
+
+bool ConditionEvaluator::evaluate(const Row& row, const Condition& condition) {
+    return evaluateCondition(row, nullptr, condition);
+}
+
+bool ConditionEvaluator::evaluate(const Row& row, const shared_ptr<LogicExpression>& expression) {
+    return evaluateTree(row, nullptr, expression);
+}
+
+bool ConditionEvaluator::evaluate(const Row& row, const vector<string>& column_names, const Condition& condition) {
+    return evaluateCondition(row, &column_names, condition);
+}
+
+bool ConditionEvaluator::evaluate(const Row& row, const vector<string>& column_names, const shared_ptr<LogicExpression>& expression) {
+    return evaluateTree(row, &column_names, expression);
+}
+
+const Value& ConditionEvaluator::operand(const Row& row, const vector<string>* column_names, const string& column, int index) {
+    if (column_names) {
+        return row.getValue(column, *column_names);
+    }
+    if (index < 0 || static_cast<size_t>(index) >= row.size()) {
+        throw runtime_error("Column not found: " + column);
+    }
+    return row[index];
+}
+
+bool ConditionEvaluator::evaluateCondition(const Row& row, const vector<string>* column_names, const Condition& condition) {
+    if (condition.subquery) {
+        return evaluateSubquery(row, column_names, condition);
+    }
+    Value computed;
+    const Value& left_value = condition.expression ? (computed = condition.expression->evaluate(row))
+                                                   : operand(row, column_names, condition.left_column, condition.left_index);
+    
+    if (condition.like) {
+        const string* text = get_if<string>(&left_value);
+        return text && condition.like->matches(*text) == (condition.op == CompareOp::LIKE);
+    }
+    
+    if (condition.is_column_comparison) {
+        const Value& right_value = operand(row, column_names, condition.right_column, condition.right_index);
+        return condition.kernel ? condition.kernel(left_value, right_value) : compare(left_value, right_value, condition.op);
+    } else {
+        return condition.kernel ? condition.kernel(left_value, condition.constant_value) : compare(left_value, condition.constant_value, condition.op);
+    }
+}
+
+bool ConditionEvaluator::evaluateSubquery(const Row& row, const vector<string>* column_names, const Condition& condition) {
+    const Subquery& subquery = *condition.subquery;
+    if (!subquery.keys) {
+        throw runtime_error("Subquery on table '" + subquery.table + "' was not bound");
+    }
+    
+    if (subquery.kind == SubqueryKind::IN) {
+        return subquery.keys->contains(operand(row, column_names, condition.left_column, condition.left_index));
+    }
+    // Uncorrelated EXISTS only depends on whether the subquery returned anything.
+    if (subquery.outer_column.empty()) {
+        return subquery.has_rows;
+    }
+    return subquery.keys->contains(operand(row, column_names, subquery.outer_column, subquery.outer_index));
+}
+
+bool ConditionEvaluator::evaluateTree(const Row& row, const vector<string>* column_names, const shared_ptr<LogicExpression>& expression) {
+    if (!expression) return false;
+    
+    if (expression->isSingleCondition) {
+        if (holds_alternative<Condition>(expression->left)) {
+            return evaluateCondition(row, column_names, get<Condition>(expression->left));
+        }
+        return false;
+    }
+    
+    auto evaluateOperand = [&](const variant<Condition, shared_ptr<LogicExpression>>& operand) {
+        if (const auto* condition = get_if<Condition>(&operand)) {
+            return evaluateCondition(row, column_names, *condition);
+        }
+        return evaluateTree(row, column_names, get<shared_ptr<LogicExpression>>(operand));
+    };
+    
+    // The right side only runs when the left one does not decide; WhereParser::rewrite puts
+    // the term most likely to decide a chain on the left.
+    switch (expression->op) {
+        case LogicOp::AND: return evaluateOperand(expression->left) && evaluateOperand(expression->right);
+        case LogicOp::OR: return evaluateOperand(expression->left) || evaluateOperand(expression->right);
+        case LogicOp::NOT: return !evaluateOperand(expression->left);
+        case LogicOp::ALWAYS_TRUE: return true;
+        default: return false;
+    }
+}
+
+// Part V. Realization of WhereParser class in minisql.h
+shared_ptr<LogicExpression> WhereParser::parse(const string& where_str, const vector<Column>& columns) {
+    try {
+        return bind(*SqlParser(where_str).parseCondition(), columns);
+    } catch (const SqlSyntaxError& e) {
+        cerr << "Error: Invalid WHERE expression syntax: " << e.what() << endl;
+        return nullptr;
+    }
+}
+
+static const string& columnType(const string& column_name, const vector<Column>& columns) {
+    static const string varchar = "VARCHAR";
+    for (const auto& col : columns) {
+        if (col.name == column_name) return col.type;
+    }
+    return varchar;
+}
+
+// Column type a value of that alternative is stored in.
+static string valueType(const Value& value) {
+    return holds_alternative<int>(value) ? "INT" : holds_alternative<double>(value) ? "DOUBLE" : "VARCHAR";
+}
+
+// Position of column_name among columns, the first one like Row::getValue; -1 if absent.
+static int columnPosition(const string& column_name, const vector<Column>& columns) {
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (columns[i].name == column_name) return static_cast<int>(i);
+    }
+    return -1;
+}
+
+// Selects the compare kernel and resolves the column positions of every condition in a bound
+// tree. slot_types holds the type of the conditions whose constant is a ? parameter, which
+// EXECUTE converts to that type.
+static void selectKernels(const shared_ptr<LogicExpression>& expression, const vector<Column>& columns, const unordered_map<const Condition*, string>& slot_types) {
+    if (expression->op == LogicOp::ALWAYS_TRUE || expression->op == LogicOp::ALWAYS_FALSE) return;
+    
+    for (auto* side : {&expression->left, &expression->right}) {
+        if (auto* child = get_if<shared_ptr<LogicExpression>>(side)) {
+            if (*child) selectKernels(*child, columns, slot_types);
+        } else {
+            Condition& condition = get<Condition>(*side);
+            condition.left_index = columnPosition(condition.left_column, columns);
+            condition.right_index = condition.is_column_comparison ? columnPosition(condition.right_column, columns) : -1;
+            if (!condition.subquery && !condition.like) {
+                const string& left_type = condition.expression ? condition.expression->type() : columnType(condition.left_column, columns);
+                auto slot = slot_types.find(&condition);
+                if (condition.is_column_comparison) {
+                    condition.kernel = ConditionEvaluator::kernel(left_type, columnType(condition.right_column, columns), condition.op);
+                } else if (slot != slot_types.end()) {
+                    condition.kernel = ConditionEvaluator::kernel(left_type, slot->second, condition.op);
                 } else {
-                    for (const auto& col_name : columns) {
-                        size_t dot_pos = col_name.find('.');
-                        if (dot_pos != string::npos) {
-                            string table_name = col_name.substr(0, dot_pos);
-                            string column_name = col_name.substr(dot_pos + 1);
-                            if (table_name == left_table.name()) {
-                                int col_idx = left_table.getColumnIndex(column_name);
-                                if (col_idx != -1) {
-                                    joined_values.push_back(left_row[col_idx]);
-                                }
-                            } else if (table_name == right_table.name()) {
-                                int col_idx = right_table.getColumnIndex(column_name);
-                                if (col_idx != -1) {
-                                    joined_values.push_back(right_row[col_idx]);
-                                }
-                            }
-                        } else {
-                            int col_idx = left_table.getColumnIndex(col_name);
-                            if (col_idx != -1) {
-                                joined_values.push_back(left_row[col_idx]);
-                            } else {
-                                col_idx = right_table.getColumnIndex(col_name);
-                                if (col_idx != -1) {
-                                    joined_values.push_back(right_row[col_idx]);
-                                }
-                            }
-                        }
-                    }
-                    
-                    for (const auto& val : left_row.values()) {
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : right_row.values()) {
-                        all_values_for_where.push_back(val);
-                    }
-                    where_eval_columns = all_columns_for_where;
-                }
-                
-                Row joined_row(joined_values);
-                Row where_eval_row(all_values_for_where); 
-                
-                if (!where_clause || ConditionEvaluator::evaluate(where_eval_row, where_eval_columns, where_clause)) {
-                    result.push_back(joined_row);
+                    condition.kernel = ConditionEvaluator::kernel(left_type, valueType(condition.constant_value), condition.op);
                 }
             }
         }
+        if (expression->isSingleCondition) break;
     }
-    
-    return result;
 }
 
-vector<Row> JoinOptimizer::hashJoin(const Table& left_table, const Table& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
+shared_ptr<LogicExpression> WhereParser::bind(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters) {
+    size_t first_slot = parameters ? parameters->size() : 0;
+    auto bound = bindExpression(expression, columns, parameters);
+    if (!bound) {
+        return nullptr;
+    }
     
-    // Choose the smaller table as the build table.
-    size_t left_size = left_table.rowCount();
-    size_t right_size = right_table.rowCount();
-    const Table& build_table = (left_size <= right_size) ? left_table : right_table;
-    const Table& probe_table = (left_size <= right_size) ? right_table : left_table;
+    unordered_set<const Condition*> opaque;
+    for (size_t i = first_slot; parameters && i < parameters->size(); ++i) {
+        opaque.insert((*parameters)[i].condition);
+    }
+    auto rewritten = rewrite(bound, false, columns, opaque);
+    
+    // Slots of terms the rewrite dropped, e.g. id = ? in id = ? OR 1 = 1, must not be written to.
+    if (!opaque.empty()) {
+        unordered_set<const Condition*> live;
+        collectConditions(rewritten, live);
+        parameters->erase(remove_if(parameters->begin() + first_slot, parameters->end(),
+                                    [&live](const ParameterSlot& slot) { return live.count(slot.condition) == 0; }),
+                          parameters->end());
+    }
     
-    int build_idx, probe_idx;
-    if (&build_table == &left_table) {
-        build_idx = build_table.getColumnIndex(condition.left_column);
-        probe_idx = probe_table.getColumnIndex(condition.right_column);
-    } else {
-        build_idx = build_table.getColumnIndex(condition.right_column);
-        probe_idx = probe_table.getColumnIndex(condition.left_column);
+    unordered_map<const Condition*, string> slot_types;
+    for (size_t i = first_slot; parameters && i < parameters->size(); ++i) {
+        slot_types.emplace((*parameters)[i].condition, (*parameters)[i].type);
+    }
+    selectKernels(rewritten, columns, slot_types);
+    return rewritten;
+}
+
+shared_ptr<LogicExpression> WhereParser::bindExpression(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters) {
+    switch (expression.kind) {
+        case ExprKind::AND:
+        case ExprKind::OR: {
+            auto left_expr = bindExpression(*expression.left, columns, parameters);
+            auto right_expr = left_expr ? bindExpression(*expression.right, columns, parameters) : nullptr;
+            if (!right_expr) {
+                return nullptr;
+            }
+            auto expr = make_shared<LogicExpression>();
+            expr->op = expression.kind == ExprKind::AND ? LogicOp::AND : LogicOp::OR;
+            expr->isSingleCondition = false;
+            expr->left = left_expr;
+            expr->right = right_expr;
+            return expr;
+        }
+        case ExprKind::NOT: {
+            auto inner_expr = bindExpression(*expression.left, columns, parameters);
+            if (!inner_expr) {
+                return nullptr;
+            }
+            auto expr = make_shared<LogicExpression>();
+            expr->op = LogicOp::NOT;
+            expr->isSingleCondition = false;
+            expr->left = inner_expr;
+            return expr;
+        }
+        case ExprKind::COMPARE:
+            return bindComparison(expression, columns, parameters);
+        case ExprKind::LIKE:
+            return bindLike(expression, columns, parameters);
+        case ExprKind::IN_SUBQUERY:
+        case ExprKind::EXISTS:
+            return bindSubquery(expression, columns);
+        case ExprKind::ARITHMETIC:
+        case ExprKind::NEGATE:
+        case ExprKind::CASE:
+        case ExprKind::COLUMN:
+        case ExprKind::NUMBER:
+        case ExprKind::STRING:
+            // A value used as a condition, e.g. WHERE CASE ... END or WHERE active: true when nonzero.
+            return bindComputed(expression, columns);
+        default:
+            cerr << "Error: Expected a condition instead of '" << expression.text << "'" << endl;
+            return nullptr;
+    }
+}
+
+Value WhereParser::parseValue(const SqlExpr& literal, const string& type) {
+    if (type == "VARCHAR" || literal.kind == ExprKind::COLUMN) {
+        return literal.text;
+    }
+    if (literal.kind == ExprKind::NUMBER) {
+        return type == "DOUBLE" ? Value(stod(literal.text)) : numberValue(literal.text);
     }
     
-    if (build_idx == -1 || probe_idx == -1) {
-        throw runtime_error("Join column not found");
+    // A quoted number compared with a numeric column, e.g. age = '30'.
+    try {
+        size_t pos = 0;
+        double number = stod(literal.text, &pos);
+        if (pos == literal.text.size()) {
+            return type == "DOUBLE" ? Value(number) : numberValue(literal.text);
+        }
+    } catch (...) {
+    }
+    return literal.text;
+}
+
+Value WhereParser::parameterValue(const Value& value, const string& type) {
+    if (type == "VARCHAR") {
+        if (holds_alternative<string>(value)) return value;
+        ostringstream text;
+        visit([&text](auto&& arg) { text << arg; }, value);
+        return text.str();
+    }
+    if (holds_alternative<string>(value)) {
+        SqlExpr literal{ExprKind::STRING, get<string>(value), CompareOp::EQUAL, nullptr, nullptr, nullptr, 0};
+        return parseValue(literal, type);
     }
+    if (type == "DOUBLE" && holds_alternative<int>(value)) {
+        return static_cast<double>(get<int>(value));
+    }
+    return value;
+}
 
-    bool select_all = (columns.size() == 1 && columns[0] == "*");
+string WhereParser::parseColumnName(const string& column_ref, const vector<Column>& columns) {
+    string column_name_only = column_ref;
     
-    vector<string> left_cols, right_cols;
-    for (const auto& col : left_table.columns()) left_cols.push_back(col.name);
-    for (const auto& col : right_table.columns()) right_cols.push_back(col.name);
+    size_t dot_pos = column_ref.find('.');
+    if (dot_pos != string::npos) {
+        column_name_only = column_ref.substr(dot_pos + 1);
+    }
     
-    vector<string> all_columns_for_where = left_cols;
-    all_columns_for_where.insert(all_columns_for_where.end(), right_cols.begin(), right_cols.end());
+    for (const auto& col : columns) {
+        if (col.name == column_name_only) {
+            return column_name_only;
+        }
+    }
     
-    // construct hash table
-    unordered_multimap<Value, const Row*> hash_table;
-    for (const auto& row : build_table.getAllRows()) {
-        hash_table.insert({row[build_idx], &row});
+    return "";
+}
+
+shared_ptr<LogicExpression> WhereParser::makeLeaf(Condition condition) {
+    auto expression = make_shared<LogicExpression>();
+    expression->isSingleCondition = true;
+    expression->left = move(condition);
+    expression->op = LogicOp::AND;
+    return expression;
+}
+
+bool WhereParser::addParameterSlot(const SqlExpr& operand, const shared_ptr<LogicExpression>& leaf, const string& type, vector<ParameterSlot>* parameters) {
+    if (!parameters) {
+        cerr << "Error: Parameter ? can only be used in a prepared statement" << endl;
+        return false;
+    }
+    parameters->push_back({&get<Condition>(leaf->left), operand.parameter, type});
+    return true;
+}
+
+// a op b is b mirroredOp(op) a.
+static CompareOp mirroredOp(CompareOp op) {
+    switch (op) {
+        case CompareOp::GREATER: return CompareOp::LESS;
+        case CompareOp::LESS: return CompareOp::GREATER;
+        case CompareOp::GREATER_EQUAL: return CompareOp::LESS_EQUAL;
+        case CompareOp::LESS_EQUAL: return CompareOp::GREATER_EQUAL;
+        default: return op;
+    }
+}
+
+// Operands beyond a column, a literal or ?, e.g. salary * 12.
+static bool isComputed(const SqlExpr& operand) {
+    return operand.kind != ExprKind::COLUMN && operand.kind != ExprKind::NUMBER &&
+           operand.kind != ExprKind::STRING && operand.kind != ExprKind::PARAMETER;
+}
+
+shared_ptr<LogicExpression> WhereParser::bindComparison(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters) {
+    const SqlExpr* left = expression.left.get();
+    const SqlExpr* right = expression.right.get();
+    CompareOp op = expression.op;
+    
+    // Two literals, e.g. the 1 = 1 of generated filters, compare the same for every row.
+    auto isLiteral = [](const SqlExpr* operand) { return operand->kind == ExprKind::NUMBER || operand->kind == ExprKind::STRING; };
+    if (isLiteral(left) && isLiteral(right)) {
+        return makeConstant(ConditionEvaluator::compare(literalValue(*left), literalValue(*right), op));
     }
     
-    vector<Row> result;
+    // salary * 12 > bonus * 10 has no plain side, so it is computed as a whole.
+    if (isComputed(*left) && isComputed(*right)) {
+        return bindComputed(expression, columns);
+    }
     
-    // scan probe table(the larger one)
-    for (const auto& probe_row : probe_table.getAllRows()) {
-        const Value& probe_key = probe_row[probe_idx];
-        
-        auto range = hash_table.equal_range(probe_key);
-        for (auto it = range.first; it != range.second; ++it) {
-            const Row* build_row = it->second;
-            
-            vector<Value> joined_values;
-            vector<Value> all_values_for_where; 
-            vector<string> where_eval_columns;
-            
-            if (select_all) {
-                if (&build_table == &left_table) {
-                    for (const auto& val : build_row->values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : probe_row.values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    where_eval_columns = all_columns_for_where;
-                } else {
-                    for (const auto& val : probe_row.values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : build_row->values()) {
-                        joined_values.push_back(val);
-                        all_values_for_where.push_back(val);
-                    }
-                    where_eval_columns = all_columns_for_where;
-                }
-            } else {
-                for (const auto& col_name : columns) {
-                    bool found = false;
-                    size_t dot_pos = col_name.find('.');
-                    if (dot_pos != string::npos) {
-                        string table_name = col_name.substr(0, dot_pos);
-                        string column_name = col_name.substr(dot_pos + 1);
-                        if (table_name == left_table.name()) {
-                            int col_idx = left_table.getColumnIndex(column_name);
-                            if (col_idx != -1) {
-                                joined_values.push_back((&build_table == &left_table) ? (*build_row)[col_idx] : probe_row[col_idx]);
-                                found = true;
-                            }
-                        } else if (table_name == right_table.name()) {
-                            int col_idx = right_table.getColumnIndex(column_name);
-                            if (col_idx != -1) {
-                                joined_values.push_back((&build_table == &right_table) ? (*build_row)[col_idx] : probe_row[col_idx]);
-                                found = true;
-                            }
-                        }
-                    } else {
-                        int col_idx = left_table.getColumnIndex(col_name);
-                        if (col_idx != -1) {
-                            joined_values.push_back((&build_table == &left_table) ? (*build_row)[col_idx] : probe_row[col_idx]);
-                            found = true;
-                        } else {
-                            col_idx = right_table.getColumnIndex(col_name);
-                            if (col_idx != -1) {
-                                joined_values.push_back((&build_table == &right_table) ? (*build_row)[col_idx] : probe_row[col_idx]);
-                                found = true;
-                            }
-                        }
-                    }
+    // 25 < age is age > 25, and 50000 < salary * 12 is salary * 12 > 50000.
+    if (isComputed(*right) || (!isComputed(*left) && left->kind != ExprKind::COLUMN && right->kind == ExprKind::COLUMN)) {
+        swap(left, right);
+        op = mirroredOp(op);
+    }
     
-                    if (!found) {
-                        cout << "Warning: Column '" << col_name << "' not found in join tables" << endl;
-                    }
-                }
-
-                if (&build_table == &left_table) {
-                    for (const auto& val : build_row->values()) {
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : probe_row.values()) {
-                        all_values_for_where.push_back(val);
-                    }
-                } else {
-                    for (const auto& val : probe_row.values()) {
-                        all_values_for_where.push_back(val);
-                    }
-                    for (const auto& val : build_row->values()) {
-                        all_values_for_where.push_back(val);
-                    }
+    // A computed left side takes the place of the column, with its type.
+    shared_ptr<const Expression> computed;
+    string left_column_name;
+    string col_type = "VARCHAR";
+    if (isComputed(*left)) {
+        computed = compileOperand(*left, columns);
+        if (!computed) {
+            return nullptr;
+        }
+        if (computed->isConstant() && isLiteral(right)) {
+            return makeConstant(ConditionEvaluator::compare(computed->evaluate(Row()), parseValue(*right, computed->type()), op));
+        }
+        string right_column_name = right->kind == ExprKind::COLUMN ? parseColumnName(right->text, columns) : "";
+        if (computed->isConstant() && !right_column_name.empty()) {
+            // id = 2 * 3 is id = 6, so an index on id still applies.
+            Condition condition;
+            condition.left_column = right_column_name;
+            condition.op = mirroredOp(op);
+            condition.is_column_comparison = false;
+            for (const auto& col : columns) {
+                if (col.name == right_column_name) {
+                    condition.constant_value = parameterValue(computed->evaluate(Row()), col.type);
+                    break;
                 }
-                where_eval_columns = all_columns_for_where;
             }
-
-            Row joined_row(joined_values);
-            Row where_eval_row(all_values_for_where);
-            
-            if (!where_clause || ConditionEvaluator::evaluate(where_eval_row, where_eval_columns, where_clause)) {
-                result.push_back(joined_row);
+            return makeLeaf(move(condition));
+        }
+        col_type = computed->type();
+    } else {
+        left_column_name = left->kind == ExprKind::COLUMN ? parseColumnName(left->text, columns) : "";
+        if (left_column_name.empty()) {
+            cerr << "Error: Left column '" << left->text << "' not found in tables" << endl;
+            return nullptr;
+        }
+        for (const auto& col : columns) {
+            if (col.name == left_column_name) {
+                col_type = col.type;
+                break;
             }
         }
     }
     
-    return result;
+    Condition condition;
+    condition.left_column = left_column_name;
+    condition.expression = move(computed);
+    condition.op = op;
+    
+    // An identifier on the right must name a column like the left one; strings are quoted,
+    // e.g. name = 'Alice'.
+    string right_column_name = right->kind == ExprKind::COLUMN ? parseColumnName(right->text, columns) : "";
+    if (right->kind == ExprKind::COLUMN && right_column_name.empty()) {
+        cerr << "Error: Right column '" << right->text << "' not found in tables" << endl;
+        return nullptr;
+    }
+    condition.is_column_comparison = !right_column_name.empty();
+    if (condition.is_column_comparison) {
+        condition.right_column = right_column_name;
+    } else if (right->kind != ExprKind::PARAMETER) {
+        condition.constant_value = parseValue(*right, col_type);
+    }
+    
+    auto leaf = makeLeaf(move(condition));
+    if (right->kind == ExprKind::PARAMETER && !addParameterSlot(*right, leaf, col_type, parameters)) {
+        return nullptr;
+    }
+    return leaf;
 }
 
-// Part IV.Realization of ConditionEvaluator class in minisql.h
-template<typename T>
-bool ConditionEvaluator::compareValues(const T& left, const T& right, CompareOp op) {
+shared_ptr<const Expression> WhereParser::compileOperand(const SqlExpr& operand, const vector<Column>& columns) {
+    try {
+        return ExpressionCompiler::compile(operand, columns);
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return nullptr;
+    }
+}
+
+shared_ptr<LogicExpression> WhereParser::bindComputed(const SqlExpr& expression, const vector<Column>& columns) {
+    auto compiled = compileOperand(expression, columns);
+    if (!compiled) {
+        return nullptr;
+    }
+    // Constant parts are folded when compiling, so e.g. 2 * 3 = 6 * 1 is one constant here.
+    if (compiled->isConstant()) {
+        return makeConstant(Expression::isTrue(compiled->evaluate(Row())));
+    }
+    
+    // True when nonzero (or, for strings, not empty).
+    Condition condition;
+    condition.op = CompareOp::NOT_EQUAL;
+    condition.constant_value = compiled->type() == "VARCHAR" ? Value(string()) : Value(0);
+    condition.is_column_comparison = false;
+    condition.expression = move(compiled);
+    return makeLeaf(move(condition));
+}
+
+shared_ptr<LogicExpression> WhereParser::bindLike(const SqlExpr& expression, const vector<Column>& columns, vector<ParameterSlot>* parameters) {
+    shared_ptr<const Expression> computed;
+    string left_column_name;
+    if (isComputed(*expression.left)) {
+        computed = compileOperand(*expression.left, columns);
+        if (!computed) {
+            return nullptr;
+        }
+    } else {
+        left_column_name = expression.left->kind == ExprKind::COLUMN ? parseColumnName(expression.left->text, columns) : "";
+        if (left_column_name.empty()) {
+            cerr << "Error: Left column '" << expression.left->text << "' not found in tables" << endl;
+            return nullptr;
+        }
+    }
+    if (expression.right->kind != ExprKind::STRING && expression.right->kind != ExprKind::PARAMETER) {
+        cerr << "Error: LIKE needs a quoted pattern, got " << expression.right->text << endl;
+        return nullptr;
+    }
+    
+    Condition condition;
+    condition.left_column = left_column_name;
+    condition.expression = move(computed);
+    condition.op = expression.op;
+    condition.is_column_comparison = false;
+    if (expression.right->kind == ExprKind::STRING) {
+        const string& pattern = expression.right->text;
+        condition.constant_value = pattern;
+        condition.like = make_shared<LikePattern>(pattern);
+    }
+    
+    // A ? pattern is compiled by MiniSQL::execute once its value is known.
+    auto leaf = makeLeaf(move(condition));
+    if (expression.right->kind == ExprKind::PARAMETER && !addParameterSlot(*expression.right, leaf, "VARCHAR", parameters)) {
+        return nullptr;
+    }
+    return leaf;
+}
+
+shared_ptr<LogicExpression> WhereParser::bindSubquery(const SqlExpr& expression, const vector<Column>& columns) {
+    Condition condition;
+    if (expression.kind == ExprKind::IN_SUBQUERY) {
+        condition.left_column = expression.left->kind == ExprKind::COLUMN ? parseColumnName(expression.left->text, columns) : "";
+        if (condition.left_column.empty()) {
+            cerr << "Error: Left column '" << expression.left->text << "' not found in tables" << endl;
+            return nullptr;
+        }
+    }
+    condition.op = CompareOp::EQUAL;
+    condition.is_column_comparison = false;
+    // Each binding gets its own copy, since running the subquery stores its key set there.
+    condition.subquery = make_shared<Subquery>(*expression.subquery);
+    return makeLeaf(move(condition));
+}
+
+string WhereParser::describe(const Condition& condition) {
+    if (condition.subquery) {
+        if (condition.subquery->kind == SubqueryKind::EXISTS) return "EXISTS " + formatSubquery(*condition.subquery);
+        return condition.left_column + " IN " + formatSubquery(*condition.subquery);
+    }
+    string left = condition.left_column;
+    if (condition.expression) {
+        left = condition.expression->text();
+        if (condition.expression->columnIndex() == -1) left = "(" + left + ")";
+    }
+    string right = condition.is_column_comparison ? condition.right_column : formatLiteral(condition.constant_value);
+    return left + " " + compareOpText(condition.op) + " " + right;
+}
+
+string WhereParser::describe(const shared_ptr<LogicExpression>& expression) {
+    if (!expression) return "";
+    auto operand = [&expression](const variant<Condition, shared_ptr<LogicExpression>>& side) {
+        if (const Condition* condition = get_if<Condition>(&side)) return describe(*condition);
+        const auto& child = get<shared_ptr<LogicExpression>>(side);
+        string text = describe(child);
+        bool nested = child && !child->isSingleCondition && child->op != expression->op &&
+                      (child->op == LogicOp::AND || child->op == LogicOp::OR);
+        return nested ? "(" + text + ")" : text;
+    };
+    if (expression->isSingleCondition) return operand(expression->left);
+    switch (expression->op) {
+        case LogicOp::AND: return operand(expression->left) + " AND " + operand(expression->right);
+        case LogicOp::OR: return operand(expression->left) + " OR " + operand(expression->right);
+        case LogicOp::NOT: {
+            // AND / OR operands come back parenthesized already.
+            string text = operand(expression->left);
+            const auto* child = get_if<shared_ptr<LogicExpression>>(&expression->left);
+            bool chain = child && *child && !(*child)->isSingleCondition && ((*child)->op == LogicOp::AND || (*child)->op == LogicOp::OR);
+            return chain ? "NOT " + text : "NOT (" + text + ")";
+        }
+        case LogicOp::ALWAYS_TRUE: return "TRUE";
+        default: return "FALSE";
+    }
+}
+
+shared_ptr<LogicExpression> WhereParser::makeConstant(bool value) {
+    auto expression = make_shared<LogicExpression>();
+    expression->op = value ? LogicOp::ALWAYS_TRUE : LogicOp::ALWAYS_FALSE;
+    expression->isSingleCondition = false;
+    return expression;
+}
+
+static bool isNumericType(const string& type) {
+    return type == "INT" || type == "DOUBLE";
+}
+
+// Stored values have their column's type, and compare() never matches a number with a string,
+// so some conditions hold for every row or for none. Returns false when the row decides.
+static bool foldCondition(const Condition& condition, const vector<Column>& columns, bool& value) {
+    if (condition.subquery) return false;
+    
+    bool numeric = isNumericType(condition.expression ? condition.expression->type() : columnType(condition.left_column, columns));
+    if (condition.is_column_comparison) {
+        if (numeric != isNumericType(columnType(condition.right_column, columns))) {
+            value = false;
+            return true;
+        }
+        if (condition.left_column == condition.right_column) {
+            value = condition.op == CompareOp::EQUAL || condition.op == CompareOp::GREATER_EQUAL || condition.op == CompareOp::LESS_EQUAL;
+            return true;
+        }
+        return false;
+    }
+    // LIKE on a number column, or a constant that did not convert to the column type.
+    if (condition.like ? numeric : numeric == holds_alternative<string>(condition.constant_value)) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+static CompareOp negatedOp(CompareOp op) {
     switch (op) {
-        case CompareOp::EQUAL: return left == right;
-        case CompareOp::NOT_EQUAL: return left != right;
-        case CompareOp::GREATER: return left > right;
-        case CompareOp::LESS: return left < right;
-        case CompareOp::GREATER_EQUAL: return left >= right;
-        case CompareOp::LESS_EQUAL: return left <= right;
-        default: return false;
+        case CompareOp::EQUAL: return CompareOp::NOT_EQUAL;
+        case CompareOp::NOT_EQUAL: return CompareOp::EQUAL;
+        case CompareOp::GREATER: return CompareOp::LESS_EQUAL;
+        case CompareOp::LESS: return CompareOp::GREATER_EQUAL;
+        case CompareOp::GREATER_EQUAL: return CompareOp::LESS;
+        case CompareOp::LESS_EQUAL: return CompareOp::GREATER;
+        case CompareOp::LIKE: return CompareOp::NOT_LIKE;
+        case CompareOp::NOT_LIKE: return CompareOp::LIKE;
     }
+    return op;
 }
 
-bool ConditionEvaluator::compare(const Value& left, const Value& right, CompareOp op) {
-    return visit([&right, op](auto&& left_val) {
-        return visit([&left_val, op](auto&& right_val) {
-            using LeftType = decay_t<decltype(left_val)>;
-            using RightType = decay_t<decltype(right_val)>;
-            
-            if constexpr (is_same_v<LeftType, RightType>) {
-                return compareValues(left_val, right_val, op);
-            } else if constexpr (is_arithmetic_v<LeftType> && is_arithmetic_v<RightType>) {
-                double left_double = static_cast<double>(left_val);
-                double right_double = static_cast<double>(right_val);
-                return compareValues(left_double, right_double, op);
-            } else {
-                return false;
-            }
-        }, right);
-    }, left);
+static bool sameCondition(const Condition& left, const Condition& right) {
+    return !left.subquery && !right.subquery && !left.expression && !right.expression &&
+           left.left_column == right.left_column && left.op == right.op &&
+           left.is_column_comparison == right.is_column_comparison &&
+           (left.is_column_comparison ? left.right_column == right.right_column : left.constant_value == right.constant_value);
 }
 
-bool ConditionEvaluator::evaluate(const Row& row, const vector<string>& column_names, const Condition& condition) {
-    try {
-        Value left_value = row.getValue(condition.left_column, column_names);
+// Rough per-row cost and fraction of rows passing a term, used to order the terms of a chain.
+struct TermEstimate {
+    double cost;
+    double selectivity;
+};
+
+static TermEstimate estimateTerm(const shared_ptr<LogicExpression>& term, const vector<Column>& columns) {
+    if (term->isSingleCondition) {
+        const Condition& condition = get<Condition>(term->left);
+        if (condition.subquery) {
+            if (condition.subquery->kind == SubqueryKind::IN) return {2.0, 0.3};
+            return {condition.subquery->where ? 2.0 : 0.5, 0.5};
+        }
+        if (condition.like) {
+            return {4.0, condition.op == CompareOp::LIKE ? 0.25 : 0.75};
+        }
+        if (condition.expression) {
+            return {3.0, 0.33};
+        }
         
-        if (condition.is_column_comparison) {
-            Value right_value = row.getValue(condition.right_column, column_names);
-            return compare(left_value, right_value, condition.op);
-        } else {
-            return compare(left_value, condition.constant_value, condition.op);
+        bool unique = false;
+        for (const auto& col : columns) {
+            if (col.name == condition.left_column) {
+                unique = col.unique;
+                break;
+            }
         }
-    } catch (...) {
-        return false;
+        double cost = condition.is_column_comparison ? 2.0 : holds_alternative<string>(condition.constant_value) ? 1.5 : 1.0;
+        switch (condition.op) {
+            case CompareOp::EQUAL: return {cost, unique && !condition.is_column_comparison ? 0.01 : 0.1};
+            case CompareOp::NOT_EQUAL: return {cost, unique && !condition.is_column_comparison ? 0.99 : 0.9};
+            default: return {cost, 0.33};
+        }
+    }
+    
+    if (term->op == LogicOp::NOT) {
+        TermEstimate inner = estimateTerm(get<shared_ptr<LogicExpression>>(term->left), columns);
+        return {inner.cost, 1.0 - inner.selectivity};
+    }
+    
+    TermEstimate left = estimateTerm(get<shared_ptr<LogicExpression>>(term->left), columns);
+    TermEstimate right = estimateTerm(get<shared_ptr<LogicExpression>>(term->right), columns);
+    if (term->op == LogicOp::AND) {
+        return {left.cost + left.selectivity * right.cost, left.selectivity * right.selectivity};
     }
+    return {left.cost + (1.0 - left.selectivity) * right.cost, 1.0 - (1.0 - left.selectivity) * (1.0 - right.selectivity)};
 }
 
-bool ConditionEvaluator::evaluate(const Row& row, const vector<string>& column_names, const shared_ptr<LogicExpression>& expression) {
-    if (!expression) return false;
+// Terms of a chain of op, in order.
+static void collectChain(const shared_ptr<LogicExpression>& expression, LogicOp op, vector<shared_ptr<LogicExpression>>& terms) {
+    if (!expression->isSingleCondition && expression->op == op) {
+        collectChain(get<shared_ptr<LogicExpression>>(expression->left), op, terms);
+        collectChain(get<shared_ptr<LogicExpression>>(expression->right), op, terms);
+    } else {
+        terms.push_back(expression);
+    }
+}
+
+shared_ptr<LogicExpression> WhereParser::rewrite(const shared_ptr<LogicExpression>& expression, bool negated, const vector<Column>& columns, const unordered_set<const Condition*>& opaque) {
+    if (expression->op == LogicOp::ALWAYS_TRUE || expression->op == LogicOp::ALWAYS_FALSE) {
+        return makeConstant((expression->op == LogicOp::ALWAYS_TRUE) != negated);
+    }
     
     if (expression->isSingleCondition) {
-        if (holds_alternative<Condition>(expression->left)) {
-            return evaluate(row, column_names, get<Condition>(expression->left));
+        Condition& condition = get<Condition>(expression->left);
+        bool known = !opaque.count(&condition);
+        bool value = false;
+        if (known && foldCondition(condition, columns, value)) {
+            return makeConstant(value != negated);
         }
-        return false;
+        if (!negated) {
+            return expression;
+        }
+        // NOT age > 30 is age <= 30: both sides have the column's type, so no row compares
+        // false either way. Subqueries and ? parameters keep their NOT.
+        if (known && !condition.subquery) {
+            condition.op = negatedOp(condition.op);
+            return expression;
+        }
+        auto inverted = make_shared<LogicExpression>();
+        inverted->op = LogicOp::NOT;
+        inverted->isSingleCondition = false;
+        inverted->left = expression;
+        return inverted;
     }
     
-    bool left_result = false;
-    if (holds_alternative<Condition>(expression->left)) {
-        left_result = evaluate(row, column_names, get<Condition>(expression->left));
-    } else if (holds_alternative<shared_ptr<LogicExpression>>(expression->left)) {
-        left_result = evaluate(row, column_names, get<shared_ptr<LogicExpression>>(expression->left));
-    }
+    auto operand = [](const variant<Condition, shared_ptr<LogicExpression>>& side) {
+        if (const auto* condition = get_if<Condition>(&side)) return makeLeaf(*condition);
+        return get<shared_ptr<LogicExpression>>(side);
+    };
     
     if (expression->op == LogicOp::NOT) {
-        return !left_result;
-    }
-    
-    bool right_result = false;
-    if (holds_alternative<Condition>(expression->right)) {
-        right_result = evaluate(row, column_names, get<Condition>(expression->right));
-    } else if (holds_alternative<shared_ptr<LogicExpression>>(expression->right)) {
-        right_result = evaluate(row, column_names, get<shared_ptr<LogicExpression>>(expression->right));
+        return rewrite(operand(expression->left), !negated, columns, opaque);
     }
     
-    switch (expression->op) {
-        case LogicOp::AND: return left_result && right_result;
-        case LogicOp::OR: return left_result || right_result;
-        default: return false;
+    // De Morgan: under a NOT, AND becomes OR of the negated terms and vice versa.
+    LogicOp op = expression->op;
+    if (negated) {
+        op = op == LogicOp::AND ? LogicOp::OR : LogicOp::AND;
     }
-}
-
-// Part V. Realization of WhereParser class in minisql.h
-shared_ptr<LogicExpression> WhereParser::parse(const string& where_str, const vector<Column>& columns) {
-    string str = trim(where_str);
+    LogicOp absorbing = op == LogicOp::AND ? LogicOp::ALWAYS_FALSE : LogicOp::ALWAYS_TRUE;
     
-    if (!validateExpression(str)) {
-        cerr << "Error: Invalid WHERE expression syntax: " << where_str << endl;
-        return nullptr;
+    vector<shared_ptr<LogicExpression>> terms;
+    for (const auto* side : {&expression->left, &expression->right}) {
+        collectChain(rewrite(operand(*side), negated, columns, opaque), op, terms);
     }
     
-    return parseExpression(str, columns);
-}
-
-Value WhereParser::parseValue(const string& str, const string& type) {
-    if (type == "INT") {
-        try {
-            return stoi(str);
-        } catch (...) {
-            return 0;
+    vector<pair<double, shared_ptr<LogicExpression>>> ranked;
+    for (const auto& term : terms) {
+        if (term->op == absorbing && !term->isSingleCondition) {
+            return term;
         }
-    } else if (type == "DOUBLE") {
-        try {
-            return stod(str);
-        } catch (...) {
-            return 0.0;
+        if (term->op == LogicOp::ALWAYS_TRUE || term->op == LogicOp::ALWAYS_FALSE) {
+            continue;
         }
-    } else {
-        if (str.front() == '\'' && str.back() == '\'') {
-            return str.substr(1, str.length() - 2);
+        bool duplicate = false;
+        if (term->isSingleCondition && !opaque.count(&get<Condition>(term->left))) {
+            for (const auto& [rank, kept] : ranked) {
+                if (kept->isSingleCondition && !opaque.count(&get<Condition>(kept->left)) &&
+                    sameCondition(get<Condition>(kept->left), get<Condition>(term->left))) {
+                    duplicate = true;
+                    break;
+                }
+            }
         }
-        return str;
+        if (duplicate) continue;
+        
+        // AND runs cheap terms that reject many rows first, OR cheap terms that accept many.
+        TermEstimate estimate = estimateTerm(term, columns);
+        double decides = op == LogicOp::AND ? 1.0 - estimate.selectivity : estimate.selectivity;
+        ranked.emplace_back(estimate.cost / max(decides, 1e-6), term);
     }
-}
-
-CompareOp WhereParser::parseCompareOp(const string& op_str) {
-    if (op_str == "=") return CompareOp::EQUAL;
-    if (op_str == "<>" || op_str == "!=") return CompareOp::NOT_EQUAL;
-    if (op_str == ">") return CompareOp::GREATER;
-    if (op_str == "<") return CompareOp::LESS;
-    if (op_str == ">=") return CompareOp::GREATER_EQUAL;
-    if (op_str == "<=") return CompareOp::LESS_EQUAL;
-    return CompareOp::EQUAL;
-}
-
-LogicOp WhereParser::parseLogicOp(const string& op_str) {
-    string upper_op = op_str;
-    transform(upper_op.begin(), upper_op.end(), upper_op.begin(), ::toupper);
     
-    if (upper_op == "AND") return LogicOp::AND;
-    if (upper_op == "OR") return LogicOp::OR;
-    if (upper_op == "NOT") return LogicOp::NOT;
-    return LogicOp::AND;
+    if (ranked.empty()) {
+        return makeConstant(op == LogicOp::AND);
+    }
+    stable_sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    
+    shared_ptr<LogicExpression> chain = ranked.back().second;
+    for (size_t i = ranked.size() - 1; i-- > 0;) {
+        auto node = make_shared<LogicExpression>();
+        node->op = op;
+        node->isSingleCondition = false;
+        node->left = ranked[i].second;
+        node->right = chain;
+        chain = node;
+    }
+    return chain;
 }
 
-string WhereParser::parseColumnName(const string& column_ref, const vector<Column>& columns) {
-    string column_name_only = column_ref;
-    
-    size_t dot_pos = column_ref.find('.');
-    if (dot_pos != string::npos) {
-        column_name_only = column_ref.substr(dot_pos + 1);
+// Part VI.Realization of BufferPool class in minisql.h
+shared_ptr<Table> BufferPool::getTable(const string& table_name) {
+    auto it = entries_.find(table_name);
+    if (it != entries_.end()) {
+        ++stats_[table_name].hits;
+        touch(it->second);
+        return it->second->table;
     }
     
-    for (const auto& col : columns) {
-        if (col.name == column_name_only) {
-            return column_name_only;
-        }
+    shared_ptr<Table> table;
+    auto pending = pending_.find(table_name);
+    if (pending != pending_.end()) {
+        table = pending->second.get();
+        pending_.erase(pending);
+    } else if (Loader loader = catalog_(table_name)) {
+        table = loader();
+    }
+    if (!table) {
+        return nullptr;
     }
     
-    return "";
+    ++loads_;
+    ++stats_[table_name].misses;
+    putTable(table_name, table);
+    return table;
 }
 
-shared_ptr<LogicExpression> WhereParser::parseSingleCondition(const string& condition_str, const vector<Column>& columns) {
-    string str = trim(condition_str);
-    
-    if (str.empty()) {
-        return nullptr;
+void BufferPool::prefetch(const string& table_name) {
+    if (hasTable(table_name) || pending_.count(table_name)) {
+        return;
     }
-    
-    regex pattern(R"(([\w\.]+)\s*([=<>!]+)\s*('?[^']*'?|\d+\.?\d*|[\w\.]+))");
-    smatch matches;
-    
-    if (!regex_search(str, matches, pattern) || matches.size() < 4) {
-        cerr << "Error: Invalid condition format: " << str << endl;
-        return nullptr;
+    if (Loader loader = catalog_(table_name)) {
+        pending_[table_name] = async(launch::async, move(loader));
+        ++prefetches_;
     }
-    
-    string left_column_full = matches[1].str();
-    string op = matches[2].str();
-    string right_part = matches[3].str();
-    
-    string left_column_name = parseColumnName(left_column_full, columns);
-    if (left_column_name.empty()) {
-        cerr << "Error: Left column '" << left_column_full << "' not found in tables" << endl;
-        return nullptr;
+}
+
+void BufferPool::putTable(const string& table_name, shared_ptr<Table> table) {
+    // A prefetch still running would bring back the table being replaced.
+    auto pending = pending_.find(table_name);
+    if (pending != pending_.end()) {
+        pending->second.wait();
+        pending_.erase(pending);
     }
     
-    string col_type = "VARCHAR";
-    for (const auto& col : columns) {
-        if (col.name == left_column_name) {
-            col_type = col.type;
-            break;
-        }
+    auto it = entries_.find(table_name);
+    if (it != entries_.end()) {
+        it->second->table = move(table);
+        touch(it->second);
+        return;
     }
     
-    bool is_column_comparison = false;
-    string right_column_name = "";
-    
-    bool is_quoted_string = (right_part.front() == '\'' && right_part.back() == '\'');
-    bool is_number = !right_part.empty() && all_of(right_part.begin(), right_part.end(), [](char c) {
-        return isdigit(c) || c == '.' || c == '-' || c == '+';
-    });
+    // Under TWO_Q only a table evicted from probation a short while ago skips it.
+    bool probation = policy_ == Policy::TWO_Q && !forget(table_name);
     
-    if (!is_quoted_string && !is_number) {
-        right_column_name = parseColumnName(right_part, columns);
-        if (!right_column_name.empty()) {
-            is_column_comparison = true;
-        }
+    LruList& list = probation ? probation_ : main_;
+    list.push_front({table_name, move(table), 0, probation});
+    entries_[table_name] = list.begin();
+    touch(list.begin());
+}
+
+bool BufferPool::removeTable(const string& table_name) {
+    auto pending = pending_.find(table_name);
+    if (pending != pending_.end()) {
+        pending->second.wait();
+        pending_.erase(pending);
     }
     
-    auto expression = make_shared<LogicExpression>();
-    Condition condition;
-    condition.left_column = left_column_name;
-    condition.op = parseCompareOp(op);
-    condition.is_column_comparison = is_column_comparison;
+    stats_.erase(table_name);
+    forget(table_name);
     
-    if (is_column_comparison) {
-        condition.right_column = right_column_name;
-    } else {
-        condition.constant_value = parseValue(right_part, col_type);
+    auto it = entries_.find(table_name);
+    if (it == entries_.end()) {
+        return false;
     }
     
-    expression->isSingleCondition = true;
-    expression->left = condition;
-    expression->op = LogicOp::AND;
-    
-    return expression;
+    if (it->second->table->isDirty()) {
+        it->second->table->saveToCSV();
+    }
+    unlink(it->second);
+    return true;
 }
 
-//** Difficult part: parse condition expression, including finding syntax error.
-shared_ptr<LogicExpression> WhereParser::parseExpression(const string& expr_str, const vector<Column>& columns) {
-    string str = trim(expr_str);
-    
-    if (str.empty()) {
-        cerr << "Error: Empty expression" << endl;
-        return nullptr;
-    }
-    
-    //Parsing the OR operator
-    size_t or_pos = findOuterOperator(str, "OR");
-    if (or_pos != string::npos) {
-        string left_str = trim(str.substr(0, or_pos));
-        string right_str = trim(str.substr(or_pos + 2)); 
-        
-        if (left_str.empty() || right_str.empty()) {
-            cerr << "Error: Missing operand for OR operator" << endl;
-            return nullptr;
-        }
-        
-        auto left_expr = parseExpression(left_str, columns);
-        auto right_expr = parseExpression(right_str, columns);
-        
-        if (!left_expr || !right_expr) {
-            return nullptr;
+void BufferPool::saveAllTables() {
+    for (auto* list : {&main_, &probation_}) {
+        for (auto& entry : *list) {
+            if (entry.table->isDirty()) {
+                entry.table->saveToCSV();
+            }
         }
-        
-        auto expr = make_shared<LogicExpression>();
-        expr->op = LogicOp::OR;
-        expr->isSingleCondition = false;
-        expr->left = left_expr;
-        expr->right = right_expr;
-        
-        return expr;
     }
-    
-    // Parsing the AND operator (considering parentheses using findOuterOperator)
-    size_t and_pos = findOuterOperator(str, "AND");
-    if (and_pos != string::npos) {
-        string left_str = trim(str.substr(0, and_pos));
-        string right_str = trim(str.substr(and_pos + 3));
-        
-        if (left_str.empty() || right_str.empty()) {
-            cerr << "Error: Missing operand for AND operator" << endl;
-            return nullptr;
+}
+
+size_t BufferPool::flushAllTables() {
+    size_t flushed = 0;
+    for (auto* list : {&main_, &probation_}) {
+        for (auto& entry : *list) {
+            if (entry.table->hasDirtyPages()) {
+                entry.table->flushPages();
+                ++flushed;
+            }
         }
-        
-        auto left_expr = parseExpression(left_str, columns);
-        auto right_expr = parseExpression(right_str, columns);
-        
-        if (!left_expr || !right_expr) {
-            return nullptr;
+    }
+    return flushed;
+}
+
+size_t BufferPool::dirtyBytes() const {
+    size_t bytes = 0;
+    for (const auto* list : {&main_, &probation_}) {
+        for (const auto& entry : *list) {
+            bytes += entry.table->dirtyBytes();
         }
-        
-        auto expr = make_shared<LogicExpression>();
-        expr->op = LogicOp::AND;
-        expr->isSingleCondition = false;
-        expr->left = left_expr;
-        expr->right = right_expr;
-        
-        return expr;
     }
-    
-    // Parsing the NOT operator
-    string upper_str = str;
-    transform(upper_str.begin(), upper_str.end(), upper_str.begin(), ::toupper);
-    
-    if (upper_str.size() >= 3 && upper_str.substr(0, 3) == "NOT") {
-        size_t not_end = 3;
-        while (not_end < str.size() && isspace(str[not_end])) {
-            not_end++;
+    return bytes;
+}
+
+vector<string> BufferPool::getAllTableNames() const {
+    vector<string> names;
+    names.reserve(entries_.size());
+    for (const auto* list : {&main_, &probation_}) {
+        for (const auto& entry : *list) {
+            names.push_back(entry.name);
         }
-        
-        if (not_end >= str.size()) {
-            cerr << "Command Error! Missing operand for NOT operator" << endl;
-            return nullptr;
+    }
+    return names;
+}
+
+void BufferPool::setCapacity(size_t bytes) {
+    capacity_bytes_ = bytes;
+    trimGhosts();
+    evictTo(capacity_bytes_);
+}
+
+void BufferPool::setPolicy(Policy policy) {
+    policy_ = policy;
+    for (auto& entry : probation_) {
+        entry.probation = false;
+    }
+    main_.splice(main_.end(), probation_);
+    probation_bytes_ = 0;
+    ghosts_.clear();
+    ghost_entries_.clear();
+    ghost_bytes_ = 0;
+}
+
+void BufferPool::touch(LruList::iterator entry) {
+    if (!entry->probation) {
+        main_.splice(main_.begin(), main_, entry);
+    }
+    size_t bytes = entry->table->memoryUsage();
+    bytes_ = bytes_ - entry->bytes + bytes;
+    if (entry->probation) {
+        probation_bytes_ = probation_bytes_ - entry->bytes + bytes;
+    }
+    entry->bytes = bytes;
+    last_touched_ = &*entry;
+    evictTo(capacity_bytes_);
+}
+
+void BufferPool::evictTo(size_t limit) {
+    while (bytes_ > limit) {
+        // A scan's table still in use must not push the main list out; the pool stays over
+        // the capacity until a later access evicts it.
+        if (probation_bytes_ > capacity_bytes_ / 4) {
+            if (!evictFrom(probation_)) break;
+        } else if (!evictFrom(main_) && !evictFrom(probation_)) {
+            break;
         }
-        
-        string inner_str = trim(str.substr(not_end));
-        if (inner_str.empty()) {
-            cerr << "Command Error! Empty expression after NOT" << endl;
-            return nullptr;
+    }
+}
+
+bool BufferPool::evictFrom(LruList& list) {
+    for (auto victim = list.end(); victim != list.begin();) {
+        --victim;
+        if (&*victim == last_touched_ || victim->table.use_count() > 1) {
+            continue;
         }
         
-        if (inner_str.front() == '(' && inner_str.back() == ')') {
-            inner_str = inner_str.substr(1, inner_str.length() - 2);
-            inner_str = trim(inner_str);
+        if (victim->table->hasDirtyPages()) {
+            victim->table->flushPages();
         }
-        
-        auto inner_expr = parseExpression(inner_str, columns);
-        if (!inner_expr) {
-            return nullptr;
+        ++evictions_;
+        ++stats_[victim->name].evictions;
+        if (victim->probation) {
+            remember(victim->name, victim->bytes);
         }
-        
-        auto expr = make_shared<LogicExpression>();
-        expr->op = LogicOp::NOT;
-        expr->isSingleCondition = false;
-        expr->left = inner_expr;
-        
-        return expr;
+        unlink(victim);
+        return true;
     }
-    
-    // Parsing parentheses expressions
-    if (str.front() == '(' && str.back() == ')') {
-        string inner_str = str.substr(1, str.length() - 2);
-        
-        if (trim(inner_str).empty()) {
-            cerr << "Error: Empty expression inside parentheses" << endl;
-            return nullptr;
+    return false;
+}
+
+void BufferPool::unlink(LruList::iterator entry) {
+    bytes_ -= entry->bytes;
+    if (entry->probation) {
+        probation_bytes_ -= entry->bytes;
+    }
+    if (last_touched_ == &*entry) {
+        last_touched_ = nullptr;
+    }
+    entries_.erase(entry->name);
+    (entry->probation ? probation_ : main_).erase(entry);
+}
+
+void BufferPool::remember(const string& table_name, size_t bytes) {
+    // A table over the bound would only push out every other name.
+    if (bytes > capacity_bytes_ / 2) {
+        return;
+    }
+    ghosts_.emplace_front(table_name, bytes);
+    ghost_entries_[table_name] = ghosts_.begin();
+    ghost_bytes_ += bytes;
+    trimGhosts();
+}
+
+bool BufferPool::forget(const string& table_name) {
+    auto ghost = ghost_entries_.find(table_name);
+    if (ghost == ghost_entries_.end()) {
+        return false;
+    }
+    ghost_bytes_ -= ghost->second->second;
+    ghosts_.erase(ghost->second);
+    ghost_entries_.erase(ghost);
+    return true;
+}
+
+void BufferPool::trimGhosts() {
+    while (ghost_bytes_ > capacity_bytes_ / 2) {
+        ghost_bytes_ -= ghosts_.back().second;
+        ghost_entries_.erase(ghosts_.back().first);
+        ghosts_.pop_back();
+    }
+}
+
+// Part VII. Realization of ResultCache class in minisql.h
+// Approximate heap size of a cached result.
+static size_t resultBytes(const string& key, const vector<Column>& columns, const vector<Row>& rows) {
+    size_t bytes = key.capacity() + columns.size() * sizeof(Column);
+    for (const auto& col : columns) bytes += col.name.capacity() + col.type.capacity();
+    for (const auto& row : rows) {
+        bytes += sizeof(Row) + row.size() * sizeof(Value);
+        for (size_t i = 0; i < row.size(); ++i) {
+            if (holds_alternative<string>(row[i])) bytes += get<string>(row[i]).capacity();
         }
-        
-        return parseExpression(inner_str, columns);
+    }
+    return bytes;
+}
+
+const ResultCache::Entry* ResultCache::lookup(const string& key) {
+    if (key.empty() || capacity_bytes_ == 0) {
+        return nullptr;
     }
     
-    // Parsing NOT in parentheses, such as (NOT age > 25)
-    if (str.size() > 4 && str.front() == '(' && 
-        toupper(str[1]) == 'N' && toupper(str[2]) == 'O' && toupper(str[3]) == 'T') {
-        
-        size_t not_start = 4;
-        while (not_start < str.size() && isspace(str[not_start])) {
-            not_start++;
-        }
-        
-        if (not_start < str.size() && str.back() == ')') {
-            string inner_without_not = str.substr(not_start, str.length() - not_start - 1);
-            string inner_str = trim(inner_without_not);
-            
-            if (!inner_str.empty()) {
-                auto inner_expr = parseExpression(inner_str, columns);
-                if (!inner_expr) {
-                    return nullptr;
-                }
-                
-                auto expr = make_shared<LogicExpression>();
-                expr->op = LogicOp::NOT;
-                expr->isSingleCondition = false;
-                expr->left = inner_expr;
-                
-                return expr;
-            }
-        }
+    auto it = entries_.find(key);
+    if (it == entries_.end()) {
+        ++misses_;
+        return nullptr;
     }
     
-    // SingleCondition
-    return parseSingleCondition(str, columns);
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return &it->second->second;
 }
 
-bool WhereParser::validateExpression(const string& expr_str) {
-    string str = trim(expr_str);
-    if (str.empty()) {
-        cerr << "Error: Empty WHERE expression" << endl;
-        return false;
+void ResultCache::insert(const string& key, vector<Column> columns, vector<Row> rows) {
+    if (key.empty() || capacity_bytes_ == 0) {
+        return;
     }
     
-    int paren_count = 0;
-    for (char c : str) {
-        if (c == '(') paren_count++;
-        else if (c == ')') paren_count--;
-        if (paren_count < 0) {
-            cerr << "Error: Unmatched ')'" << endl;
-            return false;
-        }
+    size_t bytes = resultBytes(key, columns, rows);
+    if (bytes > capacity_bytes_) {
+        return;
     }
-    if (paren_count != 0) {
-        cerr << "Error: Unmatched parentheses" << endl;
-        return false;
+    
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+        bytes_ -= it->second->second.bytes;
+        lru_.erase(it->second);
+        entries_.erase(it);
     }
     
-    return true;
+    evictTo(capacity_bytes_ - bytes);
+    lru_.emplace_front(key, Entry{move(columns), move(rows), bytes});
+    entries_[key] = lru_.begin();
+    bytes_ += bytes;
 }
 
-bool WhereParser::validateCondition(const string& cond_str) {
-    regex pattern(R"(\s*([\w\.]+)\s*([=<>!]+)\s*('?[^']*'?|\d+\.?\d*|[\w\.]+)\s*)");
-    return regex_match(cond_str, pattern);
+void ResultCache::clear() {
+    lru_.clear();
+    entries_.clear();
+    bytes_ = 0;
 }
 
-// Part VI.Realization of BufferPool class in minisql.h
-shared_ptr<Table> BufferPool::getTable(const string& table_name) {
-    auto it = cache_.find(table_name);
-    if (it != cache_.end()) {
-        auto order_it = find(access_order_.begin(), access_order_.end(), table_name);
-        if (order_it != access_order_.end()) {
-            access_order_.erase(order_it);
-            access_order_.push_back(table_name);
+void ResultCache::setCapacity(size_t bytes) {
+    capacity_bytes_ = bytes;
+    evictTo(capacity_bytes_);
+}
+
+void ResultCache::evictTo(size_t limit) {
+    while (bytes_ > limit && !lru_.empty()) {
+        bytes_ -= lru_.back().second.bytes;
+        entries_.erase(lru_.back().first);
+        lru_.pop_back();
+        ++evictions_;
+    }
+}
+
+// Part VIII. Realization of MiniSQL class in minisql.h
+MiniSQL::MiniSQL() {
+    buffer_pool_ = make_unique<BufferPool>([this](const string& table_name) -> BufferPool::Loader {
+        auto it = catalog_.find(table_name);
+        if (it == catalog_.end()) {
+            return nullptr;
+        }
+        return [this, table_name, csv_path = it->second] { return readTable(table_name, csv_path); };
+    });
+    loadAllTablesFromDisk();
+}
+
+MiniSQL::~MiniSQL() {
+    if (checkpointer_.joinable()) {
+        {
+            lock_guard<recursive_mutex> lock(statement_mutex_);
+            stopping_ = true;
         }
-        return it->second;
+        checkpoint_wake_.notify_one();
+        checkpointer_.join();
     }
-    return nullptr;
+    saveAllTables();
 }
 
-void BufferPool::putTable(const string& table_name, shared_ptr<Table> table) {
-    if (cache_.size() >= capacity_) {
-        evictLRU();
+void MiniSQL::startCheckpointer() {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    if (!checkpointer_.joinable()) {
+        checkpointer_ = thread(&MiniSQL::runCheckpointer, this);
     }
-    
-    cache_[table_name] = table;
-    access_order_.push_back(table_name);
 }
 
-bool BufferPool::removeTable(const string& table_name) {
-    auto it = cache_.find(table_name);
-    if (it != cache_.end()) {
-        it->second->saveToCSV();
-        
-        auto order_it = find(access_order_.begin(), access_order_.end(), table_name);
-        if (order_it != access_order_.end()) {
-            access_order_.erase(order_it);
+void MiniSQL::runCheckpointer() {
+    unique_lock<recursive_mutex> lock(statement_mutex_);
+    while (!stopping_) {
+        auto woken = [this] { return stopping_ || checkpoint_requested_; };
+        if (checkpoint_interval_ms_ == 0) {
+            checkpoint_wake_.wait(lock, woken);
+        } else {
+            // Waits of more than a day could overflow the clock.
+            size_t interval_ms = min<size_t>(checkpoint_interval_ms_, 24 * 60 * 60 * 1000);
+            checkpoint_wake_.wait_for(lock, chrono::milliseconds(interval_ms), woken);
         }
-        cache_.erase(it);
-        return true;
+        if (stopping_) break;
+        checkpoint_requested_ = false;
+        checkpoint();
     }
-    return false;
 }
 
-void BufferPool::saveAllTables() {
-    for (auto& [name, table] : cache_) {
-        table->saveToCSV();
+void MiniSQL::checkpointIfNeeded() {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    bool threshold_reached = buffer_pool_->dirtyBytes() >= checkpoint_bytes_;
+    if (checkpoint_interval_ms_ == 0) {
+        checkpoint();
+    } else if (checkpointer_.joinable()) {
+        if (threshold_reached) {
+            checkpoint_requested_ = true;
+            checkpoint_wake_.notify_one();
+        }
+    } else if (threshold_reached || chrono::steady_clock::now() - last_checkpoint_ >= chrono::milliseconds(checkpoint_interval_ms_)) {
+        checkpoint();
     }
 }
 
-void BufferPool::evictLRU() {
-    if (!access_order_.empty()) {
-        string lru_table = access_order_.front();
-        access_order_.erase(access_order_.begin());
-        
-        auto it = cache_.find(lru_table);
-        if (it != cache_.end()) {
-            it->second->saveToCSV();
-            cache_.erase(it);
-        }
+void MiniSQL::checkpoint() {
+    last_checkpoint_ = chrono::steady_clock::now();
+    size_t flushed = buffer_pool_->flushAllTables();
+    if (flushed > 0) {
+        ++checkpoints_;
+        checkpointed_tables_ += flushed;
     }
 }
 
-// Part VII. Realization of MiniSQL class in minisql.h
-MiniSQL::MiniSQL() {
-    buffer_pool_ = make_unique<BufferPool>(100);
-    loadAllTablesFromDisk();
+void MiniSQL::setCheckpointInterval(size_t milliseconds) {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    checkpoint_interval_ms_ = milliseconds;
+    // The checkpoint thread may be waiting on the old interval.
+    checkpoint_requested_ = true;
+    checkpoint_wake_.notify_one();
+}
+
+void MiniSQL::setCheckpointBytes(size_t bytes) {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    checkpoint_bytes_ = bytes;
+}
+
+size_t MiniSQL::checkpointInterval() const {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    return checkpoint_interval_ms_;
+}
+
+size_t MiniSQL::checkpointBytes() const {
+    lock_guard<recursive_mutex> lock(statement_mutex_);
+    return checkpoint_bytes_;
 }
 
 void MiniSQL::createTable(const string& name, const vector<Column>& columns, const string& csv_file) {
     
-    if (buffer_pool_->hasTable(name)) {
+    if (tableExists(name)) {
         cout << "Error: Table '" << name << "' already exists in memory." << endl;
         return;
     }
@@ -1013,21 +3736,31 @@ void MiniSQL::createTable(const string& name, const vector<Column>& columns, con
     }
     
     auto table = make_shared<Table>(name, columns, csv_path);
+    table->saveSchema();
     
+    catalog_[name] = csv_path;
     buffer_pool_->putTable(name, table);
-    tables_[name] = table;
     
     cout << "Table '" << name << "' created successfully with " << columns.size() << " columns." << endl;
 }
 
 void MiniSQL::saveAllTables() {
     buffer_pool_->saveAllTables();
+    
+    // Evicted tables only wrote their changed pages back; bring their CSV files up to date.
+    for (const auto& [name, csv_path] : catalog_) {
+        if (buffer_pool_->hasTable(name)) continue;
+        if (!PageFile::csvBehind(filesystem::path(csv_path).replace_extension(".pages").string(), csv_path)) continue;
+        if (auto table = readTable(name, csv_path)) {
+            table->saveToCSV();
+        }
+    }
 }
 
 vector<string> MiniSQL::listTables() const {
     vector<string> all_tables;
     
-    for (const auto& pair : tables_) {
+    for (const auto& pair : catalog_) {
         all_tables.push_back(pair.first);
     }
     
@@ -1045,7 +3778,7 @@ vector<string> MiniSQL::listTables() const {
 }
 
 bool MiniSQL::dropTable(const string& table_name) {
-    bool in_memory = tables_.find(table_name) != tables_.end();
+    bool in_memory = tableExists(table_name);
     bool on_disk = false;
     
     string csv_file = "../../data/" + table_name + ".csv";
@@ -1060,12 +3793,22 @@ bool MiniSQL::dropTable(const string& table_name) {
     }
     
     if (in_memory) {
-        auto it = tables_.find(table_name);
-        if (it != tables_.end()) {
-            buffer_pool_->removeTable(table_name);
-            tables_.erase(it);
+        buffer_pool_->removeTable(table_name);
+        catalog_.erase(table_name);
+    }
+    
+    // Schema and index files go with the table.
+    string schema_file = "../../data/" + table_name + ".schema";
+    vector<Column> schema_columns;
+    vector<IndexDefinition> schema_indexes;
+    if (Table::readSchema(schema_file, schema_columns, schema_indexes)) {
+        for (const auto& definition : schema_indexes) {
+            filesystem::remove("../../data/" + table_name + "." + definition.name + ".idx", ec);
         }
     }
+    filesystem::remove(schema_file, ec);
+    filesystem::remove("../../data/" + table_name + ".zonemap", ec);
+    filesystem::remove("../../data/" + table_name + ".pages", ec);
     
     if (on_disk) {
         if (!filesystem::remove(csv_file, ec)) {
@@ -1090,13 +3833,45 @@ bool MiniSQL::dropTable(const string& table_name) {
 bool MiniSQL::insert(const string& table_name, const Row& row) {
     auto table = buffer_pool_->getTable(table_name);
     if (!table) {
+        cerr << "Error: Table '" << table_name << "' does not exist" << endl;
+        return false;
+    }
+    
+    if (!table->insertRow(row)) {
+        return false;
+    }
+    checkpointIfNeeded();
+    return true;
+}
+
+bool MiniSQL::upsert(const string& table_name, const Row& row, bool& replaced) {
+    auto table = buffer_pool_->getTable(table_name);
+    if (!table) {
+        cerr << "Error: Table '" << table_name << "' does not exist" << endl;
+        replaced = false;
         return false;
     }
     
-    table->insertRow(row);
+    if (!table->upsertRow(row, replaced)) {
+        return false;
+    }
+    checkpointIfNeeded();
     return true;
 }
 
+long long MiniSQL::count(const string& table_name, const shared_ptr<LogicExpression>& where_clause) {
+    auto table = buffer_pool_->getTable(table_name);
+    if (!table) {
+        return -1;
+    }
+
+    vector<string> column_names;
+    for (const auto& col : table->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+
+    return static_cast<long long>(table->countRows(where_clause));
+}
+
 vector<Row> MiniSQL::select(const string& table_name, const vector<string>& columns, const vector<string>& column_aliases, const shared_ptr<LogicExpression>& where_clause) {
     
     auto table = buffer_pool_->getTable(table_name);
@@ -1104,10 +3879,27 @@ vector<Row> MiniSQL::select(const string& table_name, const vector<string>& colu
         return {};
     }
     
+    vector<string> column_names;
+    for (const auto& col : table->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+    
     vector<string> aliases = column_aliases.empty() ? columns : column_aliases;
     return table->selectRows(columns, aliases, where_clause);
 }
 
+vector<Row> MiniSQL::select(const string& table_name, const vector<shared_ptr<const Expression>>& projections, const shared_ptr<LogicExpression>& where_clause) {
+    auto table = buffer_pool_->getTable(table_name);
+    if (!table) {
+        return {};
+    }
+    
+    vector<string> column_names;
+    for (const auto& col : table->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+    
+    return table->projectRows(projections, where_clause);
+}
+
 vector<Row> MiniSQL::join(const string& left_table, const string& right_table, const vector<string>& columns, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
     
     auto left_table_ptr = buffer_pool_->getTable(left_table);
@@ -1117,7 +3909,13 @@ vector<Row> MiniSQL::join(const string& left_table, const string& right_table, c
         return {};
     }
     
-    return Table::joinTables(*left_table_ptr, *right_table_ptr, columns, join_type, condition, where_clause);
+    vector<string> column_names;
+    for (const auto& col : left_table_ptr->columns()) column_names.push_back(col.name);
+    for (const auto& col : right_table_ptr->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+    
+    last_query_stats_ = QueryStats{};
+    return Table::joinTables(*left_table_ptr, *right_table_ptr, columns, join_type, condition, where_clause, &last_query_stats_, query_memory_budget_);
 }
 
 bool MiniSQL::saveJoinAsTable(const string& new_table_name, const string& left_table_name, const string& right_table_name, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
@@ -1129,6 +3927,22 @@ shared_ptr<Table> MiniSQL::getTable(const string& table_name) {
     return buffer_pool_->getTable(table_name);
 }
 
+string MiniSQL::resultCacheKey(const string& sql, const vector<string>& tables) {
+    string key = normalizeStatement(sql);
+    // The first table loads in the foreground while the others are prefetched.
+    for (size_t i = 1; i < tables.size(); ++i) {
+        prefetch(tables[i]);
+    }
+    for (const auto& table_name : tables) {
+        auto table = getTable(table_name);
+        if (!table) {
+            return "";
+        }
+        key += '\n' + table_name + '@' + to_string(table->version());
+    }
+    return key;
+}
+
 int MiniSQL::deleteRows(const string& table_name, const shared_ptr<LogicExpression>& where_clause) {
     auto table = buffer_pool_->getTable(table_name);
     if (!table) {
@@ -1136,11 +3950,24 @@ int MiniSQL::deleteRows(const string& table_name, const shared_ptr<LogicExpressi
         return 0;
     }
     
+    vector<string> column_names;
+    for (const auto& col : table->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+    
     int deleted_count = table->deleteRows(where_clause);
+    checkpointIfNeeded();
     return deleted_count;
 }
 
 int MiniSQL::updateRows(const string& table_name, const unordered_map<string, Value>& updates, const shared_ptr<LogicExpression>& where_clause) {
+    unordered_map<string, shared_ptr<const Expression>> assignments;
+    for (const auto& [col_name, value] : updates) {
+        assignments[col_name] = Expression::constant(value);
+    }
+    return updateRows(table_name, assignments, where_clause);
+}
+
+int MiniSQL::updateRows(const string& table_name, const unordered_map<string, shared_ptr<const Expression>>& updates, const shared_ptr<LogicExpression>& where_clause) {
     auto table = buffer_pool_->getTable(table_name);
     if (!table) {
         cerr << "Error: Table '" << table_name << "' does not exist" << endl;
@@ -1152,17 +3979,68 @@ int MiniSQL::updateRows(const string& table_name, const unordered_map<string, Va
         return 0;
     }
     
-    try {
-        int updated_count = table->updateRows(updates, where_clause);
-        return updated_count;
-    } catch (const exception& e) {
-        cerr << "Update error: " << e.what() << endl;
-        return 0;
+    vector<string> column_names;
+    for (const auto& col : table->columns()) column_names.push_back(col.name);
+    bindSubqueries(where_clause, column_names);
+    
+    int updated_count = table->updateRows(updates, where_clause);
+    checkpointIfNeeded();
+    return updated_count;
+}
+
+bool MiniSQL::createIndex(const string& index_name, const string& table_name, const string& column_name, IndexKind kind, const vector<string>& include_columns) {
+    auto table = buffer_pool_->getTable(table_name);
+    if (!table) {
+        cerr << "Error: Table '" << table_name << "' does not exist" << endl;
+        return false;
+    }
+    
+    // Index names are unique across the whole database so DROP INDEX can omit the table.
+    string owner = indexOwner(index_name);
+    if (!owner.empty()) {
+        cout << "Error: Index '" << index_name << "' already exists on table '" << owner << "'" << endl;
+        return false;
     }
+    
+    return table->createIndex(index_name, column_name, kind, include_columns);
+}
+
+bool MiniSQL::dropIndex(const string& index_name, const string& table_name) {
+    if (!table_name.empty()) {
+        auto table = buffer_pool_->getTable(table_name);
+        if (!table) {
+            cerr << "Error: Table '" << table_name << "' does not exist" << endl;
+            return false;
+        }
+        if (table->dropIndex(index_name)) return true;
+    } else {
+        string owner = indexOwner(index_name);
+        auto table = owner.empty() ? nullptr : getTable(owner);
+        if (table && table->dropIndex(index_name)) return true;
+    }
+    
+    cout << "Error: Index '" << index_name << "' does not exist" << endl;
+    return false;
 }
 
 bool MiniSQL::tableExists(const string& table_name) const {
-    return tables_.find(table_name) != tables_.end();
+    return catalog_.find(table_name) != catalog_.end();
+}
+
+string MiniSQL::indexOwner(const string& index_name) const {
+    for (const auto& [name, csv_path] : catalog_) {
+        if (auto table = buffer_pool_->peekTable(name)) {
+            if (table->hasIndex(index_name)) return name;
+            continue;
+        }
+        vector<Column> columns;
+        vector<IndexDefinition> indexes;
+        if (!Table::readSchema(filesystem::path(csv_path).replace_extension(".schema").string(), columns, indexes)) continue;
+        for (const auto& definition : indexes) {
+            if (definition.name == index_name) return name;
+        }
+    }
+    return "";
 }
 
 bool MiniSQL::createTableFromJoin(const string& new_table_name, const string& left_table_name, const string& right_table_name, JoinType join_type, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause) {
@@ -1172,6 +4050,7 @@ bool MiniSQL::createTableFromJoin(const string& new_table_name, const string& le
         return false;
     }
     
+    prefetch(right_table_name);
     auto left_table = getTable(left_table_name);
     auto right_table = getTable(right_table_name);
     
@@ -1187,12 +4066,14 @@ bool MiniSQL::createTableFromJoin(const string& new_table_name, const string& le
     for (const auto& col : left_table->columns()) {
         Column new_col = col;
         new_col.name = left_table->name() + "_" + col.name;
+        new_col.primary_key = new_col.unique = false;   // join results may repeat keys
         merged_columns.push_back(new_col);
     }
     
     for (const auto& col : right_table->columns()) {
         Column new_col = col;
         new_col.name = right_table->name() + "_" + col.name;
+        new_col.primary_key = new_col.unique = false;
         merged_columns.push_back(new_col);
     }
     
@@ -1204,6 +4085,7 @@ bool MiniSQL::createTableFromJoin(const string& new_table_name, const string& le
         for (const auto& row : results) {
             new_table->insertRow(row);
         }
+        checkpointIfNeeded();
         cout << "Created table '" << new_table_name << "' with " 
               << results.size() << " rows from JOIN" << endl;
         return true;
@@ -1212,6 +4094,172 @@ bool MiniSQL::createTableFromJoin(const string& new_table_name, const string& le
     return false;
 }
 
+void MiniSQL::bindSubqueries(const shared_ptr<LogicExpression>& expression, const vector<string>& outer_columns, QueryStats* stats) {
+    if (!expression) return;
+    
+    for (auto* side : {&expression->left, &expression->right}) {
+        if (auto* condition = get_if<Condition>(side)) {
+            if (condition->subquery) {
+                // bindSubquery adds the entry at index, ahead of its own nested subqueries.
+                size_t index = stats ? stats->subqueries.size() : 0;
+                bindSubquery(*condition->subquery, outer_columns, stats);
+                if (stats) stats->subqueries[index].description = WhereParser::describe(*condition);
+            }
+        } else if (auto* child = get_if<shared_ptr<LogicExpression>>(side)) {
+            bindSubqueries(*child, outer_columns, stats);
+        }
+    }
+}
+
+// Terms of the top-level AND chain of a parsed expression.
+static void collectSqlConjuncts(const shared_ptr<const SqlExpr>& expression, vector<shared_ptr<const SqlExpr>>& conjuncts) {
+    if (expression->kind == ExprKind::AND) {
+        collectSqlConjuncts(expression->left, conjuncts);
+        collectSqlConjuncts(expression->right, conjuncts);
+    } else {
+        conjuncts.push_back(expression);
+    }
+}
+
+// First column reference in expression that the subquery on inner_table cannot resolve by
+// itself: one qualified with another table, or an outer column the inner table lacks. Nested
+// subqueries resolve their own references. Empty when there is none.
+static string outerReference(const SqlExpr& expression, const Table& inner_table, const vector<string>& outer_columns) {
+    if (expression.kind == ExprKind::COLUMN) {
+        size_t dot_pos = expression.text.find('.');
+        if (dot_pos != string::npos) {
+            return expression.text.substr(0, dot_pos) == inner_table.name() ? "" : expression.text;
+        }
+        bool outer_only = inner_table.getColumnIndex(expression.text) == -1 &&
+                          find(outer_columns.begin(), outer_columns.end(), expression.text) != outer_columns.end();
+        return outer_only ? expression.text : "";
+    }
+    for (const auto* child : {expression.left.get(), expression.right.get()}) {
+        if (!child) continue;
+        string reference = outerReference(*child, inner_table, outer_columns);
+        if (!reference.empty()) return reference;
+    }
+    return "";
+}
+
+void MiniSQL::bindSubquery(Subquery& subquery, const vector<string>& outer_columns, QueryStats* stats) {
+    auto start = Clock::now();
+    auto inner_table = getTable(subquery.table);
+    if (!inner_table) {
+        throw runtime_error("Subquery table '" + subquery.table + "' does not exist");
+    }
+    size_t index = 0;
+    if (stats) {
+        index = stats->subqueries.size();
+        stats->subqueries.push_back(SubqueryStats{});
+        stats->subqueries[index].table = subquery.table;
+    }
+    
+    vector<string> inner_columns;
+    for (const auto& col : inner_table->columns()) inner_columns.push_back(col.name);
+    
+    auto isInnerColumn = [&](const string& ref) {
+        size_t dot_pos = ref.find('.');
+        if (dot_pos != string::npos) {
+            return ref.substr(0, dot_pos) == subquery.table && inner_table->getColumnIndex(ref.substr(dot_pos + 1)) != -1;
+        }
+        return inner_table->getColumnIndex(ref) != -1;
+    };
+    auto outerColumnOf = [&](const string& ref) -> string {
+        size_t dot_pos = ref.find('.');
+        if (dot_pos != string::npos && ref.substr(0, dot_pos) == subquery.table) return "";
+        string name = (dot_pos != string::npos) ? ref.substr(dot_pos + 1) : ref;
+        if (dot_pos == string::npos && inner_table->getColumnIndex(name) != -1) return "";
+        return find(outer_columns.begin(), outer_columns.end(), name) != outer_columns.end() ? name : "";
+    };
+    
+    // EXISTS: pull one "inner.col = outer.col" conjunct out of the WHERE clause as the
+    // semi join key; the remaining conjuncts filter the inner table.
+    shared_ptr<const SqlExpr> filter_expr = subquery.where;
+    string key_column;
+    subquery.outer_column.clear();
+    subquery.outer_index = -1;
+    if (subquery.kind == SubqueryKind::EXISTS && filter_expr) {
+        vector<shared_ptr<const SqlExpr>> conjuncts;
+        collectSqlConjuncts(filter_expr, conjuncts);
+        
+        filter_expr = nullptr;
+        for (const auto& conjunct : conjuncts) {
+            bool column_equal = conjunct->kind == ExprKind::COMPARE && conjunct->op == CompareOp::EQUAL &&
+                                conjunct->left->kind == ExprKind::COLUMN && conjunct->right->kind == ExprKind::COLUMN;
+            if (subquery.outer_column.empty() && column_equal) {
+                const string& lhs = conjunct->left->text;
+                const string& rhs = conjunct->right->text;
+                if (isInnerColumn(lhs) && !outerColumnOf(rhs).empty()) {
+                    key_column = lhs;
+                    subquery.outer_column = outerColumnOf(rhs);
+                    continue;
+                }
+                if (isInnerColumn(rhs) && !outerColumnOf(lhs).empty()) {
+                    key_column = rhs;
+                    subquery.outer_column = outerColumnOf(lhs);
+                    continue;
+                }
+            }
+            filter_expr = !filter_expr ? conjunct : make_shared<const SqlExpr>(SqlExpr{ExprKind::AND, "", CompareOp::EQUAL, filter_expr, conjunct, nullptr, 0});
+        }
+        auto outer_position = find(outer_columns.begin(), outer_columns.end(), subquery.outer_column);
+        subquery.outer_index = outer_position != outer_columns.end() ? static_cast<int>(outer_position - outer_columns.begin()) : -1;
+    } else if (subquery.kind == SubqueryKind::IN) {
+        key_column = subquery.select_column;
+    }
+    
+    int key_idx = -1;
+    if (!key_column.empty()) {
+        size_t dot_pos = key_column.find('.');
+        key_idx = inner_table->getColumnIndex(dot_pos != string::npos ? key_column.substr(dot_pos + 1) : key_column);
+        if (key_idx == -1) {
+            throw runtime_error("Column '" + key_column + "' not found in subquery table '" + subquery.table + "'");
+        }
+    }
+    
+    // Only the key conjunct above is decorrelated; any other outer reference would be bound
+    // against the inner table alone and silently give wrong rows.
+    shared_ptr<LogicExpression> filter = nullptr;
+    if (filter_expr) {
+        string reference = outerReference(*filter_expr, *inner_table, outer_columns);
+        if (!reference.empty()) {
+            throw runtime_error("Subquery on table '" + subquery.table + "' refers to '" + reference +
+                                "'; only one inner.column = outer.column condition in its top-level AND chain may refer to the outer query");
+        }
+        filter = WhereParser::bind(*filter_expr, inner_table->columns());
+        if (!filter) {
+            throw runtime_error("Invalid WHERE clause in subquery on table '" + subquery.table + "'");
+        }
+        bindSubqueries(filter, inner_columns, stats);
+    }
+    
+    // Build side of the semi join: only the key column of qualifying inner rows is kept,
+    // and an uncorrelated EXISTS stops at the first qualifying row.
+    subquery.keys = make_shared<SemiJoinKeys>();
+    subquery.has_rows = false;
+    size_t rows_read = 0;
+    for (const auto& row : inner_table->getAllRows()) {
+        ++rows_read;
+        if (filter && !ConditionEvaluator::evaluate(row, inner_columns, filter)) {
+            continue;
+        }
+        subquery.has_rows = true;
+        if (key_idx == -1) {
+            break;
+        }
+        subquery.keys->insert(row[key_idx]);
+    }
+    
+    if (stats) {
+        SubqueryStats& entry = stats->subqueries[index];
+        entry.rows = rows_read;
+        entry.keys = subquery.keys->numbers.distinctKeys() + subquery.keys->strings.distinctKeys();
+        entry.bytes = subquery.keys->numbers.memoryUsage() + subquery.keys->strings.memoryUsage();
+        entry.time_ms = elapsedMs(start);
+    }
+}
+
 vector<string> MiniSQL::getCSVFilesInDataDir() const {
     vector<string> csv_files;
     string data_dir = "../../data/";
@@ -1257,23 +4305,32 @@ void MiniSQL::loadAllTablesFromDisk() {
             string csv_file = entry.path().filename().string();
             string table_name = csv_file.substr(0, csv_file.size() - 4);
             
-            if (!buffer_pool_->hasTable(table_name)) {
-                loadTableFromDisk(table_name, entry.path().string());
-            }
+            catalog_.emplace(table_name, entry.path().string());
         }
     }
 }
 
 bool MiniSQL::loadTableFromDisk(const string& table_name, const string& csv_path) {
+    auto table = readTable(table_name, csv_path);
+    if (!table) {
+        return false;
+    }
+    
+    catalog_[table_name] = csv_path;
+    buffer_pool_->putTable(table_name, table);
+    return true;
+}
+
+shared_ptr<Table> MiniSQL::readTable(const string& table_name, const string& csv_path) const {
     try {
         ifstream file(csv_path);
         if (!file.is_open()) {
-            return false;
+            return nullptr;
         }
         
         string header;
         if (!getline(file, header)) {
-            return false;
+            return nullptr;
         }
         
         //Determine the data type by reading 5 lines and check their types.
@@ -1291,6 +4348,19 @@ bool MiniSQL::loadTableFromDisk(const string& table_name, const string& csv_path
             col_names.push_back(trim(col_name));
         }
         
+        // A schema file written by CREATE TABLE / CREATE INDEX keeps the declared types, key
+        // constraints and indexes; without one the types are inferred from the first rows.
+        string schema_path = filesystem::path(csv_path).replace_extension(".schema").string();
+        vector<Column> schema_columns;
+        vector<IndexDefinition> schema_indexes;
+        if (Table::readSchema(schema_path, schema_columns, schema_indexes) && schema_columns.size() == col_names.size()) {
+            auto table = make_shared<Table>(table_name, schema_columns, csv_path);
+            for (const auto& definition : schema_indexes) {
+                table->openIndex(definition);
+            }
+            return table;
+        }
+        
         auto inferColumnType = [&sample_rows](size_t col_index) -> string {
             if (sample_rows.empty()) return "VARCHAR";
             
@@ -1405,14 +4475,556 @@ bool MiniSQL::loadTableFromDisk(const string& table_name, const string& csv_path
             columns.push_back(col);
         }
         
-        auto table = make_shared<Table>(table_name, columns, csv_path);
+        return make_shared<Table>(table_name, columns, csv_path);
+        
+    } catch (...) {
+        return nullptr;
+    }
+}
+// Part IX. Prepared statements
+// A statement parsed once by PREPARE. Its WHERE clause is bound to the tables when it is
+// prepared; EXECUTE only stores the parameters into the slots and runs the bound tree.
+struct PreparedStatement {
+    Statement statement;
+    size_t parameter_count = 0;
+    weak_ptr<Table> table;
+    weak_ptr<Table> join_table;
+    shared_ptr<LogicExpression> where_clause;
+    vector<ParameterSlot> slots;
+    vector<shared_ptr<const Expression>> projections;   // computed SELECT list
+    vector<Column> result_columns;                       // of a computed SELECT list
+    unordered_map<string, shared_ptr<const Expression>> assignments;   // UPDATE values but ?
+};
+
+bool MiniSQL::prepare(const string& name, const string& sql) {
+    auto prepared = make_shared<PreparedStatement>();
+    try {
+        SqlParser parser(sql);
+        prepared->statement = parser.parseStatement();
+        prepared->parameter_count = parser.parameterCount();
+    } catch (const SqlSyntaxError& e) {
+        cerr << "Error: " << e.what() << endl;
+        return false;
+    }
+    
+    if (!holds_alternative<SelectStatement>(prepared->statement) && !holds_alternative<InsertStatement>(prepared->statement) &&
+        !holds_alternative<UpdateStatement>(prepared->statement) && !holds_alternative<DeleteStatement>(prepared->statement)) {
+        cerr << "Error: Only SELECT, INSERT, UPDATE and DELETE can be prepared" << endl;
+        return false;
+    }
+    
+    if (!compilePrepared(*prepared)) {
+        return false;
+    }
+    
+    prepared_statements_[name] = prepared;
+    return true;
+}
+
+bool MiniSQL::compilePrepared(PreparedStatement& prepared) {
+    string table_name, join_table_name;
+    shared_ptr<const SqlExpr> where;
+    visit([&](const auto& statement) {
+        using T = decay_t<decltype(statement)>;
+        if constexpr (is_same_v<T, SelectStatement> || is_same_v<T, InsertStatement> ||
+                      is_same_v<T, UpdateStatement> || is_same_v<T, DeleteStatement>) {
+            table_name = statement.table;
+        }
+        if constexpr (is_same_v<T, SelectStatement>) {
+            join_table_name = statement.join_table;
+        }
+        if constexpr (is_same_v<T, SelectStatement> || is_same_v<T, UpdateStatement> || is_same_v<T, DeleteStatement>) {
+            where = statement.where;
+        }
+    }, prepared.statement);
+    
+    if (!join_table_name.empty()) prefetch(join_table_name);
+    auto table = getTable(table_name);
+    if (!table) {
+        cerr << "Error: Table '" << table_name << "' does not exist" << endl;
+        return false;
+    }
+    shared_ptr<Table> join_table = nullptr;
+    if (!join_table_name.empty()) {
+        join_table = getTable(join_table_name);
+        if (!join_table) {
+            cerr << "Error: Table '" << join_table_name << "' does not exist" << endl;
+            return false;
+        }
+    }
+    
+    vector<ParameterSlot> slots;
+    shared_ptr<LogicExpression> where_clause = nullptr;
+    if (where) {
+        vector<Column> columns = table->columns();
+        if (join_table) {
+            columns.insert(columns.end(), join_table->columns().begin(), join_table->columns().end());
+        }
+        where_clause = WhereParser::bind(*where, columns, &slots);
+        if (!where_clause) {
+            return false;
+        }
+    }
+    
+    vector<shared_ptr<const Expression>> projections;
+    vector<Column> result_columns;
+    unordered_map<string, shared_ptr<const Expression>> assignments;
+    if (const auto* query = get_if<SelectStatement>(&prepared.statement); query && !query->expressions.empty()) {
+        vector<Column> columns = table->columns();
+        vector<string> tables(columns.size(), table_name);
+        if (join_table) {
+            columns.insert(columns.end(), join_table->columns().begin(), join_table->columns().end());
+            tables.resize(columns.size(), join_table_name);
+        }
+        if (!compileSelectList(*query, columns, join_table ? tables : vector<string>{}, projections, result_columns)) {
+            return false;
+        }
+    } else if (const auto* update = get_if<UpdateStatement>(&prepared.statement)) {
+        try {
+            assignments = compileAssignments(*update, table->columns(), true);
+        } catch (const exception& e) {
+            cerr << "Error: " << e.what() << endl;
+            return false;
+        }
+    }
+    
+    prepared.table = table;
+    prepared.join_table = join_table;
+    prepared.where_clause = where_clause;
+    prepared.slots = move(slots);
+    prepared.projections = move(projections);
+    prepared.result_columns = move(result_columns);
+    prepared.assignments = move(assignments);
+    return true;
+}
+
+QueryResult MiniSQL::execute(const string& name, const vector<Value>& parameters) {
+    QueryResult result;
+    auto it = prepared_statements_.find(name);
+    if (it == prepared_statements_.end()) {
+        cerr << "Error: Prepared statement '" << name << "' does not exist" << endl;
+        return result;
+    }
+    
+    PreparedStatement& prepared = *it->second;
+    if (parameters.size() != prepared.parameter_count) {
+        cerr << "Error: Prepared statement '" << name << "' expects " << prepared.parameter_count
+             << " parameter(s), got " << parameters.size() << endl;
+        return result;
+    }
+    
+    // Rebind only when a table object was replaced (dropped and recreated, or reloaded).
+    visit([&](const auto& statement) {
+        using T = decay_t<decltype(statement)>;
+        if constexpr (is_same_v<T, SelectStatement>) {
+            if (prepared.table.lock() != getTable(statement.table) ||
+                (!statement.join_table.empty() && prepared.join_table.lock() != getTable(statement.join_table))) {
+                prepared.table.reset();
+            }
+        } else if constexpr (is_same_v<T, InsertStatement> || is_same_v<T, UpdateStatement> || is_same_v<T, DeleteStatement>) {
+            if (prepared.table.lock() != getTable(statement.table)) {
+                prepared.table.reset();
+            }
+        }
+    }, prepared.statement);
+    if (prepared.table.expired() && !compilePrepared(prepared)) {
+        return result;
+    }
+    
+    for (const auto& slot : prepared.slots) {
+        const Value& parameter = parameters[slot.parameter];
+        Condition& condition = *slot.condition;
+        if (condition.op == CompareOp::LIKE || condition.op == CompareOp::NOT_LIKE) {
+            if (!holds_alternative<string>(parameter)) {
+                cerr << "Error: LIKE needs a string parameter" << endl;
+                return result;
+            }
+            condition.constant_value = parameter;
+            condition.like = make_shared<LikePattern>(get<string>(parameter));
+        } else {
+            condition.constant_value = WhereParser::parameterValue(parameter, slot.type);
+        }
+    }
+    
+    auto operandValue = [&](const SqlExpr& operand) {
+        return operand.kind == ExprKind::PARAMETER ? parameters[operand.parameter] : literalValue(operand);
+    };
+    
+    if (auto* query = get_if<SelectStatement>(&prepared.statement)) {
+        auto table = prepared.table.lock();
+        if (query->count_star) {
+            result.rows.push_back(Row({Value(static_cast<int>(count(query->table, prepared.where_clause)))}));
+            result.columns.push_back(Column{"COUNT(*)", "INT"});
+        } else if (!query->join_table.empty()) {
+            auto join_table = prepared.join_table.lock();
+            if (!query->save_as.empty()) {
+                result.ok = saveJoinAsTable(query->save_as, query->table, query->join_table, query->join, prepared.where_clause);
+                return result;
+            }
+            if (!prepared.projections.empty()) {
+                result.rows = join(query->table, query->join_table, {"*"}, JoinType::INNER_JOIN, query->join, prepared.where_clause);
+                try {
+                    for (Row& row : result.rows) {
+                        row = Expression::project(row, prepared.projections);
+                    }
+                } catch (const exception& e) {
+                    cerr << "Error: " << e.what() << endl;
+                    result.rows.clear();
+                    return result;
+                }
+                result.columns = prepared.result_columns;
+            } else if (query->columns.size() == 1 && query->columns[0] == "*") {
+                result.rows = join(query->table, query->join_table, query->columns, JoinType::INNER_JOIN, query->join, prepared.where_clause);
+                for (const auto& [side, side_name] : {make_pair(table, query->table), make_pair(join_table, query->join_table)}) {
+                    for (Column col : side->columns()) {
+                        col.name = side_name + "." + col.name;
+                        result.columns.push_back(col);
+                    }
+                }
+            } else {
+                result.rows = join(query->table, query->join_table, query->columns, JoinType::INNER_JOIN, query->join, prepared.where_clause);
+                for (const auto& col_name : query->columns) {
+                    result.columns.push_back(Column{col_name, "VARCHAR", 50});
+                }
+            }
+        } else if (!prepared.projections.empty()) {
+            try {
+                result.rows = select(query->table, prepared.projections, prepared.where_clause);
+            } catch (const exception& e) {
+                cerr << "Error: " << e.what() << endl;
+                return result;
+            }
+            result.columns = prepared.result_columns;
+        } else {
+            result.rows = select(query->table, query->columns, {}, prepared.where_clause);
+            for (const auto& col_name : query->columns) {
+                if (col_name == "*") {
+                    result.columns = table->columns();
+                    break;
+                }
+                for (const auto& col : table->columns()) {
+                    if (col.name == col_name) {
+                        result.columns.push_back(col);
+                        break;
+                    }
+                }
+            }
+        }
+        result.ok = true;
+    } else if (auto* insert_statement = get_if<InsertStatement>(&prepared.statement)) {
+        vector<Value> values;
+        for (const auto& value : insert_statement->values) {
+            values.push_back(operandValue(*value));
+        }
+        Row row(values);
+        bool replaced = false;
+        result.ok = insert_statement->replace ? upsert(insert_statement->table, row, replaced) : insert(insert_statement->table, row);
+        result.affected_rows = result.ok ? 1 : 0;
+    } else if (auto* update = get_if<UpdateStatement>(&prepared.statement)) {
+        auto table = prepared.table.lock();
+        unordered_map<string, shared_ptr<const Expression>> updates = prepared.assignments;
+        for (const auto& [col_name, value_expr] : update->assignments) {
+            if (value_expr->kind == ExprKind::PARAMETER) {
+                int col_idx = table->getColumnIndex(col_name);
+                string col_type = col_idx == -1 ? "VARCHAR" : table->columns()[col_idx].type;
+                updates[col_name] = Expression::constant(assignmentValue(parameters[value_expr->parameter], col_type));
+            }
+        }
+        result.affected_rows = updateRows(update->table, updates, prepared.where_clause);
+        result.ok = true;
+    } else if (auto* remove = get_if<DeleteStatement>(&prepared.statement)) {
+        result.affected_rows = deleteRows(remove->table, prepared.where_clause);
+        result.ok = true;
+    }
+    
+    return result;
+}
+
+bool MiniSQL::deallocate(const string& name) {
+    if (prepared_statements_.erase(name) == 0) {
+        cerr << "Error: Prepared statement '" << name << "' does not exist" << endl;
+        return false;
+    }
+    return true;
+}
+
+int MiniSQL::parameterCount(const string& name) const {
+    auto it = prepared_statements_.find(name);
+    return it == prepared_statements_.end() ? -1 : static_cast<int>(it->second->parameter_count);
+}
+
+// Part X. EXPLAIN
+// Subquery predicates of a bound WHERE tree, for a plan that does not run them.
+static void collectSubqueryConditions(const shared_ptr<LogicExpression>& expression, vector<const Condition*>& conditions) {
+    if (!expression) return;
+    for (const auto* side : {&expression->left, &expression->right}) {
+        if (const auto* condition = get_if<Condition>(side)) {
+            if (condition->subquery) conditions.push_back(condition);
+        } else if (const auto* child = get_if<shared_ptr<LogicExpression>>(side)) {
+            collectSubqueryConditions(*child, conditions);
+        }
+    }
+}
+
+static string formatMs(double ms) {
+    ostringstream text;
+    text << fixed << setprecision(3) << ms;
+    return text.str();
+}
+
+static string joinConditionText(const JoinCondition& condition) {
+    string text = condition.left_table + "." + condition.left_column + " " + compareOpText(condition.op) + " " + condition.right_table + "." + condition.right_column;
+    for (const auto& [left_column, right_column] : condition.extra_keys) {
+        text += " AND " + condition.left_table + "." + left_column + " = " + condition.right_table + "." + right_column;
+    }
+    return text;
+}
+
+// A table read in full from memory, as every join input is.
+static PlanNode tableNode(const Table& table, bool analyze) {
+    PlanNode node;
+    node.name = "Seq Scan on " + table.name();
+    if (analyze) {
+        node.analyzed = true;
+        node.rows_in = node.rows_out = table.rowCount();
+    } else {
+        node.details.push_back("Rows to read: " + to_string(table.rowCount()));
+    }
+    return node;
+}
+
+// The subqueries run once before the query, as children of the operator evaluating the WHERE
+// clause. rows out is the number of keys kept for the semi join.
+static void addSubqueryNodes(const QueryStats& stats, bool analyze, PlanNode& parent) {
+    for (const auto& subquery : stats.subqueries) {
+        PlanNode node;
+        node.name = "Subquery Scan on " + subquery.table;
+        node.details.push_back("Predicate: " + subquery.description);
+        if (analyze) {
+            node.analyzed = true;
+            node.time_ms = subquery.time_ms;
+            node.rows_in = subquery.rows;
+            node.rows_out = subquery.keys;
+            node.bytes = subquery.bytes;
+        }
+        parent.children.push_back(move(node));
+    }
+}
+
+static PlanNode joinPlan(const Table& left_table, const Table& right_table, const JoinCondition& condition, const shared_ptr<LogicExpression>& where_clause, const QueryStats& stats, bool analyze, size_t result_rows, size_t result_bytes) {
+    const Table& build_table = stats.build_is_left ? left_table : right_table;
+    const Table& probe_table = stats.build_is_left ? right_table : left_table;
+    PlanNode join;
+    join.analyzed = analyze;
+    join.rows_out = result_rows;
+    join.bytes = result_bytes;
+    
+    if (stats.join_algorithm == "index nested loop join") {
+        // build_is_left names the outer side here.
+        join.name = "Index Nested Loop Join";
+        PlanNode outer = tableNode(build_table, analyze);
+        if (!stats.outer_filter.empty()) outer.details.push_back("Filter: " + stats.outer_filter);
+        if (analyze) {
+            outer.time_ms = stats.build_ms;
+            outer.rows_out = stats.probe_rows;
+            outer.bytes = stats.probe_rows * sizeof(size_t);
+        } else {
+            outer.details.push_back("Rows after filter: " + to_string(stats.probe_rows));
+        }
+        PlanNode inner;
+        size_t dot_pos = stats.join_index.find('.');
+        inner.name = "Index Lookup on " + probe_table.name() + " using " + stats.join_index.substr(dot_pos + 1);
+        inner.details.push_back("Index Cond: " + joinConditionText(condition));
+        if (analyze) {
+            inner.analyzed = true;
+            inner.rows_in = stats.probe_rows;
+            inner.rows_out = stats.joined_rows;
+        }
+        join.time_ms = stats.probe_ms;
+        join.rows_in = stats.probe_rows + stats.joined_rows;
+        join.children.push_back(move(outer));
+        join.children.push_back(move(inner));
+    } else if (stats.join_algorithm == "nested loop join") {
+        join.name = "Nested Loop Join";
+        join.details.push_back("Join Cond: " + joinConditionText(condition));
+        join.time_ms = stats.probe_ms;
+        join.rows_in = left_table.rowCount() + right_table.rowCount();
+        join.children.push_back(tableNode(left_table, analyze));
+        join.children.push_back(tableNode(right_table, analyze));
+    } else {
+        join.name = stats.spill_partitions > 0 ? "Grace Hash Join" : "Hash Join";
+        join.details.push_back("Hash Cond: " + joinConditionText(condition));
+        if (analyze && !stats.join_filter.empty()) {
+            join.details.push_back("Join Filter: " + stats.join_filter + ", " + to_string(stats.probe_rows_filtered) + " probe rows rejected");
+        }
+        if (stats.spill_partitions > 0) {
+            join.details.push_back("Spill: " + to_string(stats.spill_partitions) + " partitions" +
+                                   (analyze ? ", " + to_string(stats.bytes_spilled) + " bytes written in " + formatMs(stats.partition_ms) + " ms" : ""));
+        }
+        PlanNode hash;
+        hash.name = "Hash";
+        hash.children.push_back(tableNode(build_table, analyze));
+        if (analyze) {
+            hash.analyzed = true;
+            hash.time_ms = stats.build_ms;
+            hash.rows_in = stats.build_rows;
+            hash.rows_out = stats.hash_entries;
+            hash.hash_entries = stats.hash_entries;
+            hash.bytes = stats.hash_bytes;
+        }
+        join.time_ms = stats.probe_ms + stats.partition_ms;
+        join.rows_in = stats.probe_rows + stats.hash_entries;
+        join.children.push_back(tableNode(probe_table, analyze));
+        join.children.push_back(move(hash));
+    }
+    
+    if (where_clause) {
+        join.details.push_back("Filter: " + WhereParser::describe(where_clause));
+        if (analyze) join.details.push_back("Rows Removed by Filter: " + to_string(stats.joined_rows - result_rows));
+    }
+    return join;
+}
+
+bool MiniSQL::explain(const SelectStatement& query, bool analyze, PlanNode& plan) {
+    if (!query.join_table.empty()) prefetch(query.join_table);
+    auto left_table = getTable(query.table);
+    auto right_table = query.join_table.empty() ? nullptr : getTable(query.join_table);
+    if (!left_table || (!query.join_table.empty() && !right_table)) {
+        cerr << "Error: Table '" << (left_table ? query.join_table : query.table) << "' does not exist" << endl;
+        return false;
+    }
+    
+    vector<Column> columns = left_table->columns();
+    vector<string> tables(columns.size(), query.table);
+    if (right_table) {
+        columns.insert(columns.end(), right_table->columns().begin(), right_table->columns().end());
+        tables.resize(columns.size(), query.join_table);
+    }
+    vector<string> column_names;
+    for (const auto& col : columns) column_names.push_back(col.name);
+    
+    try {
+        shared_ptr<LogicExpression> where_clause = nullptr;
+        if (query.where) {
+            where_clause = WhereParser::bind(*query.where, columns);
+            if (!where_clause) return false;
+        }
+        vector<shared_ptr<const Expression>> projections;
+        vector<Column> result_columns;
+        if (!query.expressions.empty() && !compileSelectList(query, columns, right_table ? tables : vector<string>{}, projections, result_columns)) {
+            return false;
+        }
+        
+        string output;
+        if (query.count_star) {
+            output = "COUNT(*)";
+        } else if (!projections.empty()) {
+            for (const auto& projection : projections) output += (output.empty() ? "" : ", ") + projection->text();
+        } else {
+            for (const auto& column : query.columns) output += (output.empty() ? "" : ", ") + column;
+        }
         
-        buffer_pool_->putTable(table_name, table);
-        tables_[table_name] = table;
+        // The join planner filters the outer side of an index nested loop join, which reads
+        // the subquery results, so a join needs them bound even when it is not run.
+        QueryStats stats;
+        if (analyze || right_table) {
+            bindSubqueries(where_clause, column_names, &stats);
+        } else {
+            vector<const Condition*> subqueries;
+            collectSubqueryConditions(where_clause, subqueries);
+            for (const Condition* condition : subqueries) {
+                stats.subqueries.push_back(SubqueryStats{WhereParser::describe(*condition), condition->subquery->table});
+            }
+        }
         
-        return true;
+        auto start = Clock::now();
+        vector<Row> rows;
+        size_t count = 0;
+        if (analyze && right_table) {
+            rows = Table::joinTables(*left_table, *right_table, projections.empty() ? query.columns : vector<string>{"*"}, JoinType::INNER_JOIN, query.join, where_clause, &stats, query_memory_budget_);
+            last_query_stats_ = stats;
+            auto project_start = Clock::now();
+            for (Row& row : rows) {
+                if (!projections.empty()) row = Expression::project(row, projections);
+            }
+            stats.project_ms = elapsedMs(project_start);
+        } else if (analyze && query.count_star) {
+            count = left_table->countRows(where_clause, &stats);
+        } else if (analyze && !projections.empty()) {
+            rows = left_table->projectRows(projections, where_clause, &stats);
+        } else if (analyze) {
+            rows = left_table->selectRows(query.columns, query.columns, where_clause, &stats);
+        } else if (right_table) {
+            JoinOptimizer::planJoin(*left_table, *right_table, JoinType::INNER_JOIN, query.join, where_clause, stats, query_memory_budget_);
+        } else {
+            left_table->explainScan(projections.empty() ? query.columns : vector<string>{}, where_clause, query.count_star, stats);
+        }
+        double total_ms = elapsedMs(start);
         
-    } catch (...) {
+        PlanNode projection;
+        projection.name = "Projection";
+        projection.analyzed = analyze;
+        projection.time_ms = stats.project_ms;
+        projection.rows_in = projection.rows_out = rows.size();
+        projection.bytes = estimateRowBytes(rows);
+        
+        if (right_table) {
+            bool computed = !projections.empty();
+            PlanNode join = joinPlan(*left_table, *right_table, query.join, where_clause, stats, analyze, rows.size(), computed ? 0 : estimateRowBytes(rows));
+            addSubqueryNodes(stats, analyze, join);
+            // The join builds its output rows itself; a computed list is evaluated on them afterwards.
+            if (computed) {
+                projection.children.push_back(move(join));
+                plan = move(projection);
+            } else {
+                plan = move(join);
+            }
+            plan.details.insert(plan.details.begin(), "Output: " + output);
+            return true;
+        }
+        
+        PlanNode scan;
+        scan.name = stats.access_path + " on " + query.table;
+        if (!stats.scan_index.empty()) scan.name += " using " + stats.scan_index;
+        if (!stats.index_condition.empty()) scan.details.push_back("Index Cond: " + stats.index_condition);
+        if (!stats.filter.empty()) {
+            scan.details.push_back((stats.access_path == "Bitmap Index Scan" ? "Recheck Cond: " : "Filter: ") + stats.filter);
+        }
+        if (stats.blocks_total > 0) {
+            scan.details.push_back("Zone Map: " + to_string(stats.blocks_skipped) + " of " + to_string(stats.blocks_total) + " blocks skipped");
+        }
+        if (analyze) {
+            scan.analyzed = true;
+            scan.time_ms = stats.scan_ms;
+            scan.rows_in = stats.scan_rows;
+            scan.rows_out = query.count_star ? count : rows.size();
+            // Positions of the matching rows, unless a bitmap counted them.
+            if (!(query.count_star && stats.exact)) scan.bytes = scan.rows_out * sizeof(size_t);
+        } else {
+            scan.details.push_back("Rows to read: " + to_string(stats.scan_rows));
+        }
+        addSubqueryNodes(stats, analyze, scan);
+        
+        if (query.count_star) {
+            plan = PlanNode{};
+            plan.name = "Aggregate";
+            plan.analyzed = analyze;
+            plan.time_ms = max(0.0, total_ms - stats.scan_ms);
+            plan.rows_in = count;
+            plan.rows_out = 1;
+            plan.children.push_back(move(scan));
+        } else if (stats.access_path == "Index Only Scan") {
+            // The index entries are the output rows.
+            scan.bytes = estimateRowBytes(rows);
+            plan = move(scan);
+        } else {
+            projection.children.push_back(move(scan));
+            plan = move(projection);
+        }
+        plan.details.insert(plan.details.begin(), "Output: " + output);
+        return true;
+    } catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
         return false;
     }
-}
\ No newline at end of file
+}